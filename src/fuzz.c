@@ -0,0 +1,2756 @@
+//
+// MOS6502 Emulator
+// fuzz.c: Differential fuzzing harness comparing the execution engines.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+// Every input describes a processor state and a memory image. The cycle and step engines run it instruction by
+// instruction in lockstep, and the harness aborts with both states when they disagree after an instruction. The cached
+// engine (m65_run_cached()), and with --aot the compiled engine (m65_run_aot()), run it in stretches up to where
+// interrupts are injected and to the end, and are compared with the cycle engine there.
+//
+// Input format:
+// - byte 0: variant (modulo 3)
+// - bytes 1-5: a, x, y, s, and flags
+// - bytes 6-7: address of the first instruction (little endian)
+// - byte 8: number of instructions to run (modulo 64, plus 1)
+// - byte 9: instruction before which IRQ is asserted (0xFF for never)
+// - byte 10: instruction before which NMI is triggered (0xFF for never)
+// - byte 11: DEVICE_INPUT for inputs that run with a timer device (see run_devices()), otherwise ignored
+// - the rest: memory contents, repeated over the whole address space starting at the first instruction
+//
+// Build with -DM65_LIBFUZZER and -fsanitize=fuzzer for libFuzzer. Otherwise the harness runs the files given as
+// arguments (or stdin), which is what AFL expects, or with --vectors, a set of single instruction tests of every
+// opcode and addressing mode. --traps checks native implementations of guest subroutines (see traps.h) against the
+// emulated subroutines with random inputs. --random [N] runs N random inputs from a fixed seed. --aot compiles the
+// code of every input file given after it to a shared object (with the compiler in $CC, or cc, run from the root of
+// the repository) and checks the compiled engine too. --devices [N] [dir] runs N device inputs from a fixed seed,
+// optionally writing them to dir. --cache [N] checks that N caches saved and loaded again give the same results.
+// --async [N] signals interrupts N times from another thread to a processor run by each engine. --arena [N] checks
+// the pools of arenas and the arenas of threads. --snapshots [N] saves and restores N pairs of snapshots. --system runs
+// boards of two processors, one of them taking IRQs from a timer or signals from another thread. --mappers [N] switches
+// the banks of every built in mapper type N times in all. --trace [N] checks N rounds of random records traced in both
+// formats. --loader loads images of every format and checks their cached flat images. --checkpoints [runner] checks
+// that the runner (./m6502 by default) traces the same with and without checkpoints. --coverage [N] checks the
+// coverage every engine records over N runs of random branches, and the coverage files and reports. --disasm checks
+// the disassembler and its cache.
+//
+// test/corpus holds a fixed set of random inputs, including the ones that caught engines disagreeing before, to run
+// as a regression test with `m6502-fuzz test/corpus/*`. `make test` runs all of the above.
+//
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "m6502-src/aot.h"
+#include "m6502-src/arena.h"
+#include "m6502-src/coverage.h"
+#include "m6502-src/disasm.h"
+#include "m6502-src/loader.h"
+#include "m6502-src/mapper.h"
+#include "m6502-src/m6502.h"
+#include "m6502-src/memory.h"
+#include "m6502-src/opcodes.h"
+#include "m6502-src/snapshot.h"
+#include "m6502-src/step.h"
+#include "m6502-src/system.h"
+#include "m6502-src/trace.h"
+#include "m6502-src/traps.h"
+
+// The size of the input header.
+#define HEADER_SIZE 12
+
+// Byte 11 of inputs that run with a timer device (see run_devices()), and the page the timer is mapped at.
+#define DEVICE_INPUT 0xD0
+#define DEVICE_PAGE 0xD0
+
+// Whether a mismatch aborts the process, which is what fuzzers look for.
+static bool abort_on_mismatch = true;
+
+// The compiled image of the input being run with --aot, or NULL.
+static m65_aot_t* aot = NULL;
+
+// print_state(const char*, const m6502_t*) -> void
+// Prints the state of a processor.
+static void print_state(const char* name, const m6502_t* cpu)
+{
+	fprintf(stderr, "  %-5s pc=%04x a=%02x x=%02x y=%02x s=%02x p=%02x cycles=%" PRIu64 " irq=%d poll=%d lines=%08x\n",
+			name, cpu->pins.addr, cpu->a, cpu->x, cpu->y, cpu->s, cpu->flags, cpu->cycles, cpu->handle_interrupt,
+			cpu->int_poll, cpu->int_lines);
+}
+
+// cycle_step(m6502_t*, m65_mem_t*) -> void
+// Runs the cycle engine until the next instruction boundary.
+static void cycle_step(m6502_t* cpu, m65_mem_t* mem)
+{
+	do
+	{
+		m65_mem_bus(mem, cpu);
+		m65_cycle(cpu);
+	} while (cpu->phase != M65_PHASE_FETCH);
+}
+
+// same_state(const m6502_t*, const m6502_t*) -> bool
+// Checks that two processors are at the same instruction boundary with the same registers.
+static bool same_state(const m6502_t* a, const m6502_t* b)
+{
+	return a->pins.addr == b->pins.addr && a->pc == b->pc && a->a == b->a && a->x == b->x && a->y == b->y
+		&& a->s == b->s && a->flags == b->flags && a->cycles == b->cycles && a->handle_interrupt == b->handle_interrupt
+		&& a->int_poll == b->int_poll && a->int_lines == b->int_lines;
+}
+
+// load_input(const uint8_t*, size_t, m6502_t*, m65_mem_t*) -> void
+// Sets up a processor and fills memory with the payload of an input, starting at the first instruction. The input has
+// a whole header.
+static void load_input(const uint8_t* data, size_t size, m6502_t* cpu, m65_mem_t* mem)
+{
+	init_6502_variant(cpu, data[0] % 3);
+	cpu->a = data[1];
+	cpu->x = data[2];
+	cpu->y = data[3];
+	cpu->s = data[4];
+	cpu->flags = data[5] | 0x30;
+	cpu->pins.addr = data[6] | data[7] << 8;
+	cpu->pc = cpu->pins.addr + 1;
+
+	const uint8_t* payload = data + HEADER_SIZE;
+	size_t length = size - HEADER_SIZE;
+	for (size_t i = 0; i < M65_PAGES * M65_PAGE_SIZE; i++)
+		mem->ram[(uint16_t) (cpu->pins.addr + i)] = length ? payload[i % length] : 0;
+}
+
+// compare_engine(const char*, const char*, unsigned, const m6502_t*, const m6502_t*, const m65_mem_t*, const m6502_t*,
+//		const m65_mem_t*) -> bool
+// Compares an engine with the reference engine before instruction i, printing both states if they disagree. Returns
+// false if they do.
+static bool compare_engine(const char* ref_name, const char* name, unsigned i, const m6502_t* before,
+		const m6502_t* ref, const m65_mem_t* ref_mem, const m6502_t* cpu, const m65_mem_t* mem)
+{
+	const char* what = NULL;
+	if (!same_state(ref, cpu))
+		what = "state";
+	else if (memcmp(ref_mem->ram, mem->ram, M65_PAGES * M65_PAGE_SIZE) != 0)
+		what = "memory";
+	if (what == NULL)
+		return true;
+
+	fprintf(stderr, "%s mismatch of the %s engine before instruction %u\n", what, name, i);
+	print_state("from", before);
+	print_state(ref_name, ref);
+	print_state(name, cpu);
+	for (size_t addr = 0; addr < M65_PAGES * M65_PAGE_SIZE; addr++)
+	{
+		if (ref_mem->ram[addr] != mem->ram[addr])
+			fprintf(stderr, "  memory %04zx: %s=%02x %s=%02x\n", addr, ref_name, ref_mem->ram[addr], name,
+					mem->ram[addr]);
+	}
+
+	if (abort_on_mismatch)
+		abort();
+	return false;
+}
+
+// run_engine(const char*, unsigned, const m6502_t*, const m65_mem_t*, m6502_t*, m65_mem_t*, m65_cache_t*) -> bool
+// Runs the cached engine (with a cache) or the compiled engine (without) up to the cycle the reference engine reached
+// before instruction i, and compares them. Returns false if they disagree.
+static bool run_engine(const char* name, unsigned i, const m6502_t* ref, const m65_mem_t* ref_mem, m6502_t* cpu,
+		m65_mem_t* mem, m65_cache_t* cache)
+{
+	// Both run whole instructions until the cycles passed, so they stop at the same boundary as the reference
+	m6502_t before = *cpu;
+	if (ref->cycles > cpu->cycles && cache != NULL)
+		m65_run_cached(cpu, mem, cache, ref->cycles - cpu->cycles);
+	else if (ref->cycles > cpu->cycles)
+		m65_run_aot(cpu, mem, aot, ref->cycles - cpu->cycles);
+	return compare_engine("cycle", name, i, &before, ref, ref_mem, cpu, mem);
+}
+
+// Represents the timer of device inputs. It raises IRQ every period cycles until it's acknowledged. Register 0 reads
+// the low byte of the cycle it was caught up to, register 1 acknowledges the interrupt and reads how many times it
+// fired, writing register 2 sets the period to the value plus 8, and reading register 3 fires it at once.
+typedef struct
+{
+	m65_device_t dev;
+	m6502_t* cpu;
+	uint64_t period;
+	uint8_t fired;
+} fuzz_timer_t;
+
+// timer_advance(m65_device_t*, uint64_t, uint64_t) -> void
+// Fires the timer at every deadline up to cycle to.
+static void timer_advance(m65_device_t* dev, uint64_t from, uint64_t to)
+{
+	(void) from;
+	fuzz_timer_t* timer = dev->ctx;
+	while (dev->deadline <= to)
+	{
+		timer->fired++;
+		m65_irq_assert(timer->cpu, 1);
+		dev->deadline += timer->period;
+	}
+}
+
+// timer_read(m65_device_t*, uint16_t) -> uint8_t
+// Reads a register of the timer.
+static uint8_t timer_read(m65_device_t* dev, uint16_t addr)
+{
+	fuzz_timer_t* timer = dev->ctx;
+	switch (addr & 0xff)
+	{
+		case 0:
+			return dev->synced;
+		case 1:
+			m65_irq_release(timer->cpu, 1);
+			return timer->fired;
+		case 3:
+			timer->fired++;
+			m65_irq_assert(timer->cpu, 1);
+			return timer->fired;
+		default:
+			return 0xff;
+	}
+}
+
+// timer_write(m65_device_t*, uint16_t, uint8_t) -> void
+// Writes a register of the timer.
+static void timer_write(m65_device_t* dev, uint16_t addr, uint8_t data)
+{
+	fuzz_timer_t* timer = dev->ctx;
+	if ((addr & 0xff) == 2)
+	{
+		timer->period = data + 8;
+		dev->deadline = dev->synced + timer->period;
+	}
+}
+
+// run_devices(const uint8_t*, size_t) -> bool
+// Runs a device input: the timer is mapped at DEVICE_PAGE and starts with a period of byte 9 plus 8 cycles, the IRQ
+// vector points at the first instruction, and every engine runs for byte 8 (modulo 64, plus 1) times 16 cycles. The
+// step engine is the reference, since the cycle engine accesses devices on the exact cycle rather than at the start
+// of the instruction. Returns false if the engines disagree.
+static bool run_devices(const uint8_t* data, size_t size)
+{
+	static m65_mem_t mems[3];
+	static fuzz_timer_t timers[3];
+	static const char* names[3] = {"step", "cached", "aot"};
+	m6502_t cpus[3];
+
+	if (mems[0].ram == NULL)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (!m65_mem_init(&mems[i]))
+				abort();
+			timers[i].dev.advance = timer_advance;
+			timers[i].dev.read = timer_read;
+			timers[i].dev.write = timer_write;
+			timers[i].dev.ctx = &timers[i];
+			m65_mem_map_device(&mems[i], DEVICE_PAGE, 1, &timers[i].dev);
+		}
+	}
+
+	load_input(data, size, &cpus[0], &mems[0]);
+	mems[0].ram[0xFFFE] = cpus[0].pins.addr & 0xff;
+	mems[0].ram[0xFFFF] = cpus[0].pins.addr >> 8;
+	for (int i = 0; i < 3; i++)
+	{
+		cpus[i] = cpus[0];
+		memcpy(mems[i].ram, mems[0].ram, M65_PAGES * M65_PAGE_SIZE);
+		m65_mem_set_clock(&mems[i], &cpus[i].cycles);
+		timers[i].cpu = &cpus[i];
+		timers[i].period = data[9] + 8;
+		timers[i].fired = 0;
+		timers[i].dev.synced = 0;
+		m65_device_schedule(&mems[i], &timers[i].dev, timers[i].period);
+	}
+
+	m6502_t start = cpus[0];
+	m65_cache_t cache;
+	m65_cache_init(&cache);
+	uint64_t cycles = (data[8] % 64 + 1) * 16;
+	m65_run(&cpus[0], &mems[0], cycles);
+	m65_run_cached(&cpus[1], &mems[1], &cache, cycles);
+	if (aot != NULL)
+		m65_run_aot(&cpus[2], &mems[2], aot, cycles);
+	m65_cache_free(&cache);
+
+	for (int i = 1; i < (aot != NULL ? 3 : 2); i++)
+	{
+		if (!compare_engine(names[0], names[i], 0, &start, &cpus[0], &mems[0], &cpus[i], &mems[i]))
+			return false;
+		if (timers[i].fired == timers[0].fired && timers[i].period == timers[0].period
+				&& timers[i].dev.synced == timers[0].dev.synced && timers[i].dev.deadline == timers[0].dev.deadline)
+			continue;
+
+		fprintf(stderr, "timer mismatch of the %s engine: fired %u/%u, synced %" PRIu64 "/%" PRIu64 "\n", names[i],
+				timers[0].fired, timers[i].fired, timers[0].dev.synced, timers[i].dev.synced);
+		if (abort_on_mismatch)
+			abort();
+		return false;
+	}
+	return true;
+}
+
+// run_input(const uint8_t*, size_t) -> bool
+// Runs an input on every engine. Returns false if they disagree.
+static bool run_input(const uint8_t* data, size_t size)
+{
+	if (size < HEADER_SIZE)
+		return true;
+	if (data[11] == DEVICE_INPUT)
+		return run_devices(data, size);
+
+	static m65_mem_t cycle_mem, step_mem, cached_mem, compiled_mem;
+	if (cycle_mem.ram == NULL && (!m65_mem_init(&cycle_mem) || !m65_mem_init(&step_mem) || !m65_mem_init(&cached_mem)
+			|| !m65_mem_init(&compiled_mem)))
+		abort();
+
+	m6502_t cycle, step, cached, compiled;
+	load_input(data, size, &cycle, &cycle_mem);
+	step = cached = compiled = cycle;
+	memcpy(step_mem.ram, cycle_mem.ram, M65_PAGES * M65_PAGE_SIZE);
+	memcpy(cached_mem.ram, cycle_mem.ram, M65_PAGES * M65_PAGE_SIZE);
+	memcpy(compiled_mem.ram, cycle_mem.ram, M65_PAGES * M65_PAGE_SIZE);
+
+	m65_cache_t cache;
+	m65_cache_init(&cache);
+	bool same = true;
+
+	unsigned count = data[8] % 64 + 1;
+	for (unsigned i = 0; i < count; i++)
+	{
+		// The other engines catch up before interrupts are injected into all of them
+		if (i == data[9] || i == data[10])
+		{
+			same = run_engine("cached", i, &cycle, &cycle_mem, &cached, &cached_mem, &cache)
+				&& (aot == NULL || run_engine("aot", i, &cycle, &cycle_mem, &compiled, &compiled_mem, NULL));
+			if (!same)
+				break;
+		}
+
+		if (i == data[9])
+		{
+			m65_irq_assert(&cycle, 0);
+			m65_irq_assert(&step, 0);
+			m65_irq_assert(&cached, 0);
+			m65_irq_assert(&compiled, 0);
+		}
+		if (i == data[10])
+		{
+			m65_nmi(&cycle);
+			m65_nmi(&step);
+			m65_nmi(&cached);
+			m65_nmi(&compiled);
+		}
+
+		m6502_t before = cycle;
+		uint8_t opcode = m65_mem_read(&cycle_mem, cycle.pins.addr);
+		cycle_step(&cycle, &cycle_mem);
+		m65_step(&step, &step_mem);
+
+		// Compare the registers and all of memory
+		const char* what = NULL;
+		if (!same_state(&cycle, &step))
+			what = "state";
+		else if (memcmp(cycle_mem.ram, step_mem.ram, M65_PAGES * M65_PAGE_SIZE) != 0)
+			what = "memory";
+
+		if (what != NULL)
+		{
+			fprintf(stderr, "%s mismatch after instruction %u (opcode %02x %02x %02x at %04x, %s)\n", what, i, opcode,
+					m65_mem_read(&cycle_mem, before.pins.addr + 1), m65_mem_read(&cycle_mem, before.pins.addr + 2),
+					before.pins.addr, before.handle_interrupt ? "interrupt" : "instruction");
+			print_state("from", &before);
+			print_state("cycle", &cycle);
+			print_state("step", &step);
+			for (size_t addr = 0; addr < M65_PAGES * M65_PAGE_SIZE; addr++)
+			{
+				if (cycle_mem.ram[addr] != step_mem.ram[addr])
+					fprintf(stderr, "  memory %04zx: cycle=%02x step=%02x\n", addr, cycle_mem.ram[addr],
+							step_mem.ram[addr]);
+			}
+
+			if (abort_on_mismatch)
+				abort();
+			m65_cache_free(&cache);
+			return false;
+		}
+	}
+
+	if (same)
+	{
+		same = run_engine("cached", count, &cycle, &cycle_mem, &cached, &cached_mem, &cache)
+			&& (aot == NULL || run_engine("aot", count, &cycle, &cycle_mem, &compiled, &compiled_mem, NULL));
+	}
+
+	m65_cache_free(&cache);
+	return same;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	run_input(data, size);
+	return 0;
+}
+
+#ifndef M65_LIBFUZZER
+// run_vectors(const char*) -> int
+// Runs single instruction tests of every opcode of every variant with edge case operands and registers. If dir isn't
+// NULL, the tests are also written to it as a seed corpus. Returns the number of failed tests.
+static int run_vectors(const char* dir)
+{
+	static const uint8_t values[] = {0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF};
+	static const uint16_t addrs[] = {0x0200, 0x02FE, 0x80FD, 0xFFFE};
+	uint8_t input[HEADER_SIZE + 256];
+	int tests = 0, failed = 0;
+	uint32_t seed = 1;
+
+	for (int variant = 0; variant < 3; variant++)
+	{
+		for (int opcode = 0; opcode < 256; opcode++)
+		{
+			if (m65_opinfo[variant][opcode].cycles == 0)
+				continue;
+
+			for (int i = 0; i < 48; i++)
+			{
+				// Random memory with the instruction and edge case operands at the start
+				for (size_t j = 0; j < sizeof(input); j++)
+				{
+					seed = seed * 1103515245 + 12345;
+					input[j] = seed >> 16;
+				}
+
+				uint16_t addr = addrs[i % 4];
+				input[0] = variant;
+				input[1] = values[i % 6];
+				input[2] = values[(i / 6) % 6];
+				input[3] = values[(i + 3) % 6];
+				input[6] = addr & 0xff;
+				input[7] = addr >> 8;
+				input[8] = 0;
+				input[9] = 0xFF;
+				input[10] = 0xFF;
+				input[HEADER_SIZE] = opcode;
+				input[HEADER_SIZE + 1] = values[(i + i / 6) % 6];
+
+				if (dir != NULL)
+				{
+					char path[4096];
+					snprintf(path, sizeof(path), "%s/%d-%02x-%02d", dir, variant, opcode, i);
+					FILE* file = fopen(path, "wb");
+					if (file != NULL)
+					{
+						fwrite(input, 1, sizeof(input), file);
+						fclose(file);
+					}
+				}
+
+				tests++;
+				failed += !run_input(input, sizeof(input));
+			}
+		}
+	}
+
+	printf("%d of %d test vectors passed\n", tests - failed, tests);
+	return failed;
+}
+
+// run_random(unsigned) -> int
+// Runs random inputs from a fixed seed on every engine. Returns the number of inputs they disagree on.
+static int run_random(unsigned count)
+{
+	uint8_t input[HEADER_SIZE + 512];
+	uint32_t seed = 1;
+	int failed = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		for (size_t j = 0; j < sizeof(input); j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			input[j] = seed >> 16;
+		}
+
+		size_t size = HEADER_SIZE + 1 + (input[11] | input[12] << 8) % 512;
+		failed += !run_input(input, size);
+	}
+
+	printf("%u of %u random inputs passed\n", count - failed, count);
+	return failed;
+}
+
+// run_devices_random(unsigned, const char*) -> int
+// Runs device inputs from a fixed seed, whose payloads mix random bytes with code that reads and programs the timer
+// in loops. If dir isn't NULL, the inputs are also written to it. Returns the number of inputs the engines disagree on.
+static int run_devices_random(unsigned count, const char* dir)
+{
+	// Reads the cycle, sets the period, acknowledges, adds the cycle, loops on x, loops on y, cli, sei, and fires the
+	// timer from the middle of lda and sta and of iny, cpy and bne, where RANDOM keeps the random byte of the input as
+	// the operand
+	enum { RANDOM = 0x100 };
+	static const uint16_t snippets[][8] = {
+		{6, 0xAD, 0x00, DEVICE_PAGE, 0x9D, 0x00, 0x03},
+		{5, 0xA9, RANDOM, 0x8D, 0x02, DEVICE_PAGE},
+		{3, 0xAD, 0x01, DEVICE_PAGE},
+		{4, 0x18, 0x6D, 0x00, DEVICE_PAGE},
+		{5, 0xA2, RANDOM, 0xCA, 0xD0, 0xFD},
+		{7, 0xA0, 0x00, 0xC8, 0xC0, RANDOM, 0xD0, 0xFB},
+		{1, 0x58},
+		{1, 0x78},
+		{6, 0xAD, 0x03, DEVICE_PAGE, 0x8D, 0x00, 0x03},
+		{6, 0xC8, 0xCC, 0x03, DEVICE_PAGE, 0xD0, 0xFA},
+	};
+	uint8_t input[HEADER_SIZE + 64];
+	uint32_t seed = 1;
+	int failed = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		for (size_t j = 0; j < sizeof(input); j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			input[j] = seed >> 16;
+		}
+
+		// Code at 0x0400, with the operands of the snippets kept random
+		input[6] = 0x00;
+		input[7] = 0x04;
+		input[11] = DEVICE_INPUT;
+		for (size_t j = HEADER_SIZE; j < sizeof(input) - 8; )
+		{
+			// Some random instructions in between
+			const uint16_t* snippet = snippets[input[j] % 10];
+			if (input[j + 1] & 0x80)
+			{
+				j++;
+				continue;
+			}
+
+			for (int k = 1; k <= snippet[0]; k++)
+			{
+				if (snippet[k] != RANDOM)
+					input[j + k - 1] = snippet[k];
+			}
+			j += snippet[0];
+		}
+
+		if (dir != NULL)
+		{
+			char path[4096];
+			snprintf(path, sizeof(path), "%s/device-%03u", dir, i);
+			FILE* file = fopen(path, "wb");
+			if (file != NULL)
+			{
+				fwrite(input, 1, sizeof(input), file);
+				fclose(file);
+			}
+		}
+
+		failed += !run_input(input, sizeof(input));
+	}
+
+	printf("%u of %u device inputs passed\n", count - failed, count);
+	return failed;
+}
+
+// run_cache(unsigned) -> int
+// Runs random inputs from a fixed seed with the cached engine, saves the cache, and runs them again from the start
+// with the cache loaded from the file. Both runs have to end like m65_run(), and some pages have to be loaded. Returns
+// the number of inputs that don't.
+static int run_cache(unsigned count)
+{
+	m65_mem_t ref_mem, cold_mem, warm_mem;
+	if (!m65_mem_init(&ref_mem) || !m65_mem_init(&cold_mem) || !m65_mem_init(&warm_mem))
+		abort();
+
+	char path[] = "/tmp/m6502-fuzz-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+	{
+		perror(path);
+		return 1;
+	}
+	close(fd);
+
+	uint8_t input[HEADER_SIZE + 512];
+	uint32_t seed = 1;
+	size_t loaded = 0;
+	int failed = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		for (size_t j = 0; j < sizeof(input); j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			input[j] = seed >> 16;
+		}
+
+		m6502_t ref, cold, warm;
+		size_t size = HEADER_SIZE + 1 + (input[11] | input[12] << 8) % 512;
+		load_input(input, size, &ref, &ref_mem);
+		load_input(input, size, &cold, &cold_mem);
+		load_input(input, size, &warm, &warm_mem);
+		m6502_t start = ref;
+
+		m65_cache_t cache;
+		uint64_t cycles = (input[8] % 64 + 1) * 8;
+		m65_run(&ref, &ref_mem, cycles);
+		m65_cache_init(&cache);
+		m65_run_cached(&cold, &cold_mem, &cache, cycles);
+		bool saved = m65_cache_save(&cache, &cold_mem, cold.variant, path);
+		m65_cache_free(&cache);
+
+		m65_cache_init(&cache);
+		size_t pages = saved ? m65_cache_load(&cache, &warm_mem, warm.variant, path) : 0;
+		m65_run_cached(&warm, &warm_mem, &cache, cycles);
+		m65_cache_free(&cache);
+
+		loaded += pages;
+		failed += !saved || !compare_engine("step", "cold", i, &start, &ref, &ref_mem, &cold, &cold_mem)
+			|| !compare_engine("step", "reloaded", i, &start, &ref, &ref_mem, &warm, &warm_mem);
+	}
+
+	unlink(path);
+	m65_mem_free(&ref_mem);
+	m65_mem_free(&cold_mem);
+	m65_mem_free(&warm_mem);
+	printf("%u of %u reloaded caches passed (%zu pages loaded)\n", count - failed, count, loaded);
+	return failed + (loaded == 0);
+}
+
+// Represents the device run_async() watches a processor through. Writing register 0 or 1 counts a run of the IRQ or
+// NMI handler, register 2 reads whether IRQ is still held, and reading register 3 counts a turn of the main loop. The
+// counters are the only part of it that other threads touch.
+typedef struct
+{
+	m65_device_t dev;
+	atomic_uint irqs;
+	atomic_uint nmis;
+	atomic_bool irq_held;
+	atomic_uint loops;
+} fuzz_signals_t;
+
+// signals_read(m65_device_t*, uint16_t) -> uint8_t
+// Reads a register of the signal device.
+static uint8_t signals_read(m65_device_t* dev, uint16_t addr)
+{
+	fuzz_signals_t* signals = dev->ctx;
+	if ((addr & 0xff) == 2)
+		return atomic_load_explicit(&signals->irq_held, memory_order_acquire);
+	if ((addr & 0xff) == 3)
+		atomic_fetch_add_explicit(&signals->loops, 1, memory_order_release);
+	return 0;
+}
+
+// signals_write(m65_device_t*, uint16_t, uint8_t) -> void
+// Writes a register of the signal device.
+static void signals_write(m65_device_t* dev, uint16_t addr, uint8_t data)
+{
+	(void) data;
+	fuzz_signals_t* signals = dev->ctx;
+	if ((addr & 0xff) == 0)
+		atomic_fetch_add_explicit(&signals->irqs, 1, memory_order_release);
+	else if ((addr & 0xff) == 1)
+		atomic_fetch_add_explicit(&signals->nmis, 1, memory_order_release);
+}
+
+// Represents a processor that run_async() signals, with the engine that runs it: 0 for m65_run(), 1 for
+// m65_run_cached() and 2 for m65_cycle().
+typedef struct
+{
+	m6502_t cpu;
+	m65_mem_t mem;
+	m65_cache_t cache;
+	fuzz_signals_t signals;
+	int engine;
+	atomic_bool stop;
+} fuzz_async_t;
+
+// async_init(fuzz_async_t*, int) -> bool
+// Sets up a processor to be signalled, reset into its main loop, which loops on inx and a read of register 3. The IRQ
+// handler reports itself and waits until the line isn't held, and the NMI handler reports itself. Returns false if
+// memory can't be allocated.
+static bool async_init(fuzz_async_t* run, int engine)
+{
+	static const uint8_t main_loop[] = {0x58, 0xE8, 0xAD, 0x03, 0xD0, 0x4C, 0x01, 0x02};
+	static const uint8_t irq[] = {0x8D, 0x00, 0xD0, 0xAD, 0x02, 0xD0, 0xD0, 0xFB, 0x40};
+	static const uint8_t nmi[] = {0x8D, 0x01, 0xD0, 0x40};
+	static const uint8_t vectors[] = {0x10, 0x03, 0x00, 0x02, 0x00, 0x03};
+
+	memset(run, 0, sizeof(fuzz_async_t));
+	if (!m65_mem_init(&run->mem))
+		return false;
+	memcpy(run->mem.ram + 0x0200, main_loop, sizeof(main_loop));
+	memcpy(run->mem.ram + 0x0300, irq, sizeof(irq));
+	memcpy(run->mem.ram + 0x0310, nmi, sizeof(nmi));
+	memcpy(run->mem.ram + 0xFFFA, vectors, sizeof(vectors));
+
+	run->signals.dev.read = signals_read;
+	run->signals.dev.write = signals_write;
+	run->signals.dev.ctx = &run->signals;
+	run->signals.dev.deadline = UINT64_MAX;
+	m65_mem_map_device(&run->mem, 0xD0, 1, &run->signals.dev);
+	m65_mem_set_clock(&run->mem, &run->cpu.cycles);
+	m65_cache_init(&run->cache);
+	run->engine = engine;
+
+	init_6502(&run->cpu);
+	m65_res(&run->cpu);
+	return true;
+}
+
+// async_free(fuzz_async_t*) -> void
+// Frees a signalled processor.
+static void async_free(fuzz_async_t* run)
+{
+	m65_cache_free(&run->cache);
+	m65_mem_free(&run->mem);
+}
+
+// async_run(void*) -> void*
+// Runs a signalled processor until it's stopped.
+static void* async_run(void* arg)
+{
+	fuzz_async_t* run = arg;
+	while (!atomic_load_explicit(&run->stop, memory_order_relaxed))
+	{
+		if (run->engine == 0)
+			m65_run(&run->cpu, &run->mem, 1000);
+		else if (run->engine == 1)
+			m65_run_cached(&run->cpu, &run->mem, &run->cache, 1000);
+		else for (int i = 0; i < 1000; i++)
+		{
+			m65_mem_bus(&run->mem, &run->cpu);
+			m65_cycle(&run->cpu);
+		}
+	}
+	return NULL;
+}
+
+// wait_count(atomic_uint*, unsigned) -> bool
+// Waits up to 10 seconds for a counter of the signal device to reach a value. Returns false if it doesn't.
+static bool wait_count(atomic_uint* counter, unsigned value)
+{
+	for (int i = 0; i < 100000; i++)
+	{
+		if (atomic_load_explicit(counter, memory_order_acquire) >= value)
+			return true;
+		nanosleep(&(struct timespec) {0, 100000}, NULL);
+	}
+	return false;
+}
+
+// run_async_snapshot(void) -> bool
+// Checks that an NMI held by another thread across saving and restoring a snapshot is taken once, and that the line
+// still triggers once released and asserted again. Returns false if it doesn't.
+static bool run_async_snapshot(void)
+{
+	fuzz_async_t run;
+	m65_snap_store_t store;
+	if (!async_init(&run, 0) || !m65_snap_init(&store, NULL))
+		abort();
+
+	m65_nmi_assert_async(&run.cpu, 2);
+	m65_run(&run.cpu, &run.mem, 500);
+	unsigned before = atomic_load(&run.signals.nmis);
+	uint32_t id = m65_snap_save(&store, &run.cpu, &run.mem, M65_SNAP_NONE);
+	m65_run(&run.cpu, &run.mem, 500);
+	bool ok = id != M65_SNAP_NONE && m65_snap_restore(&store, id, &run.cpu, &run.mem, id);
+	m65_run(&run.cpu, &run.mem, 500);
+	unsigned restored = atomic_load(&run.signals.nmis);
+
+	m65_nmi_release_async(&run.cpu, 2);
+	m65_run(&run.cpu, &run.mem, 500);
+	m65_nmi_assert_async(&run.cpu, 2);
+	m65_run(&run.cpu, &run.mem, 500);
+	unsigned again = atomic_load(&run.signals.nmis);
+
+	ok = ok && before == 1 && restored == 1 && again == 2;
+	if (!ok)
+		fprintf(stderr, "held NMI across a snapshot: taken %u, %u after restoring, %u asserted again\n", before,
+				restored, again);
+	m65_snap_free(&store);
+	async_free(&run);
+	return ok;
+}
+
+// run_async(unsigned) -> int
+// Raises and clears interrupts from this thread while every engine runs a processor on another, count times each: an
+// IRQ held until the handler ran, an NMI line held while the handler runs, and an NMI request. Every signal has to run
+// its handler exactly once. Also checks snapshots of a held NMI. Returns the number of engines and checks that fail.
+static int run_async(unsigned count)
+{
+	static const char* names[] = {"step", "cached", "cycle"};
+	int failed = 0;
+
+	for (int engine = 0; engine < 3; engine++)
+	{
+		fuzz_async_t* run = malloc(sizeof(fuzz_async_t));
+		pthread_t thread;
+		if (run == NULL || !async_init(run, engine) || pthread_create(&thread, NULL, async_run, run) != 0)
+			abort();
+
+		fuzz_signals_t* signals = &run->signals;
+		bool ok = true;
+		for (unsigned i = 1; ok && i <= count; i++)
+		{
+			// The IRQ handler waits for the release, so it runs once however long the line was held
+			atomic_store_explicit(&signals->irq_held, true, memory_order_release);
+			m65_irq_assert_async(&run->cpu, 3);
+			ok = wait_count(&signals->irqs, i);
+			m65_irq_release_async(&run->cpu, 3);
+			atomic_store_explicit(&signals->irq_held, false, memory_order_release);
+
+			m65_nmi_assert_async(&run->cpu, 2);
+			ok = ok && wait_count(&signals->nmis, 2 * i - 1);
+			m65_nmi_release_async(&run->cpu, 2);
+			m65_nmi_async(&run->cpu);
+			ok = ok && wait_count(&signals->nmis, 2 * i);
+		}
+
+		// Let it run on for a while to take any interrupt it shouldn't
+		ok = ok && wait_count(&signals->loops, atomic_load(&signals->loops) + 1000);
+		atomic_store(&run->stop, true);
+		pthread_join(thread, NULL);
+
+		unsigned irqs = atomic_load(&signals->irqs), nmis = atomic_load(&signals->nmis);
+		if (!ok || irqs != count || nmis != 2 * count)
+		{
+			fprintf(stderr, "%s engine: %u of %u IRQs and %u of %u NMIs taken\n", names[engine], irqs, count, nmis,
+					2 * count);
+			failed++;
+		}
+
+		async_free(run);
+		free(run);
+	}
+
+	failed += !run_async_snapshot();
+	printf("%d of 4 interrupt checks from another thread passed\n", 4 - failed);
+	return failed;
+}
+
+// arena_fill(m65_mem_t*, uint8_t) -> bool
+// Writes a value to 16 pages of a memory map from an arena, checking that they read as zero first. Returns false if
+// they don't.
+static bool arena_fill(m65_mem_t* mem, uint8_t value)
+{
+	for (unsigned page = 0x10; page < 0x20; page++)
+	{
+		if (m65_mem_peek(mem, page << 8 | value) != 0)
+			return false;
+		m65_mem_write(mem, page << 8 | value, value);
+	}
+	return true;
+}
+
+// arena_thread(void*) -> void*
+// Uses the arena of a new thread for a sparse memory map, which is freed unless arg is set, in which case it's handed
+// back to outlive the thread.
+static void* arena_thread(void* arg)
+{
+	m65_mem_t* mem = malloc(sizeof(m65_mem_t));
+	if (mem == NULL || !m65_mem_init_sparse(mem))
+		abort();
+	m65_mem_write(mem, 0x1234, 0x56);
+	if (arg != NULL)
+		return mem;
+
+	m65_mem_free(mem);
+	free(mem);
+	return NULL;
+}
+
+// process_size() -> size_t
+// Returns the size of the address space of the process in pages, or 0 if it's unknown.
+static size_t process_size(void)
+{
+	size_t size = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file != NULL)
+	{
+		if (fscanf(file, "%zu", &size) != 1)
+			size = 0;
+		fclose(file);
+	}
+	return size;
+}
+
+// run_arena(unsigned) -> int
+// Checks that pools hand released processors, memory maps and pages out again without growing their arena, count
+// times, that a reset starts over in the same chunks, that stale and repeated releases are ignored, and that the arenas
+// of threads go back to the system when they exit, or when the last map that outlived its thread is freed. Returns the
+// number of checks that fail.
+static int run_arena(unsigned count)
+{
+	m65_arena_t arena;
+	m65_arena_init(&arena, false);
+	int failed = 0;
+
+	// Released objects come back first, cleared by the map
+	m6502_t* first_cpu = m65_cpu_new(&arena, M65_NMOS);
+	m65_mem_t* first_map = m65_mem_new(&arena);
+	bool filled = first_map != NULL && arena_fill(first_map, 1);
+	m65_cpu_release(&arena, first_cpu);
+	m65_mem_release(&arena, first_map);
+	size_t reserved = arena.reserved;
+	bool reused = filled;
+	for (unsigned i = 0; reused && i < count; i++)
+	{
+		m6502_t* cpu = m65_cpu_new(&arena, M65_CMOS);
+		m65_mem_t* mem = m65_mem_new(&arena);
+		reused = cpu == first_cpu && mem == first_map && arena_fill(mem, 2 + i % 200);
+		m65_cpu_release(&arena, cpu);
+		m65_mem_release(&arena, mem);
+	}
+	if (!reused || arena.reserved != reserved || arena.cpus.live + arena.maps.live + arena.pages.live != 0)
+	{
+		fprintf(stderr, "pools didn't reuse their objects: %zu bytes reserved, %zu before\n", arena.reserved, reserved);
+		failed++;
+	}
+
+	// A reset drops the maps without freeing them and cuts the same objects again
+	m65_cpu_new(&arena, M65_NMOS);
+	m6502_t* stale = m65_cpu_new(&arena, M65_NMOS);
+	for (unsigned i = 0; i < count; i++)
+		m65_mem_new(&arena);
+	reserved = arena.reserved;
+	m65_arena_reset(&arena);
+	m6502_t* cpu = m65_cpu_new(&arena, M65_NMOS);
+	for (unsigned i = 0; i < count; i++)
+		m65_mem_new(&arena);
+	if (cpu != first_cpu || arena.reserved != reserved)
+	{
+		fprintf(stderr, "reset didn't reuse the chunks: %zu bytes reserved, %zu before\n", arena.reserved, reserved);
+		failed++;
+	}
+
+	// Releases of objects from before the reset and second releases are ignored
+	m65_cpu_release(&arena, stale);
+	m65_cpu_release(&arena, cpu);
+	m65_cpu_release(&arena, cpu);
+	m6502_t* again = m65_cpu_new(&arena, M65_NMOS);
+	m6502_t* other = m65_cpu_new(&arena, M65_NMOS);
+	if (arena.cpus.live != 2 || again != cpu || other == cpu)
+	{
+		fprintf(stderr, "stale or repeated releases reached the pool: %zu processors live\n", arena.cpus.live);
+		failed++;
+	}
+	m65_arena_free(&arena);
+
+	// Every thread maps at least a chunk for its arena, which has to go back when it exits. The first thread is only
+	// there for the heap malloc() gives threads, which is kept for the next one
+	size_t before = 0;
+	for (unsigned i = 0; i <= 64; i++)
+	{
+		if (i == 1)
+			before = process_size();
+
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, arena_thread, NULL) != 0)
+			abort();
+		pthread_join(thread, NULL);
+	}
+	size_t after = process_size();
+	if (after - before > 4 * M65_ARENA_CHUNK / sysconf(_SC_PAGESIZE))
+	{
+		fprintf(stderr, "the arenas of threads weren't freed: %zu pages mapped, %zu before\n", after, before);
+		failed++;
+	}
+
+	// A map that outlives its thread keeps the arena, until it's freed
+	before = process_size();
+	pthread_t thread;
+	m65_mem_t* kept;
+	if (pthread_create(&thread, NULL, arena_thread, &kept) != 0)
+		abort();
+	pthread_join(thread, (void**) &kept);
+	m65_mem_write(kept, 0x4321, 0x65);
+	if (m65_mem_peek(kept, 0x1234) != 0x56 || m65_mem_peek(kept, 0x4321) != 0x65)
+	{
+		fprintf(stderr, "a map that outlived its thread lost its memory\n");
+		failed++;
+	}
+	m65_mem_free(kept);
+	free(kept);
+	after = process_size();
+	if (after >= before + M65_ARENA_CHUNK / sysconf(_SC_PAGESIZE))
+	{
+		fprintf(stderr, "the arena of a thread wasn't freed with its last map: %zu pages mapped, %zu before\n", after,
+				before);
+		failed++;
+	}
+
+	printf("%d of 6 arena checks passed\n", 6 - failed);
+	return failed;
+}
+
+// snap_check(m65_snap_store_t*, uint32_t, uint32_t, const m6502_t*, const uint8_t*, m6502_t*, m65_mem_t*) -> bool
+// Scribbles over a processor and its memory map, restores a snapshot into them from base, and checks that they're
+// byte for byte what was saved. Returns false if they aren't.
+static bool snap_check(m65_snap_store_t* store, uint32_t id, uint32_t base, const m6502_t* saved, const uint8_t* ram,
+		m6502_t* cpu, m65_mem_t* mem)
+{
+	for (unsigned addr = 0; addr < M65_PAGES * M65_PAGE_SIZE; addr += 97)
+		m65_mem_write(mem, addr, addr >> 3);
+	cpu->a ^= 0xff;
+	cpu->cycles += 1000;
+
+	if (!m65_snap_restore(store, id, cpu, mem, base))
+	{
+		fprintf(stderr, "snapshot %u couldn't be restored\n", id);
+		return false;
+	}
+
+	if (!same_state(saved, cpu) || saved->cycles != cpu->cycles || saved->int_lines != cpu->int_lines)
+	{
+		fprintf(stderr, "snapshot %u restored other registers\n", id);
+		print_state("saved", saved);
+		print_state("restored", cpu);
+		return false;
+	}
+
+	for (size_t addr = 0; addr < M65_PAGES * M65_PAGE_SIZE; addr++)
+	{
+		if (m65_mem_peek(mem, addr) != ram[addr])
+		{
+			fprintf(stderr, "snapshot %u restored %02x at %04zx instead of %02x\n", id, m65_mem_peek(mem, addr), addr,
+					ram[addr]);
+			return false;
+		}
+	}
+	return true;
+}
+
+// run_snapshots(unsigned) -> int
+// Saves two random states that share all but a few pages, count times, and checks that the store keeps the shared
+// pages once and that restoring either one, from the other or from nothing and after reloading the pack file, gives
+// back the same memory and registers. Returns the number of rounds that fail.
+static int run_snapshots(unsigned count)
+{
+	static uint8_t ram[2][M65_PAGES * M65_PAGE_SIZE];
+	char dir[] = "/tmp/m6502-fuzz-XXXXXX";
+	char path[sizeof(dir) + 8];
+	if (mkdtemp(dir) == NULL)
+	{
+		perror(dir);
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/pack", dir);
+
+	uint32_t seed = 1;
+	int failed = 0;
+	for (unsigned round = 0; round < count; round++)
+	{
+		m65_snap_store_t store;
+		m65_mem_t mem;
+		m6502_t cpus[2], cpu;
+		unlink(path);
+		if (!m65_snap_init(&store, path) || !m65_mem_init(&mem))
+			abort();
+
+		// Random memory, with some pages of zeros, and then a few pages changed
+		for (size_t addr = 0; addr < M65_PAGES * M65_PAGE_SIZE; addr++)
+		{
+			seed = seed * 1103515245 + 12345;
+			mem.ram[addr] = (addr >> 8) % 7 == 0 ? 0 : seed >> 16;
+		}
+		init_6502_variant(&cpus[0], round % 3);
+		cpus[0].a = seed >> 8;
+		cpus[0].pins.addr = seed >> 12;
+		cpus[0].cycles = round;
+		memcpy(ram[0], mem.ram, sizeof(ram[0]));
+		uint32_t first = m65_snap_save(&store, &cpus[0], &mem, M65_SNAP_NONE);
+		size_t pages = store.page_count;
+
+		cpus[1] = cpus[0];
+		cpus[1].x = cpus[0].a + 1;
+		cpus[1].cycles += 12345;
+		unsigned changed = 1 + round % 8;
+		for (unsigned i = 0; i < changed; i++)
+		{
+			// A different page each time, so every changed page is new to the store
+			uint16_t addr = (1 + i * 29 % 255) << 8 | round % 256;
+			m65_mem_write(&mem, addr, m65_mem_peek(&mem, addr) ^ 0x5a);
+		}
+		memcpy(ram[1], mem.ram, sizeof(ram[1]));
+		uint32_t second = m65_snap_save(&store, &cpus[1], &mem, first);
+
+		// The pages of zeros are all the one page 0, and the pages both share are the same ones in the store
+		bool saved = first != M65_SNAP_NONE && second != M65_SNAP_NONE;
+		bool ok = saved && pages == 1 + M65_PAGES - (M65_PAGES + 6) / 7 && store.page_count == pages + changed;
+		unsigned shared = 0;
+		for (unsigned page = 0; saved && page < M65_PAGES; page++)
+		{
+			bool same = memcmp(ram[0] + page * M65_PAGE_SIZE, ram[1] + page * M65_PAGE_SIZE, M65_PAGE_SIZE) == 0;
+			shared += same && m65_snap_page(&store, store.snapshots[first], page)
+				== m65_snap_page(&store, store.snapshots[second], page);
+		}
+		ok = ok && shared == M65_PAGES - changed;
+		if (!ok)
+			fprintf(stderr, "round %u: %zu pages stored for %u changed, %u shared\n", round, store.page_count - pages,
+					changed, shared);
+
+		// Restoring from the other snapshot copies only what differs, and from nothing copies everything
+		cpu = cpus[1];
+		ok = ok && snap_check(&store, first, second, &cpus[0], ram[0], &cpu, &mem)
+			&& snap_check(&store, second, first, &cpus[1], ram[1], &cpu, &mem)
+			&& snap_check(&store, first, M65_SNAP_NONE, &cpus[0], ram[0], &cpu, &mem);
+		m65_snap_free(&store);
+		m65_mem_free(&mem);
+
+		// The pack file holds both, into a new map
+		ok = ok && m65_snap_init(&store, path) && store.count == 2 && store.page_count == pages + changed;
+		if (ok)
+		{
+			if (!m65_mem_init(&mem))
+				abort();
+			ok = snap_check(&store, second, M65_SNAP_NONE, &cpus[1], ram[1], &cpu, &mem)
+				&& snap_check(&store, first, second, &cpus[0], ram[0], &cpu, &mem);
+			m65_mem_free(&mem);
+			m65_snap_free(&store);
+		}
+
+		failed += !ok;
+	}
+
+	unlink(path);
+	rmdir(dir);
+	printf("%u of %u snapshot rounds passed\n", count - failed, count);
+	return failed;
+}
+
+// system_init(m65_system_t*, fuzz_timer_t*) -> bool
+// Sets up a board of two processors sharing page 0x40. The first has a timer raising IRQ every 250 cycles, and its
+// handler acknowledges it, counts its runs in 0x4000 and copies the number of times the timer fired to 0x4001. The
+// second copies the count to 0x4002 in a loop, so both access the shared page all the time. Returns false if memory
+// can't be allocated.
+static bool system_init(m65_system_t* sys, fuzz_timer_t* timer)
+{
+	static const uint8_t main_loop[] = {0x58, 0xE8, 0x4C, 0x01, 0x02};
+	static const uint8_t irq[] = {0xAD, 0x01, DEVICE_PAGE, 0xEE, 0x00, 0x40, 0x8D, 0x01, 0x40, 0x40};
+	static const uint8_t copy_loop[] = {0xAD, 0x00, 0x40, 0x8D, 0x02, 0x40, 0x4C, 0x00, 0x02};
+	if (!m65_system_init(sys, 2))
+		return false;
+	m65_system_share(sys, 0x40, 1);
+
+	memcpy(sys->mems[0].ram + 0x0200, main_loop, sizeof(main_loop));
+	memcpy(sys->mems[0].ram + 0x0300, irq, sizeof(irq));
+	memcpy(sys->mems[1].ram + 0x0200, copy_loop, sizeof(copy_loop));
+	for (unsigned i = 0; i < 2; i++)
+	{
+		sys->mems[i].ram[0xFFFC] = 0x00;
+		sys->mems[i].ram[0xFFFD] = 0x02;
+		sys->mems[i].ram[0xFFFE] = 0x00;
+		sys->mems[i].ram[0xFFFF] = 0x03;
+		m65_res(&sys->cpus[i]);
+	}
+
+	memset(timer, 0, sizeof(fuzz_timer_t));
+	timer->dev.advance = timer_advance;
+	timer->dev.read = timer_read;
+	timer->dev.write = timer_write;
+	timer->dev.ctx = timer;
+	timer->cpu = &sys->cpus[0];
+	timer->period = 250;
+	m65_mem_map_device(&sys->mems[0], DEVICE_PAGE, 1, &timer->dev);
+	m65_mem_set_clock(&sys->mems[0], &sys->cpus[0].cycles);
+	m65_device_schedule(&sys->mems[0], &timer->dev, timer->period);
+	return true;
+}
+
+// system_signal(bool, bool, unsigned) -> bool
+// Runs a board whose first processor stores to a shared page that the second one polls, after a delay that puts it
+// ahead of the second one. Right before the store, another thread asserts the IRQ line of the first processor while
+// interrupts are disabled, or asserts and releases it again if released is set, so the store still has to go in the
+// order of the cycles. The run has to end the same as a run where the processor took the lines in beforehand.
+static bool system_signal(bool released, bool threaded, unsigned delay)
+{
+	static const uint8_t store[] = {0xA2, 0x00, 0xCA, 0xD0, 0xFD, 0xA9, 0x01, 0x8D, 0x00, 0x40, 0x4C, 0x0A, 0x02};
+	static const uint8_t poll[] = {0xC8, 0xAD, 0x00, 0x40, 0xF0, 0xFA, 0x8C, 0x01, 0x40, 0x4C, 0x09, 0x02};
+	m65_system_t systems[2];
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		m65_system_t* sys = &systems[i];
+		if (!m65_system_init(sys, 2))
+			abort();
+		m65_system_share(sys, 0x40, 1);
+		memcpy(sys->mems[0].ram + 0x0200, store, sizeof(store));
+		memcpy(sys->mems[1].ram + 0x0200, poll, sizeof(poll));
+		sys->mems[0].ram[0x0201] = delay + 1;
+		for (unsigned j = 0; j < 2; j++)
+		{
+			sys->mems[j].ram[0xFFFC] = 0x00;
+			sys->mems[j].ram[0xFFFD] = 0x02;
+			m65_res(&sys->cpus[j]);
+		}
+
+		// The delay touches nothing shared, so it can run before the board does
+		m6502_t* cpu = &sys->cpus[0];
+		while (cpu->phase != M65_PHASE_FETCH || cpu->pins.addr != 0x0207)
+			m65_step(cpu, &sys->mems[0]);
+
+		m65_irq_assert_async(cpu, 1);
+		if (released)
+			m65_irq_release_async(cpu, 1);
+		if (i == 0)
+			m65_int_collect(cpu);
+
+		if (threaded)
+			m65_system_run_threads(sys, 2000);
+		else m65_system_run(sys, 2000);
+	}
+
+	bool ok = memcmp(systems[0].shared_ram, systems[1].shared_ram, M65_PAGES * M65_PAGE_SIZE) == 0;
+	for (unsigned j = 0; j < 2; j++)
+		ok = ok && same_state(&systems[0].cpus[j], &systems[1].cpus[j]);
+	if (!ok)
+	{
+		fprintf(stderr, "%s system with a %s IRQ after %u loops: the poll saw the store after %u and %u loops\n",
+				threaded ? "threaded" : "single threaded", released ? "released" : "masked", delay + 1,
+				systems[0].shared_ram[0x4001], systems[1].shared_ram[0x4001]);
+		print_state("expected", &systems[0].cpus[1]);
+		print_state("poll", &systems[1].cpus[1]);
+	}
+
+	m65_system_free(&systems[0]);
+	m65_system_free(&systems[1]);
+	return ok;
+}
+
+// run_system(void) -> int
+// Runs a board whose first processor takes an IRQ from a timer every 250 cycles, on one thread and on a thread per
+// processor. The handler has to run exactly once every time the timer fires, and both runs have to end the same. Then
+// runs boards whose processors get signals that leave no interrupt pending. Returns the number of runs that fail.
+static int run_system(void)
+{
+	m65_system_t systems[2];
+	fuzz_timer_t timers[2];
+	static const char* names[] = {"single threaded", "threaded"};
+	int failed = 0;
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		if (!system_init(&systems[i], &timers[i]))
+			abort();
+		if (i == 0)
+			m65_system_run(&systems[i], 50000);
+		else m65_system_run_threads(&systems[i], 50000);
+
+		// The handler may be in the middle of a run at the end, so the timer can be one ahead
+		const uint8_t* shared = systems[i].shared_ram + 0x4000;
+		unsigned handled = shared[0];
+		bool ok = timers[i].fired >= 190 && (handled == timers[i].fired || handled + 1 == timers[i].fired)
+			&& shared[1] == handled;
+		if (i == 1)
+		{
+			ok = ok && memcmp(systems[0].shared_ram, systems[1].shared_ram, M65_PAGES * M65_PAGE_SIZE) == 0;
+			for (unsigned j = 0; j < 2; j++)
+				ok = ok && same_state(&systems[0].cpus[j], &systems[1].cpus[j]);
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "%s system: the timer fired %u times, the handler ran %u times and saw %u\n", names[i],
+					timers[i].fired, handled, shared[1]);
+			print_state("main", &systems[i].cpus[0]);
+			print_state("copy", &systems[i].cpus[1]);
+			failed++;
+		}
+	}
+
+	m65_system_free(&systems[0]);
+	m65_system_free(&systems[1]);
+
+	// Signals that leave no interrupt pending, while the next instruction writes the shared page
+	for (unsigned i = 0; i < 64; i++)
+		failed += !system_signal(i & 1, i >> 1 & 1, i >> 2);
+
+	printf("%d of 66 system runs passed\n", 66 - failed);
+	return failed;
+}
+
+// The ROM sizes run_mappers() banks, from smaller than a window to more banks than a register can select.
+static const size_t mapper_rom_sizes[] = {0x2000, 0x3000, 0x4000, 0x6000, 0x8000, 0x20000, 0x80000};
+
+// Represents what run_mappers() expects of a mapper: its registers, the bits written to its shift register so far,
+// its cartridge RAM and the RAM of the memory map, which the RAM windows read once the mapper is freed.
+typedef struct
+{
+	uint8_t regs[M65_MAPPER_REGS];
+	uint8_t shift;
+	uint8_t shift_count;
+	uint8_t ram[32 * M65_PAGE_SIZE];
+	uint8_t own[M65_PAGES * M65_PAGE_SIZE];
+	bool freed;
+} fuzz_cart_t;
+
+// cart_write(const m65_mapper_type_t*, fuzz_cart_t*, uint16_t, uint8_t) -> void
+// Writes to the registers of the expected mapper. Serial registers take five writes, whose bits come in from the top
+// like on the MMC1, and a write with bit 7 set starts over and selects the last layout.
+static void cart_write(const m65_mapper_type_t* type, fuzz_cart_t* cart, uint16_t addr, uint8_t data)
+{
+	unsigned reg = addr >> type->reg_shift & type->reg_mask;
+	if (type->decode == M65_REGS_DIRECT)
+		cart->regs[reg] = data;
+	else if (data & 0x80)
+	{
+		cart->shift_count = 0;
+		cart->regs[type->mode_reg] |= type->mode_mask << type->mode_shift;
+	} else
+	{
+		cart->shift = cart->shift >> 1 | (data & 1) << 4;
+		if (++cart->shift_count == 5)
+		{
+			cart->regs[reg] = cart->shift;
+			cart->shift_count = 0;
+		}
+	}
+}
+
+// cart_peek(const m65_mapper_type_t*, const fuzz_cart_t*, const uint8_t*, size_t, uint16_t) -> int
+// Returns the byte the expected mapper reads at an address, or -1 if the address is in a window of another layout.
+static int cart_peek(const m65_mapper_type_t* type, const fuzz_cart_t* cart, const uint8_t* rom, size_t rom_size,
+					 uint16_t addr)
+{
+	int layout = type->mode_reg < 0 ? 0 : cart->regs[type->mode_reg] >> type->mode_shift & type->mode_mask;
+	for (const m65_window_t* window = type->layouts[layout]; window->pages; window++)
+	{
+		size_t size = window->pages * M65_PAGE_SIZE;
+		size_t offset = addr - window->page * M65_PAGE_SIZE;
+		if (offset >= size)
+			continue;
+		if (cart->freed && window->source == M65_BANK_RAM)
+			return cart->own[addr];
+
+		// Sources smaller than a window repeat through it, and banks past the end wrap around
+		const uint8_t* data = window->source == M65_BANK_ROM ? rom : cart->ram;
+		size_t total = window->source == M65_BANK_ROM ? rom_size : type->ram_pages * M65_PAGE_SIZE;
+		long banks = total / size;
+		long bank = window->reg < 0 ? window->bank : cart->regs[window->reg] >> window->shift & window->mask;
+		if (banks == 0)
+			return data[offset % total];
+		return data[(bank % banks + banks) % banks * size + offset];
+	}
+
+	for (unsigned i = 0; i < M65_MAPPER_LAYOUTS; i++)
+	{
+		for (const m65_window_t* window = type->layouts[i]; window->pages; window++)
+		{
+			if (addr >> 8 >= window->page && addr >> 8 < window->page + window->pages)
+				return -1;
+		}
+	}
+
+	return cart->own[addr];
+}
+
+// cart_check(const char*, const m65_mem_t*, const m65_mapper_type_t*, const fuzz_cart_t*, const uint8_t*, size_t,
+//            uint32_t*) -> bool
+// Checks that a memory map reads what the expected mapper does, at a random byte of every page, or everywhere if
+// seed is NULL. Prints the first byte that differs.
+static bool cart_check(const char* name, const m65_mem_t* mem, const m65_mapper_type_t* type, const fuzz_cart_t* cart,
+					   const uint8_t* rom, size_t rom_size, uint32_t* seed)
+{
+	for (unsigned i = 0; i < M65_PAGES * M65_PAGE_SIZE; i++)
+	{
+		uint16_t addr = i;
+		if (seed != NULL)
+		{
+			if (i >= M65_PAGES)
+				break;
+			*seed = *seed * 1103515245 + 12345;
+			addr = i << 8 | (*seed >> 16 & 0xff);
+		}
+
+		int expected = cart_peek(type, cart, rom, rom_size, addr);
+		if (expected >= 0 && m65_mem_peek(mem, addr) != expected)
+		{
+			fprintf(stderr, "%s %s with %zu bytes of ROM: 0x%04x reads %02x instead of %02x\n", name, type->name,
+					rom_size, addr, m65_mem_peek(mem, addr), expected);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// run_mappers(unsigned) -> int
+// Banks random ROMs through every built in mapper type, count times in all, with random writes to the registers and
+// the cartridge RAM, and checks that every window reads the bank the registers select. Halfway through, the mapper is
+// cloned and both copies go on separately. Once they are freed, the ROM banks stay and the RAM windows read the RAM of
+// the memory map again. Returns the number of rounds that fail.
+static int run_mappers(unsigned count)
+{
+	static fuzz_cart_t carts[2];
+	static uint8_t rom[0x80000];
+	unsigned types = 0;
+	while (m65_mappers[types].name != NULL)
+		types++;
+
+	uint32_t seed = 1;
+	int failed = 0;
+	for (unsigned round = 0; round < count; round++)
+	{
+		const m65_mapper_type_t* type = &m65_mappers[round % types];
+		size_t sizes = sizeof(mapper_rom_sizes) / sizeof(mapper_rom_sizes[0]);
+		m65_rom_t image = {.data = rom, .size = mapper_rom_sizes[round / types % sizes]};
+		for (size_t i = 0; i < image.size; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			rom[i] = seed >> 16;
+		}
+
+		m65_mem_t mems[2];
+		m65_mapper_t mappers[2];
+		if (!m65_mem_init(&mems[0]))
+			abort();
+		for (size_t i = 0; i < sizeof(carts[0].own); i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			mems[0].ram[i] = carts[0].own[i] = seed >> 16;
+		}
+		memcpy(carts[0].regs, type->reset, sizeof(carts[0].regs));
+		carts[0].shift_count = 0;
+		carts[0].freed = false;
+		memset(carts[0].ram, 0, sizeof(carts[0].ram));
+		if (!m65_mapper_init(&mappers[0], type, &mems[0], &image))
+			abort();
+
+		bool ok = m65_mapper_find(type->name) == type && (type->ines < 0 || m65_mapper_find_ines(type->ines) == type)
+			&& cart_check("new", &mems[0], type, &carts[0], rom, image.size, NULL);
+		unsigned copies = 1;
+		for (unsigned step = 0; ok && step < 64; step++)
+		{
+			if (step == 32)
+			{
+				if (!m65_mem_clone(&mems[1], &mems[0]) || !m65_mapper_clone(&mappers[1], &mappers[0], &mems[1]))
+					abort();
+				carts[1] = carts[0];
+				copies = 2;
+				ok = cart_check("cloned", &mems[1], type, &carts[1], rom, image.size, NULL);
+			}
+
+			// Serial registers mostly get single bits, and now and then a reset
+			seed = seed * 1103515245 + 12345;
+			unsigned i = seed >> 16 & (copies - 1);
+			uint8_t data = seed >> 24;
+			if (type->decode == M65_REGS_SERIAL && seed >> 20 & 7)
+				data &= 1;
+			if (type->reg_pages && seed >> 12 & 3)
+			{
+				uint16_t addr = type->reg_page * M65_PAGE_SIZE + (seed >> 4) % (type->reg_pages * M65_PAGE_SIZE);
+				m65_mem_write(&mems[i], addr, data);
+				cart_write(type, &carts[i], addr, data);
+			} else
+			{
+				uint16_t addr = 0x6000 | (seed >> 4 & 0x1fff);
+				m65_mem_write(&mems[i], addr, data);
+				if (type->ram_pages)
+					carts[i].ram[addr & 0x1fff] = data;
+				else carts[i].own[addr] = data;
+			}
+
+			for (unsigned j = 0; j < copies; j++)
+				ok = ok && cart_check(j ? "cloned" : "banked", &mems[j], type, &carts[j], rom, image.size, &seed);
+		}
+
+		// Freed mappers leave the banks mapped and ignore register writes
+		for (unsigned i = 0; i < copies; i++)
+		{
+			m65_mapper_free(&mappers[i]);
+			carts[i].freed = true;
+			uint64_t writes = mappers[i].writes;
+			if (type->reg_pages)
+				m65_mem_write(&mems[i], type->reg_page * M65_PAGE_SIZE, 0x80);
+			ok = ok && mappers[i].writes == writes;
+			ok = ok && cart_check("freed", &mems[i], type, &carts[i], rom, image.size, NULL);
+			m65_mem_free(&mems[i]);
+		}
+
+		failed += !ok;
+	}
+
+	printf("%u of %u mapper rounds passed\n", count - failed, count);
+	return failed;
+}
+
+// The number of records in every round of run_trace(), and the capacity of its queues, which is tiny so that the
+// emulation side keeps finding them full.
+#define TRACE_RECORDS 3000
+#define TRACE_QUEUE 4
+
+// trace_records(m65_trace_record_t*, m65_variant_t, uint32_t*) -> void
+// Makes up records that mostly go through the code in order, with gaps of cycles up to 56 bits wide, jumps back to
+// addresses traced before or anywhere, code that changes at an address traced before, and random registers.
+static void trace_records(m65_trace_record_t* records, m65_variant_t variant, uint32_t* seed)
+{
+	static uint8_t code[65536][3];
+	memset(code, 0, sizeof(code));
+
+	m65_trace_record_t record = {0};
+	uint16_t next = 0;
+	for (unsigned i = 0; i < TRACE_RECORDS; i++)
+	{
+		uint32_t r = *seed = *seed * 1103515245 + 12345;
+		uint32_t value = *seed = *seed * 1103515245 + 12345;
+
+		// Instructions take a few cycles, but waiting for an interrupt can take any number
+		if (r & 0xf)
+			record.cycles += 2 + (value & 7);
+		else record.cycles += ((uint64_t) value << 24 ^ value) & ((1ull << (r >> 4) % 57) - 1);
+
+		if (r >> 8 & 3)
+			record.pc = next;
+		else if (i > 0 && r >> 10 & 1)
+			record.pc = records[(value >> 8) % i].pc;
+		else record.pc = value >> 16;
+
+		// Code seen for the first time, or changed now and then, sometimes only in one of its bytes
+		uint8_t* bytes = code[record.pc];
+		if ((bytes[0] | bytes[1] | bytes[2]) == 0 || (r >> 11 & 7) == 0)
+		{
+			bytes[0] = value;
+			bytes[1] = value >> 8;
+			bytes[2] = value >> 24;
+		} else if ((r >> 28 & 3) == 0)
+			bytes[(r >> 30) % 3] ^= value >> 16 | 1;
+		if ((r >> 14 & 15) == 0)
+			memset(bytes, 0, 3);
+		memcpy(record.bytes, bytes, 3);
+
+		uint8_t* regs[] = {&record.a, &record.x, &record.y, &record.s, &record.flags};
+		for (int j = 0; j < 5; j++)
+		{
+			if ((r >> (18 + 2 * j) & 3) == 0)
+				*regs[j] = value >> (5 * j);
+		}
+
+		const m65_opinfo_t* info = &m65_opinfo[variant][record.bytes[0]];
+		next = record.pc + (info->cycles ? m65_mode_length[info->mode] : 1);
+		records[i] = record;
+	}
+}
+
+// trace_write(FILE*, const m65_trace_record_t*, bool*, unsigned, m65_trace_format_t, m65_trace_policy_t,
+//             m65_variant_t) -> bool
+// Traces the records marked in pushed to a file through a tiny queue, and marks the ones that got through. Returns
+// false if the trace can't be started or doesn't count the records it dropped.
+static bool trace_write(FILE* out, const m65_trace_record_t* records, bool* pushed, unsigned count,
+						m65_trace_format_t format, m65_trace_policy_t policy, m65_variant_t variant)
+{
+	m65_trace_t trace;
+	if (!m65_trace_init(&trace, out, format, policy, variant, TRACE_QUEUE))
+		return false;
+
+	// Pausing now and then lets some records through when they are dropped
+	uint64_t dropped = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (pushed[i])
+			dropped += !(pushed[i] = m65_trace_push(&trace, &records[i]));
+		if (policy == M65_TRACE_DROP && i % 32 == 31)
+			nanosleep(&(struct timespec) {0, 200000}, NULL);
+	}
+
+	return m65_trace_close(&trace) == dropped;
+}
+
+// same_file(FILE*, FILE*) -> bool
+// Checks if two files have the same contents, from their start.
+static bool same_file(FILE* a, FILE* b)
+{
+	char buf[2][4096];
+	size_t size;
+	rewind(a);
+	rewind(b);
+	do
+	{
+		size = fread(buf[0], 1, sizeof(buf[0]), a);
+		if (fread(buf[1], 1, sizeof(buf[1]), b) != size || memcmp(buf[0], buf[1], size) != 0)
+			return false;
+	} while (size > 0);
+
+	return true;
+}
+
+// run_trace(unsigned) -> int
+// Traces random records in both formats, in up to three parts joined with m65_trace_append(), and checks that the
+// delta trace decodes to the text trace. Then traces them again dropping what doesn't fit in the queue, and checks
+// that the records that got through make the same trace as when they are all waited for. Returns the number of rounds
+// that fail.
+static int run_trace(unsigned count)
+{
+	static m65_trace_record_t records[TRACE_RECORDS];
+	static bool pushed[TRACE_RECORDS];
+	static const char* names[] = {"text", "delta"};
+	uint32_t seed = 1;
+	int failed = 0;
+
+	for (unsigned round = 0; round < count; round++)
+	{
+		m65_variant_t variant = round % 3;
+		unsigned parts = 1 + round % 3;
+		trace_records(records, variant, &seed);
+
+		FILE* joined[2] = {tmpfile(), tmpfile()};
+		FILE* dumped = tmpfile();
+		if (joined[0] == NULL || joined[1] == NULL || dumped == NULL)
+			abort();
+
+		// The parts go into files of their own first, like the segments of m6502 -k
+		bool ok = true;
+		for (unsigned part = 0; part < parts; part++)
+		{
+			unsigned start = TRACE_RECORDS * part / parts;
+			unsigned end = TRACE_RECORDS * (part + 1) / parts;
+			for (m65_trace_format_t format = M65_TRACE_TEXT; format <= M65_TRACE_DELTA; format++)
+			{
+				FILE* file = tmpfile();
+				memset(pushed, true, sizeof(pushed));
+				ok = ok && file != NULL
+					&& trace_write(file, records + start, pushed, end - start, format, M65_TRACE_BLOCK, variant);
+				if (file != NULL)
+				{
+					rewind(file);
+					ok = ok && m65_trace_append(joined[format], file, format, part == 0);
+					fclose(file);
+				}
+			}
+		}
+
+		rewind(joined[M65_TRACE_DELTA]);
+		ok = ok && m65_trace_dump(joined[M65_TRACE_DELTA], dumped) && same_file(joined[M65_TRACE_TEXT], dumped);
+		if (!ok)
+			fprintf(stderr, "trace round %u: a delta trace in %u parts doesn't decode to the text trace\n", round,
+					parts);
+		fclose(joined[0]);
+		fclose(joined[1]);
+		fclose(dumped);
+
+		// Traces that drop records are the traces of the records that got through
+		for (m65_trace_format_t format = M65_TRACE_TEXT; ok && format <= M65_TRACE_DELTA; format++)
+		{
+			FILE* trace = tmpfile();
+			FILE* text = format == M65_TRACE_DELTA ? tmpfile() : trace;
+			FILE* kept = tmpfile();
+			memset(pushed, true, sizeof(pushed));
+			ok = trace != NULL && text != NULL && kept != NULL
+				&& trace_write(trace, records, pushed, TRACE_RECORDS, format, M65_TRACE_DROP, variant)
+				&& trace_write(kept, records, pushed, TRACE_RECORDS, M65_TRACE_TEXT, M65_TRACE_BLOCK, variant);
+			if (ok && format == M65_TRACE_DELTA)
+			{
+				rewind(trace);
+				ok = m65_trace_dump(trace, text);
+			}
+			ok = ok && same_file(text, kept);
+			if (!ok)
+				fprintf(stderr, "trace round %u: a %s trace dropping records isn't the trace of the others\n", round,
+						names[format]);
+
+			if (text != trace && text != NULL)
+				fclose(text);
+			if (trace != NULL)
+				fclose(trace);
+			if (kept != NULL)
+				fclose(kept);
+		}
+
+		failed += !ok;
+	}
+
+	printf("%u of %u trace rounds passed\n", count - failed, count);
+	return failed;
+}
+
+// loader_write(const char*, const void*, size_t, long) -> bool
+// Writes a file for run_loader(), with a modification time in a fixed second and the given nanoseconds.
+static bool loader_write(const char* path, const void* data, size_t size, long nsec)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	bool ok = fwrite(data, 1, size, file) == size;
+	ok = fclose(file) == 0 && ok;
+	struct timespec times[2] = {{1700000000, nsec}, {1700000000, nsec}};
+	return ok && utimensat(AT_FDCWD, path, times, 0) == 0;
+}
+
+// loader_check(const char*, const m65_rom_t*, int, size_t, const uint8_t*, size_t) -> bool
+// Maps an image with its program at an address, or at its own address with m65_rom_map() if load is -1, and checks
+// that size bytes of the program from skip on are there. Then checks the same with the program copied into RAM.
+// Prints what's wrong otherwise.
+static bool loader_check(const char* name, const m65_rom_t* rom, int load, size_t skip, const uint8_t* bytes,
+						 size_t size)
+{
+	m65_mem_t mem;
+	bool ok = true;
+	uint16_t addr = load < 0 ? rom->load : load;
+	for (int copy = 0; ok && copy < 2; copy++)
+	{
+		if (!m65_mem_init(&mem))
+			abort();
+		if (copy)
+			m65_rom_load_at(&mem, rom, addr);
+		else if (load < 0)
+			m65_rom_map(&mem, rom);
+		else m65_rom_map_at(&mem, rom, addr);
+
+		for (size_t i = 0; ok && i < size; i++)
+		{
+			uint16_t at = addr + skip + i;
+			if (m65_mem_peek(&mem, at) != bytes[i])
+			{
+				fprintf(stderr, "%s %s at 0x%04x: 0x%04x reads %02x instead of %02x\n", name,
+						copy ? "copied" : "mapped", addr, at, m65_mem_peek(&mem, at), bytes[i]);
+				ok = false;
+			}
+		}
+		m65_mem_free(&mem);
+	}
+
+	return ok;
+}
+
+// run_loader(void) -> int
+// Loads an iNES image, a .prg file and an Intel HEX file, at their own addresses and elsewhere, and checks that a
+// cached flat image is only used while its file stays the same, down to the nanoseconds of its modification time.
+// Returns the number of checks that fail.
+static int run_loader(void)
+{
+	char dir[] = "/tmp/m6502-fuzz-XXXXXX";
+	char nes[sizeof(dir) + 16], prg[sizeof(dir) + 16], hex[sizeof(dir) + 16];
+	if (mkdtemp(dir) == NULL)
+	{
+		perror(dir);
+		return 1;
+	}
+	snprintf(nes, sizeof(nes), "%s/test.nes", dir);
+	snprintf(prg, sizeof(prg), "%s/test.prg", dir);
+	snprintf(hex, sizeof(hex), "%s/test.hex", dir);
+
+	static uint8_t image[16 + 0x4000];
+	uint32_t seed = 1;
+	for (size_t i = 0; i < sizeof(image); i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		image[i] = seed >> 16;
+	}
+	const uint8_t* program = image + 16;
+	int checks = 0;
+	int failed = 0;
+
+	// A 16 KiB iNES image with mapper 1, mirrored at 0xC000
+	memcpy(image, "NES\x1a\x01\x00\x10\x00", 8);
+	memset(image + 8, 0, 8);
+	m65_rom_t* rom = loader_write(nes, image, sizeof(image), 0) ? m65_rom_open(nes) : NULL;
+	checks += 3;
+	failed += !(rom != NULL && rom->format == M65_ROM_INES && rom->load == 0x8000 && rom->offset == 0
+				&& rom->size == 0x4000 && rom->mapper == 1);
+	failed += !(rom != NULL && loader_check("ines", rom, -1, 0, program, 0x4000));
+	failed += !(rom != NULL && loader_check("ines", rom, 0xC000, 0, program, 0x4000));
+	if (rom != NULL)
+	{
+		m65_mem_t mem;
+		if (!m65_mem_init(&mem))
+			abort();
+		m65_rom_map(&mem, rom);
+		checks++;
+		failed += m65_mem_peek(&mem, 0xC000) != program[0] || m65_mem_peek(&mem, 0xFFFF) != program[0x3FFF];
+		m65_mem_free(&mem);
+		m65_rom_close(rom);
+	}
+
+	// A .prg file at 0x0801, at its own address, on a page boundary and at the same offset into another page
+	uint8_t* file = malloc(2 + 1000);
+	file[0] = 0x01;
+	file[1] = 0x08;
+	memcpy(file + 2, program, 1000);
+	static const int prg_loads[] = {-1, 0x4000, 0x3001, 0x2345};
+	for (int reload = 0; reload < 2; reload++)
+	{
+		rom = (reload || loader_write(prg, file, 2 + 1000, 100)) ? m65_rom_open(prg) : NULL;
+		checks++;
+		failed += !(rom != NULL && rom->format == M65_ROM_PRG && rom->load == 0x0801 && rom->offset == 1);
+		for (int i = 0; i < 4; i++)
+		{
+			checks++;
+			failed += !(rom != NULL && loader_check(reload ? "cached prg" : "prg", rom, prg_loads[i], 0, program, 1000));
+		}
+		if (rom != NULL)
+			m65_rom_close(rom);
+	}
+
+	// The same file changed within the same second, so only the nanoseconds tell the cache is stale
+	file[2] ^= 0xff;
+	rom = loader_write(prg, file, 2 + 1000, 200) ? m65_rom_open(prg) : NULL;
+	checks++;
+	failed += !(rom != NULL && loader_check("rewritten prg", rom, -1, 0, file + 2, 1000));
+	if (rom != NULL)
+		m65_rom_close(rom);
+
+	// An Intel HEX file with two records and a gap between them, starting at 0x1234
+	char text[256];
+	static const uint16_t hex_addrs[] = {0x1234, 0x1300};
+	int length = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		uint8_t sum = 16 + (hex_addrs[i] >> 8) + hex_addrs[i];
+		length += sprintf(text + length, ":10%04X00", hex_addrs[i]);
+		for (int j = 0; j < 16; j++)
+		{
+			length += sprintf(text + length, "%02X", program[i * 16 + j]);
+			sum += program[i * 16 + j];
+		}
+		length += sprintf(text + length, "%02X\n", (uint8_t) -sum);
+	}
+	length += sprintf(text + length, ":00000001FF\n");
+
+	static const int hex_loads[] = {-1, 0x4000, 0x5634};
+	rom = loader_write(hex, text, length, 0) ? m65_rom_open(hex) : NULL;
+	checks++;
+	failed += !(rom != NULL && rom->format == M65_ROM_HEX && rom->load == 0x1234 && rom->offset == 0x34);
+	for (int i = 0; i < 3; i++)
+	{
+		checks += 2;
+		failed += !(rom != NULL && loader_check("hex", rom, hex_loads[i], 0, program, 16));
+		failed += !(rom != NULL && loader_check("hex", rom, hex_loads[i], 0x1300 - 0x1234, program + 16, 16));
+	}
+	if (rom != NULL)
+		m65_rom_close(rom);
+
+	free(file);
+	char flat[sizeof(dir) + 32];
+	const char* paths[] = {nes, prg, hex};
+	for (int i = 0; i < 3; i++)
+	{
+		snprintf(flat, sizeof(flat), "%s.flat", paths[i]);
+		unlink(flat);
+		unlink(paths[i]);
+	}
+	rmdir(dir);
+	printf("%d of %d loader checks passed\n", checks - failed, checks);
+	return failed;
+}
+
+// The program run_checkpoints() traces, at 0x0801: nested loops that add two pages of data, modify their own operand
+// and call a subroutine that changes the data.
+static const uint8_t checkpoint_program[] = {
+	0xA2, 0x00,			// ldx #0
+	0xA0, 0x00,			// outer: ldy #0
+	0xB9, 0x00, 0x09,	// inner: lda $0900,y
+	0x7D, 0x00, 0x0A,	// adc $0A00,x
+	0x99, 0x00, 0x09,	// sta $0900,y
+	0xEE, 0x06, 0x08,	// inc inner+1
+	0x88,				// dey
+	0xD0, 0xF1,			// bne inner
+	0xE8,				// inx
+	0x20, 0x1B, 0x08,	// jsr sub
+	0x4C, 0x03, 0x08,	// jmp outer
+	0x48,				// sub: pha
+	0x8A,				// txa
+	0x49, 0x5A,			// eor #$5A
+	0x9D, 0x00, 0x0A,	// sta $0A00,x
+	0x68,				// pla
+	0x60,				// rts
+};
+
+// checkpoint_same(const char*, const char*, bool) -> bool
+// Checks if a trace is the same as a text trace, converting it to text first if it's a delta trace.
+static bool checkpoint_same(const char* path, const char* text_path, bool delta)
+{
+	FILE* trace = fopen(path, "rb");
+	FILE* text = fopen(text_path, "rb");
+	FILE* dumped = delta ? tmpfile() : trace;
+	bool ok = trace != NULL && text != NULL && dumped != NULL && (!delta || m65_trace_dump(trace, dumped))
+		&& same_file(dumped, text);
+	if (dumped != trace && dumped != NULL)
+		fclose(dumped);
+	if (trace != NULL)
+		fclose(trace);
+	if (text != NULL)
+		fclose(text);
+	return ok;
+}
+
+// run_checkpoints(const char*) -> int
+// Runs jobs that trace a program in both formats with the runner at path, once tracing while they run and then with
+// checkpoints every few cycles on several threads (m6502 -k), and checks that every checkpointed trace is the text
+// trace of the first run, once delta traces are converted. Returns the number of traces that differ.
+static int run_checkpoints(const char* runner)
+{
+	static const unsigned intervals[] = {1000, 7919, 40000};
+	static const unsigned threads[] = {1, 4};
+	char dir[] = "/tmp/m6502-fuzz-XXXXXX";
+	char prg[sizeof(dir) + 16], jobs[sizeof(dir) + 16], path[sizeof(dir) + 32], text[sizeof(dir) + 32];
+	char command[4096 + 256];
+	if (mkdtemp(dir) == NULL)
+	{
+		perror(dir);
+		return 1;
+	}
+	snprintf(prg, sizeof(prg), "%s/test.prg", dir);
+	snprintf(jobs, sizeof(jobs), "%s/jobs", dir);
+
+	// The program at 0x0801 and random data up to 0x0AFF
+	uint8_t image[2 + 0x0AFF];
+	uint32_t seed = 1;
+	for (size_t i = 0; i < sizeof(image); i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		image[i] = seed >> 16;
+	}
+	image[0] = 0x01;
+	image[1] = 0x08;
+	memcpy(image + 2, checkpoint_program, sizeof(checkpoint_program));
+
+	// Jobs 0 and 1 run as long as each other, and so do jobs 2 and 3, with the text trace first
+	FILE* file = fopen(jobs, "w");
+	for (int i = 0; file != NULL && i < 4; i++)
+		fprintf(file, "%s -e 0x0801 -c %u -t %s/trace%s\n", prg, i < 2 ? 60000 : 90001, dir, i % 2 ? " -Z" : "");
+	bool ok = file != NULL && fclose(file) == 0 && loader_write(prg, image, sizeof(image), 0);
+	snprintf(command, sizeof(command), "%s -T 2 -j %s > /dev/null", runner, jobs);
+	ok = ok && system(command) == 0;
+	for (int i = 0; ok && i < 4; i += 2)
+	{
+		snprintf(path, sizeof(path), "%s/trace.%d", dir, i);
+		snprintf(text, sizeof(text), "%s/text.%d", dir, i);
+		ok = rename(path, text) == 0;
+	}
+	if (!ok)
+		fprintf(stderr, "%s: can't run the jobs\n", runner);
+
+	int checks = 0;
+	int failed = 0;
+	for (size_t i = 0; ok && i < sizeof(intervals) / sizeof(intervals[0]); i++)
+	{
+		for (size_t j = 0; j < sizeof(threads) / sizeof(threads[0]); j++)
+		{
+			snprintf(command, sizeof(command), "%s -T %u -k %u -j %s > /dev/null", runner, threads[j], intervals[i],
+					jobs);
+			bool ran = system(command) == 0;
+			for (int k = 0; k < 4; k++)
+			{
+				snprintf(path, sizeof(path), "%s/trace.%d", dir, k);
+				snprintf(text, sizeof(text), "%s/text.%d", dir, k & ~1);
+				checks++;
+				if (ran && checkpoint_same(path, text, k % 2))
+					continue;
+				fprintf(stderr, "job %d with checkpoints every %u cycles on %u threads: the %s trace differs\n", k,
+						intervals[i], threads[j], k % 2 ? "delta" : "text");
+				failed++;
+			}
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		snprintf(path, sizeof(path), "%s/trace.%d", dir, i);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/text.%d", dir, i);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s.flat", prg);
+	unlink(path);
+	unlink(prg);
+	unlink(jobs);
+	rmdir(dir);
+	if (!ok)
+		return 1;
+	printf("%d of %d checkpointed traces passed\n", checks - failed, checks);
+	return failed;
+}
+
+// The program of the listings run_coverage() reports on, at 0x0400: a loop, a branch that's always taken and one that
+// never runs.
+static const uint8_t coverage_program[] = {0xA2, 0x03, 0xCA, 0xD0, 0xFD, 0xF0, 0x02, 0x90, 0x00, 0x4C, 0x09, 0x04};
+
+// Its listing in both formats m65_coverage_lcov() reads, with the address first, and after a line number.
+static const char* coverage_listings[] = {
+	"; coverage test\n"
+	"0400  A2 03     ldx #3\n"
+	"                loop:\n"
+	"0402  CA        dex\n"
+	"0403  D0 FD     bne loop\n"
+	"0405  F0 02     beq skip\n"
+	"0407  90 00     bcc skip\n"
+	"0409  4C 09 04  skip: jmp skip\n",
+
+	"   1                    ; coverage test\n"
+	"   2  0400  a2 03       ldx #3\n"
+	"   3                    loop:\n"
+	"   4  0402  ca          dex\n"
+	"   5  0403  d0 fd       bne loop\n"
+	"   6  0405  f0 02       beq skip\n"
+	"   7  0407  90 00       bcc skip\n"
+	"   8  0409  4c 09 04    skip: jmp skip\n",
+};
+
+// The lcov tracefile of both listings after the program ran, without its first two lines.
+static const char coverage_lcov[] =
+	"DA:2,1\nDA:4,1\nDA:5,1\nBRDA:5,0,0,1\nBRDA:5,0,1,1\nDA:6,1\nBRDA:6,0,0,1\nBRDA:6,0,1,0\nDA:7,0\n"
+	"BRDA:7,0,0,-\nBRDA:7,0,1,-\nDA:8,1\nBRF:6\nBRH:3\nLF:6\nLH:5\nend_of_record\n";
+
+// coverage_run(int, uint64_t, m65_coverage_t*, const m65_mem_t*, const m6502_t*) -> m6502_t
+// Runs a copy of a processor and its memory for at least a number of cycles with the cycle engine (0), the step
+// engine (1) or the cached engine (2), recording coverage. Returns the processor at the boundary it stopped at.
+static m6502_t coverage_run(int engine, uint64_t cycles, m65_coverage_t* cov, const m65_mem_t* start,
+		const m6502_t* cpu)
+{
+	static m65_mem_t mem;
+	if (mem.ram == NULL && !m65_mem_init(&mem))
+		abort();
+	memcpy(mem.ram, start->ram, M65_PAGES * M65_PAGE_SIZE);
+	m6502_t run = *cpu;
+	run.coverage = cov;
+	memset(cov, 0, sizeof(m65_coverage_t));
+
+	m65_cache_t cache;
+	m65_cache_init(&cache);
+	if (engine == 0)
+	{
+		while (run.cycles < cycles)
+			cycle_step(&run, &mem);
+	} else if (engine == 1)
+		m65_run(&run, &mem, cycles);
+	else m65_run_cached(&run, &mem, &cache, cycles);
+	m65_cache_free(&cache);
+	return run;
+}
+
+// run_coverage(unsigned) -> int
+// Runs random code made of loops and branches with every engine and checks that they record the same coverage, that
+// coverage maps merge and are saved and loaded again unchanged, and that the lcov tracefiles of a small program's
+// listing in both formats are exactly as expected. Returns the number of checks that fail.
+static int run_coverage(unsigned count)
+{
+	// Loops on x, then branches on the result of cmp, adc, and and adc again over an inx or iny, where RANDOM keeps
+	// the random byte as the operand
+	enum { RANDOM = 0x100 };
+	static const uint16_t snippets[][6] = {
+		{5, 0xA2, RANDOM, 0xCA, 0xD0, 0xFD},
+		{5, 0xC9, RANDOM, 0xF0, 0x01, 0xE8},
+		{5, 0x69, RANDOM, 0x90, 0x01, 0xC8},
+		{5, 0x29, RANDOM, 0x30, 0x01, 0xE8},
+		{5, 0x69, RANDOM, 0x70, 0x01, 0xC8},
+	};
+	static m65_coverage_t covs[3], merged, expected, loaded;
+	static const char* names[] = {"cycle", "step", "cached"};
+	m65_mem_t mem;
+	if (!m65_mem_init(&mem))
+		abort();
+	memset(&merged, 0, sizeof(merged));
+	memset(&expected, 0, sizeof(expected));
+	uint32_t seed = 1;
+	int checks = 0;
+	int failed = 0;
+
+	for (unsigned round = 0; round < count; round++)
+	{
+		// Snippets from 0x0400 and a jump back to the start, with random data everywhere else
+		uint8_t random[4];
+		for (size_t i = 0; i < M65_PAGES * M65_PAGE_SIZE; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			mem.ram[i] = seed >> 16;
+		}
+		uint16_t addr = 0x0400;
+		for (int i = 0; i < 32; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				seed = seed * 1103515245 + 12345;
+				random[j] = seed >> 16;
+			}
+			const uint16_t* snippet = snippets[random[0] % 5];
+			for (int k = 1; k <= snippet[0]; k++, addr++)
+				mem.ram[addr] = snippet[k] == RANDOM ? random[1] : snippet[k];
+		}
+		mem.ram[addr] = 0x4C;
+		mem.ram[addr + 1] = 0x00;
+		mem.ram[addr + 2] = 0x04;
+
+		m6502_t cpu;
+		init_6502_variant(&cpu, round % 3);
+		cpu.flags = random[2] | 0x34;
+		cpu.pins.addr = 0x0400;
+		cpu.pc = 0x0401;
+
+		// Every engine runs to the boundary the step engine stops at
+		uint64_t cycles = 200 + random[3] * 8;
+		m6502_t ends[3];
+		ends[1] = coverage_run(1, cycles, &covs[1], &mem, &cpu);
+		ends[0] = coverage_run(0, ends[1].cycles, &covs[0], &mem, &cpu);
+		ends[2] = coverage_run(2, ends[1].cycles, &covs[2], &mem, &cpu);
+		for (int engine = 0; engine < 3; engine += 2)
+		{
+			checks++;
+			if (ends[engine].cycles == ends[1].cycles && memcmp(&covs[engine], &covs[1], sizeof(covs[1])) == 0)
+				continue;
+			fprintf(stderr, "coverage round %u: the %s engine recorded other coverage than the step engine\n", round,
+					names[engine]);
+			failed++;
+		}
+
+		// Merging the rounds adds up their bits
+		m65_coverage_merge(&merged, &covs[1]);
+		for (unsigned i = 0; i < 1024; i++)
+		{
+			expected.executed[i] |= covs[1].executed[i];
+			expected.taken[i] |= covs[1].taken[i];
+			expected.not_taken[i] |= covs[1].not_taken[i];
+		}
+	}
+
+	char dir[] = "/tmp/m6502-fuzz-XXXXXX";
+	char path[sizeof(dir) + 16];
+	if (mkdtemp(dir) == NULL)
+	{
+		perror(dir);
+		return failed + 1;
+	}
+
+	// The merged map has branches both ways, and loading it again gives the same map, or adds it to another one
+	bool both = false;
+	for (unsigned i = 0; i < 1024; i++)
+		both = both || (expected.taken[i] & expected.not_taken[i]);
+	snprintf(path, sizeof(path), "%s/map.cov", dir);
+	memset(&loaded, 0, sizeof(loaded));
+	checks += 3;
+	failed += !both || memcmp(&merged, &expected, sizeof(merged)) != 0;
+	failed += !(m65_coverage_save(&merged, path) && m65_coverage_load(&loaded, path)
+				&& memcmp(&loaded, &merged, sizeof(loaded)) == 0);
+	memset(&loaded, 0, sizeof(loaded));
+	loaded.executed[0] = 1;
+	expected.executed[0] |= 1;
+	failed += !(m65_coverage_load(&loaded, path) && memcmp(&loaded, &expected, sizeof(loaded)) == 0);
+	unlink(path);
+
+	// The program runs until it spins on its last jump
+	memset(mem.ram, 0, M65_PAGES * M65_PAGE_SIZE);
+	memcpy(mem.ram + 0x0400, coverage_program, sizeof(coverage_program));
+	m6502_t cpu;
+	init_6502_variant(&cpu, M65_NMOS);
+	cpu.pins.addr = 0x0400;
+	cpu.pc = 0x0401;
+	coverage_run(1, 100, &covs[0], &mem, &cpu);
+
+	for (int format = 0; format < 2; format++)
+	{
+		char expected_lcov[sizeof(coverage_lcov) + sizeof(path) + 16];
+		snprintf(path, sizeof(path), "%s/test.lst", dir);
+		snprintf(expected_lcov, sizeof(expected_lcov), "TN:\nSF:%s\n%s", path, coverage_lcov);
+		FILE* listing = fopen(path, "w");
+		FILE* out = tmpfile();
+		bool ok = listing != NULL && fputs(coverage_listings[format], listing) >= 0;
+		ok = listing != NULL && fclose(listing) == 0 && ok && out != NULL && m65_coverage_lcov(&covs[0], path, out);
+
+		char lcov[sizeof(expected_lcov)];
+		size_t size = 0;
+		if (ok)
+		{
+			rewind(out);
+			size = fread(lcov, 1, sizeof(lcov) - 1, out);
+		}
+		lcov[size] = '\0';
+		checks++;
+		if (!ok || strcmp(lcov, expected_lcov) != 0)
+		{
+			fprintf(stderr, "lcov of listing format %d:\n%s", format, lcov);
+			failed++;
+		}
+		if (out != NULL)
+			fclose(out);
+		unlink(path);
+	}
+
+	rmdir(dir);
+	m65_mem_free(&mem);
+	printf("%d of %d coverage checks passed\n", checks - failed, checks);
+	return failed;
+}
+
+// Instructions with their expected disassembly, at the address they are disassembled at.
+static const struct
+{
+	m65_variant_t variant;
+	uint16_t addr;
+	uint8_t bytes[3];
+	const char* text;
+} disasm_samples[] = {
+	{M65_NMOS, 0x1000, {0xA9, 0x34, 0x12}, "lda #$34"},
+	{M65_NMOS, 0x1000, {0xBD, 0x34, 0x12}, "lda $1234,x"},
+	{M65_NMOS, 0x1000, {0xB6, 0x34, 0x12}, "ldx $34,y"},
+	{M65_NMOS, 0x1000, {0x6C, 0x34, 0x12}, "jmp ($1234)"},
+	{M65_NMOS, 0x1000, {0xA1, 0x34, 0x12}, "lda ($34,x)"},
+	{M65_NMOS, 0x1000, {0xB1, 0x34, 0x12}, "lda ($34),y"},
+	{M65_NMOS, 0x1000, {0x02, 0x34, 0x12}, ".byte $02"},
+	{M65_NMOS, 0x1000, {0xB2, 0x34, 0x12}, ".byte $b2"},
+	{M65_CMOS, 0x1000, {0xB2, 0x34, 0x12}, "lda ($34)"},
+	{M65_NMOS, 0x1000, {0xD0, 0x10, 0x12}, "bne $1012"},
+	{M65_NMOS, 0x1000, {0xD0, 0xFE, 0x12}, "bne $1000"},
+
+	// Branch targets wrap around the address space both ways
+	{M65_NMOS, 0xFFF0, {0xD0, 0x20, 0x12}, "bne $0012"},
+	{M65_NMOS, 0x0010, {0xF0, 0x80, 0x12}, "beq $ff92"},
+	{M65_NMOS, 0xFFFE, {0x10, 0x00, 0x12}, "bpl $0000"},
+};
+
+// disasm_expect(m65_disasm_cache_t*, m65_mem_t*, uint16_t, const char*, uint8_t) -> bool
+// Checks the cached disassembly at an address against the text and length expected. Prints it otherwise.
+static bool disasm_expect(m65_disasm_cache_t* cache, m65_mem_t* mem, uint16_t addr, const char* text, uint8_t length)
+{
+	uint8_t got;
+	const char* line = m65_disasm_cached(cache, mem, addr, &got);
+	if (strcmp(line, text) == 0 && got == length)
+		return true;
+	fprintf(stderr, "cached disassembly at 0x%04x: \"%s\" (%u bytes) instead of \"%s\" (%u bytes)\n", addr, line, got,
+			text, length);
+	return false;
+}
+
+// run_disasm(void) -> int
+// Checks that every opcode disassembles as the opcode table of each variant decodes it, with a mnemonic for every
+// implemented one, and a sample of instructions in every addressing mode, including branches that wrap around. Then
+// checks that the cache decodes pages again when code in them is written or mapped over, including instructions that
+// run into the next page and code in the zero page. Returns the number of checks that fail.
+static int run_disasm(void)
+{
+	char buf[M65_DISASM_SIZE];
+	int checks = 0;
+	int failed = 0;
+
+	for (unsigned op = 0; op < 256; op++)
+	{
+		bool ok = true;
+		for (m65_variant_t variant = M65_NMOS; variant <= M65_2A03; variant++)
+		{
+			const m65_opinfo_t* info = &m65_opinfo[variant][op];
+			uint8_t bytes[3] = {op, 0x34, 0x12};
+			uint8_t length = m65_disasm_bytes(variant, 0x1000, bytes, buf);
+			size_t name = strlen(m65_mnemonics[op]);
+			if (info->cycles == 0)
+			{
+				char byte[M65_DISASM_SIZE];
+				snprintf(byte, sizeof(byte), ".byte $%02x", op);
+				ok = ok && length == 1 && strcmp(buf, byte) == 0;
+			} else ok = ok && strcmp(m65_mnemonics[op], "???") != 0 && length == m65_mode_length[info->mode]
+				&& strncmp(buf, m65_mnemonics[op], name) == 0 && (buf[name] == '\0' || buf[name] == ' ');
+		}
+
+		checks++;
+		if (!ok)
+		{
+			fprintf(stderr, "opcode %02x (%s) doesn't disassemble as it's decoded\n", op, m65_mnemonics[op]);
+			failed++;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(disasm_samples) / sizeof(disasm_samples[0]); i++)
+	{
+		m65_disasm_bytes(disasm_samples[i].variant, disasm_samples[i].addr, disasm_samples[i].bytes, buf);
+		checks++;
+		if (strcmp(buf, disasm_samples[i].text) == 0)
+			continue;
+		fprintf(stderr, "0x%04x: \"%s\" instead of \"%s\"\n", disasm_samples[i].addr, buf, disasm_samples[i].text);
+		failed++;
+	}
+
+	// Code in a page, at its end running into the next page, and in the zero page
+	m65_mem_t mem;
+	m65_disasm_cache_t cache;
+	if (!m65_mem_init(&mem))
+		abort();
+	m65_disasm_init(&cache, M65_NMOS);
+	m65_mem_track_code(&mem, NULL, NULL);
+	static const uint8_t code[] = {0xA9, 0x01, 0x8D, 0x00, 0x30};
+	memcpy(mem.ram + 0x2000, code, sizeof(code));
+	memcpy(mem.ram + 0x20FE, code + 2, 3);
+	memcpy(mem.ram + 0x0010, code, 2);
+	checks += 15;
+	failed += !disasm_expect(&cache, &mem, 0x2000, "lda #$01", 2);
+	failed += !disasm_expect(&cache, &mem, 0x2002, "sta $3000", 3);
+	failed += !disasm_expect(&cache, &mem, 0x20FE, "sta $3000", 3);
+	failed += !disasm_expect(&cache, &mem, 0x0010, "lda #$01", 2);
+	failed += !m65_mem_is_code(&mem, 0x20);
+
+	// Self-modifying writes change the generation of the page, so the whole page is decoded again, even once the code
+	// in it runs again
+	uint32_t generation = m65_mem_generation(&mem, 0x20);
+	m65_mem_write(&mem, 0x2001, 0x02);
+	m65_mem_write(&mem, 0x2004, 0x31);
+	m65_mem_exec(&mem, 0x2000);
+	failed += m65_mem_generation(&mem, 0x20) == generation;
+	failed += !disasm_expect(&cache, &mem, 0x2000, "lda #$02", 2);
+	failed += !disasm_expect(&cache, &mem, 0x2002, "sta $3100", 3);
+	failed += !disasm_expect(&cache, &mem, 0x20FE, "sta $3000", 3);
+
+	// Writes to the next page and to the zero page show up too
+	m65_mem_write(&mem, 0x2100, 0x32);
+	m65_mem_write(&mem, 0x0011, 0x03);
+	failed += !disasm_expect(&cache, &mem, 0x20FE, "sta $3200", 3);
+	failed += !disasm_expect(&cache, &mem, 0x0010, "lda #$03", 2);
+
+	// Writes elsewhere leave the page alone, and mapping other memory over it decodes it again
+	generation = m65_mem_generation(&mem, 0x20);
+	m65_mem_write(&mem, 0x4000, 0xEA);
+	failed += m65_mem_generation(&mem, 0x20) != generation;
+	static uint8_t rom[M65_PAGE_SIZE];
+	rom[0] = 0xEA;
+	m65_mem_map_rom(&mem, 0x20, rom, sizeof(rom));
+	failed += !disasm_expect(&cache, &mem, 0x2000, "nop", 1);
+	failed += !disasm_expect(&cache, &mem, 0x2002, "brk", 1);
+	m65_mem_map_own(&mem, 0x20, 1);
+	failed += !disasm_expect(&cache, &mem, 0x2002, "sta $3100", 3);
+
+	m65_disasm_free(&cache);
+	m65_mem_free(&mem);
+	printf("%d of %d disassembler checks passed\n", checks - failed, checks);
+	return failed;
+}
+
+// The guest subroutines checked by run_traps(), which all start at 0x8000.
+// multiply: $F1:$F0 = a * x by repeated addition; a = the low byte, x = 0
+static const uint8_t guest_multiply[] = {
+	0xD8,				// cld
+	0x85, 0xF2,			// sta $F2
+	0xA9, 0x00,			// lda #0
+	0x85, 0xF1,			// sta $F1
+	0xE0, 0x00,			// cpx #0
+	0xF0, 0x0A,			// beq done
+	0x18,				// loop: clc
+	0x65, 0xF2,			// adc $F2
+	0x90, 0x02,			// bcc skip
+	0xE6, 0xF1,			// inc $F1
+	0xCA,				// skip: dex
+	0xD0, 0xF6,			// bne loop
+	0x85, 0xF0,			// done: sta $F0
+	0x60				// rts
+};
+
+// copy: copies x bytes (256 for 0) from ($F0) to ($F2) forwards; a = the last byte, x = 0, y = the count
+static const uint8_t guest_copy[] = {
+	0xA0, 0x00,			// ldy #0
+	0xB1, 0xF0,			// loop: lda ($F0),y
+	0x91, 0xF2,			// sta ($F2),y
+	0xC8,				// iny
+	0xCA,				// dex
+	0xD0, 0xF8,			// bne loop
+	0x60				// rts
+};
+
+// checksum: a = the exclusive or of x bytes (256 for 0) at ($F0); x = 0, y = the count
+static const uint8_t guest_checksum[] = {
+	0xA9, 0x00,			// lda #0
+	0xA8,				// tay
+	0x51, 0xF0,			// loop: eor ($F0),y
+	0xC8,				// iny
+	0xCA,				// dex
+	0xD0, 0xFA,			// bne loop
+	0x60				// rts
+};
+
+// fold: a ^= x ^ (x - 1) ^ ... ^ 1 with a loop that jumps back to the entry; $F4 = the last x folded in, x = 0
+static const uint8_t guest_fold[] = {
+	0xE0, 0x00,			// loop: cpx #0
+	0xF0, 0x08,			// beq done
+	0x86, 0xF4,			// stx $F4
+	0x45, 0xF4,			// eor $F4
+	0xCA,				// dex
+	0x4C, 0x00, 0x80,	// jmp loop
+	0x60				// done: rts
+};
+
+// trap_multiply(m6502_t*, m65_mem_t*, void*) -> uint64_t
+// Runs guest_multiply natively.
+static uint64_t trap_multiply(m6502_t* cpu, m65_mem_t* mem, void* ctx)
+{
+	(void) ctx;
+	uint8_t value = cpu->a;
+	unsigned count = cpu->x;
+	uint8_t low = 0, high = 0;
+	uint64_t cycles = 12 + 3 + 6;
+
+	cpu->flags &= ~0x08;
+	if (count == 0)
+	{
+		// cpx #0 sets carry and zero, and beq is taken
+		cpu->flags = (cpu->flags & ~0x80) | 0x03;
+		cycles += 3;
+	} else
+	{
+		cycles += 2 + count * 7 + (count - 1) * 3 + 2;
+		for (unsigned i = 0; i < count; i++)
+		{
+			unsigned sum = low + value;
+			bool overflow = ~(low ^ value) & (low ^ sum) & 0x80;
+			cpu->flags = (cpu->flags & ~0x41) | (sum > 0xff) | overflow << 6;
+			low = sum;
+			high += sum > 0xff;
+			cycles += sum > 0xff ? 7 : 3;
+		}
+
+		// dex leaves zero set and negative clear
+		cpu->flags = (cpu->flags & ~0x80) | 0x02;
+	}
+
+	m65_mem_write(mem, 0xF2, value);
+	m65_mem_write(mem, 0xF1, high);
+	m65_mem_write(mem, 0xF0, low);
+	cpu->a = low;
+	cpu->x = 0;
+	return cycles;
+}
+
+// trap_bytes(m6502_t*, m65_mem_t*, bool) -> uint64_t
+// Runs guest_copy or guest_checksum natively.
+static uint64_t trap_bytes(m6502_t* cpu, m65_mem_t* mem, bool copy)
+{
+	unsigned count = cpu->x ? cpu->x : 256;
+	uint16_t src = m65_mem_read(mem, 0xF0) | m65_mem_read(mem, 0xF1) << 8;
+	uint16_t dst = m65_mem_read(mem, 0xF2) | m65_mem_read(mem, 0xF3) << 8;
+	uint64_t cycles = copy ? 2 + 6 - 1 : 2 + 2 + 6 - 1;
+	uint8_t a = 0;
+
+	for (unsigned y = 0; y < count; y++)
+	{
+		uint8_t byte = m65_mem_read(mem, src + y);
+		if (copy)
+		{
+			m65_mem_write(mem, dst + y, byte);
+			a = byte;
+		} else a ^= byte;
+
+		// The indexed read takes an extra cycle when it crosses a page
+		cycles += (copy ? 5 + 6 + 2 + 2 + 3 : 5 + 2 + 2 + 3) + ((src & 0xff) + y > 0xff);
+	}
+
+	cpu->a = a;
+	cpu->x = 0;
+	cpu->y = count;
+	cpu->flags = (cpu->flags & ~0x80) | 0x02;
+	return cycles;
+}
+
+// trap_copy(m6502_t*, m65_mem_t*, void*) -> uint64_t
+// Runs guest_copy natively.
+static uint64_t trap_copy(m6502_t* cpu, m65_mem_t* mem, void* ctx)
+{
+	(void) ctx;
+	return trap_bytes(cpu, mem, true);
+}
+
+// trap_checksum(m6502_t*, m65_mem_t*, void*) -> uint64_t
+// Runs guest_checksum natively.
+static uint64_t trap_checksum(m6502_t* cpu, m65_mem_t* mem, void* ctx)
+{
+	(void) ctx;
+	return trap_bytes(cpu, mem, false);
+}
+
+// trap_fold(m6502_t*, m65_mem_t*, void*) -> uint64_t
+// Runs guest_fold natively, but only for even counts. Odd counts fall back to the emulated loop, which jumps back to
+// the entry with an even count and must not be trapped there.
+static uint64_t trap_fold(m6502_t* cpu, m65_mem_t* mem, void* ctx)
+{
+	(void) ctx;
+	unsigned count = cpu->x;
+	if (count & 1)
+		return 0;
+
+	for (unsigned x = count; x > 0; x--)
+		cpu->a ^= x;
+	if (count != 0)
+		m65_mem_write(mem, 0xF4, 1);
+
+	// The last cpx #0 sets carry and zero, and beq is taken
+	cpu->x = 0;
+	cpu->flags = (cpu->flags & ~0x83) | 0x03;
+	return count * 15 + 2 + 3 + 6;
+}
+
+// run_traps(unsigned) -> int
+// Calls every guest subroutine with random registers and memory, once emulated and once trapped, and compares the
+// results. Returns the number of failed tests.
+static int run_traps(unsigned count)
+{
+	static const struct
+	{
+		const char* name;
+		const uint8_t* code;
+		size_t size;
+		m65_trap_fn_t fn;
+
+		// Whether the trap declines odd counts in x.
+		bool even_only;
+	} routines[] = {
+		{"multiply", guest_multiply, sizeof(guest_multiply), trap_multiply, false},
+		{"copy", guest_copy, sizeof(guest_copy), trap_copy, false},
+		{"checksum", guest_checksum, sizeof(guest_checksum), trap_checksum, false},
+		{"fold", guest_fold, sizeof(guest_fold), trap_fold, true}
+	};
+
+	static m65_mem_t emulated_mem, trapped_mem;
+	if (!m65_mem_init(&emulated_mem) || !m65_mem_init(&trapped_mem))
+		abort();
+
+	m65_traps_t traps;
+	m65_traps_init(&traps);
+	uint32_t seed = 1;
+	int tests = 0, failed = 0;
+
+	for (size_t r = 0; r < sizeof(routines) / sizeof(routines[0]); r++)
+	{
+		m65_trap_add(&traps, 0x8000, routines[r].fn, NULL);
+		uint64_t hits = 0;
+		for (unsigned i = 0; i < count; i++)
+		{
+			// Random memory with the subroutine at 0x8000 and a jsr to it at 0x0200
+			for (size_t j = 0; j < M65_PAGES * M65_PAGE_SIZE; j += 2)
+			{
+				seed = seed * 1103515245 + 12345;
+				emulated_mem.ram[j] = seed >> 16;
+				emulated_mem.ram[j + 1] = seed >> 24;
+			}
+			memcpy(emulated_mem.ram + 0x8000, routines[r].code, routines[r].size);
+			memcpy(emulated_mem.ram + 0x0200, (uint8_t[]) {0x20, 0x00, 0x80}, 3);
+
+			// Copies go somewhere that doesn't overlap the pointers, the stack or the code
+			uint16_t dst = 0x0300 + (seed >> 8) % 0x7c00;
+			emulated_mem.ram[0xF2] = dst & 0xff;
+			emulated_mem.ram[0xF3] = dst >> 8;
+			memcpy(trapped_mem.ram, emulated_mem.ram, M65_PAGES * M65_PAGE_SIZE);
+
+			m6502_t emulated, trapped;
+			init_6502_variant(&emulated, i % 3);
+			emulated.a = emulated_mem.ram[0x1000];
+			emulated.x = i < 256 ? i : emulated_mem.ram[0x1001];
+			emulated.y = emulated_mem.ram[0x1002];
+			emulated.s = emulated_mem.ram[0x1003];
+			emulated.flags = emulated_mem.ram[0x1004] | 0x34;
+			emulated.pins.addr = 0x0200;
+			emulated.pc = 0x0201;
+			trapped = emulated;
+			trapped.traps = &traps;
+
+			m6502_t before = emulated;
+			hits += !routines[r].even_only || !(emulated.x & 1);
+			for (unsigned steps = 0; emulated.pins.addr != 0x0203 && steps < 100000; steps++)
+				m65_step(&emulated, &emulated_mem);
+			for (unsigned steps = 0; trapped.pins.addr != 0x0203 && steps < 100000; steps++)
+				m65_step(&trapped, &trapped_mem);
+			trapped.traps = NULL;
+
+			tests++;
+			const char* what = NULL;
+			if (!same_state(&emulated, &trapped))
+				what = "state";
+			else if (memcmp(emulated_mem.ram, trapped_mem.ram, M65_PAGES * M65_PAGE_SIZE) != 0)
+				what = "memory";
+			else if (m65_trap_find(&traps, 0x8000)->hits != hits)
+				what = "trap";
+			if (what == NULL)
+				continue;
+
+			failed++;
+			fprintf(stderr, "%s mismatch in %s, test %u\n", what, routines[r].name, i);
+			print_state("from", &before);
+			print_state("emul", &emulated);
+			print_state("trap", &trapped);
+			for (size_t addr = 0; addr < M65_PAGES * M65_PAGE_SIZE; addr++)
+			{
+				if (emulated_mem.ram[addr] != trapped_mem.ram[addr])
+					fprintf(stderr, "  memory %04zx: emul=%02x trap=%02x\n", addr, emulated_mem.ram[addr],
+							trapped_mem.ram[addr]);
+			}
+		}
+	}
+
+	printf("%d of %d trap tests passed\n", tests - failed, tests);
+	m65_traps_free(&traps);
+	m65_mem_free(&emulated_mem);
+	m65_mem_free(&trapped_mem);
+	return failed;
+}
+
+// run_file(FILE*) -> bool
+// Runs an input read from a file.
+static bool run_file(FILE* file)
+{
+	static uint8_t data[1 << 20];
+	size_t size = fread(data, 1, sizeof(data), file);
+	return run_input(data, size);
+}
+
+// run_aot(const char*) -> bool
+// Compiles the code of an input file into a shared object and runs the input with the compiled engine too. Returns
+// false if the engines disagree or the code can't be compiled.
+static bool run_aot(const char* path)
+{
+	static uint8_t data[1 << 20];
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		perror(path);
+		return false;
+	}
+	size_t size = fread(data, 1, sizeof(data), file);
+	fclose(file);
+	if (size < HEADER_SIZE)
+		return true;
+
+	// Compile the code reachable from the first instruction and the vectors
+	static m65_mem_t mem;
+	if (mem.ram == NULL && !m65_mem_init(&mem))
+		abort();
+	m6502_t cpu;
+	load_input(data, size, &cpu, &mem);
+	uint16_t entry = cpu.pins.addr;
+
+	char dir[] = "/tmp/m6502-fuzz-XXXXXX";
+	char source[64], object[64], command[256];
+	if (mkdtemp(dir) == NULL)
+	{
+		perror("mkdtemp");
+		return false;
+	}
+	snprintf(source, sizeof(source), "%s/image.c", dir);
+	snprintf(object, sizeof(object), "%s/image.so", dir);
+	snprintf(command, sizeof(command), "%s -O1 -shared -fPIC -I src -o %s %s",
+			getenv("CC") != NULL ? getenv("CC") : "cc", object, source);
+
+	bool same = false;
+	m65_aot_t image;
+	FILE* out = fopen(source, "w");
+	bool compiled = out != NULL && m65_aot_compile(&mem, data[0] % 3, &entry, 1, out);
+	if (out != NULL)
+		fclose(out);
+
+	if (compiled && system(command) == 0 && m65_aot_open(&image, object))
+	{
+		aot = &image;
+		same = run_input(data, size);
+		aot = NULL;
+		m65_aot_close(&image);
+	} else fprintf(stderr, "%s: can't compile the code\n", path);
+
+	remove(source);
+	remove(object);
+	rmdir(dir);
+	return same;
+}
+
+int main(int argc, char** argv)
+{
+	// Run the test vectors
+	if (argc > 1 && strcmp(argv[1], "--vectors") == 0)
+	{
+		abort_on_mismatch = false;
+		return run_vectors(argc > 2 ? argv[2] : NULL) != 0;
+	}
+
+	// Run random inputs
+	if (argc > 1 && strcmp(argv[1], "--random") == 0)
+	{
+		abort_on_mismatch = false;
+		return run_random(argc > 2 ? strtoul(argv[2], NULL, 0) : 20000) != 0;
+	}
+
+	// Run device inputs
+	if (argc > 1 && strcmp(argv[1], "--devices") == 0)
+	{
+		abort_on_mismatch = false;
+		return run_devices_random(argc > 2 ? strtoul(argv[2], NULL, 0) : 1000, argc > 3 ? argv[3] : NULL) != 0;
+	}
+
+	// Save and reload caches
+	if (argc > 1 && strcmp(argv[1], "--cache") == 0)
+	{
+		abort_on_mismatch = false;
+		return run_cache(argc > 2 ? strtoul(argv[2], NULL, 0) : 2000) != 0;
+	}
+
+	// Signal interrupts from another thread
+	if (argc > 1 && strcmp(argv[1], "--async") == 0)
+		return run_async(argc > 2 ? strtoul(argv[2], NULL, 0) : 1000) != 0;
+
+	// Run a board of processors
+	if (argc > 1 && strcmp(argv[1], "--system") == 0)
+		return run_system() != 0;
+
+	// Switch the banks of the mappers
+	if (argc > 1 && strcmp(argv[1], "--mappers") == 0)
+		return run_mappers(argc > 2 ? strtoul(argv[2], NULL, 0) : 300) != 0;
+
+	// Trace random records
+	if (argc > 1 && strcmp(argv[1], "--trace") == 0)
+		return run_trace(argc > 2 ? strtoul(argv[2], NULL, 0) : 20) != 0;
+
+	// Load images
+	if (argc > 1 && strcmp(argv[1], "--loader") == 0)
+		return run_loader() != 0;
+
+	// Disassemble
+	if (argc > 1 && strcmp(argv[1], "--disasm") == 0)
+		return run_disasm() != 0;
+
+	// Record coverage
+	if (argc > 1 && strcmp(argv[1], "--coverage") == 0)
+		return run_coverage(argc > 2 ? strtoul(argv[2], NULL, 0) : 200) != 0;
+
+	// Trace with the runner's checkpoints
+	if (argc > 1 && strcmp(argv[1], "--checkpoints") == 0)
+		return run_checkpoints(argc > 2 ? argv[2] : "./m6502") != 0;
+
+	// Save and restore snapshots
+	if (argc > 1 && strcmp(argv[1], "--snapshots") == 0)
+		return run_snapshots(argc > 2 ? strtoul(argv[2], NULL, 0) : 100) != 0;
+
+	// Check the arenas
+	if (argc > 1 && strcmp(argv[1], "--arena") == 0)
+		return run_arena(argc > 2 ? strtoul(argv[2], NULL, 0) : 1000) != 0;
+
+	// Check the native subroutines
+	if (argc > 1 && strcmp(argv[1], "--traps") == 0)
+		return run_traps(argc > 2 ? strtoul(argv[2], NULL, 0) : 10000) != 0;
+
+	// Run the input files with their code compiled
+	if (argc > 1 && strcmp(argv[1], "--aot") == 0)
+	{
+		int passed = 0;
+		for (int i = 2; i < argc; i++)
+			passed += run_aot(argv[i]);
+		printf("%d of %d compiled inputs passed\n", passed, argc - 2);
+		return passed != argc - 2;
+	}
+
+	// Run the input files, or the input on stdin
+	if (argc == 1)
+		return !run_file(stdin);
+
+	for (int i = 1; i < argc; i++)
+	{
+		FILE* file = fopen(argv[i], "rb");
+		if (file == NULL)
+		{
+			perror(argv[i]);
+			return 2;
+		}
+
+		run_file(file);
+		fclose(file);
+	}
+
+	return 0;
+}
+#endif
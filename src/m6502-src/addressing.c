@@ -129,7 +129,7 @@ bool m65_addr_zp_##register (m6502_t* cpu)								\
 																		\
 		/* cycle 2 - zp+register */										\
 		case 1:															\
-			cpu->addr_buf = (uint8_t) cpu->pins.data + cpu->register;	\
+			cpu->addr_buf = (uint8_t) (cpu->pins.data + cpu->register);	\
 			return false;												\
 																		\
 		/* cycle 3 - addressing (rw set by operation) */				\
@@ -139,7 +139,7 @@ bool m65_addr_zp_##register (m6502_t* cpu)								\
 		/* cycle 4 - operation and fetch */								\
 		default:														\
 			return true;												\
-	}															\
+	}																	\
 }
 
 m65_addr_zp_(x);
@@ -149,46 +149,49 @@ m65_addr_zp_(y);
 
 // Absolute, register offset addressing: Adds the value of an index register to the supplied address and loads the value from the calculated address.
 // Length: 3 bytes / 1.5 words
-// Time: 4 cycles + 1 if page boundary crossed
-#define m65_addr_abs_(register)										\
-bool m65_addr_abs_##register (m6502_t* cpu)							\
-{																	\
-	switch (cpu->ipc)												\
-	{																\
-		/* cycle 1 - load low byte of address */					\
-		case 0:														\
-			cpu->pins.rw = READ;									\
-			cpu->pins.addr = cpu->pc++;								\
-			return false;											\
-																	\
-		/* cycle 2 - lb+reg, load high byte of address */			\
-		case 1:														\
-			cpu->addr_buf = cpu->pins.data + cpu->register;			\
-			cpu->pins.rw = READ;									\
-			cpu->pins.addr = cpu->pc++;								\
-			return false;											\
-																	\
-		/* cycle 2.5 - increment high byte if needed */				\
-		case 2:														\
-			if (cpu->addr_buf & 0x100)								\
-			{														\
-				cpu->addr_buf &= 0xff;								\
-				cpu->pins.data++;									\
-				return false;										\
-			} cpu->ipc++;											\
-																	\
-		/* cycle 3 - addressing (rw set by operation) */			\
-		case 3:														\
-			cpu->pins.addr = cpu->pins.data << 8 | cpu->addr_buf;	\
-																	\
-		/* cycle 4 - operation and fetch */							\
-		default:													\
-			return true;											\
-	}																\
+// Time: 4 cycles + 1 if page boundary crossed (always for the *_w versions used by writes)
+#define m65_addr_abs_(name, register, always)										\
+bool m65_addr_##name (m6502_t* cpu)													\
+{																					\
+	switch (cpu->ipc)																\
+	{																				\
+		/* cycle 1 - load low byte of address */									\
+		case 0:																		\
+			cpu->pins.rw = READ;													\
+			cpu->pins.addr = cpu->pc++;												\
+			return false;															\
+																					\
+		/* cycle 2 - lb+reg, load high byte of address */							\
+		case 1:																		\
+			cpu->addr_buf = cpu->pins.data + cpu->register;							\
+			cpu->pins.rw = READ;													\
+			cpu->pins.addr = cpu->pc++;												\
+			return false;															\
+																					\
+		/* cycle 2.5 - increment high byte if needed (always taken by writes) */	\
+		case 2:																		\
+			if ((cpu->addr_buf & 0x100) || always)									\
+			{																		\
+				cpu->addr_buf += cpu->pins.data << 8;								\
+				return false;														\
+			}																		\
+			cpu->addr_buf += cpu->pins.data << 8;									\
+			cpu->ipc++;																\
+																					\
+		/* cycle 3 - addressing (rw set by operation) */							\
+		case 3:																		\
+			cpu->pins.addr = cpu->addr_buf;											\
+																					\
+		/* cycle 4 - operation and fetch */											\
+		default:																	\
+			return true;															\
+	}																				\
 }
 
-m65_addr_abs_(x);
-m65_addr_abs_(y);
+m65_addr_abs_(abs_x, x, false);
+m65_addr_abs_(abs_y, y, false);
+m65_addr_abs_(abs_x_w, x, true);
+m65_addr_abs_(abs_y_w, y, true);
 
 #undef m65_addr_abs_
 
@@ -205,9 +208,9 @@ bool m65_addr_ind_zp_x(m6502_t* cpu)
 			cpu->pins.addr = cpu->pc++;
 			return false;
 
-		// cycle 2 - zp+x
+		// cycle 2 - zp+x (wrapping within the zero page)
 		case 1:
-			cpu->addr_buf = cpu->pins.data + cpu->x;
+			cpu->addr_buf = (uint8_t) (cpu->pins.data + cpu->x);
 			return false;
 
 		// cycle 3 - load low byte at address
@@ -216,11 +219,11 @@ bool m65_addr_ind_zp_x(m6502_t* cpu)
 			cpu->pins.addr = cpu->addr_buf;
 			return false;
 
-		// cycle 4 - load high byte at address
+		// cycle 4 - load high byte at address + 1 (wrapping within the zero page)
 		case 3:
 			cpu->addr_buf = cpu->pins.data;
 			cpu->pins.rw = READ;
-			cpu->pins.addr++;
+			cpu->pins.addr = (uint8_t) (cpu->pins.addr + 1);
 			return false;
 
 		// cycle 5 - addressing (rw set by operation)
@@ -235,8 +238,61 @@ bool m65_addr_ind_zp_x(m6502_t* cpu)
 
 // Indirect Y addressing - loads an address from zero page, adds the y register to it, and loads a value from the calculated address.
 // Length: 2 bytes / 1 word
-// Time 5 cycles + 1 if page boundary crossed
-bool m65_addr_ind_zp_y(m6502_t* cpu)
+// Time 5 cycles + 1 if page boundary crossed (always for the *_w version used by writes)
+#define m65_addr_ind_zp_y_(name, always)											\
+bool m65_addr_##name (m6502_t* cpu)													\
+{																					\
+	switch (cpu->ipc)																\
+	{																				\
+		/* cycle 1 - load address */												\
+		case 0:																		\
+			cpu->pins.rw = READ;													\
+			cpu->pins.addr = cpu->pc++;												\
+			return false;															\
+																					\
+		/* cycle 2 - load low byte at address */									\
+		case 1:																		\
+			cpu->addr_buf = cpu->pins.data;											\
+			cpu->pins.rw = READ;													\
+			cpu->pins.addr = cpu->addr_buf;											\
+			return false;															\
+																					\
+		/* cycle 3 - lb+y, load high byte at zero page address + 1 */				\
+		case 2:																		\
+			cpu->addr_buf = cpu->pins.data + cpu->y;								\
+			cpu->pins.rw = READ;													\
+			cpu->pins.addr = (uint8_t) (cpu->pins.addr + 1);						\
+			return false;															\
+																					\
+		/* cycle 3.5 - increment high byte if necessary (always taken by writes) */	\
+		case 3:																		\
+			if ((cpu->addr_buf & 0x100) || always)									\
+			{																		\
+				cpu->addr_buf += cpu->pins.data << 8;								\
+				return false;														\
+			}																		\
+			cpu->addr_buf += cpu->pins.data << 8;									\
+			cpu->ipc++;																\
+																					\
+		/* cycle 4 - addressing (rw set by operation) */							\
+		case 4:																		\
+			cpu->pins.addr = cpu->addr_buf;											\
+																					\
+		/* cycle 5 - operation and fetch */											\
+		default:																	\
+			return true;															\
+	}																				\
+}
+
+m65_addr_ind_zp_y_(ind_zp_y, false);
+m65_addr_ind_zp_y_(ind_zp_y_w, true);
+
+#undef m65_addr_ind_zp_y_
+
+// Indirect addressing (65C02 only) - loads an address from zero page and loads a value from that address.
+// Length: 2 bytes / 1 word
+// Time: 5 cycles
+bool m65_addr_ind_zp(m6502_t* cpu)
 {
 	switch (cpu->ipc)
 	{
@@ -248,29 +304,19 @@ bool m65_addr_ind_zp_y(m6502_t* cpu)
 
 		// cycle 2 - load low byte at address
 		case 1:
-			cpu->addr_buf = cpu->pins.data;
 			cpu->pins.rw = READ;
-			cpu->pins.addr = cpu->addr_buf;
+			cpu->pins.addr = cpu->pins.data;
 			return false;
 
-		// cycle 3 - lb+y, load high byte at address + 1
+		// cycle 3 - load high byte at address + 1 (wrapping within the zero page)
 		case 2:
-			cpu->addr_buf = cpu->pins.data + cpu->y;
+			cpu->addr_buf = cpu->pins.data;
 			cpu->pins.rw = READ;
-			cpu->pins.addr++;
+			cpu->pins.addr = (uint8_t) (cpu->pins.addr + 1);
 			return false;
 
-		// cycle 3.5 - increment high byte if necessary
-		case 3:
-			if (cpu->addr_buf & 0x100)
-			{
-				cpu->addr_buf &= 0xff;
-				cpu->pins.data++;
-				return false;
-			} else cpu->ipc++;
-
 		// cycle 4 - addressing (rw set by operation)
-		case 4:
+		case 3:
 			cpu->pins.addr = cpu->pins.data << 8 | cpu->addr_buf;
 
 		// cycle 5 - operation and fetch
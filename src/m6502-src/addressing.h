@@ -15,9 +15,18 @@
 extern const addr_fn addressing_modes[3][8];
 
 bool m65_addr_impl(m6502_t* cpu);
+bool m65_addr_zp(m6502_t* cpu);
+bool m65_addr_abs(m6502_t* cpu);
 bool m65_addr_zp_x(m6502_t* cpu);
 bool m65_addr_zp_y(m6502_t* cpu);
 bool m65_addr_abs_x(m6502_t* cpu);
 bool m65_addr_abs_y(m6502_t* cpu);
+bool m65_addr_ind_zp(m6502_t* cpu);
+bool m65_addr_ind_zp_y(m6502_t* cpu);
+
+// Versions of the indexed addressing modes that always take the page boundary cycle, used by writes.
+bool m65_addr_abs_x_w(m6502_t* cpu);
+bool m65_addr_abs_y_w(m6502_t* cpu);
+bool m65_addr_ind_zp_y_w(m6502_t* cpu);
 
 #endif /* ADDRESSING_H */
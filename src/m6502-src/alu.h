@@ -0,0 +1,104 @@
+//
+// MOS6502 Emulator
+// alu.h: Arithmetic shared by the instruction implementations.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef ALU_H
+#define ALU_H
+
+#include "m6502.h"
+#include "variant.h"
+
+// m65_alu_adc(m6502_t*, uint8_t, int) -> void
+// Adds a value and the carry to the accumulator and updates the flags. bcd is one of the M65_BCD_* constants; it is
+// always a constant in the callers, so the unused decimal paths are removed at compile time.
+static inline void m65_alu_adc(m6502_t* cpu, uint8_t value, int bcd)
+{
+	uint8_t a = cpu->a;
+	uint8_t carry = cpu->flags & 1;
+	uint16_t sum = a + value + carry;
+
+	// Binary mode
+	if (bcd == M65_BCD_NONE || !(cpu->flags & 0x08))
+	{
+		cpu->a = sum;
+		cpu->flags = (cpu->flags & 0x3C)
+				   | (sum & 0x80)
+				   | (~(a ^ value) & (a ^ sum) & 0x80) >> 1
+				   | ((sum & 0xff) == 0) << 1
+				   | sum >> 8;
+		return;
+	}
+
+	// Decimal mode: adjust each nibble separately
+	uint16_t low = (a & 0x0f) + (value & 0x0f) + carry;
+	if (low >= 0x0a)
+		low = ((low + 0x06) & 0x0f) + 0x10;
+	uint16_t result = (a & 0xf0) + (value & 0xf0) + low;
+
+	// The NMOS chips take N and V from the result before the high nibble is adjusted and Z from the binary sum
+	uint8_t flags = (cpu->flags & 0x3C)
+				  | (result & 0x80)
+				  | (~(a ^ value) & (a ^ result) & 0x80) >> 1;
+	if (result >= 0xa0)
+		result += 0x60;
+	flags |= result >= 0x100;
+
+	cpu->a = result;
+	if (bcd == M65_BCD_CMOS)
+		flags = (flags & 0x7F) | (cpu->a & 0x80) | (cpu->a == 0) << 1;
+	else flags |= ((sum & 0xff) == 0) << 1;
+	cpu->flags = flags;
+}
+
+// m65_alu_sbc(m6502_t*, uint8_t, int) -> void
+// Subtracts a value and the borrow from the accumulator and updates the flags. bcd is one of the M65_BCD_* constants.
+static inline void m65_alu_sbc(m6502_t* cpu, uint8_t value, int bcd)
+{
+	uint8_t a = cpu->a;
+	uint8_t carry = cpu->flags & 1;
+
+	// Binary mode (and the flags for the NMOS decimal mode)
+	uint16_t sum = a + (uint8_t) ~value + carry;
+	uint8_t flags = (cpu->flags & 0x3C)
+				  | (sum & 0x80)
+				  | ((a ^ value) & (a ^ sum) & 0x80) >> 1
+				  | ((sum & 0xff) == 0) << 1
+				  | sum >> 8;
+
+	if (bcd == M65_BCD_NONE || !(cpu->flags & 0x08))
+	{
+		cpu->a = sum;
+		cpu->flags = flags;
+		return;
+	}
+
+	int low = (a & 0x0f) - (value & 0x0f) + carry - 1;
+	int result;
+	if (bcd == M65_BCD_CMOS)
+	{
+		// The 65C02 adjusts the whole binary difference and has valid N and Z flags
+		result = a - value + carry - 1;
+		if (result < 0)
+			result -= 0x60;
+		if (low < 0)
+			result -= 0x06;
+		cpu->a = result;
+		flags = (flags & 0x7D) | (cpu->a & 0x80) | (cpu->a == 0) << 1;
+	} else
+	{
+		if (low < 0)
+			low = ((low - 0x06) & 0x0f) - 0x10;
+		result = (a & 0xf0) - (value & 0xf0) + low;
+		if (result < 0)
+			result -= 0x60;
+		cpu->a = result;
+	}
+
+	cpu->flags = flags;
+}
+
+#endif /* ALU_H */
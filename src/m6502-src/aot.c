@@ -0,0 +1,382 @@
+//
+// MOS6502 Emulator
+// aot.c: Ahead of time compiler from memory images to C, and the runtime that runs the compiled code.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "disasm.h"
+#include "step.h"
+#include "variant.h"
+
+// The states of an entry point.
+enum
+{
+	// The code wasn't checked since the page changed.
+	M65_AOT_UNKNOWN,
+
+	// Memory holds the code the block was compiled from.
+	M65_AOT_VALID,
+
+	// Memory holds something else.
+	M65_AOT_STALE
+};
+
+// The names and traits of each variant, indexed by m65_variant_t.
+static const struct
+{
+	const char* id;
+	int bcd;
+	bool jmp_bug;
+	bool int_cld;
+} m65_aot_traits[3] = {
+#define m65_aot_traits_(v) [M65_TRAIT(ID, v)] = {#v, M65_TRAIT(BCD, v), M65_TRAIT(JMP_BUG, v), M65_TRAIT(INT_CLD, v)},
+	m65_variants_(m65_aot_traits_)
+#undef m65_aot_traits_
+};
+
+// The variant names used in the generated code.
+static const char* const m65_aot_variants[3] = {"M65_NMOS", "M65_CMOS", "M65_2A03"};
+
+// Represents an instruction of a block being compiled.
+typedef struct
+{
+	uint16_t pc;
+	uint8_t bytes[3];
+	const m65_opinfo_t* info;
+
+	// Whether a branch or jmp in the block goes to the instruction.
+	bool label;
+} m65_aot_instr_t;
+
+// m65_aot_ends_block(uint8_t) -> bool
+// Checks if control never falls through an instruction.
+static bool m65_aot_ends_block(uint8_t op)
+{
+	switch (op)
+	{
+		case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// m65_aot_target(const m65_aot_instr_t*) -> int
+// Returns the address an instruction jumps to when it's known, or -1.
+static int m65_aot_target(const m65_aot_instr_t* instr)
+{
+	uint16_t operand = instr->bytes[2] << 8 | instr->bytes[1];
+	if (instr->info->mode == M65_MODE_REL)
+		return (uint16_t) (instr->pc + 2 + (int8_t) instr->bytes[1]);
+	if (instr->bytes[0] == 0x4C || instr->bytes[0] == 0x20)
+		return operand;
+	return -1;
+}
+
+// m65_aot_decode(const m65_mem_t*, m65_variant_t, uint16_t, m65_aot_instr_t*) -> size_t
+// Decodes the basic block at an address into instrs, which has room for a page of instructions. Returns the number of
+// instructions, which is 0 if no block can start there.
+static size_t m65_aot_decode(const m65_mem_t* mem, m65_variant_t variant, uint16_t addr, m65_aot_instr_t* instrs)
+{
+	uint8_t page = addr >> 8;
+	size_t count = 0;
+
+	// Code in the zero page and the stack can't be tracked, and device registers aren't code
+	if (page < 2 || mem->read[page] == NULL)
+		return 0;
+
+	for (uint16_t pc = addr; pc >> 8 == page; )
+	{
+		m65_aot_instr_t* instr = &instrs[count];
+		instr->pc = pc;
+		instr->bytes[0] = m65_mem_peek(mem, pc);
+		instr->info = &m65_opinfo[variant][instr->bytes[0]];
+		instr->label = false;
+
+		// Instructions that don't fit in the page are left to the interpreter
+		uint8_t length = m65_mode_length[instr->info->mode];
+		if (instr->info->cycles == 0 || (pc & 0xff) + length > M65_PAGE_SIZE)
+			break;
+		instr->bytes[1] = length > 1 ? m65_mem_peek(mem, pc + 1) : 0;
+		instr->bytes[2] = length > 2 ? m65_mem_peek(mem, pc + 2) : 0;
+		count++;
+
+		if (m65_aot_ends_block(instr->bytes[0]))
+			break;
+		pc += length;
+	}
+
+	// Label the targets of branches and jmp within the block
+	for (size_t i = 0; i < count; i++)
+	{
+		int target = m65_aot_target(&instrs[i]);
+		if (target < 0 || instrs[i].bytes[0] == 0x20)
+			continue;
+		for (size_t j = 0; j < count; j++)
+		{
+			if (instrs[j].pc == target)
+				instrs[j].label = true;
+		}
+	}
+	return count;
+}
+
+// m65_aot_in_block(const m65_aot_instr_t*, size_t, int) -> bool
+// Checks if an instruction of a block starts at an address.
+static bool m65_aot_in_block(const m65_aot_instr_t* instrs, size_t count, int addr)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (instrs[i].pc == addr)
+			return true;
+	}
+	return false;
+}
+
+// m65_aot_emit(const m65_aot_instr_t*, size_t, m65_variant_t, FILE*) -> void
+// Writes the code bytes and the function of a block.
+static void m65_aot_emit(const m65_aot_instr_t* instrs, size_t count, m65_variant_t variant, FILE* out)
+{
+	uint16_t addr = instrs[0].pc;
+	fprintf(out, "\n// $%04X\nstatic const uint8_t code_%04x[] = {", addr, addr);
+	unsigned bytes = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (uint8_t j = 0; j < m65_mode_length[instrs[i].info->mode]; j++, bytes++)
+			fprintf(out, "%s0x%02X", bytes == 0 ? "\n\t" : bytes % 16 == 0 ? ",\n\t" : ", ", instrs[i].bytes[j]);
+	}
+
+	fprintf(out, "\n};\n\nstatic void block_%04x(m6502_t* cpu, m65_mem_t* mem, uint64_t end)\n{\n", addr);
+	fprintf(out, "\tuint32_t gen = m65_mem_generation(mem, 0x%02X);\n\n", addr >> 8);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const m65_aot_instr_t* instr = &instrs[i];
+		const m65_opinfo_t* info = instr->info;
+		char text[M65_DISASM_SIZE];
+		m65_disasm_bytes(variant, instr->pc, instr->bytes, text);
+
+		if (instr->label)
+			fprintf(out, "i_%04x:\n", instr->pc);
+		fprintf(out, "\tif (m65_aot_op(0x%04X, 0x%02X, 0x%02X, 0x%02X, %u, %u, %u))\t// %s\n\t\treturn;\n",
+				instr->pc, instr->bytes[0], instr->bytes[1], instr->bytes[2], info->mode, info->cycles,
+				info->penalty, text);
+
+		// Taken branches and jmp go on in the block if their target is in it
+		int target = m65_aot_target(instr);
+		bool inside = target >= 0 && instr->bytes[0] != 0x20 && m65_aot_in_block(instrs, count, target);
+		if (info->mode == M65_MODE_REL && i + 1 < count)
+		{
+			if (inside)
+				fprintf(out, "\tif (cpu->pins.addr != 0x%04X)\n\t\tgoto i_%04x;\n", instr->pc + 2, target);
+			else fprintf(out, "\tif (cpu->pins.addr != 0x%04X)\n\t\treturn;\n", instr->pc + 2);
+		} else if (info->mode == M65_MODE_REL && inside)
+			fprintf(out, "\tif (cpu->pins.addr == 0x%04X)\n\t\tgoto i_%04x;\n", target, target);
+		else if (instr->bytes[0] == 0x4C && inside)
+			fprintf(out, "\tgoto i_%04x;\n", target);
+	}
+	fputs("}\n", out);
+}
+
+// m65_aot_compile(const m65_mem_t*, m65_variant_t, const uint16_t*, size_t, FILE*) -> bool
+// Writes C code implementing the code reachable from the vectors and entry points of a memory map.
+bool m65_aot_compile(const m65_mem_t* mem, m65_variant_t variant, const uint16_t* entries, size_t count, FILE* out)
+{
+	// Every address is queued at most once
+	uint8_t* queued = calloc(M65_PAGES * M65_PAGE_SIZE / 8, 1);
+	uint16_t* queue = malloc(M65_PAGES * M65_PAGE_SIZE * sizeof(uint16_t));
+	uint16_t* blocks = malloc(M65_PAGES * M65_PAGE_SIZE * sizeof(uint16_t));
+	m65_aot_instr_t* instrs = malloc(M65_PAGE_SIZE * sizeof(m65_aot_instr_t));
+	size_t queue_size = 0;
+	size_t block_count = 0;
+	if (queued == NULL || queue == NULL || blocks == NULL || instrs == NULL)
+	{
+		free(queued);
+		free(queue);
+		free(blocks);
+		free(instrs);
+		return false;
+	}
+
+#define m65_aot_queue(addr)						\
+	do											\
+	{											\
+		uint16_t a = (addr);					\
+		if (!(queued[a >> 3] & 1 << (a & 7)))	\
+		{										\
+			queued[a >> 3] |= 1 << (a & 7);		\
+			queue[queue_size++] = a;			\
+		}										\
+	} while (0)
+
+	for (uint16_t vector = 0xFFFA; vector != 0; vector += 2)
+		m65_aot_queue(m65_mem_peek(mem, vector) | m65_mem_peek(mem, vector + 1) << 8);
+	for (size_t i = 0; i < count; i++)
+		m65_aot_queue(entries[i]);
+
+	fprintf(out, "// Generated by the MOS6502 emulator: %s code compiled ahead of time.\n"
+			"// Build with: cc -O2 -shared -fPIC -I src -o image.so image.c\n\n"
+			"#include \"m6502-src/aot.h\"\n\n"
+			"#define M65_AOT_TRAITS %d, %d, %d\n", m65_aot_traits[variant].id, m65_aot_traits[variant].bcd,
+			m65_aot_traits[variant].jmp_bug, m65_aot_traits[variant].int_cld);
+
+	// Walk the control flow graph, compiling every block reached
+	while (queue_size != 0)
+	{
+		uint16_t addr = queue[--queue_size];
+		size_t instr_count = m65_aot_decode(mem, variant, addr, instrs);
+		if (instr_count == 0)
+			continue;
+
+		m65_aot_emit(instrs, instr_count, variant, out);
+		blocks[block_count++] = addr;
+
+		// Every target is a block of its own, and so is the instruction after jsr, which rts returns to
+		for (size_t i = 0; i < instr_count; i++)
+		{
+			int target = m65_aot_target(&instrs[i]);
+			if (target >= 0)
+				m65_aot_queue(target);
+			if (instrs[i].bytes[0] == 0x20)
+				m65_aot_queue(instrs[i].pc + 3);
+		}
+
+		// Blocks that end by running into the end of the page or an unimplemented opcode go on after it
+		const m65_aot_instr_t* last = &instrs[instr_count - 1];
+		uint16_t next = last->pc + m65_mode_length[last->info->mode];
+		if (!m65_aot_ends_block(last->bytes[0]) && next >> 8 != addr >> 8)
+			m65_aot_queue(next);
+	}
+
+#undef m65_aot_queue
+
+	fputs("\nstatic const m65_aot_block_t blocks[] = {\n", out);
+	for (size_t i = 0; i < block_count; i++)
+		fprintf(out, "\t{0x%04X, sizeof(code_%04x), code_%04x, block_%04x},\n", blocks[i], blocks[i], blocks[i],
+				blocks[i]);
+	fprintf(out, "};\n\nconst m65_aot_image_t m65_aot_image = {M65_AOT_VERSION, %s, %zu, blocks};\n",
+			m65_aot_variants[variant], block_count);
+
+	free(queued);
+	free(queue);
+	free(blocks);
+	free(instrs);
+	return !ferror(out);
+}
+
+// m65_aot_open(m65_aot_t*, const char*) -> bool
+// Loads a compiled image from a shared object.
+bool m65_aot_open(m65_aot_t* aot, const char* path)
+{
+	memset(aot, 0, sizeof(m65_aot_t));
+
+	// dlopen() searches the library path for names without a slash
+	char local[4096];
+	if (strchr(path, '/') == NULL)
+	{
+		snprintf(local, sizeof(local), "./%s", path);
+		path = local;
+	}
+
+	if ((aot->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL)
+		return false;
+	aot->image = dlsym(aot->handle, "m65_aot_image");
+	if (aot->image == NULL || aot->image->version != M65_AOT_VERSION)
+	{
+		m65_aot_close(aot);
+		return false;
+	}
+
+	for (size_t i = 0; i < aot->image->count; i++)
+	{
+		const m65_aot_block_t* block = &aot->image->blocks[i];
+		m65_aot_entry_t** entries = &aot->pages[block->addr >> 8];
+		if (*entries == NULL && (*entries = calloc(M65_PAGE_SIZE, sizeof(m65_aot_entry_t))) == NULL)
+		{
+			m65_aot_close(aot);
+			return false;
+		}
+		(*entries)[block->addr & 0xff].block = block;
+	}
+	return true;
+}
+
+// m65_aot_close(m65_aot_t*) -> void
+// Unloads a compiled image.
+void m65_aot_close(m65_aot_t* aot)
+{
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		free(aot->pages[page]);
+		aot->pages[page] = NULL;
+	}
+
+	if (aot->handle != NULL)
+		dlclose(aot->handle);
+	aot->handle = NULL;
+	aot->image = NULL;
+}
+
+// m65_aot_lookup(m65_aot_t*, m65_mem_t*, uint16_t) -> m65_aot_fn_t
+// Returns the compiled block at an address, or NULL if there is none or memory doesn't hold its code anymore. The code
+// is only compared again when the generation of its page changed.
+static inline m65_aot_fn_t m65_aot_lookup(m65_aot_t* aot, m65_mem_t* mem, uint16_t pc)
+{
+	uint8_t page = pc >> 8;
+	m65_aot_entry_t* entry = aot->pages[page] != NULL ? &aot->pages[page][pc & 0xff] : NULL;
+	if (entry == NULL || entry->block == NULL)
+		return NULL;
+
+	if (entry->state == M65_AOT_UNKNOWN || entry->generation != m65_mem_generation(mem, page)
+			|| !m65_mem_is_code(mem, page))
+	{
+		// Marking the page makes writes to it bump its generation
+		if (!m65_mem_is_code(mem, page))
+			m65_mem_mark_code(mem, page);
+		entry->generation = m65_mem_generation(mem, page);
+
+		const uint8_t* bytes = mem->read[page];
+		entry->state = bytes != NULL && memcmp(bytes + (pc & 0xff), entry->block->code, entry->block->length) == 0
+				? M65_AOT_VALID : M65_AOT_STALE;
+	}
+	return entry->state == M65_AOT_VALID ? entry->block->fn : NULL;
+}
+
+// m65_run_aot(m6502_t*, m65_mem_t*, m65_aot_t*, uint64_t) -> uint64_t
+// Executes whole instructions like m65_run(), running compiled blocks where possible.
+uint64_t m65_run_aot(m6502_t* cpu, m65_mem_t* mem, m65_aot_t* aot, uint64_t cycles)
+{
+	uint64_t start = cpu->cycles;
+	uint64_t end = start + cycles;
+	if (aot->image == NULL || aot->image->variant != cpu->variant || cpu->coverage != NULL)
+		return m65_run(cpu, mem, cycles);
+
+	// Blocks stop where m65_run() would catch up devices, so they're caught up at the same points
+	while (cpu->cycles < end)
+	{
+		m65_aot_fn_t fn = NULL;
+		if (cpu->phase == M65_PHASE_FETCH && !cpu->handle_interrupt && !m65_int_signalled(cpu)
+				&& (cpu->traps == NULL || !m65_trapped(cpu->traps, cpu->pins.addr)))
+			fn = m65_aot_lookup(aot, mem, cpu->pins.addr);
+
+		if (fn != NULL)
+		{
+			fn(cpu, mem, end);
+			aot->blocks++;
+		} else
+		{
+			m65_step(cpu, mem);
+			aot->steps++;
+		}
+		m65_mem_poll_devices(mem, cpu->cycles);
+	}
+
+	return cpu->cycles - start;
+}
@@ -0,0 +1,126 @@
+//
+// MOS6502 Emulator
+// aot.h: Header file for aot.c, also included by the C code it generates.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdio.h>
+
+#include "exec.h"
+#include "m6502.h"
+#include "memory.h"
+#include "traps.h"
+
+// The version of the interface between the generated code and the runtime. Images of another version are rejected.
+#define M65_AOT_VERSION 1
+
+// A compiled basic block. It runs its instructions from the instruction boundary at its address until control leaves
+// the block, an interrupt is pending, the cycle counter reaches end or the next device deadline, the code in its page
+// changes, or the next instruction is trapped (see traps.h).
+typedef void (*m65_aot_fn_t)(m6502_t* cpu, m65_mem_t* mem, uint64_t end);
+
+// Represents a basic block in a compiled image.
+typedef struct
+{
+	// The address of the first instruction.
+	uint16_t addr;
+
+	// The code the block was compiled from, which memory has to match for the block to run.
+	uint16_t length;
+	const uint8_t* code;
+
+	// The compiled block.
+	m65_aot_fn_t fn;
+} m65_aot_block_t;
+
+// Represents a compiled image, which the generated code exports as m65_aot_image.
+typedef struct
+{
+	// M65_AOT_VERSION when the image was compiled.
+	unsigned version;
+
+	// The variant the image was compiled for.
+	m65_variant_t variant;
+
+	// The basic blocks.
+	size_t count;
+	const m65_aot_block_t* blocks;
+} m65_aot_image_t;
+
+// Represents the entry point of a compiled block at an address.
+typedef struct
+{
+	// The block, or NULL if none starts at the address.
+	const m65_aot_block_t* block;
+
+	// The generation of the page when the code of the block was last checked, and whether it matched.
+	uint32_t generation;
+	uint8_t state;
+} m65_aot_entry_t;
+
+// Represents a compiled image loaded from a shared object.
+typedef struct
+{
+	// The shared object and the image in it.
+	void* handle;
+	const m65_aot_image_t* image;
+
+	// The blocks starting at each address of each page, or NULL for pages without blocks.
+	m65_aot_entry_t* pages[M65_PAGES];
+
+	// The number of blocks entered and of instructions stepped by the interpreter.
+	uint64_t blocks;
+	uint64_t steps;
+} m65_aot_t;
+
+// m65_aot_compile(const m65_mem_t*, m65_variant_t, const uint16_t*, size_t, FILE*) -> bool
+// Writes C code implementing the code reachable from the reset, IRQ and NMI vectors and the given entry points of a
+// memory map. The control flow graph is walked from those through branches, jmp and jsr; the targets of rts, rti, brk
+// and indirect jumps are unknown, so they're left to the interpreter, as are unimplemented opcodes and code in the zero
+// page, the stack and device pages. Blocks lie within one page. The result is compiled into a shared object with the
+// source directory on the include path (-shared -fPIC -I src). Returns false if the code can't be written.
+bool m65_aot_compile(const m65_mem_t* mem, m65_variant_t variant, const uint16_t* entries, size_t count, FILE* out);
+
+// m65_aot_open(m65_aot_t*, const char*) -> bool
+// Loads a compiled image from a shared object. Paths without a slash are relative to the working directory. Returns
+// false if the shared object can't be loaded or holds no image of this version.
+bool m65_aot_open(m65_aot_t* aot, const char* path);
+
+// m65_aot_close(m65_aot_t*) -> void
+// Unloads a compiled image.
+void m65_aot_close(m65_aot_t* aot);
+
+// m65_run_aot(m6502_t*, m65_mem_t*, m65_aot_t*, uint64_t) -> uint64_t
+// Executes whole instructions like m65_run(), with the same result, but runs the compiled blocks of an image where one
+// starts at an instruction boundary, no interrupt is pending and memory still holds the code it was compiled from.
+// Everything else is interpreted, as is everything on processors of another variant and processors recording
+// coverage.
+uint64_t m65_run_aot(m6502_t* cpu, m65_mem_t* mem, m65_aot_t* aot, uint64_t cycles);
+
+// m65_aot_exec(m6502_t*, m65_mem_t*, uint64_t, uint32_t, uint16_t, uint8_t, uint8_t, uint8_t, const m65_opinfo_t*, int,
+//		bool, bool) -> bool
+// Executes an instruction of a compiled block and checks if the block has to return. gen is the generation of the page
+// of the block when it was entered.
+__attribute__((always_inline)) static inline bool m65_aot_exec(m6502_t* cpu, m65_mem_t* mem, uint64_t end,
+		uint32_t gen, uint16_t pc, uint8_t op, uint8_t low, uint8_t high, const m65_opinfo_t* info, int bcd,
+		bool jmp_bug, bool int_cld)
+{
+	m65_exec(cpu, mem, pc, op, low, high, info, bcd, jmp_bug, int_cld);
+	return cpu->handle_interrupt || m65_int_signalled(cpu) || cpu->cycles >= end
+		|| cpu->cycles >= mem->devices.deadline || m65_mem_generation(mem, pc >> 8) != gen
+		|| (cpu->traps != NULL && m65_trapped(cpu->traps, cpu->pins.addr));
+}
+
+// m65_aot_op(pc, op, low, high, mode, cycles, penalty) -> bool
+// Executes an instruction in generated code, which defines M65_AOT_TRAITS as the traits of its variant and has cpu,
+// mem, end and gen in scope. The opcode metadata is a constant, so the compiler removes the unused addressing modes.
+#define m65_aot_op(pc, op, low, high, mode, cycles, penalty)												\
+	m65_aot_exec(cpu, mem, end, gen, pc, op, low, high, &(const m65_opinfo_t) {mode, cycles, penalty},	\
+			M65_AOT_TRAITS)
+
+#endif /* AOT_H */
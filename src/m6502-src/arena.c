@@ -0,0 +1,250 @@
+//
+// MOS6502 Emulator
+// arena.c: Implements arenas and pools of fixed size objects.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "memory.h"
+
+// The arena of every thread, and the key that frees it when the thread exits. Chunks are only given back then, so that
+// creating and freeing maps doesn't go to the system.
+static _Thread_local m65_arena_t* m65_arena_local = NULL;
+static pthread_key_t m65_arena_key;
+static pthread_once_t m65_arena_key_once = PTHREAD_ONCE_INIT;
+
+// m65_arena_round(size_t) -> size_t
+// Rounds a size up to the alignment of arenas.
+static size_t m65_arena_round(size_t size)
+{
+	return (size + M65_ARENA_ALIGN - 1) & ~(size_t) (M65_ARENA_ALIGN - 1);
+}
+
+// m65_arena_init(m65_arena_t*, bool) -> void
+// Initialises an empty arena.
+void m65_arena_init(m65_arena_t* arena, bool huge)
+{
+	memset(arena, 0, sizeof(m65_arena_t));
+	arena->huge = huge;
+	m65_slab_init(&arena->cpus, arena, sizeof(m6502_t));
+	m65_slab_init(&arena->maps, arena, sizeof(m65_mem_t));
+	m65_slab_init(&arena->tables, arena, M65_PAGES * sizeof(uint8_t*));
+	m65_slab_init(&arena->pages, arena, M65_PAGE_SIZE);
+}
+
+// m65_arena_free(m65_arena_t*) -> void
+// Gives the memory of an arena back to the system.
+void m65_arena_free(m65_arena_t* arena)
+{
+	for (m65_arena_chunk_t* chunk = arena->chunks, * next; chunk != NULL; chunk = next)
+	{
+		next = chunk->next;
+		munmap(chunk, chunk->size);
+	}
+
+	m65_arena_init(arena, arena->huge);
+}
+
+// m65_arena_reset(m65_arena_t*) -> void
+// Drops everything allocated from an arena at once. The pools drop their released objects when they see the new
+// epoch.
+void m65_arena_reset(m65_arena_t* arena)
+{
+	arena->current = arena->chunks;
+	arena->used = sizeof(m65_arena_chunk_t);
+	arena->epoch++;
+}
+
+// m65_arena_chunk(m65_arena_t*, size_t) -> m65_arena_chunk_t*
+// Maps a new chunk of at least size bytes. Huge chunks are aligned to M65_ARENA_CHUNK by mapping more and unmapping
+// what sticks out. Returns NULL if memory can't be mapped.
+static m65_arena_chunk_t* m65_arena_chunk(m65_arena_t* arena, size_t size)
+{
+	size = (size + M65_ARENA_CHUNK - 1) & ~(size_t) (M65_ARENA_CHUNK - 1);
+	size_t mapped = arena->huge ? size + M65_ARENA_CHUNK : size;
+	uint8_t* base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	if (arena->huge)
+	{
+		uint8_t* aligned = (uint8_t*) (((uintptr_t) base + M65_ARENA_CHUNK - 1) & ~(uintptr_t) (M65_ARENA_CHUNK - 1));
+		if (aligned != base)
+			munmap(base, aligned - base);
+		if (aligned + size != base + mapped)
+			munmap(aligned + size, base + mapped - (aligned + size));
+		base = aligned;
+
+		// The kernel may not have huge pages enabled, which only costs speed
+		madvise(base, size, MADV_HUGEPAGE);
+	}
+
+	m65_arena_chunk_t* chunk = (m65_arena_chunk_t*) base;
+	chunk->next = NULL;
+	chunk->size = size;
+	arena->reserved += size;
+	return chunk;
+}
+
+// m65_arena_alloc(m65_arena_t*, size_t) -> void*
+// Allocates size bytes from an arena.
+void* m65_arena_alloc(m65_arena_t* arena, size_t size)
+{
+	size = m65_arena_round(size);
+	if (arena->current == NULL || arena->used + size > arena->current->size)
+	{
+		// Move on to the next chunk kept from before a reset that is big enough, or else map a new one
+		size_t need = m65_arena_round(sizeof(m65_arena_chunk_t)) + size;
+		m65_arena_chunk_t* chunk = arena->current != NULL ? arena->current->next : arena->chunks;
+		while (chunk != NULL && chunk->size < need)
+			chunk = chunk->next;
+
+		if (chunk == NULL)
+		{
+			if ((chunk = m65_arena_chunk(arena, need)) == NULL)
+				return NULL;
+			if (arena->last != NULL)
+				arena->last->next = chunk;
+			else arena->chunks = chunk;
+			arena->last = chunk;
+		}
+
+		arena->current = chunk;
+		arena->used = sizeof(m65_arena_chunk_t);
+	}
+
+	arena->used = m65_arena_round(arena->used);
+	void* obj = (uint8_t*) arena->current + arena->used;
+	arena->used += size;
+	return obj;
+}
+
+// m65_arena_idle(const m65_arena_t*) -> bool
+// Checks if every object from the pools of an arena was released.
+static bool m65_arena_idle(const m65_arena_t* arena)
+{
+	return !arena->cpus.live && !arena->maps.live && !arena->tables.live && !arena->pages.live;
+}
+
+// m65_arena_exit(void*) -> void
+// Frees the arena of a thread that exited, unless objects from it are still in use, which keep it until the last of
+// them is released.
+static void m65_arena_exit(void* arg)
+{
+	m65_arena_t* arena = arg;
+	if (!m65_arena_idle(arena))
+	{
+		arena->orphaned = true;
+		return;
+	}
+
+	m65_arena_free(arena);
+	free(arena);
+}
+
+// m65_arena_key_init() -> void
+// Creates the key of the arenas of threads.
+static void m65_arena_key_init(void)
+{
+	pthread_key_create(&m65_arena_key, m65_arena_exit);
+}
+
+// m65_arena_thread() -> m65_arena_t*
+// Returns the arena of the calling thread.
+m65_arena_t* m65_arena_thread(void)
+{
+	if (m65_arena_local == NULL)
+	{
+		pthread_once(&m65_arena_key_once, m65_arena_key_init);
+		m65_arena_t* arena = malloc(sizeof(m65_arena_t));
+		if (arena == NULL)
+			return NULL;
+
+		m65_arena_init(arena, false);
+		pthread_setspecific(m65_arena_key, arena);
+		m65_arena_local = arena;
+	}
+
+	return m65_arena_local;
+}
+
+// m65_slab_init(m65_slab_t*, m65_arena_t*, size_t) -> void
+// Initialises a pool of objects of size bytes from an arena.
+void m65_slab_init(m65_slab_t* slab, m65_arena_t* arena, size_t size)
+{
+	slab->arena = arena;
+	slab->size = size < sizeof(void*) ? sizeof(void*) : size;
+	slab->tag = (slab->size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	slab->free = NULL;
+	slab->epoch = arena->epoch;
+	slab->live = 0;
+}
+
+// m65_slab_sync(m65_slab_t*) -> void
+// Drops the released objects of a pool if its arena was reset since it last looked.
+static void m65_slab_sync(m65_slab_t* slab)
+{
+	if (slab->epoch != slab->arena->epoch)
+	{
+		slab->free = NULL;
+		slab->epoch = slab->arena->epoch;
+		slab->live = 0;
+	}
+}
+
+// m65_slab_tag(const m65_slab_t*, void*) -> uint64_t*
+// Returns the tag after an object of a pool.
+static uint64_t* m65_slab_tag(const m65_slab_t* slab, void* obj)
+{
+	return (uint64_t*) ((uint8_t*) obj + slab->tag);
+}
+
+// m65_slab_alloc(m65_slab_t*) -> void*
+// Allocates an object from a pool.
+void* m65_slab_alloc(m65_slab_t* slab)
+{
+	m65_slab_sync(slab);
+	void* obj = slab->free;
+	if (obj == NULL)
+		obj = m65_arena_alloc(slab->arena, slab->tag + sizeof(uint64_t));
+	else memcpy(&slab->free, obj, sizeof(void*));
+
+	if (obj != NULL)
+	{
+		*m65_slab_tag(slab, obj) = slab->epoch ^ (uintptr_t) obj;
+		slab->live++;
+	}
+	return obj;
+}
+
+// m65_slab_release(m65_slab_t*, void*) -> void
+// Gives an object back to its pool.
+void m65_slab_release(m65_slab_t* slab, void* obj)
+{
+	// Objects that aren't tagged with the current epoch are stale, or were released already
+	m65_slab_sync(slab);
+	uint64_t* tag = m65_slab_tag(slab, obj);
+	if (*tag != (slab->epoch ^ (uintptr_t) obj))
+		return;
+	*tag = ~*tag;
+
+	memcpy(obj, &slab->free, sizeof(void*));
+	slab->free = obj;
+	slab->live--;
+
+	// The arena of a thread that exited goes with the last object from it
+	m65_arena_t* arena = slab->arena;
+	if (arena->orphaned && m65_arena_idle(arena))
+	{
+		m65_arena_free(arena);
+		free(arena);
+	}
+}
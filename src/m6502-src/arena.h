@@ -0,0 +1,127 @@
+//
+// MOS6502 Emulator
+// arena.h: Header file for arena.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#include "m6502.h"
+
+// The size of the chunks arenas get memory in, which is also the size of a huge page.
+#define M65_ARENA_CHUNK (2 << 20)
+
+// The alignment of everything allocated from an arena, a cache line.
+#define M65_ARENA_ALIGN 64
+
+// Represents a block of memory an arena cuts objects from.
+typedef struct s_m65_arena_chunk m65_arena_chunk_t;
+struct s_m65_arena_chunk
+{
+	// The next chunk of the arena.
+	m65_arena_chunk_t* next;
+
+	// The size of the chunk, including this header.
+	size_t size;
+};
+
+// Represents a pool of objects of one size cut from an arena. Released objects are linked through their first bytes
+// and handed out again before the arena is asked for more. Every object is followed by a tag of the epoch it was handed
+// out in, mixed with its address, so releases of objects from before a reset or of objects already released are
+// caught.
+typedef struct
+{
+	// The arena the objects come from.
+	m65_arena_t* arena;
+
+	// The size of the objects, and the offset of their tags.
+	size_t size;
+	size_t tag;
+
+	// The released objects, valid while epoch is the epoch of the arena.
+	void* free;
+	uint64_t epoch;
+
+	// The number of objects handed out and not released since the arena was last reset.
+	size_t live;
+} m65_slab_t;
+
+// Represents an arena: memory that objects are allocated from by bumping a pointer, and that is all dropped at once.
+// Arenas aren't thread safe, so every thread uses its own. Chunks are kept when the arena is reset, so an arena that
+// is reset after every batch of work stops allocating memory after the first.
+struct s_m65_arena
+{
+	// Whether the chunks are backed by transparent huge pages.
+	bool huge;
+
+	// Every chunk, in the order they were allocated, the last one, and the one objects are currently cut from.
+	m65_arena_chunk_t* chunks;
+	m65_arena_chunk_t* last;
+	m65_arena_chunk_t* current;
+
+	// The number of bytes of the current chunk in use.
+	size_t used;
+
+	// The number of times the arena was reset.
+	uint64_t epoch;
+
+	// Whether the arena belongs to a thread that exited while objects from it were still in use, in which case the
+	// release of the last one frees it.
+	bool orphaned;
+
+	// The pools of processors (m65_cpu_new()), memory maps (m65_mem_new()), the page tables of sparse maps and their
+	// pages.
+	m65_slab_t cpus;
+	m65_slab_t maps;
+	m65_slab_t tables;
+	m65_slab_t pages;
+
+	// The number of bytes of chunks allocated.
+	size_t reserved;
+};
+
+// m65_arena_init(m65_arena_t*, bool) -> void
+// Initialises an empty arena. With huge set, chunks are aligned to huge pages and the kernel is advised to back them
+// with transparent huge pages, which saves TLB misses when many memory maps are touched at random.
+void m65_arena_init(m65_arena_t* arena, bool huge);
+
+// m65_arena_free(m65_arena_t*) -> void
+// Gives the memory of an arena back to the system. Everything allocated from it is gone.
+void m65_arena_free(m65_arena_t* arena);
+
+// m65_arena_reset(m65_arena_t*) -> void
+// Drops everything allocated from an arena at once, in constant time, keeping its memory for the next batch. Objects
+// from before the reset must not be used or released afterwards; memory maps from the arena don't have to be freed.
+void m65_arena_reset(m65_arena_t* arena);
+
+// m65_arena_alloc(m65_arena_t*, size_t) -> void*
+// Allocates size bytes from an arena, aligned to M65_ARENA_ALIGN. The memory isn't cleared. Returns NULL if memory
+// can't be allocated.
+void* m65_arena_alloc(m65_arena_t* arena, size_t size);
+
+// m65_arena_thread() -> m65_arena_t*
+// Returns the arena of the calling thread, which sparse memory maps (m65_mem_init_sparse()) get their pages from, or
+// NULL if memory can't be allocated. It is never reset. Its memory goes back to the system when the thread exits if
+// every object from it was released by then; otherwise it stays for the objects that outlive the thread, which may
+// still be freed later from any one thread, and goes back once the last of them is.
+m65_arena_t* m65_arena_thread(void);
+
+// m65_slab_init(m65_slab_t*, m65_arena_t*, size_t) -> void
+// Initialises a pool of objects of size bytes from an arena.
+void m65_slab_init(m65_slab_t* slab, m65_arena_t* arena, size_t size);
+
+// m65_slab_alloc(m65_slab_t*) -> void*
+// Allocates an object from a pool. The memory isn't cleared. Returns NULL if memory can't be allocated.
+void* m65_slab_alloc(m65_slab_t* slab);
+
+// m65_slab_release(m65_slab_t*, void*) -> void
+// Gives an object back to its pool. Objects from before a reset of the arena and objects that were already released
+// are ignored, unless the pool handed the same object out again since.
+void m65_slab_release(m65_slab_t* slab, void* obj);
+
+#endif /* ARENA_H */
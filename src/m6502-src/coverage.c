@@ -0,0 +1,190 @@
+//
+// MOS6502 Emulator
+// coverage.c: Implements coverage maps of guest code and their reports.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coverage.h"
+
+// The first bytes of a saved coverage map. The three bitmaps follow as little endian bytes.
+static const char m65_coverage_magic[8] = "M65COV1";
+
+// m65_coverage_merge(m65_coverage_t*, const m65_coverage_t*) -> void
+// Adds the coverage in from to into.
+void m65_coverage_merge(m65_coverage_t* into, const m65_coverage_t* from)
+{
+	for (unsigned i = 0; i < 1024; i++)
+	{
+		if (from->executed[i])
+			__atomic_fetch_or(&into->executed[i], from->executed[i], __ATOMIC_RELAXED);
+		if (from->taken[i])
+			__atomic_fetch_or(&into->taken[i], from->taken[i], __ATOMIC_RELAXED);
+		if (from->not_taken[i])
+			__atomic_fetch_or(&into->not_taken[i], from->not_taken[i], __ATOMIC_RELAXED);
+	}
+}
+
+// m65_coverage_save(const m65_coverage_t*, const char*) -> bool
+// Writes a coverage map to a file.
+bool m65_coverage_save(const m65_coverage_t* cov, const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+
+	fwrite(m65_coverage_magic, 1, sizeof(m65_coverage_magic), file);
+	const uint64_t* maps[3] = {cov->executed, cov->taken, cov->not_taken};
+	for (int map = 0; map < 3; map++)
+	{
+		for (unsigned i = 0; i < 1024; i++)
+		{
+			for (int byte = 0; byte < 8; byte++)
+				fputc(maps[map][i] >> byte * 8 & 0xff, file);
+		}
+	}
+
+	return fclose(file) == 0;
+}
+
+// m65_coverage_load(m65_coverage_t*, const char*) -> bool
+// Merges the coverage map saved in a file into cov.
+bool m65_coverage_load(m65_coverage_t* cov, const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	static const size_t size = sizeof(m65_coverage_magic) + 3 * 1024 * 8;
+	uint8_t* data = malloc(size);
+	bool valid = data != NULL && fread(data, 1, size, file) == size
+		&& memcmp(data, m65_coverage_magic, sizeof(m65_coverage_magic)) == 0;
+	fclose(file);
+
+	if (valid)
+	{
+		uint64_t* maps[3] = {cov->executed, cov->taken, cov->not_taken};
+		const uint8_t* bytes = data + sizeof(m65_coverage_magic);
+		for (int map = 0; map < 3; map++)
+		{
+			for (unsigned i = 0; i < 1024; i++, bytes += 8)
+			{
+				for (int byte = 0; byte < 8; byte++)
+					maps[map][i] |= (uint64_t) bytes[byte] << byte * 8;
+			}
+		}
+	}
+
+	free(data);
+	return valid;
+}
+
+// m65_hex_token(const char*, size_t, size_t) -> long
+// Parses a token of exactly digits hex digits, optionally prefixed with '.' or '$' and followed by ':'. Returns -1 if
+// the token is something else.
+static long m65_hex_token(const char* token, size_t length, size_t digits)
+{
+	if (length > 0 && (*token == '.' || *token == '$'))
+	{
+		token++;
+		length--;
+	}
+	if (length == digits + 1 && token[digits] == ':')
+		length--;
+	if (length != digits)
+		return -1;
+
+	long value = 0;
+	for (size_t i = 0; i < digits; i++)
+	{
+		if (!isxdigit((unsigned char) token[i]))
+			return -1;
+		value = value * 16 + (isdigit((unsigned char) token[i]) ? token[i] - '0' : (token[i] | 0x20) - 'a' + 10);
+	}
+	return value;
+}
+
+// m65_listing_line(const char*, uint16_t*, uint8_t*) -> bool
+// Finds the address and first byte of a listing line. Only the first few tokens are looked at, so that the source
+// text can't be mistaken for them.
+static bool m65_listing_line(const char* line, uint16_t* addr, uint8_t* opcode)
+{
+	const char* tokens[4];
+	size_t lengths[4];
+	int count = 0;
+
+	while (count < 4)
+	{
+		line += strspn(line, " \t");
+		if (*line == '\0' || *line == '\n' || *line == '\r' || *line == ';')
+			break;
+		tokens[count] = line;
+		lengths[count] = strcspn(line, " \t\r\n");
+		line += lengths[count++];
+	}
+
+	for (int i = 0; i + 1 < count; i++)
+	{
+		long address = m65_hex_token(tokens[i], lengths[i], 4);
+		long byte = m65_hex_token(tokens[i + 1], lengths[i + 1], 2);
+		if (address >= 0 && byte >= 0)
+		{
+			*addr = address;
+			*opcode = byte;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// m65_coverage_lcov(const m65_coverage_t*, const char*, FILE*) -> bool
+// Writes an lcov tracefile for an assembler listing.
+bool m65_coverage_lcov(const m65_coverage_t* cov, const char* listing, FILE* out)
+{
+	FILE* file = fopen(listing, "r");
+	if (file == NULL)
+		return false;
+
+	char* line = NULL;
+	size_t line_size = 0;
+	unsigned lines = 0, lines_hit = 0, branches = 0, branches_hit = 0;
+
+	fprintf(out, "TN:\nSF:%s\n", listing);
+	for (unsigned line_no = 1; getline(&line, &line_size, file) != -1; line_no++)
+	{
+		uint16_t addr;
+		uint8_t opcode;
+		if (!m65_listing_line(line, &addr, &opcode))
+			continue;
+
+		bool executed = m65_covered(cov->executed, addr);
+		fprintf(out, "DA:%u,%d\n", line_no, executed);
+		lines++;
+		lines_hit += executed;
+
+		// bpl, bmi, bvc, bvs, bcc, bcs, bne, beq
+		if ((opcode & 0x1F) != 0x10)
+			continue;
+
+		for (int taken = 1; taken >= 0; taken--)
+		{
+			bool hit = m65_covered(taken ? cov->taken : cov->not_taken, addr);
+			if (executed)
+				fprintf(out, "BRDA:%u,0,%d,%d\n", line_no, !taken, hit);
+			else fprintf(out, "BRDA:%u,0,%d,-\n", line_no, !taken);
+			branches++;
+			branches_hit += hit;
+		}
+	}
+
+	fprintf(out, "BRF:%u\nBRH:%u\nLF:%u\nLH:%u\nend_of_record\n", branches, branches_hit, lines, lines_hit);
+	free(line);
+	fclose(file);
+	return true;
+}
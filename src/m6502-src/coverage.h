@@ -0,0 +1,71 @@
+//
+// MOS6502 Emulator
+// coverage.h: Header file for coverage.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdio.h>
+
+#include "m6502.h"
+
+// Represents which instructions and branches of guest code were executed. Every bitmap has one bit per address. A
+// processor with a coverage map attached (m6502_t.coverage) sets the bit of every opcode it decodes and the taken or not
+// taken bit of every branch it executes, with both execution engines.
+struct s_m65_coverage
+{
+	// The addresses instructions were executed from.
+	uint64_t executed[1024];
+
+	// The addresses of branches that were taken and that weren't.
+	uint64_t taken[1024];
+	uint64_t not_taken[1024];
+};
+
+// m65_cover_exec(m65_coverage_t*, uint16_t) -> void
+// Records that an instruction was executed.
+static inline void m65_cover_exec(m65_coverage_t* cov, uint16_t addr)
+{
+	cov->executed[addr >> 6] |= (uint64_t) 1 << (addr & 63);
+}
+
+// m65_cover_branch(m65_coverage_t*, uint16_t, bool) -> void
+// Records that a branch was taken or not.
+static inline void m65_cover_branch(m65_coverage_t* cov, uint16_t addr, bool taken)
+{
+	uint64_t* bits = taken ? cov->taken : cov->not_taken;
+	bits[addr >> 6] |= (uint64_t) 1 << (addr & 63);
+}
+
+// m65_covered(const uint64_t*, uint16_t) -> bool
+// Checks if the bit of an address is set in one of the bitmaps of a coverage map.
+static inline bool m65_covered(const uint64_t* bits, uint16_t addr)
+{
+	return bits[addr >> 6] >> (addr & 63) & 1;
+}
+
+// m65_coverage_merge(m65_coverage_t*, const m65_coverage_t*) -> void
+// Adds the coverage in from to into. Merging is atomic per word, so any number of threads can merge into the same map
+// at once, as long as nothing else writes to it.
+void m65_coverage_merge(m65_coverage_t* into, const m65_coverage_t* from);
+
+// m65_coverage_save(const m65_coverage_t*, const char*) -> bool
+// Writes a coverage map to a file. Returns false if the file can't be written.
+bool m65_coverage_save(const m65_coverage_t* cov, const char* path);
+
+// m65_coverage_load(m65_coverage_t*, const char*) -> bool
+// Merges the coverage map saved in a file into cov. Returns false if the file can't be read or isn't a coverage map.
+bool m65_coverage_load(m65_coverage_t* cov, const char* path);
+
+// m65_coverage_lcov(const m65_coverage_t*, const char*, FILE*) -> bool
+// Writes an lcov tracefile for an assembler listing. Every line of the listing that has an address followed by the
+// bytes assembled there (like "C000  A9 00  lda #0" or "  12  c000  a9 00  lda #0") counts as an instruction, and
+// lines whose first byte is a branch opcode get a taken and a not taken branch. Returns false if the listing can't be
+// read.
+bool m65_coverage_lcov(const m65_coverage_t* cov, const char* listing, FILE* out);
+
+#endif /* COVERAGE_H */
@@ -0,0 +1,169 @@
+//
+// MOS6502 Emulator
+// disasm.c: Implements the disassembler.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disasm.h"
+#include "opcodes.h"
+
+// The mnemonics of the documented opcodes.
+const char m65_mnemonics[256][4] = {
+	"brk", "ora", "???", "???", "tsb", "ora", "asl", "???", "php", "ora", "asl", "???", "tsb", "ora", "asl", "???", // 0x
+	"bpl", "ora", "ora", "???", "trb", "ora", "asl", "???", "clc", "ora", "inc", "???", "trb", "ora", "asl", "???", // 1x
+	"jsr", "and", "???", "???", "bit", "and", "rol", "???", "plp", "and", "rol", "???", "bit", "and", "rol", "???", // 2x
+	"bmi", "and", "and", "???", "bit", "and", "rol", "???", "sec", "and", "dec", "???", "bit", "and", "rol", "???", // 3x
+	"rti", "eor", "???", "???", "???", "eor", "lsr", "???", "pha", "eor", "lsr", "???", "jmp", "eor", "lsr", "???", // 4x
+	"bvc", "eor", "eor", "???", "???", "eor", "lsr", "???", "cli", "eor", "phy", "???", "???", "eor", "lsr", "???", // 5x
+	"rts", "adc", "???", "???", "stz", "adc", "ror", "???", "pla", "adc", "ror", "???", "jmp", "adc", "ror", "???", // 6x
+	"bvs", "adc", "adc", "???", "stz", "adc", "ror", "???", "sei", "adc", "ply", "???", "jmp", "adc", "ror", "???", // 7x
+	"bra", "sta", "???", "???", "sty", "sta", "stx", "???", "dey", "bit", "txa", "???", "sty", "sta", "stx", "???", // 8x
+	"bcc", "sta", "sta", "???", "sty", "sta", "stx", "???", "tya", "sta", "txs", "???", "stz", "sta", "stz", "???", // 9x
+	"ldy", "lda", "ldx", "???", "ldy", "lda", "ldx", "???", "tay", "lda", "tax", "???", "ldy", "lda", "ldx", "???", // Ax
+	"bcs", "lda", "lda", "???", "ldy", "lda", "ldx", "???", "clv", "lda", "tsx", "???", "ldy", "lda", "ldx", "???", // Bx
+	"cpy", "cmp", "???", "???", "cpy", "cmp", "dec", "???", "iny", "cmp", "dex", "???", "cpy", "cmp", "dec", "???", // Cx
+	"bne", "cmp", "cmp", "???", "???", "cmp", "dec", "???", "cld", "cmp", "phx", "???", "???", "cmp", "dec", "???", // Dx
+	"cpx", "sbc", "???", "???", "cpx", "sbc", "inc", "???", "inx", "sbc", "nop", "???", "cpx", "sbc", "inc", "???", // Ex
+	"beq", "sbc", "sbc", "???", "???", "sbc", "inc", "???", "sed", "sbc", "plx", "???", "???", "sbc", "inc", "???"  // Fx
+};
+
+// m65_disasm_bytes(m65_variant_t, uint16_t, const uint8_t*, char*) -> uint8_t
+// Disassembles the instruction in bytes as if it was at addr into buf.
+uint8_t m65_disasm_bytes(m65_variant_t variant, uint16_t addr, const uint8_t* bytes, char* buf)
+{
+	const m65_opinfo_t* info = &m65_opinfo[variant][bytes[0]];
+	const char* name = m65_mnemonics[bytes[0]];
+	uint8_t low = bytes[1];
+	uint16_t word = bytes[2] << 8 | bytes[1];
+
+	if (info->cycles == 0)
+	{
+		snprintf(buf, M65_DISASM_SIZE, ".byte $%02x", bytes[0]);
+		return 1;
+	}
+
+	switch (info->mode)
+	{
+		case M65_MODE_IMPL:
+			snprintf(buf, M65_DISASM_SIZE, "%s", name);
+			break;
+		case M65_MODE_ACC:
+			snprintf(buf, M65_DISASM_SIZE, "%s a", name);
+			break;
+		case M65_MODE_IMM:
+			snprintf(buf, M65_DISASM_SIZE, "%s #$%02x", name, low);
+			break;
+		case M65_MODE_ZP:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%02x", name, low);
+			break;
+		case M65_MODE_ZPX:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%02x,x", name, low);
+			break;
+		case M65_MODE_ZPY:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%02x,y", name, low);
+			break;
+		case M65_MODE_ABS:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%04x", name, word);
+			break;
+		case M65_MODE_ABSX:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%04x,x", name, word);
+			break;
+		case M65_MODE_ABSY:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%04x,y", name, word);
+			break;
+		case M65_MODE_IND:
+			snprintf(buf, M65_DISASM_SIZE, "%s ($%04x)", name, word);
+			break;
+		case M65_MODE_INDX:
+			snprintf(buf, M65_DISASM_SIZE, "%s ($%02x,x)", name, low);
+			break;
+		case M65_MODE_INDY:
+			snprintf(buf, M65_DISASM_SIZE, "%s ($%02x),y", name, low);
+			break;
+		case M65_MODE_INDZP:
+			snprintf(buf, M65_DISASM_SIZE, "%s ($%02x)", name, low);
+			break;
+		case M65_MODE_REL:
+			snprintf(buf, M65_DISASM_SIZE, "%s $%04x", name, (uint16_t) (addr + 2 + (int8_t) low));
+			break;
+	}
+
+	return m65_mode_length[info->mode];
+}
+
+// m65_disasm(const m65_mem_t*, m65_variant_t, uint16_t, char*) -> uint8_t
+// Disassembles the instruction at addr into buf and returns its length.
+uint8_t m65_disasm(const m65_mem_t* mem, m65_variant_t variant, uint16_t addr, char* buf)
+{
+	uint8_t bytes[3];
+	for (int i = 0; i < 3; i++)
+		bytes[i] = m65_mem_peek(mem, addr + i);
+	return m65_disasm_bytes(variant, addr, bytes, buf);
+}
+
+// m65_disasm_init(m65_disasm_cache_t*, m65_variant_t) -> void
+// Initialises an empty cache.
+void m65_disasm_init(m65_disasm_cache_t* cache, m65_variant_t variant)
+{
+	memset(cache, 0, sizeof(m65_disasm_cache_t));
+	cache->variant = variant;
+}
+
+// m65_disasm_free(m65_disasm_cache_t*) -> void
+// Frees the decoded pages of a cache.
+void m65_disasm_free(m65_disasm_cache_t* cache)
+{
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		free(cache->pages[page]);
+		cache->pages[page] = NULL;
+	}
+}
+
+// m65_disasm_cached(m65_disasm_cache_t*, m65_mem_t*, uint16_t, uint8_t*) -> const char*
+// Returns the disassembly of the instruction at addr and sets length to its length.
+const char* m65_disasm_cached(m65_disasm_cache_t* cache, m65_mem_t* mem, uint16_t addr, uint8_t* length)
+{
+	static _Thread_local m65_disasm_line_t uncached;
+	uint8_t page = addr >> 8;
+	m65_disasm_line_t* lines = cache->pages[page];
+	m65_disasm_line_t* line = &uncached;
+
+	// Pages 0 and 1 can't be tracked, and instructions that run into the next page could change with it
+	if (page >= 2 && (addr & 0xff) <= M65_PAGE_SIZE - 3)
+	{
+		if (lines == NULL || cache->generation[page] != m65_mem_generation(mem, page) || !m65_mem_is_code(mem, page))
+		{
+			if (lines == NULL)
+				lines = cache->pages[page] = malloc(M65_PAGE_SIZE * sizeof(m65_disasm_line_t));
+
+			// Marking the page makes writes to it bump its generation
+			for (unsigned i = 0; lines != NULL && i < M65_PAGE_SIZE; i++)
+				lines[i].length = 0;
+			if (!m65_mem_is_code(mem, page))
+				m65_mem_mark_code(mem, page);
+			cache->generation[page] = m65_mem_generation(mem, page);
+		}
+
+		if (lines != NULL)
+			line = &lines[addr & 0xff];
+	}
+
+	if (line->length == 0 || line == &uncached)
+	{
+		char buf[M65_DISASM_SIZE];
+		line->length = m65_disasm(mem, cache->variant, addr, buf);
+		memcpy(line->text, buf, sizeof(line->text) - 1);
+		line->text[sizeof(line->text) - 1] = '\0';
+	}
+
+	if (length != NULL)
+		*length = line->length;
+	return line->text;
+}
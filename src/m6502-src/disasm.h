@@ -0,0 +1,71 @@
+//
+// MOS6502 Emulator
+// disasm.h: Header file for disasm.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "m6502.h"
+#include "memory.h"
+
+// The size of a buffer that fits any disassembled instruction, like "jmp ($1234)" or ".byte $02".
+#define M65_DISASM_SIZE 16
+
+// The mnemonics of the documented opcodes of the NMOS and CMOS instruction sets, or "???" for the others. Whether a
+// variant implements an opcode is up to m65_opinfo (opcodes.h), which the decoder builds its tables from too, so some
+// named opcodes (like the shifts, tsb and trb) still disassemble as ".byte" until a variant implements them.
+extern const char m65_mnemonics[256][4];
+
+// Represents a disassembled instruction in a cache.
+typedef struct
+{
+	// The text of the instruction.
+	char text[M65_DISASM_SIZE - 1];
+
+	// The length of the instruction in bytes, or 0 if the entry isn't decoded.
+	uint8_t length;
+} m65_disasm_line_t;
+
+// Represents a cache of disassembled memory for traces, profilers and debuggers. Every page holds the disassembly
+// starting at each of its addresses, decoded on first use. Decoding a page marks it as code in the memory map (see
+// m65_mem_track_code()), and pages whose generation changed are decoded again, so the text always matches memory.
+typedef struct
+{
+	// The variant to disassemble for.
+	m65_variant_t variant;
+
+	// The decoded lines of each page, or NULL for pages that weren't decoded.
+	m65_disasm_line_t* pages[M65_PAGES];
+
+	// The generation of each page when it was decoded.
+	uint32_t generation[M65_PAGES];
+} m65_disasm_cache_t;
+
+// m65_disasm_bytes(m65_variant_t, uint16_t, const uint8_t*, char*) -> uint8_t
+// Disassembles the instruction in bytes (which has room for three) as if it was at addr into buf, which has room for
+// M65_DISASM_SIZE characters. Opcodes the variant doesn't implement come out as ".byte". Returns the length of the
+// instruction.
+uint8_t m65_disasm_bytes(m65_variant_t variant, uint16_t addr, const uint8_t* bytes, char* buf);
+
+// m65_disasm(const m65_mem_t*, m65_variant_t, uint16_t, char*) -> uint8_t
+// Disassembles the instruction at addr into buf and returns its length.
+uint8_t m65_disasm(const m65_mem_t* mem, m65_variant_t variant, uint16_t addr, char* buf);
+
+// m65_disasm_init(m65_disasm_cache_t*, m65_variant_t) -> void
+// Initialises an empty cache. A cache belongs to one memory map.
+void m65_disasm_init(m65_disasm_cache_t* cache, m65_variant_t variant);
+
+// m65_disasm_free(m65_disasm_cache_t*) -> void
+// Frees the decoded pages of a cache.
+void m65_disasm_free(m65_disasm_cache_t* cache);
+
+// m65_disasm_cached(m65_disasm_cache_t*, m65_mem_t*, uint16_t, uint8_t*) -> const char*
+// Returns the disassembly of the instruction at addr and sets length (if not NULL) to its length. The text stays valid
+// until the next call.
+const char* m65_disasm_cached(m65_disasm_cache_t* cache, m65_mem_t* mem, uint16_t addr, uint8_t* length);
+
+#endif /* DISASM_H */
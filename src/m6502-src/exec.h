@@ -0,0 +1,347 @@
+//
+// MOS6502 Emulator
+// exec.h: Instruction semantics shared by the step engine and compiled code.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "alu.h"
+#include "coverage.h"
+#include "m6502.h"
+#include "memory.h"
+#include "opcodes.h"
+
+// Checks if an opcode is one of the eight of an accumulator instruction (see m65_alu_cases()).
+#define m65_alu_op(op, base) (((op) & 0xE0) == (base) && (((op) & 0x03) == 0x01 || ((op) & 0x1F) == 0x12))
+
+// The eight opcodes of an accumulator instruction and its 65C02 (zp) form. base is the opcode of the (zp, x) form.
+#define m65_alu_cases(base)																			\
+	case base | 0x01: case base | 0x05: case base | 0x09: case base | 0x0D:							\
+	case base | 0x11: case base | 0x15: case base | 0x19: case base | 0x1D: case base | 0x12
+
+// m65_push(m6502_t*, m65_mem_t*, uint8_t) -> void
+// Pushes a byte onto the stack.
+static inline void m65_push(m6502_t* cpu, m65_mem_t* mem, uint8_t data)
+{
+	mem->stack[cpu->s--] = data;
+}
+
+// m65_pull(m6502_t*, m65_mem_t*) -> uint8_t
+// Pops (pulls?) a byte from the stack.
+static inline uint8_t m65_pull(m6502_t* cpu, m65_mem_t* mem)
+{
+	return mem->stack[++cpu->s];
+}
+
+// m65_nz(m6502_t*, uint8_t) -> uint8_t
+// Sets the negative and zero flags for a value and returns the value.
+static inline uint8_t m65_nz(m6502_t* cpu, uint8_t value)
+{
+	cpu->flags = (cpu->flags & 0x7D) | (value & 0x80) | (value == 0) << 1;
+	return value;
+}
+
+// m65_compare(m6502_t*, uint8_t, uint8_t) -> void
+// Compares a register to a value.
+static inline void m65_compare(m6502_t* cpu, uint8_t reg, uint8_t value)
+{
+	m65_nz(cpu, reg - value);
+	cpu->flags = (cpu->flags & 0xFE) | (reg >= value);
+}
+
+// m65_operand_address(const m6502_t*, const m65_mem_t*, uint16_t, uint8_t, uint8_t, uint8_t, uint16_t*) -> uint16_t
+// Calculates the effective address of the instruction at pc from its addressing mode and operand bytes. base is set to
+// the address before indexing (for branches, the address of the next instruction), which decides the page boundary
+// penalty. It's always inlined, so that constant modes and operands fold away.
+__attribute__((always_inline)) static inline uint16_t m65_operand_address(const m6502_t* cpu, const m65_mem_t* mem,
+		uint16_t pc, uint8_t mode, uint8_t low, uint8_t high, uint16_t* base)
+{
+	switch (mode)
+	{
+		case M65_MODE_IMM:
+			return pc + 1;
+		case M65_MODE_ZP:
+			return low;
+		case M65_MODE_ZPX:
+			return (uint8_t) (low + cpu->x);
+		case M65_MODE_ZPY:
+			return (uint8_t) (low + cpu->y);
+		case M65_MODE_ABS:
+		case M65_MODE_IND:
+			return high << 8 | low;
+		case M65_MODE_ABSX:
+			*base = high << 8 | low;
+			return *base + cpu->x;
+		case M65_MODE_ABSY:
+			*base = high << 8 | low;
+			return *base + cpu->y;
+		case M65_MODE_INDX:
+		{
+			uint8_t ptr = low + cpu->x;
+			return mem->zp[ptr] | mem->zp[(uint8_t) (ptr + 1)] << 8;
+		}
+		case M65_MODE_INDY:
+			*base = mem->zp[low] | mem->zp[(uint8_t) (low + 1)] << 8;
+			return *base + cpu->y;
+		case M65_MODE_INDZP:
+			return mem->zp[low] | mem->zp[(uint8_t) (low + 1)] << 8;
+		case M65_MODE_REL:
+			*base = pc + 2;
+			return *base + (int8_t) low;
+		default:
+			return 0;
+	}
+}
+
+// m65_address(const m6502_t*, const m65_mem_t*, uint16_t, const m65_opinfo_t*, uint16_t*) -> uint16_t
+// Calculates the effective address of the instruction at pc, reading its operands from memory.
+static inline uint16_t m65_address(const m6502_t* cpu, const m65_mem_t* mem, uint16_t pc, const m65_opinfo_t* info,
+		uint16_t* base)
+{
+	// Operands are code, which is never in device registers
+	uint8_t length = m65_mode_length[info->mode];
+	uint8_t low = length > 1 ? m65_mem_peek(mem, pc + 1) : 0;
+	uint8_t high = length > 2 ? m65_mem_peek(mem, pc + 2) : 0;
+	return m65_operand_address(cpu, mem, pc, info->mode, low, high, base);
+}
+
+// m65_interrupt(m6502_t*, m65_mem_t*, uint16_t, bool) -> uint16_t
+// Runs the interrupt sequence configured in the processor for brk or a hardware interrupt. addr is the address of the
+// brk or of the interrupted instruction. Returns the address of the interrupt handler.
+static inline uint16_t m65_interrupt(m6502_t* cpu, m65_mem_t* mem, uint16_t addr, bool int_cld)
+{
+	// brk returns past its padding byte
+	if (cpu->int_brk)
+		addr += 2;
+
+	// Resets go through the motions without writing to the stack
+	if (cpu->int_rw == WRITE)
+	{
+		m65_push(cpu, mem, addr >> 8);
+		m65_push(cpu, mem, addr & 0xff);
+		m65_push(cpu, mem, cpu->int_brk ? cpu->flags | 0x10 : cpu->flags & 0xEF);
+	} else cpu->s -= 3;
+
+	// Adjust the interrupt flag post push; the 65C02 also leaves decimal mode
+	if (cpu->int_dsi)
+		cpu->flags |= 0x04;
+	else cpu->flags &= 0xFB;
+	if (int_cld)
+		cpu->flags &= 0xF7;
+
+	addr = m65_mem_read(mem, cpu->int_vec) | m65_mem_read(mem, cpu->int_vec + 1) << 8;
+
+	// Reset the interrupt config
+	cpu->int_rw = WRITE;
+	cpu->int_brk = true;
+	cpu->int_dsi = true;
+	cpu->int_vec = 0xFFFE;
+	return addr;
+}
+
+// m65_boundary(m6502_t*, uint16_t, uint8_t, uint8_t) -> void
+// Leaves the processor as if it just fetched the opcode at next after an instruction that took some cycles. poll is
+// the value of the flags when the interrupt lines were polled.
+static inline void m65_boundary(m6502_t* cpu, uint16_t next, uint8_t cycles, uint8_t poll)
+{
+	cpu->pc = next + 1;
+	cpu->pins.addr = next;
+	cpu->pins.rw = READ;
+	cpu->ipc = 0;
+	cpu->cycles += cycles;
+
+	if ((cpu->int_lines & M65_NMI_EDGE) || ((cpu->int_lines & M65_IRQ_LINES) && !(poll & 0x04)))
+		cpu->handle_interrupt = true;
+	cpu->int_poll = m65_int_pending(cpu);
+}
+
+// m65_exec(m6502_t*, m65_mem_t*, uint16_t, uint8_t, uint8_t, uint8_t, const m65_opinfo_t*, int, bool, bool) -> uint8_t
+// Executes the implemented instruction op with the operand bytes low and high at pc, leaves the processor at the next
+// instruction boundary (see m65_boundary()) and returns the number of cycles the instruction took. The traits are
+// constants in the callers (see variant.h). It's always inlined, so that compiled code (see aot.h), where the opcode
+// and its operands are constants too, only keeps the code of its instruction.
+__attribute__((always_inline)) static inline uint8_t m65_exec(m6502_t* cpu, m65_mem_t* mem, uint16_t pc, uint8_t op,
+		uint8_t low, uint8_t high, const m65_opinfo_t* info, int bcd, bool jmp_bug, bool int_cld)
+{
+	//							  N		  V		  C		  Z
+	static const uint8_t flags[4] = {1 << 7, 1 << 6, 1 << 0, 1 << 1};
+
+	uint8_t old = cpu->flags;
+	uint16_t base = 0;
+	uint16_t addr = m65_operand_address(cpu, mem, pc, info->mode, low, high, &base);
+	uint16_t next = pc + m65_mode_length[info->mode];
+	bool taken = false;
+	cpu->ir = op;
+
+	// Execute the instruction
+	switch (op)
+	{
+		m65_alu_cases(0x00):
+			cpu->a = m65_nz(cpu, cpu->a | m65_mem_read(mem, addr));
+			break;
+		m65_alu_cases(0x20):
+			cpu->a = m65_nz(cpu, cpu->a & m65_mem_read(mem, addr));
+			break;
+		m65_alu_cases(0x40):
+			cpu->a = m65_nz(cpu, cpu->a ^ m65_mem_read(mem, addr));
+			break;
+		m65_alu_cases(0x60):
+			m65_alu_adc(cpu, m65_mem_read(mem, addr), bcd);
+			break;
+		m65_alu_cases(0x80):
+			m65_mem_write(mem, addr, cpu->a);
+			break;
+		m65_alu_cases(0xA0):
+			cpu->a = m65_nz(cpu, m65_mem_read(mem, addr));
+			break;
+		m65_alu_cases(0xC0):
+			m65_compare(cpu, cpu->a, m65_mem_read(mem, addr));
+			break;
+		m65_alu_cases(0xE0):
+			m65_alu_sbc(cpu, m65_mem_read(mem, addr), bcd);
+			break;
+
+		// bit
+		case 0x24: case 0x2C:
+		{
+			uint8_t value = m65_mem_read(mem, addr);
+			cpu->flags = (cpu->flags & 0x3D) | (value & 0xC0) | ((cpu->a & value) == 0) << 1;
+			break;
+		}
+
+		// stx, sty, stz
+		case 0x86: case 0x96: case 0x8E:
+			m65_mem_write(mem, addr, cpu->x);
+			break;
+		case 0x84: case 0x94: case 0x8C:
+			m65_mem_write(mem, addr, cpu->y);
+			break;
+		case 0x64: case 0x74: case 0x9C: case 0x9E:
+			m65_mem_write(mem, addr, 0);
+			break;
+
+		// ldx, ldy, cpx, cpy
+		case 0xA2: case 0xA6: case 0xB6: case 0xAE: case 0xBE:
+			cpu->x = m65_nz(cpu, m65_mem_read(mem, addr));
+			break;
+		case 0xA0: case 0xA4: case 0xB4: case 0xAC: case 0xBC:
+			cpu->y = m65_nz(cpu, m65_mem_read(mem, addr));
+			break;
+		case 0xE0: case 0xE4: case 0xEC:
+			m65_compare(cpu, cpu->x, m65_mem_read(mem, addr));
+			break;
+		case 0xC0: case 0xC4: case 0xCC:
+			m65_compare(cpu, cpu->y, m65_mem_read(mem, addr));
+			break;
+
+		// inc, dec
+		case 0xE6: case 0xF6: case 0xEE: case 0xFE:
+			m65_mem_write(mem, addr, m65_nz(cpu, m65_mem_read(mem, addr) + 1));
+			break;
+		case 0xC6: case 0xD6: case 0xCE: case 0xDE:
+			m65_mem_write(mem, addr, m65_nz(cpu, m65_mem_read(mem, addr) - 1));
+			break;
+
+		// Branches (bra always branches)
+		case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0: case 0x80:
+			taken = op == 0x80 || (bool) (cpu->flags & flags[op >> 6]) == (bool) (op & 0x20);
+			if (cpu->coverage != NULL)
+				m65_cover_branch(cpu->coverage, pc, taken);
+			if (taken)
+				next = addr;
+			break;
+
+		// jmp, jsr, rts, rti, brk
+		case 0x4C:
+			next = addr;
+			break;
+		case 0x6C:
+		{
+			// The NMOS chips don't carry into the high byte
+			uint16_t high_addr = jmp_bug && (addr & 0xff) == 0xff ? addr & 0xff00 : addr + 1;
+			next = m65_mem_read(mem, addr) | m65_mem_read(mem, high_addr) << 8;
+			break;
+		}
+		case 0x20:
+			m65_push(cpu, mem, (pc + 2) >> 8);
+			m65_push(cpu, mem, (pc + 2) & 0xff);
+			next = addr;
+			break;
+		case 0x60:
+			next = m65_pull(cpu, mem);
+			next = (next | m65_pull(cpu, mem) << 8) + 1;
+			break;
+		case 0x40:
+			cpu->flags = (m65_pull(cpu, mem) & 0xCF) | (cpu->flags & 0x30);
+			next = m65_pull(cpu, mem);
+			next |= m65_pull(cpu, mem) << 8;
+			break;
+		case 0x00:
+			next = m65_interrupt(cpu, mem, pc, int_cld);
+			break;
+
+		// Stack
+		case 0x48:
+			m65_push(cpu, mem, cpu->a);
+			break;
+		case 0x08:
+			m65_push(cpu, mem, cpu->flags | 0x30);
+			break;
+		case 0xDA:
+			m65_push(cpu, mem, cpu->x);
+			break;
+		case 0x5A:
+			m65_push(cpu, mem, cpu->y);
+			break;
+		case 0x68:
+			cpu->a = m65_nz(cpu, m65_pull(cpu, mem));
+			break;
+		case 0x28:
+			cpu->flags = (m65_pull(cpu, mem) & 0xCF) | (cpu->flags & 0x30);
+			break;
+		case 0xFA:
+			cpu->x = m65_nz(cpu, m65_pull(cpu, mem));
+			break;
+		case 0x7A:
+			cpu->y = m65_nz(cpu, m65_pull(cpu, mem));
+			break;
+
+		// Flags
+		case 0x18: cpu->flags &= 0xFE; break;
+		case 0x38: cpu->flags |= 0x01; break;
+		case 0x58: cpu->flags &= 0xFB; break;
+		case 0x78: cpu->flags |= 0x04; break;
+		case 0xB8: cpu->flags &= 0xBF; break;
+		case 0xD8: cpu->flags &= 0xF7; break;
+		case 0xF8: cpu->flags |= 0x08; break;
+
+		// Registers
+		case 0xE8: cpu->x = m65_nz(cpu, cpu->x + 1); break;
+		case 0xCA: cpu->x = m65_nz(cpu, cpu->x - 1); break;
+		case 0xC8: cpu->y = m65_nz(cpu, cpu->y + 1); break;
+		case 0x88: cpu->y = m65_nz(cpu, cpu->y - 1); break;
+		case 0x1A: cpu->a = m65_nz(cpu, cpu->a + 1); break;
+		case 0x3A: cpu->a = m65_nz(cpu, cpu->a - 1); break;
+		case 0xAA: cpu->x = m65_nz(cpu, cpu->a); break;
+		case 0x8A: cpu->a = m65_nz(cpu, cpu->x); break;
+		case 0xA8: cpu->y = m65_nz(cpu, cpu->a); break;
+		case 0x98: cpu->a = m65_nz(cpu, cpu->y); break;
+		case 0xBA: cpu->x = m65_nz(cpu, cpu->s); break;
+		case 0x9A: cpu->s = cpu->x; break;
+
+		// nop
+		default:
+			break;
+	}
+
+	// The interrupt lines were polled on the second to last cycle, before cli, sei and plp changed the I flag
+	uint8_t cycles = m65_op_cycles(info, base, addr, taken, old & 0x08);
+	m65_boundary(cpu, next, cycles, op == 0x28 || op == 0x58 || op == 0x78 ? old : cpu->flags);
+	return cycles;
+}
+
+#endif /* EXEC_H */
@@ -6,11 +6,11 @@
 // Created on June 15 2020.
 //
 
-#include <stdio.h>
-
-
 #include <stdlib.h>
 
+#include "addressing.h"
+#include "alu.h"
+#include "coverage.h"
 #include "instructions.h"
 
 // Adds or subtracts the accumulator with carry.
@@ -32,42 +32,34 @@
 // - F9 - sbc $absolute, y
 // - E1 - sbc ($zero page, x)
 // - F1 - sbc ($zero page), y
-#define m65_instr___c(mem, inv)																						\
-bool m65_instr_##mem (m6502_t* cpu)																					\
-{																													\
-	switch (cpu->ipc)																								\
-	{																												\
-		case 0:																										\
-			/* cycle 1 - get value */																				\
-			return false;																							\
-		case 1:																										\
-			/* cycle 2 - add or subtract accumulator and fetch */													\
-			if (cpu->flags & 0x08)																					\
-			{																										\
-				/* Decimal mode */																					\
-				puts("decimal mode uhoh");																			\
-			} else																									\
-			{																										\
-				/* Binary mode */																					\
-				cpu->alu.b = inv cpu->pins.data;																	\
-				cpu->alu.c = cpu->a + cpu->alu.b + (cpu->flags & 1);												\
-			}																										\
-																													\
-			/* Update flags */																						\
-			cpu->flags = (cpu->flags & 0x3C)																		\
-					   | (cpu->alu.c & 0x80)																		\
-					   | ((cpu->a & 0x80) == (cpu->alu.b & 0x80) && (cpu->a & 0x80) != (cpu->alu.c & 0x80)) << 6	\
-					   | (cpu->alu.c == 0) << 1																		\
-					   | (cpu->a > cpu->alu.c || cpu->alu.b > cpu->alu.c);											\
-			cpu->a = cpu->alu.c;																					\
-		default:																									\
-			return true;																							\
-	}																												\
+#define m65_instr___c(mem, v)												\
+bool m65_instr_##mem##_##v (m6502_t* cpu)									\
+{																			\
+	switch (cpu->ipc)														\
+	{																		\
+		case 0:																\
+			/* cycle 1 - get value */										\
+			return false;													\
+		case 1:																\
+			/* cycle 2 - add or subtract accumulator */						\
+			m65_alu_##mem(cpu, cpu->pins.data, M65_TRAIT(BCD, v));			\
+																			\
+			/* The 65C02 takes an extra cycle in decimal mode */			\
+			if (M65_TRAIT(BCD, v) == M65_BCD_CMOS && (cpu->flags & 0x08))	\
+				return false;												\
+		default:															\
+			/* cycle 3 - fetch */											\
+			return true;													\
+	}																		\
 }
 
-m65_instr___c(adc,  )
-m65_instr___c(sbc, ~)
+#define m65_instrs___c(v)	\
+m65_instr___c(adc, v)		\
+m65_instr___c(sbc, v)
+
+m65_variants_(m65_instrs___c)
 
+#undef m65_instrs___c
 #undef m65_instr___c
 
 // Does a logic operation (and, or, xor) to the accumulator.
@@ -140,8 +132,8 @@ bool m65_instr_bit(m6502_t* cpu)
 		case 1:
 			cpu->alu.c = cpu->a & cpu->pins.data;
 			cpu->flags = (cpu->flags & 0x3D)
-					   | (cpu->alu.c & 0x80)
-					   | (cpu->alu.c & 0x40)
+					   | (cpu->pins.data & 0x80)
+					   | (cpu->pins.data & 0x40)
 					   | (cpu->alu.c == 0) << 1;
 		default:
 			return true;
@@ -160,6 +152,7 @@ bool m65_instr_bit(m6502_t* cpu)
 // - B0 - bcs rel
 // - D0 - bne rel
 // - F0 - beq rel
+// - 80 - bra rel (65C02 only)
 bool m65_instr_bra(m6502_t* cpu)
 {
 	//							  N		  V		  C		  Z
@@ -173,9 +166,12 @@ bool m65_instr_bra(m6502_t* cpu)
 			cpu->pins.rw = READ;
 			cpu->pins.addr = cpu->pc++;
 
-			// Test the flag
+			// Test the flag (bra always branches)
 			uint8_t flag = flags[(cpu->ir & 0xC0) >> 6];
-			if ((bool)(cpu->flags & flag) != (bool) (cpu->ir & 0x20))
+			bool taken = cpu->ir == 0x80 || (bool)(cpu->flags & flag) == (bool) (cpu->ir & 0x20);
+			if (cpu->coverage != NULL)
+				m65_cover_branch(cpu->coverage, cpu->pins.addr - 1, taken);
+			if (!taken)
 				cpu->ipc = 2;
 			return false;
 		
@@ -205,70 +201,79 @@ bool m65_instr_bra(m6502_t* cpu)
 // Time: 7 cycles
 // Implemented opcode:
 // - 00 - brk
-bool m65_instr_brk(m6502_t* cpu)
-{
-	switch (cpu->ipc)
-	{
-		// cycle 1 - increment program counter
-		case 0:
-			if (cpu->int_brk)
-				cpu->pc++;
-			return false;
-
-		// cycle 2 - push high byte of program counter
-		case 1:
-			cpu->pins.rw = cpu->int_rw;
-			cpu->pins.addr = 0x0100 | cpu->s--;
-			cpu->pins.data = (cpu->pc & 0xff00) >> 8;
-			return false;
-
-		// cycle 3 - push low byte of program counter
-		case 2:
-			cpu->pins.rw = cpu->int_rw;
-			cpu->pins.addr = 0x0100 | cpu->s--;
-			cpu->pins.data = cpu->pc & 0xff;
-			return false;
-
-		// cycle 4 - push processor flags
-		case 3:
-			cpu->pins.rw = cpu->int_rw;
-			cpu->pins.addr = 0x0100 | cpu->s--;
-			cpu->pins.data = cpu->flags;
-
-			// Adjust break flag in stack
-			if (cpu->int_brk)
-				cpu->pins.data |= 0x10;
-			else cpu->pins.data &= 0xEF;
-			return false;
-
-		// cycle 5 - read low byte of program counter
-		case 4:
-			cpu->pins.addr = cpu->int_vec;
-
-			// Adjust interrupt flag post push
-			if (cpu->int_dsi)
-				cpu->flags |= 0x04;
-			else cpu->flags &= 0xFD;
-			return false;
-
-		// cycle 6 - read high byte of program counter
-		case 5:
-			cpu->addr_buf = cpu->pins.data;
-			cpu->pins.addr++;
-			return false;
+#define m65_instr_brk_(v)									\
+bool m65_instr_brk_##v (m6502_t* cpu)						\
+{															\
+	switch (cpu->ipc)										\
+	{														\
+		/* cycle 1 - increment program counter */			\
+		case 0:												\
+			if (cpu->int_brk)								\
+				cpu->pc++;									\
+			return false;									\
+															\
+		/* cycle 2 - push high byte of program counter */	\
+		case 1:												\
+			cpu->pins.rw = cpu->int_rw;						\
+			cpu->pins.addr = 0x0100 | cpu->s--;				\
+			cpu->pins.data = (cpu->pc & 0xff00) >> 8;		\
+			return false;									\
+															\
+		/* cycle 3 - push low byte of program counter */	\
+		case 2:												\
+			cpu->pins.rw = cpu->int_rw;						\
+			cpu->pins.addr = 0x0100 | cpu->s--;				\
+			cpu->pins.data = cpu->pc & 0xff;				\
+			return false;									\
+															\
+		/* cycle 4 - push processor flags */				\
+		case 3:												\
+			cpu->pins.rw = cpu->int_rw;						\
+			cpu->pins.addr = 0x0100 | cpu->s--;				\
+			cpu->pins.data = cpu->flags;					\
+															\
+			/* Adjust break flag in stack */				\
+			if (cpu->int_brk)								\
+				cpu->pins.data |= 0x10;						\
+			else cpu->pins.data &= 0xEF;					\
+			return false;									\
+															\
+		/* cycle 5 - read low byte of program counter */	\
+		case 4:												\
+			cpu->pins.addr = cpu->int_vec;					\
+															\
+			/* Adjust interrupt flag post push */			\
+			if (cpu->int_dsi)								\
+				cpu->flags |= 0x04;							\
+			else cpu->flags &= 0xFB;						\
+															\
+			/* The 65C02 also leaves decimal mode */		\
+			if (M65_TRAIT(INT_CLD, v))						\
+				cpu->flags &= 0xF7;							\
+			return false;									\
+															\
+		/* cycle 6 - read high byte of program counter */	\
+		case 5:												\
+			cpu->addr_buf = cpu->pins.data;					\
+			cpu->pins.addr++;								\
+			return false;									\
+															\
+		/* cycle 7 - reset interrupt config and fetch */	\
+		case 6:												\
+			cpu->int_rw = WRITE;							\
+			cpu->int_brk = true;							\
+			cpu->int_dsi = true;							\
+			cpu->int_vec = 0xFFFE;							\
+			cpu->pc = cpu->pins.data << 8 | cpu->addr_buf;	\
+															\
+		default:											\
+			return true;									\
+	}														\
+}
 
-		// cycle 7 - reset interrupt config and fetch
-		case 6:
-			cpu->int_rw = WRITE;
-			cpu->int_brk = true;
-			cpu->int_dsi = false;
-			cpu->int_vec = 0xFFFE;
-			cpu->pc = cpu->pins.data << 8 | cpu->addr_buf;
+m65_variants_(m65_instr_brk_)
 
-		default:
-			return true;
-	}
-}
+#undef m65_instr_brk_
 
 // Compares the value of a register to another value.
 // Implemented opcodes:
@@ -288,27 +293,27 @@ bool m65_instr_brk(m6502_t* cpu)
 // - C0 - cpy #immediate
 // - C4 - cpy $zero page
 // - CC - cpy $absolute
-#define m65_instr_cmp_reg(mem, reg)												\
-bool m65_instr_##mem(m6502_t* cpu)											\
-{																			\
-	switch (cpu->ipc)														\
-	{																		\
-		/* cycle 1 - get value */											\
-		case 0:																\
-			return false;													\
-																			\
-		/* cycle 2 - compare the register to the value */					\
-		case 1:																\
-			cpu->alu.a = cpu->a;											\
-			cpu->alu.b = cpu->pins.data;									\
-			cpu->alu.c = cpu->alu.a - cpu->alu.c;							\
-			cpu->flags = (cpu->flags & 0x7C)								\
-					   | (cpu->alu.c & 0x80)								\
-					   | (cpu->alu.c == 0) << 1								\
-					   | (cpu->a > cpu->alu.c || cpu->alu.b > cpu->alu.c);	\
-		default:															\
-			return true;													\
-	}																		\
+#define m65_instr_cmp_reg(mem, reg)							\
+bool m65_instr_##mem(m6502_t* cpu)							\
+{															\
+	switch (cpu->ipc)										\
+	{														\
+		/* cycle 1 - get value */							\
+		case 0:												\
+			return false;									\
+															\
+		/* cycle 2 - compare the register to the value */	\
+		case 1:												\
+			cpu->alu.a = cpu->reg;							\
+			cpu->alu.b = cpu->pins.data;					\
+			cpu->alu.c = cpu->alu.a - cpu->alu.b;			\
+			cpu->flags = (cpu->flags & 0x7C)				\
+					   | (cpu->alu.c & 0x80)				\
+					   | (cpu->alu.c == 0) << 1				\
+					   | (cpu->alu.a >= cpu->alu.b);		\
+		default:											\
+			return true;									\
+	}														\
 }
 
 m65_instr_cmp_reg(cmp, a)
@@ -364,28 +369,27 @@ m65_instr_idm(dec, -)
 // - CA - dex
 // - C8 - iny
 // - 88 - dey
+// - 1A - inc a (65C02 only)
+// - 3A - dec a (65C02 only)
 #define m65_instr_idr(mnem, reg, op)															\
 bool m65_instr_##mnem (m6502_t* cpu)															\
 {																								\
-	switch (cpu->ipc)																			\
+	/* cycle 2 (after implied addressing) - increment or decrement the register and fetch */	\
+	if (cpu->ipc == 0)																			\
 	{																							\
-		/* cycle 1 - do nothing */																\
-		case 0:																					\
-			return false;																		\
-																								\
-		/* cycle 2 - increment or decrement the register */										\
-		case 1:																					\
-			cpu->reg op;																		\
-			cpu->flags = (cpu->flags & 0x7D) | (cpu->reg & 0x80) << 7 | (cpu->reg == 0) << 1;	\
-		default:																				\
-			return true;																		\
+		cpu->reg op;																			\
+		cpu->flags = (cpu->flags & 0x7D) | (cpu->reg & 0x80) | (cpu->reg == 0) << 1;			\
 	}																							\
+																								\
+	return true;																				\
 }
 
 m65_instr_idr(inx, x, ++)
 m65_instr_idr(dex, x, --)
 m65_instr_idr(iny, y, ++)
 m65_instr_idr(dey, y, --)
+m65_instr_idr(ina, a, ++)
+m65_instr_idr(dea, a, --)
 
 #undef m65_instr_idr
 
@@ -421,50 +425,63 @@ bool m65_instr_jpa(m6502_t* cpu)
 
 // Jumps to an address.
 // Length: 3 bytes / 1.5 words
-// Time: 5 cycles
+// Time: 5 cycles (6 on the 65C02)
 // Implemented opcode:
 // - 6C - jmp ($absolute)
-bool m65_instr_jpi(m6502_t* cpu)
-{
-	switch(cpu->ipc)
-	{
-		// cycle 1 - read low byte of address
-		case 0:
-			cpu->pins.rw = READ;
-			cpu->pins.addr = cpu->pc++;
-			return false;
-
-		// cycle 2 - read high byte of address
-		case 1:
-			cpu->addr_buf = cpu->pins.data;
-			cpu->pins.rw = READ;
-			cpu->pins.addr = cpu->pc++;
-			return false;
-
-		// cycle 3 - read low byte of location
-		case 2:
-			cpu->pins.rw = READ;
-			cpu->pins.addr = cpu->pins.data << 8 | cpu->addr_buf;
-			return false;
-
-		// cycle 4 - read high byte of location
-		case 3:
-			cpu->addr_buf = cpu->pins.data;
-			cpu->pins.rw = READ;
+#define m65_instr_jpi_(v)													\
+bool m65_instr_jpi_##v (m6502_t* cpu)										\
+{																			\
+	switch(cpu->ipc)														\
+	{																		\
+		/* cycle 1 - read low byte of address */							\
+		case 0:																\
+			cpu->pins.rw = READ;											\
+			cpu->pins.addr = cpu->pc++;										\
+			return false;													\
+																			\
+		/* cycle 2 - read high byte of address */							\
+		case 1:																\
+			cpu->addr_buf = cpu->pins.data;									\
+			cpu->pins.rw = READ;											\
+			cpu->pins.addr = cpu->pc++;										\
+			return false;													\
+																			\
+		/* cycle 3 - read low byte of location */							\
+		case 2:																\
+			cpu->pins.rw = READ;											\
+			cpu->pins.addr = cpu->pins.data << 8 | cpu->addr_buf;			\
+			return false;													\
+																			\
+		/* cycle 4 - read high byte of location */							\
+		case 3:																\
+			cpu->addr_buf = cpu->pins.data;									\
+			cpu->pins.rw = READ;											\
+																			\
+			/* The NMOS chips don't carry into the high byte */				\
+			if (M65_TRAIT(JMP_BUG, v) && (cpu->pins.addr & 0xff) == 0xff)	\
+				cpu->pins.addr &= 0xff00;									\
+			else cpu->pins.addr++;											\
+																			\
+			/* The 65C02 fixes the bug with an extra cycle */				\
+			if (M65_TRAIT(JMP_BUG, v))										\
+				cpu->ipc++;													\
+			return false;													\
+																			\
+		/* cycle 4.5 - reread the high byte on the 65C02 */					\
+		case 4:																\
+			return false;													\
+																			\
+		/* cycle 5 - set program counter (ie, jump to location) */			\
+		case 5:																\
+			cpu->pc = cpu->pins.data << 8 | cpu->addr_buf;					\
+		default:															\
+			return true;													\
+	}																		\
+}
 
-			// This instruction doesn't update the high byte when crossing a page boundary.
-			if ((cpu->pins.addr & 0xff) == 0xff)
-				cpu->pins.addr &= 0xff00;
-			else cpu->pins.addr++;
-			return false;
+m65_variants_(m65_instr_jpi_)
 
-		// cycle 5 - set program counter (ie, jump to location)
-		case 4:
-			cpu->pc = cpu->pins.data << 8 | cpu->addr_buf;
-		default:
-			return true;
-	}
-}
+#undef m65_instr_jpi_
 
 // Calls a subroutine
 // Length: 3 bytes / 1.5 words
@@ -539,23 +556,23 @@ bool m65_instr_jsr(m6502_t* cpu)
 // - B4 - ldy $zero page, X
 // - AC - ldy $absolute
 // - BC - ldy $absolute, X
-#define m65_instr_ld_(reg)																		\
-bool m65_instr_ld##reg (m6502_t* cpu)															\
-{																								\
-	switch (cpu->ipc)																			\
-	{																							\
-		/* cycle 1 - read value	*/ 																\
-		case 0:																					\
-			cpu->pins.rw = READ;																\
-			return false;																		\
-																								\
-		/* cycle 2 - store in register, update flags, and fetch next instruction */				\
-		case 1:																					\
-			cpu->reg = cpu->pins.data;															\
-			cpu->flags = (cpu->flags & 0x7D) | (cpu->reg & 0x80) << 7 | (cpu->reg == 0) << 1;	\
-		default:																				\
-			return true;																		\
-	}																							\
+#define m65_instr_ld_(reg)																	\
+bool m65_instr_ld##reg (m6502_t* cpu)														\
+{																							\
+	switch (cpu->ipc)																		\
+	{																						\
+		/* cycle 1 - read value	*/															\
+		case 0:																				\
+			cpu->pins.rw = READ;															\
+			return false;																	\
+																							\
+		/* cycle 2 - store in register, update flags, and fetch next instruction */			\
+		case 1:																				\
+			cpu->reg = cpu->pins.data;														\
+			cpu->flags = (cpu->flags & 0x7D) | (cpu->reg & 0x80) | (cpu->reg == 0) << 1;	\
+		default:																			\
+			return true;																	\
+	}																						\
 }
 
 m65_instr_ld_(a)
@@ -564,19 +581,14 @@ m65_instr_ld_(y)
 
 #undef m65_instr_ld_
 
-// Does nothing, skipping the next byte in memory.
-// Length: 2 bytes / 1 word
+// Does nothing.
+// Length: 1 byte
 // Time: 2 cycles
 // Implemented opcode:
 // - EA - nop
 bool m65_instr_nop(m6502_t* cpu)
 {
-	if (cpu->ipc == 0)
-	{
-		cpu->pc++;
-		return false;
-	}
-
+	// cycle 2 (after implied addressing) - fetch
 	return true;
 }
 
@@ -586,6 +598,8 @@ bool m65_instr_nop(m6502_t* cpu)
 // Implemented opcodes:
 // - 48 - pha
 // - 08 - php
+// - DA - phx (65C02 only)
+// - 5A - phy (65C02 only)
 #define m65_instr_ph_(mnem, reg)									\
 bool m65_instr_ph##mnem (m6502_t* cpu)								\
 {																	\
@@ -607,7 +621,9 @@ bool m65_instr_ph##mnem (m6502_t* cpu)								\
 }
 
 m65_instr_ph_(a, a)
-m65_instr_ph_(p, flags)
+m65_instr_ph_(p, flags | 0x30)
+m65_instr_ph_(x, x)
+m65_instr_ph_(y, y)
 
 #undef m65_instr_ph_
 
@@ -616,36 +632,67 @@ m65_instr_ph_(p, flags)
 // Time: 4 cycles
 // Implemented opcodes:
 // - 68 - pla
-// - 28 - plp
-#define m65_instr_pl_(mnem, reg)							\
-bool m65_instr_pl##mnem (m6502_t* cpu)						\
-{															\
-	switch (cpu->ipc)										\
-	{														\
-		/* cycle 1 - increment stack pointer */				\
-		case 0:												\
-			cpu->s++;										\
-			return false;									\
-															\
-		/* cycle 2 - load value on the top of the stack */	\
-		case 1:												\
-			cpu->pins.rw = READ;							\
-			cpu->pins.addr = 0x0100 | cpu->s;				\
-			return false;									\
-															\
-		/* cycle 3 - store tos in register and fetch */		\
-		case 2:												\
-			cpu->reg = cpu->pins.data;						\
-		default:											\
-			return true;									\
-	}														\
+// - FA - plx (65C02 only)
+// - 7A - ply (65C02 only)
+#define m65_instr_pl_(mnem, reg)															\
+bool m65_instr_pl##mnem (m6502_t* cpu)														\
+{																							\
+	switch (cpu->ipc)																		\
+	{																						\
+		/* cycle 1 - increment stack pointer */												\
+		case 0:																				\
+			cpu->s++;																		\
+			return false;																	\
+																							\
+		/* cycle 2 - load value on the top of the stack */									\
+		case 1:																				\
+			cpu->pins.rw = READ;															\
+			cpu->pins.addr = 0x0100 | cpu->s;												\
+			return false;																	\
+																							\
+		/* cycle 3 - store tos in register, update flags, and fetch */						\
+		case 2:																				\
+			cpu->reg = cpu->pins.data;														\
+			cpu->flags = (cpu->flags & 0x7D) | (cpu->reg & 0x80) | (cpu->reg == 0) << 1;	\
+		default:																			\
+			return true;																	\
+	}																						\
 }
 
 m65_instr_pl_(a, a)
-m65_instr_pl_(p, flags)
+m65_instr_pl_(x, x)
+m65_instr_pl_(y, y)
 
 #undef m65_instr_pl_
 
+// Pops (pulls?) the processor flags from the stack. Bits 4 and 5 aren't real flags and are left alone.
+// Length: 1 byte
+// Time: 4 cycles
+// Implemented opcode:
+// - 28 - plp
+bool m65_instr_plp(m6502_t* cpu)
+{
+	switch (cpu->ipc)
+	{
+		// cycle 1 - increment stack pointer
+		case 0:
+			cpu->s++;
+			return false;
+
+		// cycle 2 - load value on the top of the stack
+		case 1:
+			cpu->pins.rw = READ;
+			cpu->pins.addr = 0x0100 | cpu->s;
+			return false;
+
+		// cycle 3 - store tos in the flags and fetch
+		case 2:
+			cpu->flags = (cpu->pins.data & 0xCF) | (cpu->flags & 0x30);
+		default:
+			return true;
+	}
+}
+
 // Returns from an interrupt.
 // Length: 1 byte
 // Time: 6 cycles
@@ -661,9 +708,9 @@ bool m65_instr_rti(m6502_t* cpu)
 			cpu->pins.addr = 0x0100 | ++cpu->s;
 			return false;
 
-		// cycle 2 - increment stack pointer
+		// cycle 2 - increment stack pointer (bits 4 and 5 aren't real flags and can't be pulled)
 		case 1:
-			cpu->flags = cpu->pins.data;
+			cpu->flags = (cpu->pins.data & 0xCF) | (cpu->flags & 0x30);
 			cpu->s++;
 			return false;
 
@@ -740,7 +787,7 @@ bool m65_instr_rts(m6502_t* cpu)
 }
 
 // Stores the accumulator in memory.
-// Note: The extra page boundary cycles for sta is always executed in the real 6502, but I'm too lazy to implement it here xD.
+// Note: Indexed stores always take the page boundary cycle; the decoder gives them the *_w addressing modes for that.
 // Implemented opcodes are:
 // - 85 - sta $zero page
 // - 95 - sta $zero page, X
@@ -782,6 +829,29 @@ m65_instr_st_(y)
 
 #undef m65_instr_st_
 
+// Stores zero in memory.
+// Implemented opcodes (65C02 only):
+// - 64 - stz $zero page
+// - 74 - stz $zero page, X
+// - 9C - stz $absolute
+// - 9E - stz $absolute, X
+bool m65_instr_stz(m6502_t* cpu)
+{
+	switch (cpu->ipc)
+	{
+		// cycle 1 - write zero to memory
+		case 0:
+			cpu->pins.rw = WRITE;
+			cpu->pins.data = 0;
+			return false;
+
+		// cycle 2 - fetch
+		case 1:
+		default:
+			return true;
+	}
+}
+
 // Sets or clears a processor state flag.
 // Implemented opcodes are:
 // - 18 - clc 0001
@@ -818,24 +888,18 @@ bool m65_instr_scf(m6502_t* cpu)
 // - 8a - txa
 // - A8 - tay
 // - 98 - tya
-// - 9A - txs
 // - BA - tsx
-#define m65_instr_t__(rf, rt)																\
-bool m65_instr_t##rf##rt (m6502_t* cpu)														\
-{																							\
-	switch (cpu->ipc)																		\
-	{																						\
-		/* cycle 1 - read the next byte */													\
-		case 0:																				\
-			return false;																	\
-																							\
-		/* cycle 2 - move rf to rt */														\
-		case 1:																				\
-			cpu->rt = cpu->rf;																\
-			cpu->flags = (cpu->flags & 0x7D) | (cpu->rt & 0x80) << 7 | (cpu->rt == 0) << 1;	\
-		default:																			\
-			return true;																	\
-	}																						\
+#define m65_instr_t__(rf, rt)														\
+bool m65_instr_t##rf##rt (m6502_t* cpu)												\
+{																					\
+	/* cycle 2 (after implied addressing) - move rf to rt and fetch */				\
+	if (cpu->ipc == 0)																\
+	{																				\
+		cpu->rt = cpu->rf;															\
+		cpu->flags = (cpu->flags & 0x7D) | (cpu->rt & 0x80) | (cpu->rt == 0) << 1;	\
+	}																				\
+																					\
+	return true;																	\
 }
 
 m65_instr_t__(a, x);
@@ -843,26 +907,42 @@ m65_instr_t__(x, a);
 m65_instr_t__(a, y);
 m65_instr_t__(y, a);
 m65_instr_t__(s, x);
-m65_instr_t__(x, s);
 
 #undef m65_instr_t__
 
-// The jump table for all implemented regular instructions.
-const instr_fn instructions[3][8] = {
-	{
-		NULL		 , m65_instr_bit, m65_instr_jpa, m65_instr_jpi,
-		m65_instr_sty, m65_instr_ldy, m65_instr_cpy, m65_instr_cpx
-	},
-	{
-		m65_instr_ora, m65_instr_and, m65_instr_xor, m65_instr_adc,
-		m65_instr_sta, m65_instr_lda, m65_instr_cmp, m65_instr_sbc
-	},
-	{
-		NULL		 , NULL			, NULL		   , NULL,
-		m65_instr_stx, m65_instr_ldx, m65_instr_dec, m65_instr_inc
-	}
+// Transfers the x register into the stack pointer. Unlike the other transfers, it doesn't affect the flags.
+// Implemented opcode:
+// - 9A - txs
+bool m65_instr_txs(m6502_t* cpu)
+{
+	// cycle 2 (after implied addressing) - move x to s and fetch
+	if (cpu->ipc == 0)
+		cpu->s = cpu->x;
+
+	return true;
+}
+
+// The jump tables for all implemented regular instructions.
+#define m65_instructions_(v)											\
+const instr_fn instructions_##v[3][8] = {								\
+	{																	\
+		NULL		 , m65_instr_bit, m65_instr_jpa, m65_instr_jpi_##v,	\
+		m65_instr_sty, m65_instr_ldy, m65_instr_cpy, m65_instr_cpx		\
+	},																	\
+	{																	\
+		m65_instr_ora, m65_instr_and, m65_instr_xor, m65_instr_adc_##v,	\
+		m65_instr_sta, m65_instr_lda, m65_instr_cmp, m65_instr_sbc_##v	\
+	},																	\
+	{																	\
+		NULL		 , NULL			, NULL		   , NULL,				\
+		m65_instr_stx, m65_instr_ldx, m65_instr_dec, m65_instr_inc		\
+	}																	\
 };
 
+m65_variants_(m65_instructions_)
+
+#undef m65_instructions_
+
 // The jump table for instructions that end with 8.
 const instr_fn instr_08_f8[16] = {
 	m65_instr_php, m65_instr_scf, m65_instr_plp, m65_instr_scf,
@@ -877,7 +957,38 @@ const instr_fn instr_8a_fa[8] = {
 	m65_instr_dex, NULL			, m65_instr_nop, NULL
 };
 
-// The jump table for opcodes 00, 20, 40, and 60.
-const instr_fn instr_00_60[4] = {
-	m65_instr_brk, m65_instr_jsr, m65_instr_rti, m65_instr_rts
+// The jump tables for opcodes 00, 20, 40, and 60.
+#define m65_instr_00_60_(v)											\
+const instr_fn instr_00_60_##v[4] = {								\
+	m65_instr_brk_##v, m65_instr_jsr, m65_instr_rti, m65_instr_rts	\
+};
+
+m65_variants_(m65_instr_00_60_)
+
+#undef m65_instr_00_60_
+
+// The jump table for opcodes only decoded by the 65C02.
+const m65_op_t instr_65c02[256] = {
+	[0x1A] = {m65_instr_ina, m65_addr_impl},
+	[0x3A] = {m65_instr_dea, m65_addr_impl},
+	[0x5A] = {m65_instr_phy, m65_addr_impl},
+	[0x7A] = {m65_instr_ply, m65_addr_impl},
+	[0xDA] = {m65_instr_phx, m65_addr_impl},
+	[0xFA] = {m65_instr_plx, m65_addr_impl},
+
+	[0x64] = {m65_instr_stz, m65_addr_zp},
+	[0x74] = {m65_instr_stz, m65_addr_zp_x},
+	[0x9C] = {m65_instr_stz, m65_addr_abs},
+	[0x9E] = {m65_instr_stz, m65_addr_abs_x_w},
+
+	[0x80] = {m65_instr_bra, NULL},
+
+	[0x12] = {m65_instr_ora, m65_addr_ind_zp},
+	[0x32] = {m65_instr_and, m65_addr_ind_zp},
+	[0x52] = {m65_instr_xor, m65_addr_ind_zp},
+	[0x72] = {m65_instr_adc_cmos, m65_addr_ind_zp},
+	[0x92] = {m65_instr_sta, m65_addr_ind_zp},
+	[0xB2] = {m65_instr_lda, m65_addr_ind_zp},
+	[0xD2] = {m65_instr_cmp, m65_addr_ind_zp},
+	[0xF2] = {m65_instr_sbc_cmos, m65_addr_ind_zp}
 };
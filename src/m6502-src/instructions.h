@@ -10,9 +10,17 @@
 #define INSTRUCTIONS_H
 
 #include "m6502.h"
+#include "variant.h"
 
-// The jump table for all implemented (regular) instructions.
-extern const instr_fn instructions[3][8];
+// Represents an entry in a jump table of opcodes.
+typedef struct
+{
+	// The instruction function, or NULL if the opcode isn't implemented.
+	instr_fn instr;
+
+	// The addressing mode of the instruction.
+	addr_fn addr_mode;
+} m65_op_t;
 
 // The jump table for instructions that end with an 8.
 extern const instr_fn instr_08_f8[16];
@@ -20,15 +28,29 @@ extern const instr_fn instr_08_f8[16];
 // The jump table for instructions that end with a and are in the upper half of the byte.
 extern const instr_fn instr_8a_fa[8];
 
-// The jump table for opcodes 00, 20, 40, and 60.
-extern const instr_fn instr_00_60[4];
+// The jump table for opcodes only decoded by the 65C02.
+extern const m65_op_t instr_65c02[256];
+
+// The jump tables that depend on the variant and the instructions that the decoder checks for.
+// - instructions_<variant>: all implemented (regular) instructions.
+// - instr_00_60_<variant>: opcodes 00, 20, 40, and 60.
+#define m65_variant_instrs_(v)					\
+extern const instr_fn instructions_##v[3][8];	\
+extern const instr_fn instr_00_60_##v[4];		\
+bool m65_instr_brk_##v(m6502_t* cpu);			\
+bool m65_instr_jpi_##v(m6502_t* cpu);
+
+m65_variants_(m65_variant_instrs_)
+
+#undef m65_variant_instrs_
 
 // Instructions to be exported
-bool m65_instr_brk(m6502_t* cpu);
 bool m65_instr_bra(m6502_t* cpu);
 bool m65_instr_jpa(m6502_t* cpu);
-bool m65_instr_jpi(m6502_t* cpu);
 bool m65_instr_ldx(m6502_t* cpu);
 bool m65_instr_stx(m6502_t* cpu);
+bool m65_instr_sta(m6502_t* cpu);
+bool m65_instr_inc(m6502_t* cpu);
+bool m65_instr_dec(m6502_t* cpu);
 
 #endif /* INSTRUCTIONS_H */
@@ -0,0 +1,422 @@
+//
+// MOS6502 Emulator
+// loader.c: Implements loading ROM images.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loader.h"
+
+// The header of a cached flat image. The pages of the image follow it.
+typedef struct
+{
+	// "M65FLAT2".
+	char magic[8];
+
+	// The size and modification time of the file the image was converted from. The cache is stale once they change.
+	uint64_t source_size;
+	int64_t source_sec;
+	uint32_t source_nsec;
+
+	// The first page of the image, the number of pages in it, and the address of the program.
+	uint16_t first_page;
+	uint16_t pages;
+	uint16_t start;
+
+	uint8_t reserved[6];
+} m65_flat_header_t;
+
+// The first bytes of a cached flat image.
+static const char m65_flat_magic[8] = "M65FLAT2";
+
+// The images that are currently open, so that they can be shared.
+static m65_rom_t* m65_roms = NULL;
+static pthread_mutex_t m65_roms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// m65_has_extension(const char*, const char*) -> bool
+// Returns true if a path ends with an extension (case insensitive).
+static bool m65_has_extension(const char* path, const char* ext)
+{
+	size_t path_len = strlen(path);
+	size_t ext_len = strlen(ext);
+	return path_len >= ext_len && strcasecmp(path + path_len - ext_len, ext) == 0;
+}
+
+// m65_hex_byte(const char*) -> int
+// Parses two hexadecimal digits. Returns -1 if they aren't valid.
+static int m65_hex_byte(const char* text)
+{
+	int value = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		char c = text[i];
+		value <<= 4;
+		if (c >= '0' && c <= '9')
+			value |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			value |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			value |= c - 'A' + 10;
+		else return -1;
+	}
+
+	return value;
+}
+
+// m65_parse_hex(const char*, size_t, uint8_t*, unsigned*, unsigned*) -> bool
+// Parses an Intel HEX file into a 64 KiB image, and stores the lowest and highest address written to.
+static bool m65_parse_hex(const char* text, size_t size, uint8_t* image, unsigned* low, unsigned* high)
+{
+	const char* end = text + size;
+	*low = 0x10000;
+	*high = 0;
+
+	while (text < end)
+	{
+		// Find the start of the next record
+		if (*text != ':')
+		{
+			text++;
+			continue;
+		}
+
+		// Parse the header of the record: count, address, and type
+		if (end - text < 11)
+			return false;
+		int count = m65_hex_byte(text + 1);
+		int addr_hi = m65_hex_byte(text + 3);
+		int addr_lo = m65_hex_byte(text + 5);
+		int type = m65_hex_byte(text + 7);
+		if (count < 0 || addr_hi < 0 || addr_lo < 0 || type < 0 || end - text < 11 + count * 2)
+			return false;
+
+		// Check the checksum
+		uint8_t sum = count + addr_hi + addr_lo + type;
+		for (int i = 0; i <= count; i++)
+		{
+			int byte = m65_hex_byte(text + 9 + i * 2);
+			if (byte < 0)
+				return false;
+			sum += byte;
+		}
+		if (sum != 0)
+			return false;
+
+		switch (type)
+		{
+			// Data
+			case 0x00:
+			{
+				unsigned addr = addr_hi << 8 | addr_lo;
+				for (int i = 0; i < count; i++)
+					image[(addr + i) & 0xffff] = m65_hex_byte(text + 9 + i * 2);
+				if (addr < *low)
+					*low = addr;
+				if (addr + count > *high)
+					*high = addr + count;
+				break;
+			}
+
+			// End of file
+			case 0x01:
+				return *low < *high;
+
+			// Extended addresses only make sense if they stay in the 64 KiB address space
+			case 0x02:
+			case 0x04:
+				if (m65_hex_byte(text + 9) != 0 || m65_hex_byte(text + 11) != 0)
+					return false;
+				break;
+
+			// Start addresses
+			default:
+				break;
+		}
+
+		text += 11 + count * 2;
+	}
+
+	return *low < *high;
+}
+
+// m65_rom_flatten(m65_rom_t*, const char*, const uint8_t*, size_t, const struct stat*) -> bool
+// Converts a .prg or Intel HEX file into a flat, page aligned image and maps it. The image is cached in <path>.flat;
+// if the cache was made from a file of the same size and modification time, it's mapped instead of converting the
+// file again. Files rewritten within the same second still differ in the nanoseconds.
+static bool m65_rom_flatten(m65_rom_t* rom, const char* path, const uint8_t* src, size_t src_size, const struct stat* st)
+{
+	char cache[4096];
+	struct stat cache_st;
+	if (snprintf(cache, sizeof(cache), "%s.flat", path) >= (int) sizeof(cache))
+		return false;
+
+	// Map the cached image if it's up to date
+	int fd = open(cache, O_RDONLY);
+	if (fd >= 0 && fstat(fd, &cache_st) == 0 && (size_t) cache_st.st_size >= sizeof(m65_flat_header_t))
+	{
+		void* map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (map != MAP_FAILED)
+		{
+			const m65_flat_header_t* header = map;
+			if (memcmp(header->magic, m65_flat_magic, sizeof(m65_flat_magic)) == 0
+				&& sizeof(*header) + header->pages * M65_PAGE_SIZE == (size_t) cache_st.st_size
+				&& header->source_size == (uint64_t) st->st_size && header->source_sec == st->st_mtim.tv_sec
+				&& header->source_nsec == st->st_mtim.tv_nsec)
+			{
+				rom->map = map;
+				rom->map_size = cache_st.st_size;
+				rom->data = (const uint8_t*) (header + 1);
+				rom->size = header->pages * M65_PAGE_SIZE;
+				rom->load = header->start;
+				rom->offset = header->start - (header->first_page << 8);
+				return true;
+			}
+			munmap(map, cache_st.st_size);
+		}
+	} else if (fd >= 0)
+		close(fd);
+
+	// Convert the file into a 64 KiB image
+	uint8_t* image = calloc(1, 0x10000);
+	unsigned low, high;
+	if (image == NULL)
+		return false;
+
+	if (rom->format == M65_ROM_PRG)
+	{
+		if (src_size < 3)
+		{
+			free(image);
+			return false;
+		}
+
+		low = src[0] | src[1] << 8;
+		high = low + src_size - 2;
+		if (high > 0x10000)
+			high = 0x10000;
+		memcpy(image + low, src + 2, high - low);
+	} else if (!m65_parse_hex((const char*) src, src_size, image, &low, &high))
+	{
+		free(image);
+		return false;
+	}
+
+	// Only keep the pages that contain the image
+	m65_flat_header_t header = {
+		.source_size = st->st_size, .source_sec = st->st_mtim.tv_sec, .source_nsec = st->st_mtim.tv_nsec,
+		.first_page = low >> 8, .pages = ((high + M65_PAGE_SIZE - 1) >> 8) - (low >> 8), .start = low
+	};
+	memcpy(header.magic, m65_flat_magic, sizeof(m65_flat_magic));
+	size_t size = sizeof(header) + header.pages * M65_PAGE_SIZE;
+
+	// Write the cache through a temporary file so that other processes never see half of it
+	char tmp[4096 + 32];
+	snprintf(tmp, sizeof(tmp), "%s.%ld", cache, (long) getpid());
+	fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0)
+	{
+		if (write(fd, &header, sizeof(header)) != sizeof(header)
+			|| write(fd, image + header.first_page * M65_PAGE_SIZE, size - sizeof(header))
+				!= (ssize_t) (size - sizeof(header))
+			|| rename(tmp, cache) != 0)
+		{
+			close(fd);
+			unlink(tmp);
+			fd = -1;
+		}
+	}
+
+	void* map = MAP_FAILED;
+	if (fd >= 0)
+	{
+		map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+	}
+
+	// Keep a private copy if the cache can't be written
+	if (map == MAP_FAILED)
+	{
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED)
+		{
+			free(image);
+			return false;
+		}
+
+		memcpy(map, &header, sizeof(header));
+		memcpy((uint8_t*) map + sizeof(header), image + header.first_page * M65_PAGE_SIZE, size - sizeof(header));
+		mprotect(map, size, PROT_READ);
+	}
+
+	free(image);
+	rom->map = map;
+	rom->map_size = size;
+	rom->data = (const uint8_t*) map + sizeof(header);
+	rom->size = header.pages * M65_PAGE_SIZE;
+	rom->load = header.start;
+	rom->offset = header.start - (header.first_page << 8);
+	return true;
+}
+
+// m65_rom_open(const char*) -> m65_rom_t*
+// Opens a ROM image, detecting its format from its contents and extension.
+m65_rom_t* m65_rom_open(const char* path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	// Share the image if it's already open
+	pthread_mutex_lock(&m65_roms_lock);
+	for (m65_rom_t* rom = m65_roms; rom != NULL; rom = rom->next)
+	{
+		if (rom->dev == st.st_dev && rom->ino == st.st_ino)
+		{
+			rom->refs++;
+			pthread_mutex_unlock(&m65_roms_lock);
+			close(fd);
+			return rom;
+		}
+	}
+
+	m65_rom_t* rom = calloc(1, sizeof(m65_rom_t));
+	uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rom == NULL || map == MAP_FAILED)
+		goto fail;
+
+	rom->dev = st.st_dev;
+	rom->ino = st.st_ino;
+	rom->refs = 1;
+	rom->map = map;
+	rom->map_size = st.st_size;
+
+	// iNES: skip the header and the trainer
+	if (st.st_size >= 16 && memcmp(map, "NES\x1a", 4) == 0)
+	{
+		size_t offset = 16 + (map[6] & 0x04 ? 512 : 0);
+		rom->format = M65_ROM_INES;
+		rom->data = map + offset;
+		rom->size = map[4] * 0x4000;
+		rom->load = 0x8000;
+		rom->mapper = map[6] >> 4 | (map[7] & 0xf0);
+		if (rom->size == 0 || offset + rom->size > (size_t) st.st_size)
+			goto fail;
+
+	// .prg and Intel HEX are converted to a flat image
+	} else if (m65_has_extension(path, ".prg") || m65_has_extension(path, ".hex")
+			|| m65_has_extension(path, ".ihx") || map[0] == ':')
+	{
+		rom->format = m65_has_extension(path, ".prg") ? M65_ROM_PRG : M65_ROM_HEX;
+		rom->map = NULL;
+		bool flattened = m65_rom_flatten(rom, path, map, st.st_size, &st);
+		munmap(map, st.st_size);
+		map = NULL;
+		if (!flattened)
+			goto fail;
+
+	// Raw binaries end at the top of memory
+	} else
+	{
+		rom->format = M65_ROM_RAW;
+		rom->data = map;
+		rom->size = st.st_size;
+		rom->load = rom->size >= 0x10000 ? 0 : 0x10000 - rom->size;
+	}
+
+	rom->next = m65_roms;
+	m65_roms = rom;
+	pthread_mutex_unlock(&m65_roms_lock);
+	return rom;
+
+fail:
+	pthread_mutex_unlock(&m65_roms_lock);
+	if (map != NULL && map != MAP_FAILED)
+		munmap(map, st.st_size);
+	free(rom);
+	return NULL;
+}
+
+// m65_rom_close(m65_rom_t*) -> void
+// Releases a ROM image. It is unmapped once its last user released it.
+void m65_rom_close(m65_rom_t* rom)
+{
+	pthread_mutex_lock(&m65_roms_lock);
+	if (--rom->refs > 0)
+	{
+		pthread_mutex_unlock(&m65_roms_lock);
+		return;
+	}
+
+	for (m65_rom_t** link = &m65_roms; *link != NULL; link = &(*link)->next)
+	{
+		if (*link == rom)
+		{
+			*link = rom->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&m65_roms_lock);
+
+	munmap(rom->map, rom->map_size);
+	free(rom);
+}
+
+// m65_rom_map(m65_mem_t*, const m65_rom_t*) -> void
+// Maps a ROM image read only at its default address.
+void m65_rom_map(m65_mem_t* mem, const m65_rom_t* rom)
+{
+	m65_rom_map_at(mem, rom, rom->load);
+
+	// 16 KiB iNES images are mirrored
+	if (rom->format == M65_ROM_INES && rom->size == 0x4000)
+		m65_rom_map_at(mem, rom, 0xC000);
+}
+
+// m65_rom_map_at(m65_mem_t*, const m65_rom_t*, uint16_t) -> void
+// Maps a ROM image read only so that its program starts at an address.
+void m65_rom_map_at(m65_mem_t* mem, const m65_rom_t* rom, uint16_t addr)
+{
+	// Images that wouldn't start on a page boundary can't be mapped in place
+	unsigned base = addr - rom->offset;
+	if (addr < rom->offset || (base & 0xff))
+	{
+		m65_rom_load_at(mem, rom, addr);
+		return;
+	}
+
+	size_t size = rom->size;
+	if (size > 0x10000 - base)
+		size = 0x10000 - base;
+	m65_mem_map_rom(mem, base >> 8, rom->data, size);
+}
+
+// m65_rom_load_at(m65_mem_t*, const m65_rom_t*, uint16_t) -> void
+// Copies the program of a ROM image into writable memory at an address.
+void m65_rom_load_at(m65_mem_t* mem, const m65_rom_t* rom, uint16_t addr)
+{
+	size_t size = rom->size - rom->offset;
+	if (size > 0x10000 - addr)
+		size = 0x10000 - addr;
+
+	for (size_t i = 0; i < size; i++)
+		m65_mem_write(mem, addr + i, rom->data[rom->offset + i]);
+}
@@ -0,0 +1,96 @@
+//
+// MOS6502 Emulator
+// loader.h: Header file for loader.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "memory.h"
+
+// The image formats the loader understands.
+typedef enum
+{
+	// A raw binary, mapped as is.
+	M65_ROM_RAW,
+
+	// An iNES container; its PRG ROM is mapped in place behind the header.
+	M65_ROM_INES,
+
+	// A .prg file, which starts with its load address.
+	M65_ROM_PRG,
+
+	// An Intel HEX file.
+	M65_ROM_HEX
+} m65_rom_format_t;
+
+// Represents a ROM image mapped into the address space of the emulator. Images are memory mapped read only and
+// shared: opening the same file twice returns the same image, and every memory map it is mapped into points at the
+// same physical pages.
+typedef struct s_m65_rom
+{
+	// The format of the file.
+	m65_rom_format_t format;
+
+	// The image.
+	const uint8_t* data;
+
+	// The size of the image in bytes.
+	size_t size;
+
+	// The address the program is mapped at by default.
+	uint16_t load;
+
+	// Where the program starts in the image. Flat images of .prg and Intel HEX files start on the page boundary
+	// before the program, so this is the low byte of its address for them and 0 otherwise.
+	uint16_t offset;
+
+	// The mapper number of an iNES image (see m65_mapper_find_ines()).
+	uint16_t mapper;
+
+	// The mapping of the file (or its flat image) backing the image.
+	void* map;
+	size_t map_size;
+
+	// The file the image was opened from, used to share it.
+	dev_t dev;
+	ino_t ino;
+
+	// The number of users of the image.
+	unsigned refs;
+
+	// The next open image.
+	struct s_m65_rom* next;
+} m65_rom_t;
+
+// m65_rom_open(const char*) -> m65_rom_t*
+// Opens a ROM image, detecting its format from its contents and extension. .prg and Intel HEX files are converted
+// once into a flat image cached next to them (<path>.flat) that is mapped on later runs, as long as the size and
+// modification time of the file stay the same. Returns NULL on error.
+m65_rom_t* m65_rom_open(const char* path);
+
+// m65_rom_close(m65_rom_t*) -> void
+// Releases a ROM image. It is unmapped once its last user released it.
+void m65_rom_close(m65_rom_t* rom);
+
+// m65_rom_map(m65_mem_t*, const m65_rom_t*) -> void
+// Maps a ROM image read only at its default address. Raw images go at the top of memory so that they contain the
+// vectors, and 16 KiB iNES images are mirrored at 0x8000 and 0xC000.
+void m65_rom_map(m65_mem_t* mem, const m65_rom_t* rom);
+
+// m65_rom_map_at(m65_mem_t*, const m65_rom_t*, uint16_t) -> void
+// Maps a ROM image read only so that its program starts at an address. Images that would start off a page boundary
+// that way are copied into RAM instead.
+void m65_rom_map_at(m65_mem_t* mem, const m65_rom_t* rom, uint16_t addr);
+
+// m65_rom_load_at(m65_mem_t*, const m65_rom_t*, uint16_t) -> void
+// Copies the program of a ROM image into writable memory at an address, for programs that write to their own image.
+void m65_rom_load_at(m65_mem_t* mem, const m65_rom_t* rom, uint16_t addr);
+
+#endif /* LOADER_H */
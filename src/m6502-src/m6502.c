@@ -6,19 +6,151 @@
 // Created on June 8 2020.
 //
 
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
-
-
 #include <stdlib.h>
 
 #include "addressing.h"
+#include "arena.h"
+#include "coverage.h"
 #include "instructions.h"
 #include "m6502.h"
+#include "opcodes.h"
+#include "variant.h"
+
+// Prints what the processor is doing when built with M65_DEBUG.
+#ifdef M65_DEBUG
+#define m65_debug(message) puts(message)
+#else
+#define m65_debug(message)
+#endif
+
+// The registers, instruction state and pins are meant to fit in the first 16 bytes of the state.
+_Static_assert(offsetof(m6502_t, alu) == 16, "the hot state of m6502_t doesn't fit in 16 bytes");
+
+// m65_fetch(m6502_t*) -> void
+// Fetches the next opcode. This is done before executing any code and on the last cycle of an instruction.
+void m65_fetch(m6502_t* cpu)
+{
+	cpu->pins.rw = READ;
+	cpu->pins.addr = cpu->pc++;
+}
+
+// m65_decode_<variant>(uint8_t, m65_op_t*) -> void
+// Decodes an opcode into its instruction and addressing mode. Leaves the entry empty for unimplemented opcodes.
+#define m65_decode_(v)																												\
+static void m65_decode_##v (uint8_t ir, m65_op_t* op)																				\
+{																																	\
+	/* Opcodes added by the 65C02 */																								\
+	if (M65_TRAIT(EXT_OPS, v) && instr_65c02[ir].instr != NULL)																		\
+	{																																\
+		*op = instr_65c02[ir];																										\
+																																	\
+	/* Branches */																													\
+	} else if ((ir & 0x1f) == 0b00010000)																							\
+	{																																\
+		op->instr = m65_instr_bra;																									\
+		op->addr_mode = NULL;																										\
+																																	\
+	/* Stack related jumps */																										\
+	} else if ((ir & 0x9f) == 0x00)																									\
+	{																																\
+		op->instr = instr_00_60_##v[ir >> 5];																						\
+		op->addr_mode = NULL;																										\
+																																	\
+	/* Stuff that ends with 8 */																									\
+	} else if ((ir & 0x0f) == 0x08)																									\
+	{																																\
+		op->instr = instr_08_f8[(ir & 0xf0) >> 4];																					\
+		op->addr_mode = m65_addr_impl;																								\
+																																	\
+	/* Stuff that ends with a in the upper half of the byte */																		\
+	} else if ((ir & 0x8f) == 0x8a)																									\
+	{																																\
+		instr_fn instr = instr_8a_fa[((ir & 0xf0) >> 4) - 0x8];																		\
+																																	\
+		if (instr != NULL)																											\
+		{																															\
+			op->instr = instr;																										\
+			op->addr_mode = m65_addr_impl;																							\
+		}																															\
+																																	\
+	/* Literally everything else */																									\
+	} else																															\
+	{																																\
+		/* Get the instruction and addressing mode */																				\
+		uint8_t sel = ir & 0b11;																									\
+		addr_fn addr_mode = addressing_modes[sel][ir >> 2 & 0b111];																	\
+		instr_fn instr = instructions_##v[sel][ir >> 5];																			\
+																																	\
+		/* Check that the instruction isn't null (unimplemented or illegal opcode) */												\
+		if (instr != NULL)																											\
+		{																															\
+			/* Set the instruction function */																						\
+			op->instr = instr;																										\
+																																	\
+			/* Clear addressing mode function for jmp */																			\
+			if (instr == m65_instr_jpa || instr == m65_instr_jpi_##v)																\
+				op->addr_mode = NULL;																								\
+																																	\
+			/* Adjust addressing modes that use the X register for ldx and stx */													\
+			else if (addr_mode == m65_addr_zp_x && (instr == m65_instr_ldx || instr == m65_instr_stx))								\
+				 op->addr_mode = m65_addr_zp_y;																						\
+			else if (addr_mode == m65_addr_abs_x && instr == m65_instr_ldx)															\
+				 op->addr_mode = m65_addr_abs_y;																					\
+																																	\
+			/* Writes always take the page boundary cycle of indexed addressing */													\
+			else if (addr_mode == m65_addr_abs_x && (instr == m65_instr_sta || instr == m65_instr_inc || instr == m65_instr_dec))	\
+				 op->addr_mode = m65_addr_abs_x_w;																					\
+			else if (addr_mode == m65_addr_abs_y && instr == m65_instr_sta)															\
+				 op->addr_mode = m65_addr_abs_y_w;																					\
+			else if (addr_mode == m65_addr_ind_zp_y && instr == m65_instr_sta)														\
+				 op->addr_mode = m65_addr_ind_zp_y_w;																				\
+			else op->addr_mode = addr_mode;																							\
+		}																															\
+	}																																\
+}
+
+m65_variants_(m65_decode_)
+
+#undef m65_decode_
+
+// The decoded jump tables of each variant, indexed by opcode. m6502_t only stores the opcode and the phase of the
+// current instruction, which select the functions to run from these.
+#define m65_ops_(v) static m65_op_t m65_ops_##v[256];
+m65_variants_(m65_ops_)
+#undef m65_ops_
+
+static pthread_once_t m65_ops_once = PTHREAD_ONCE_INIT;
+
+// m65_build_ops(void) -> void
+// Decodes every opcode of every variant into the jump tables. Opcodes that aren't in the opcode table of the variant
+// (see opcodes.h) are left empty even if the decoder's bit patterns match them, so they jam like other undocumented
+// opcodes.
+static void m65_build_ops(void)
+{
+#define m65_build_ops_(v)									\
+	for (int i = 0; i < 256; i++)							\
+		if (m65_opinfo[M65_TRAIT(ID, v)][i].cycles != 0)	\
+			m65_decode_##v(i, &m65_ops_##v[i]);
+	m65_variants_(m65_build_ops_)
+#undef m65_build_ops_
+}
 
 // init_6502(m6502_t*) -> void
-// Initialises a 6502 processor.
+// Initialises an NMOS 6502 processor.
 void init_6502(m6502_t* cpu)
 {
+	init_6502_variant(cpu, M65_NMOS);
+}
+
+// init_6502_variant(m6502_t*, m65_variant_t) -> void
+// Initialises a processor of the given variant.
+void init_6502_variant(m6502_t* cpu, m65_variant_t variant)
+{
+	pthread_once(&m65_ops_once, m65_build_ops);
+
 	cpu->a = 0;
 	cpu->x = 0;
 	cpu->y = 0;
@@ -31,16 +163,18 @@ void init_6502(m6502_t* cpu)
 	cpu->alu.b = 0;
 	cpu->alu.c = 0;
 
-	cpu->instr = NULL;
-	cpu->addr_mode = NULL;
-
 	cpu->ir = 0;
 	cpu->ipc = 0;
+	cpu->phase = M65_PHASE_FETCH;
 
 	cpu->handle_interrupt = false;
+	cpu->int_poll = false;
+	cpu->int_lines = 0;
+	cpu->int_remote = 0;
+	atomic_init(&cpu->int_async, 0);
 	cpu->int_rw = WRITE;
 	cpu->int_brk = true;
-	cpu->int_dsi = false;
+	cpu->int_dsi = true;
 	cpu->int_vec = 0xFFFE;
 
 	cpu->addr_buf = 0;
@@ -48,134 +182,195 @@ void init_6502(m6502_t* cpu)
 	cpu->pins.addr = 0;
 	cpu->pins.data = 0;
 	cpu->pins.rw = READ;
+
+	cpu->variant = variant;
+	cpu->cycles = 0;
+	cpu->coverage = NULL;
+	cpu->traps = NULL;
+
+#ifdef M65_VERIFY_CYCLES
+	cpu->verify.reads = 0;
+	cpu->verify.errors = 0;
+#endif
 }
 
-// m65_fetch(m6502_t*) -> void
-// Fetches the next opcode. This is done before executing any code and on the last cycle of an instruction.
-void m65_fetch(m6502_t* cpu)
+// m65_cpu_new(m65_arena_t*, m65_variant_t) -> m6502_t*
+// Allocates a processor from an arena and initialises it.
+m6502_t* m65_cpu_new(m65_arena_t* arena, m65_variant_t variant)
 {
-	cpu->pins.rw = READ;
-	cpu->pins.addr = cpu->pc++;
+	m6502_t* cpu = m65_slab_alloc(&arena->cpus);
+	if (cpu != NULL)
+		init_6502_variant(cpu, variant);
+	return cpu;
 }
 
-// m65_decode(m6502_t*) -> void
-// Decodes the next opcode.
-void m65_decode(m6502_t* cpu)
+// m65_cpu_release(m65_arena_t*, m6502_t*) -> void
+// Gives a processor back to its arena.
+void m65_cpu_release(m65_arena_t* arena, m6502_t* cpu)
 {
-	// Transfer data from the input pins into the ir
-	cpu->ir = cpu->pins.data;
-
-	// Branches
-	if ((cpu->ir & 0x1f) == 0b00010000)
-	{
-		cpu->instr = m65_instr_bra;
-		cpu->addr_mode = NULL;
+	if (cpu != NULL)
+		m65_slab_release(&arena->cpus, cpu);
+}
 
-	// Stack related jumps
-	} else if ((cpu->ir & 0x9f) == 0x00)
-	{
-		cpu->instr = instr_00_60[cpu->ir >> 5];
-		cpu->addr_mode = NULL;
+// m65_int_select(m6502_t*) -> void
+// Configures the interrupt sequence for the pending interrupt with the highest priority. Resets configure it themselves.
+void m65_int_select(m6502_t* cpu)
+{
+	if (cpu->int_rw == READ)
+		return;
 
-	// Stuff that ends with 8
-	} else if ((cpu->ir & 0x0f) == 0x08)
-	{
-		cpu->instr = instr_08_f8[(cpu->ir & 0xf0) >> 4];
-		cpu->addr_mode = m65_addr_impl;
+	cpu->int_brk = false;
+	cpu->int_dsi = true;
 
-	// Stuff that ends with a in the upper half of the byte
-	} else if ((cpu->ir & 0x8f) == 0x8a)
+	// NMI has priority over IRQ and is acknowledged by clearing the edge
+	if (cpu->int_lines & M65_NMI_EDGE)
 	{
-		instr_fn instr = instr_8a_fa[((cpu->ir & 0xf0) >> 4) - 0x8];
+		cpu->int_lines &= ~M65_NMI_EDGE;
+		cpu->int_vec = 0xFFFA;
 
-		if (instr != NULL)
-		{
-			cpu->instr = instr;
-			cpu->addr_mode = m65_addr_impl;
-		}
-
-	// Literally everything else
+	// Requests from m65_irq() are dropped once handled; devices release their own lines
 	} else
 	{
-		// Get the instruction and addressing mode
-		uint8_t sel = cpu->ir & 0b11;
-		addr_fn addr_mode = addressing_modes[sel][cpu->ir >> 2 & 0b111];
-		instr_fn instr = instructions[sel][cpu->ir >> 5];
-
-		// Check that the instruction isn't null (unimplemented or illegal opcode)
-		if (instr != NULL)
-		{
-			// Set the instruction function
-			cpu->instr = instr;
-
-			// Clear addressing mode function for jmp
-			if (instr == m65_instr_jpa || instr == m65_instr_jpi)
-				cpu->addr_mode = NULL;
-
-			// Adjust addressing modes that use the X register for ldx and stx
-			else if (addr_mode == m65_addr_zp_x && (instr == m65_instr_ldx || instr == m65_instr_stx))
-				 cpu->addr_mode = m65_addr_zp_y;
-			else if (addr_mode == m65_addr_abs_x && instr == m65_instr_ldx)
-				 cpu->addr_mode = m65_addr_abs_y;
-			else cpu->addr_mode = addr_mode;
-		}
+		cpu->int_lines &= ~(1u << M65_IRQ_HOST);
+		cpu->int_vec = 0xFFFE;
 	}
-
-	// Fetch next instruction if not found
-	// if (cpu->instr == NULL)
-	// 	m65_fetch(cpu);
 }
 
-// m65_cycle(m6502_t*) -> void
-// Executes one cycle of a 6502 processor.
-void m65_cycle(m6502_t* cpu)
+// m65_int_collect(m6502_t*) -> void
+// Takes the interrupt lines and requests of other threads into the processor.
+void m65_int_collect(m6502_t* cpu)
 {
-	// Disable the bus
-	cpu->pins.rw = READ;
+	// Take the requests and the pending bit, and leave the lines, which stay asserted until their devices release them
+	uint64_t async = atomic_fetch_and_explicit(&cpu->int_async, M65_ASYNC_LINES, memory_order_acquire);
+	uint32_t lines = async & M65_ASYNC_LINES;
+	uint32_t old = cpu->int_lines;
+
+	cpu->int_lines = (old & ~cpu->int_remote) | lines;
+	cpu->int_remote = lines;
+	if ((async & M65_ASYNC_NMI) || (!(old & M65_NMI_LINES) && (cpu->int_lines & M65_NMI_LINES)))
+		cpu->int_lines |= M65_NMI_EDGE;
+	if (async & M65_ASYNC_IRQ)
+		cpu->int_lines |= 1u << M65_IRQ_HOST;
+	if (async & M65_ASYNC_RES)
+		m65_res(cpu);
+
+	// Signals from other threads don't arrive on a particular cycle, so they count as polled before this boundary
+	if (m65_int_pending(cpu))
+		cpu->handle_interrupt = true;
+	cpu->int_poll = m65_int_pending(cpu);
+}
 
-	// Decode the opcode if not done already
-	if (cpu->instr == NULL)
-	{
-		// deal with interrupts
-		if (cpu->handle_interrupt)
-		{
-			puts("interrupt request handler activated");
-			cpu->handle_interrupt = false;
-			cpu->ir = 0;
-			cpu->instr = m65_instr_brk;
-			cpu->addr_mode = NULL;
-			cpu->pc--;
-		} else m65_decode(cpu);
-	}
+// Checks each instruction against the timing table when built with M65_VERIFY_CYCLES.
+#ifdef M65_VERIFY_CYCLES
+#define m65_verify_cycle_(cond, start) if (cond) m65_verify_cycle(cpu, start);
+#define m65_verify_end_() m65_verify_end(cpu);
+#else
+#define m65_verify_cycle_(cond, start)
+#define m65_verify_end_()
+#endif
+
+// m65_cycle_<variant>(m6502_t*) -> void
+// Executes one cycle of a processor of a fixed variant.
+#define m65_cycle_(v)																		\
+void m65_cycle_##v (m6502_t* cpu)															\
+{																							\
+	/* Whether an interrupt was pending at the end of the previous cycle */					\
+	bool poll = cpu->int_poll;																\
+	const m65_op_t* op = &m65_ops_##v[cpu->ir];												\
+																							\
+	cpu->cycles++;																			\
+	m65_verify_cycle_(cpu->phase != M65_PHASE_FETCH, false)									\
+																							\
+	/* Disable the bus */																	\
+	cpu->pins.rw = READ;																	\
+																							\
+	/* Decode the opcode if not done already */												\
+	if (cpu->phase == M65_PHASE_FETCH)														\
+	{																						\
+		/* deal with interrupts */															\
+		m65_int_poll_async(cpu);															\
+		if (cpu->handle_interrupt)															\
+		{																					\
+			m65_debug("interrupt request handler activated");								\
+			cpu->handle_interrupt = false;													\
+			m65_int_select(cpu);															\
+			cpu->ir = 0;																	\
+			cpu->pc--;																		\
+		} else																				\
+		{																					\
+			cpu->ir = cpu->pins.data;														\
+			if (cpu->coverage != NULL)														\
+				m65_cover_exec(cpu->coverage, cpu->pins.addr);								\
+		}																					\
+		op = &m65_ops_##v[cpu->ir];															\
+																							\
+		/* Unimplemented opcodes jam the processor, which decodes the same opcode again */	\
+		if (op->instr != NULL)																\
+			cpu->phase = op->addr_mode != NULL ? M65_PHASE_ADDR : M65_PHASE_INSTR;			\
+		m65_verify_cycle_(cpu->phase != M65_PHASE_FETCH, true)								\
+	}																						\
+																							\
+	/* Execute the addressing mode code */													\
+	if (cpu->phase == M65_PHASE_ADDR)														\
+	{																						\
+		if (op->addr_mode(cpu))																\
+		{																					\
+			/* Once done, move on to the instruction and clear the IPC */					\
+			cpu->phase = M65_PHASE_INSTR;													\
+			cpu->ipc = 0;																	\
+			m65_debug("end of addressing");													\
+																							\
+		/* Otherwise increment the IPC */													\
+		} else cpu->ipc++;																	\
+	}																						\
+																							\
+	/* Execute the instruction specific code */												\
+	if (cpu->phase == M65_PHASE_INSTR)														\
+	{																						\
+		if (op->instr(cpu))																	\
+		{																					\
+			m65_verify_end_()																\
+			/* Once done, fetch the next opcode */											\
+			m65_debug("fetching next opcode");												\
+			cpu->phase = M65_PHASE_FETCH;													\
+			cpu->ipc = 0;																	\
+			m65_fetch(cpu);																	\
+																							\
+			/* Handle interrupts that were pending on the second to last cycle */			\
+			if (poll)																		\
+				cpu->handle_interrupt = true;												\
+			m65_debug("end of instruction");												\
+																							\
+		/* Otherwise increment the IPC */													\
+		} else cpu->ipc++;																	\
+	}																						\
+																							\
+	/* Poll the interrupt lines for the next cycle */										\
+	cpu->int_poll = m65_int_pending(cpu);													\
+}
 
-	// Execute the addressing mode code
-	if (cpu->addr_mode != NULL)
-	{
-		if (cpu->addr_mode(cpu))
-		{
-			// Once done, clear the addressing mode and IPC
-			cpu->addr_mode = NULL;
-			cpu->ipc = 0;
-			puts("end of addressing");
-
-		// Otherwise increment the IPC
-		} else cpu->ipc++;
-	}
+m65_variants_(m65_cycle_)
+
+#undef m65_cycle_
+#undef m65_verify_cycle_
+#undef m65_verify_end_
 
-	// Execute the instruction specific code
-	if (cpu->addr_mode == NULL && cpu->instr != NULL)
+// m65_cycle(m6502_t*) -> void
+// Executes one cycle of a 6502 processor of the variant it was initialised with.
+void m65_cycle(m6502_t* cpu)
+{
+	switch (cpu->variant)
 	{
-		if (cpu->instr(cpu))
-		{
-			// Once done, clear the instruction function and fetch the next opcode
-			puts("fetching next opcode");
-			cpu->instr = NULL;
-			cpu->ipc = 0;
-			m65_fetch(cpu);
-			puts("end of instruction");
-
-		// Otherwise increment the IPC
-		} else cpu->ipc++;
+		case M65_CMOS:
+			m65_cycle_cmos(cpu);
+			break;
+		case M65_2A03:
+			m65_cycle_2a03(cpu);
+			break;
+		case M65_NMOS:
+		default:
+			m65_cycle_nmos(cpu);
+			break;
 	}
 }
 
@@ -183,12 +378,9 @@ void m65_cycle(m6502_t* cpu)
 // Triggers a nonmaskable interrupt. Its interrupt vector is located at 0xFFFA-0xFFFB.
 void m65_nmi(m6502_t* cpu)
 {
-	// Set up the interrupt
-	puts("nonmaskable interrupt pending");
-	cpu->handle_interrupt = true;
-	cpu->int_brk = false;
-	cpu->int_dsi = true;
-	cpu->int_vec = 0xFFFA;
+	// Latch an edge on the NMI line
+	m65_debug("nonmaskable interrupt pending");
+	cpu->int_lines |= M65_NMI_EDGE;
 }
 
 // m65_res(m6502_t*) -> void
@@ -196,7 +388,7 @@ void m65_nmi(m6502_t* cpu)
 void m65_res(m6502_t* cpu)
 {
 	// Set up the interrupt
-	puts("reset pending");
+	m65_debug("reset pending");
 	cpu->handle_interrupt = true;
 	cpu->int_rw = READ;
 	cpu->int_brk = false;
@@ -205,16 +397,31 @@ void m65_res(m6502_t* cpu)
 }
 
 // m65_irq(m6502_t*) -> void
-// Triggers an interrupt request if interrupts are not disabled. Its interrupt vector is located at 0xFFFE-0xFFFF.
+// Requests an interrupt, which is handled once interrupts are enabled. Its interrupt vector is located at 0xFFFE-0xFFFF.
 void m65_irq(m6502_t* cpu)
 {
-	// Don't do the interrupt if disabled
-	if (cpu->flags & 0x04)
-		return;
+	// Assert the host's IRQ line until the request is handled
+	m65_debug("interrupt request pending");
+	m65_irq_assert(cpu, M65_IRQ_HOST);
+}
 
-	// Set up the interrupt
-	puts("interrupt request pending");
-	cpu->handle_interrupt = true;
-	cpu->int_brk = false;
-	cpu->int_dsi = true;
+// m65_nmi_async(m6502_t*) -> void
+// Triggers a nonmaskable interrupt from another thread.
+void m65_nmi_async(m6502_t* cpu)
+{
+	atomic_fetch_or_explicit(&cpu->int_async, M65_ASYNC_NMI | M65_ASYNC_PENDING, memory_order_release);
+}
+
+// m65_res_async(m6502_t*) -> void
+// Triggers a reset interrupt from another thread.
+void m65_res_async(m6502_t* cpu)
+{
+	atomic_fetch_or_explicit(&cpu->int_async, M65_ASYNC_RES | M65_ASYNC_PENDING, memory_order_release);
+}
+
+// m65_irq_async(m6502_t*) -> void
+// Requests an interrupt from another thread.
+void m65_irq_async(m6502_t* cpu)
+{
+	atomic_fetch_or_explicit(&cpu->int_async, M65_ASYNC_IRQ | M65_ASYNC_PENDING, memory_order_release);
 }
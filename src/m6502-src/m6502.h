@@ -9,13 +9,47 @@
 #ifndef M6502_H
 #define M6502_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <inttypes.h>
 
 #define READ 1
 #define WRITE 0
 
+// The interrupt lines are wired-OR: every device that can interrupt owns one bit, and a line is asserted while any
+// of its bits is set. Bits 0-15 drive IRQ and bits 16-30 drive NMI. Bit 31 latches the falling edge of NMI until the
+// processor services it. Bit 15 of IRQ is used by m65_irq().
+#define M65_IRQ_LINES	0x0000FFFF
+#define M65_NMI_LINES	0x7FFF0000
+#define M65_NMI_EDGE	0x80000000
+#define M65_IRQ_HOST	15
+
+// Interrupts signalled from other threads go through cpu->int_async. Its low 32 bits are the lines asserted by devices
+// on other threads, laid out like the interrupt lines, and the bits above are requests the processor takes once. The
+// pending bit is set on every change, and the execution engines look for it at every instruction boundary.
+#define M65_ASYNC_LINES		((M65_IRQ_LINES & ~(1u << M65_IRQ_HOST)) | M65_NMI_LINES)
+#define M65_ASYNC_PENDING	(1ull << 32)
+#define M65_ASYNC_IRQ		(1ull << 33)
+#define M65_ASYNC_NMI		(1ull << 34)
+#define M65_ASYNC_RES		(1ull << 35)
+
 typedef struct s_m6502 m6502_t;
+typedef struct s_m65_coverage m65_coverage_t;
+typedef struct s_m65_traps m65_traps_t;
+typedef struct s_m65_arena m65_arena_t;
+
+// Represents the chip variants the emulator supports.
+typedef enum
+{
+	// The original NMOS 6502.
+	M65_NMOS,
+
+	// The CMOS 65C02, with working decimal flags, the jmp indirect bug fixed, and some extra opcodes.
+	M65_CMOS,
+
+	// The Ricoh 2A03, an NMOS 6502 without decimal mode.
+	M65_2A03
+} m65_variant_t;
 
 // (m6502_t*) -> bool
 // Represents an addressing mode function. Returns true if addressing for the instruction is done.
@@ -38,9 +72,28 @@ typedef struct
 	bool rw;
 } m65_pins_t;
 
-// Represents the state of a 6502 processor.
+// The phases of an instruction, stored in m6502_t.phase.
+enum
+{
+	// The processor fetched an opcode and decodes it (or starts an interrupt) on the next cycle.
+	M65_PHASE_FETCH,
+
+	// The processor runs the addressing mode of the current instruction.
+	M65_PHASE_ADDR,
+
+	// The processor runs the current instruction.
+	M65_PHASE_INSTR
+};
+
+// Represents the state of a 6502 processor. The state touched on every cycle is packed at the front: the registers, the
+// instruction state and the pins take up the first 16 bytes. The current instruction is stored as its opcode and a
+// phase, which index the decoded jump tables of the variant instead of holding function pointers. Interrupt
+// configuration, which only changes when an interrupt is handled, is kept at the end.
 struct s_m6502
 {
+	// The program counter.
+	uint16_t pc;
+
 	// The main registers (accumulator, indexing, and stack pointer).
 	uint8_t a, x, y, s;
 
@@ -57,8 +110,20 @@ struct s_m6502
 	// C - Carry flag
 	uint8_t flags;
 
-	// The program counter.
-	uint16_t pc;
+	// The instruction register holds the opcode of the currently executing instruction.
+	uint8_t ir;
+
+	// The instruction program counter holds the current cycle of the addressing mode or instruction.
+	uint8_t ipc;
+
+	// The phase of the current instruction (see M65_PHASE_FETCH).
+	uint8_t phase;
+
+	// The buffers for the addressing pins.
+	uint16_t addr_buf;
+
+	// The pins of the processor.
+	m65_pins_t pins;
 
 	// Represents the ALU of the processor.
 	struct
@@ -67,20 +132,28 @@ struct s_m6502
 		uint8_t a, b, c;
 	} alu;
 
-	// The current instruction being executed.
-	instr_fn instr;
+	// Whether the processor has to handle a hardware interrupt or executes normally.
+	bool handle_interrupt;
 
-	// The addressing mode of the current instruction.
-	addr_fn addr_mode;
+	// Whether an interrupt was pending at the end of the previous cycle. The processor polls for interrupts on the
+	// second to last cycle of every instruction, so this decides whether one is handled after the current instruction.
+	bool int_poll;
 
-	// The instruction register holds the opcode of the currently executing instruction.
-	uint8_t ir;
+	// The chip variant that m65_cycle() emulates (an m65_variant_t).
+	uint8_t variant;
 
-	// The instruction program counter holds the current
-	uint8_t ipc;
+	// The interrupt lines (see M65_IRQ_LINES and M65_NMI_LINES).
+	uint32_t int_lines;
 
-	// Whether the processor has to handle a hardware interrupt or executes normally.
-	bool handle_interrupt;
+	// The lines taken from int_async the last time it changed, which are the ones devices on other threads own.
+	uint32_t int_remote;
+
+	// The interrupt lines and requests of other threads (see M65_ASYNC_PENDING). It's the only field of the processor
+	// that other threads may touch while it runs.
+	_Atomic uint64_t int_async;
+
+	// The number of cycles executed since the processor was initialised.
+	uint64_t cycles;
 
 	// False if the currently handled interrupt writes the program counter and status to the stack.
 	bool int_rw;
@@ -94,21 +167,172 @@ struct s_m6502
 	// The vector for the currently handled interrupt.
 	uint16_t int_vec;
 
-	// The buffers for the addressing pins.
-	uint16_t addr_buf;
+	// The coverage map executed instructions and branches are recorded in, or NULL (see coverage.h).
+	m65_coverage_t* coverage;
 
-	// The pins of the processor.
-	m65_pins_t pins;
+	// The subroutines run natively by the step engines, or NULL (see traps.h).
+	m65_traps_t* traps;
+
+#ifdef M65_VERIFY_CYCLES
+	// The state of the instruction being checked against the timing table (see opcodes.h).
+	struct
+	{
+		// The cycle the instruction was decoded on.
+		uint64_t start;
+
+		// The address of the opcode.
+		uint16_t pc;
+
+		// The opcode and the registers it was decoded with.
+		uint8_t opcode, x, y, flags;
+
+		// The reads the instruction did so far.
+		uint8_t reads;
+		struct
+		{
+			uint16_t addr;
+			uint8_t data;
+		} bus[8];
+
+		// The number of instructions that didn't take the expected number of cycles.
+		uint64_t errors;
+	} verify;
+#endif
 };
 
 // init_6502(m6502_t*) -> void
-// Initialises a 6502 processor.
+// Initialises an NMOS 6502 processor.
 void init_6502(m6502_t* cpu);
 
+// init_6502_variant(m6502_t*, m65_variant_t) -> void
+// Initialises a processor of the given variant.
+void init_6502_variant(m6502_t* cpu, m65_variant_t variant);
+
+// m65_cpu_new(m65_arena_t*, m65_variant_t) -> m6502_t*
+// Allocates a processor of the given variant from an arena (see arena.h) and initialises it. Returns NULL if memory
+// can't be allocated.
+m6502_t* m65_cpu_new(m65_arena_t* arena, m65_variant_t variant);
+
+// m65_cpu_release(m65_arena_t*, m6502_t*) -> void
+// Gives a processor back to the arena it was allocated from, or does nothing for NULL.
+void m65_cpu_release(m65_arena_t* arena, m6502_t* cpu);
+
 // m65_cycle(m6502_t*) -> void
-// Executes one cycle of a 6502 processor.
+// Executes one cycle of a 6502 processor of the variant it was initialised with.
 void m65_cycle(m6502_t* cpu);
 
+// m65_cycle_<variant>(m6502_t*) -> void
+// Executes one cycle of a processor of a fixed variant. Hosts that only ever emulate one variant should call these
+// directly; they are fully specialised and never look at cpu->variant.
+void m65_cycle_nmos(m6502_t* cpu);
+void m65_cycle_cmos(m6502_t* cpu);
+void m65_cycle_2a03(m6502_t* cpu);
+
+// m65_int_select(m6502_t*) -> void
+// Configures the interrupt sequence for the pending interrupt with the highest priority. Called by the execution
+// engines when they start handling an interrupt.
+void m65_int_select(m6502_t* cpu);
+
+// m65_fetching(const m6502_t*) -> bool
+// Returns true if the processor is between two instructions: the opcode of the next instruction is on the pins and no
+// interrupt is about to be handled.
+static inline bool m65_fetching(const m6502_t* cpu)
+{
+	return cpu->phase == M65_PHASE_FETCH && !cpu->handle_interrupt;
+}
+
+// m65_irq_assert(m6502_t*, unsigned) -> void
+// Asserts the IRQ line on behalf of a device (0-14). The line stays asserted until every device released it.
+static inline void m65_irq_assert(m6502_t* cpu, unsigned device)
+{
+	cpu->int_lines |= 1u << device;
+}
+
+// m65_irq_release(m6502_t*, unsigned) -> void
+// Releases the IRQ line on behalf of a device (0-14).
+static inline void m65_irq_release(m6502_t* cpu, unsigned device)
+{
+	cpu->int_lines &= ~(1u << device);
+}
+
+// m65_nmi_assert(m6502_t*, unsigned) -> void
+// Asserts the NMI line on behalf of a device (0-14). An interrupt is triggered if no other device asserted it before.
+static inline void m65_nmi_assert(m6502_t* cpu, unsigned device)
+{
+	if (!(cpu->int_lines & M65_NMI_LINES))
+		cpu->int_lines |= M65_NMI_EDGE;
+	cpu->int_lines |= 1u << (16 + device);
+}
+
+// m65_nmi_release(m6502_t*, unsigned) -> void
+// Releases the NMI line on behalf of a device (0-14).
+static inline void m65_nmi_release(m6502_t* cpu, unsigned device)
+{
+	cpu->int_lines &= ~(1u << (16 + device));
+}
+
+// m65_int_pending(const m6502_t*) -> bool
+// Returns true if the interrupt lines request an interrupt the processor would handle.
+static inline bool m65_int_pending(const m6502_t* cpu)
+{
+	return (cpu->int_lines & M65_NMI_EDGE) || ((cpu->int_lines & M65_IRQ_LINES) && !(cpu->flags & 0x04));
+}
+
+// m65_irq_assert_async(m6502_t*, unsigned) -> void
+// Asserts the IRQ line on behalf of a device (0-14) on another thread. It's safe to call while the processor runs on
+// its own thread, which sees the line at its next instruction boundary. A device uses either these functions or the
+// ones above, not both.
+static inline void m65_irq_assert_async(m6502_t* cpu, unsigned device)
+{
+	atomic_fetch_or_explicit(&cpu->int_async, 1ull << device | M65_ASYNC_PENDING, memory_order_release);
+}
+
+// m65_irq_release_async(m6502_t*, unsigned) -> void
+// Releases the IRQ line on behalf of a device (0-14) on another thread.
+static inline void m65_irq_release_async(m6502_t* cpu, unsigned device)
+{
+	atomic_fetch_and_explicit(&cpu->int_async, ~(1ull << device), memory_order_release);
+	atomic_fetch_or_explicit(&cpu->int_async, M65_ASYNC_PENDING, memory_order_release);
+}
+
+// m65_nmi_assert_async(m6502_t*, unsigned) -> void
+// Asserts the NMI line on behalf of a device (0-14) on another thread. An interrupt is triggered if no other device
+// asserted it before.
+static inline void m65_nmi_assert_async(m6502_t* cpu, unsigned device)
+{
+	atomic_fetch_or_explicit(&cpu->int_async, 1ull << (16 + device) | M65_ASYNC_PENDING, memory_order_release);
+}
+
+// m65_nmi_release_async(m6502_t*, unsigned) -> void
+// Releases the NMI line on behalf of a device (0-14) on another thread.
+static inline void m65_nmi_release_async(m6502_t* cpu, unsigned device)
+{
+	atomic_fetch_and_explicit(&cpu->int_async, ~(1ull << (16 + device)), memory_order_release);
+	atomic_fetch_or_explicit(&cpu->int_async, M65_ASYNC_PENDING, memory_order_release);
+}
+
+// m65_int_signalled(const m6502_t*) -> bool
+// Returns true if other threads changed their interrupt lines or requested an interrupt since the processor last
+// looked. This is a single relaxed load, so the engines can afford it on every instruction.
+static inline bool m65_int_signalled(const m6502_t* cpu)
+{
+	return atomic_load_explicit(&cpu->int_async, memory_order_relaxed) & M65_ASYNC_PENDING;
+}
+
+// m65_int_collect(m6502_t*) -> void
+// Takes the interrupt lines and requests of other threads into the processor, which is at an instruction boundary.
+// Interrupts they make pending are handled before the next instruction.
+void m65_int_collect(m6502_t* cpu);
+
+// m65_int_poll_async(m6502_t*) -> void
+// Takes the interrupt lines and requests of other threads if they changed. Called by the execution engines at every
+// instruction boundary.
+static inline void m65_int_poll_async(m6502_t* cpu)
+{
+	if (m65_int_signalled(cpu))
+		m65_int_collect(cpu);
+}
+
 // m65_nmi(m6502_t*) -> void
 // Triggers a nonmaskable interrupt. Its interrupt vector is located at 0xFFFA-0xFFFB.
 void m65_nmi(m6502_t* cpu);
@@ -118,7 +342,15 @@ void m65_nmi(m6502_t* cpu);
 void m65_res(m6502_t* cpu);
 
 // m65_irq(m6502_t*) -> void
-// Triggers an interrupt request if interrupts are not disabled. Its interrupt vector is located at 0xFFFE-0xFFFF.
+// Requests an interrupt, which is handled once interrupts are enabled. Its interrupt vector is located at
+// 0xFFFE-0xFFFF.
 void m65_irq(m6502_t* cpu);
 
+// m65_<interrupt>_async(m6502_t*) -> void
+// Triggers an interrupt like m65_nmi(), m65_res() and m65_irq(), but from another thread. They're safe to call while
+// the processor runs on its own thread, which triggers the interrupt at its next instruction boundary.
+void m65_nmi_async(m6502_t* cpu);
+void m65_res_async(m6502_t* cpu);
+void m65_irq_async(m6502_t* cpu);
+
 #endif /* M6502_H */
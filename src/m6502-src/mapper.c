@@ -0,0 +1,254 @@
+//
+// MOS6502 Emulator
+// mapper.c: Implements bank switching mappers on top of the paged memory map.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapper.h"
+
+// The cartridge RAM window most mappers have at 0x6000.
+#define M65_WINDOW_RAM {0x60, 32, M65_BANK_RAM, -1, 0, 0, 0}
+
+// The built in mapper types.
+const m65_mapper_type_t m65_mappers[] = {
+	// 16 or 32 KiB of ROM and no registers
+	{
+		.name = "nrom", .ines = 0, .mode_reg = -1,
+		.layouts = {{{0x80, 64, M65_BANK_ROM, -1, 0, 0, 0}, {0xc0, 64, M65_BANK_ROM, -1, 0, 0, -1}}}
+	},
+
+	// A shift register selecting the layout and 16 or 32 KiB banks
+	{
+		.name = "mmc1", .ines = 1, .reg_page = 0x80, .reg_pages = 128, .decode = M65_REGS_SERIAL, .reg_shift = 13,
+		.reg_mask = 3, .reset = {0x0c}, .mode_reg = 0, .mode_shift = 2, .mode_mask = 3, .ram_pages = 32,
+		.layouts = {
+			{M65_WINDOW_RAM, {0x80, 128, M65_BANK_ROM, 3, 1, 0x07, 0}},
+			{M65_WINDOW_RAM, {0x80, 128, M65_BANK_ROM, 3, 1, 0x07, 0}},
+			{M65_WINDOW_RAM, {0x80, 64, M65_BANK_ROM, -1, 0, 0, 0}, {0xc0, 64, M65_BANK_ROM, 3, 0, 0x0f, 0}},
+			{M65_WINDOW_RAM, {0x80, 64, M65_BANK_ROM, 3, 0, 0x0f, 0}, {0xc0, 64, M65_BANK_ROM, -1, 0, 0, -1}}
+		}
+	},
+
+	// A 16 KiB bank at 0x8000 and the last one fixed at 0xC000, up to 4 MiB
+	{
+		.name = "uxrom", .ines = 2, .reg_page = 0x80, .reg_pages = 128, .mode_reg = -1,
+		.layouts = {{{0x80, 64, M65_BANK_ROM, 0, 0, 0xff, 0}, {0xc0, 64, M65_BANK_ROM, -1, 0, 0, -1}}}
+	},
+
+	// Like nrom; the register only switches graphics
+	{
+		.name = "cnrom", .ines = 3, .reg_page = 0x80, .reg_pages = 128, .mode_reg = -1,
+		.layouts = {{{0x80, 64, M65_BANK_ROM, -1, 0, 0, 0}, {0xc0, 64, M65_BANK_ROM, -1, 0, 0, -1}}}
+	},
+
+	// 32 KiB banks selected by the low bits of the register
+	{
+		.name = "axrom", .ines = 7, .reg_page = 0x80, .reg_pages = 128, .mode_reg = -1,
+		.layouts = {{{0x80, 128, M65_BANK_ROM, 0, 0, 0x07, 0}}}
+	},
+	{
+		.name = "colordreams", .ines = 11, .reg_page = 0x80, .reg_pages = 128, .mode_reg = -1,
+		.layouts = {{{0x80, 128, M65_BANK_ROM, 0, 0, 0x03, 0}}}
+	},
+	{
+		.name = "bnrom", .ines = 34, .reg_page = 0x80, .reg_pages = 128, .mode_reg = -1,
+		.layouts = {{{0x80, 128, M65_BANK_ROM, 0, 0, 0xff, 0}}}
+	},
+	{
+		.name = "gxrom", .ines = 66, .reg_page = 0x80, .reg_pages = 128, .mode_reg = -1,
+		.layouts = {{{0x80, 128, M65_BANK_ROM, 0, 4, 0x03, 0}}}
+	},
+
+	// Three 8 KiB banks selected by writes to their own window and the last one fixed at 0xE000, up to 2 MiB
+	{
+		.name = "bank8k", .ines = -1, .reg_page = 0x80, .reg_pages = 96, .reg_shift = 13, .reg_mask = 3,
+		.reset = {0, 1, 2}, .mode_reg = -1, .ram_pages = 32,
+		.layouts = {{
+			M65_WINDOW_RAM, {0x80, 32, M65_BANK_ROM, 0, 0, 0xff, 0}, {0xa0, 32, M65_BANK_ROM, 1, 0, 0xff, 0},
+			{0xc0, 32, M65_BANK_ROM, 2, 0, 0xff, 0}, {0xe0, 32, M65_BANK_ROM, -1, 0, 0, -1}
+		}}
+	},
+
+	{ 0 }
+};
+
+// m65_mapper_find(const char*) -> const m65_mapper_type_t*
+// Finds a built in mapper type by name.
+const m65_mapper_type_t* m65_mapper_find(const char* name)
+{
+	for (const m65_mapper_type_t* type = m65_mappers; type->name != NULL; type++)
+	{
+		if (strcmp(type->name, name) == 0)
+			return type;
+	}
+
+	return NULL;
+}
+
+// m65_mapper_find_ines(int) -> const m65_mapper_type_t*
+// Finds a built in mapper type by its iNES mapper number.
+const m65_mapper_type_t* m65_mapper_find_ines(int number)
+{
+	for (const m65_mapper_type_t* type = m65_mappers; type->name != NULL; type++)
+	{
+		if (type->ines == number)
+			return type;
+	}
+
+	return NULL;
+}
+
+// m65_mapper_window(m65_mapper_t*, int) -> void
+// Maps the bank selected for a window of the current layout, unless it's already mapped.
+static void m65_mapper_window(m65_mapper_t* mapper, int i)
+{
+	const m65_window_t* window = &mapper->type->layouts[mapper->layout][i];
+	const uint8_t* base = window->source == M65_BANK_ROM ? mapper->rom : mapper->ram;
+	size_t total = window->source == M65_BANK_ROM ? mapper->rom_size : mapper->type->ram_pages * M65_PAGE_SIZE;
+	size_t size = window->pages * M65_PAGE_SIZE;
+	if (base == NULL || total == 0)
+		return;
+
+	// Sources smaller than the window are mirrored through it
+	long count = total / size;
+	long bank = window->reg < 0 ? window->bank : (mapper->regs[window->reg] >> window->shift) & window->mask;
+	const uint8_t* data = base;
+	if (count > 0)
+		data += ((bank % count + count) % count) * size;
+	else size = total;
+
+	if (mapper->mapped[i] == data)
+		return;
+	mapper->mapped[i] = data;
+	mapper->switches++;
+
+	for (size_t offset = 0; offset < (size_t) window->pages * M65_PAGE_SIZE; offset += size)
+	{
+		uint8_t page = window->page + offset / M65_PAGE_SIZE;
+		if (window->source == M65_BANK_ROM)
+			m65_mem_map_rom(mapper->mem, page, data, size);
+		else m65_mem_map_ram(mapper->mem, page, size / M65_PAGE_SIZE, (uint8_t*) data);
+	}
+}
+
+// m65_mapper_update(m65_mapper_t*) -> void
+// Maps the banks selected by the registers.
+static void m65_mapper_update(m65_mapper_t* mapper)
+{
+	const m65_mapper_type_t* type = mapper->type;
+	int layout = type->mode_reg < 0 ? 0 : (mapper->regs[type->mode_reg] >> type->mode_shift) & type->mode_mask;
+	if (layout != mapper->layout)
+	{
+		mapper->layout = layout;
+		memset(mapper->mapped, 0, sizeof(mapper->mapped));
+	}
+
+	for (int i = 0; i < M65_MAPPER_WINDOWS && type->layouts[layout][i].pages; i++)
+		m65_mapper_window(mapper, i);
+}
+
+// m65_mapper_io(void*, uint16_t, uint8_t) -> void
+// Handles a write by the processor to a register page.
+static void m65_mapper_io(void* ctx, uint16_t addr, uint8_t data)
+{
+	m65_mapper_write(ctx, addr, data);
+}
+
+// m65_mapper_init(m65_mapper_t*, const m65_mapper_type_t*, m65_mem_t*, const m65_rom_t*) -> bool
+// Connects a mapper with the program ROM of an image to a memory map and maps the banks selected after a reset.
+bool m65_mapper_init(m65_mapper_t* mapper, const m65_mapper_type_t* type, m65_mem_t* mem, const m65_rom_t* rom)
+{
+	memset(mapper, 0, sizeof(m65_mapper_t));
+	mapper->type = type;
+	mapper->mem = mem;
+	mapper->rom = rom->data;
+	mapper->rom_size = rom->size;
+	memcpy(mapper->regs, type->reset, sizeof(mapper->regs));
+	mapper->layout = -1;
+
+	if (type->ram_pages && (mapper->ram = calloc(type->ram_pages, M65_PAGE_SIZE)) == NULL)
+		return false;
+
+	m65_mem_map_io(mem, type->reg_page, type->reg_pages, m65_mapper_io, mapper);
+	m65_mapper_update(mapper);
+	return true;
+}
+
+// m65_mapper_clone(m65_mapper_t*, const m65_mapper_t*, m65_mem_t*) -> bool
+// Initialises a mapper as a copy of another one, connected to a copy of its memory map.
+bool m65_mapper_clone(m65_mapper_t* dst, const m65_mapper_t* src, m65_mem_t* mem)
+{
+	size_t size = src->type->ram_pages * M65_PAGE_SIZE;
+	*dst = *src;
+	dst->mem = mem;
+	if (src->ram != NULL)
+	{
+		if ((dst->ram = malloc(size)) == NULL)
+			return false;
+		memcpy(dst->ram, src->ram, size);
+		m65_mem_relocate(mem, src->ram, size, dst->ram);
+
+		for (int i = 0; i < M65_MAPPER_WINDOWS; i++)
+		{
+			if (src->mapped[i] >= src->ram && src->mapped[i] < src->ram + size)
+				dst->mapped[i] = dst->ram + (src->mapped[i] - src->ram);
+		}
+	}
+
+	m65_mem_map_io(mem, dst->type->reg_page, dst->type->reg_pages, m65_mapper_io, dst);
+	return true;
+}
+
+// m65_mapper_free(m65_mapper_t*) -> void
+// Disconnects a mapper from its memory map and frees its RAM.
+void m65_mapper_free(m65_mapper_t* mapper)
+{
+	m65_mem_map_io(mapper->mem, mapper->type->reg_page, mapper->type->reg_pages, NULL, NULL);
+
+	// Windows into the cartridge RAM go back to the map's own RAM
+	for (int i = 0; i < M65_MAPPER_WINDOWS && mapper->layout >= 0; i++)
+	{
+		const m65_window_t* window = &mapper->type->layouts[mapper->layout][i];
+		if (window->pages && window->source == M65_BANK_RAM && mapper->ram != NULL)
+			m65_mem_map_own(mapper->mem, window->page, window->pages);
+	}
+
+	free(mapper->ram);
+	mapper->ram = NULL;
+}
+
+// m65_mapper_write(m65_mapper_t*, uint16_t, uint8_t) -> void
+// Writes to the registers of a mapper.
+void m65_mapper_write(m65_mapper_t* mapper, uint16_t addr, uint8_t data)
+{
+	const m65_mapper_type_t* type = mapper->type;
+	unsigned reg = (addr >> type->reg_shift) & type->reg_mask & (M65_MAPPER_REGS - 1);
+	mapper->writes++;
+
+	if (type->decode == M65_REGS_DIRECT)
+		mapper->regs[reg] = data;
+	else if (data & 0x80)
+	{
+		// Starting over also selects the mode bits
+		mapper->shift = 0;
+		mapper->shift_count = 0;
+		if (type->mode_reg >= 0)
+			mapper->regs[type->mode_reg] |= type->mode_mask << type->mode_shift;
+	} else
+	{
+		mapper->shift |= (data & 1) << mapper->shift_count;
+		if (++mapper->shift_count < 5)
+			return;
+
+		mapper->regs[reg] = mapper->shift;
+		mapper->shift = 0;
+		mapper->shift_count = 0;
+	}
+
+	m65_mapper_update(mapper);
+}
@@ -0,0 +1,150 @@
+//
+// MOS6502 Emulator
+// mapper.h: Header file for mapper.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include "loader.h"
+#include "memory.h"
+
+// The most registers, layouts and windows per layout a mapper can have.
+#define M65_MAPPER_REGS 4
+#define M65_MAPPER_LAYOUTS 4
+#define M65_MAPPER_WINDOWS 6
+
+// What a window is mapped to.
+typedef enum
+{
+	// The (read only) program ROM of the cartridge.
+	M65_BANK_ROM,
+
+	// The RAM of the cartridge.
+	M65_BANK_RAM
+} m65_bank_source_t;
+
+// How writes to the register pages set the registers.
+typedef enum
+{
+	// The value written goes into the register selected by the address.
+	M65_REGS_DIRECT,
+
+	// The value is shifted in one bit at a time, least significant bit first, and goes into the register selected by
+	// the address on the fifth write. A write with bit 7 set starts over and sets the mode bits (MMC1).
+	M65_REGS_SERIAL
+} m65_regs_decode_t;
+
+// Represents a range of the address space that a bank is mapped into.
+typedef struct
+{
+	// The first page and the number of pages. Banks are as big as their window. A window of 0 pages ends a layout.
+	uint8_t page;
+	uint8_t pages;
+
+	// What the window is mapped to.
+	m65_bank_source_t source;
+
+	// The register that selects the bank, or -1 for a fixed bank. The bank is (register >> shift) & mask.
+	int8_t reg;
+	uint8_t shift;
+	uint8_t mask;
+
+	// The bank of a fixed window. Negative banks count from the end, so -1 is the last bank.
+	int16_t bank;
+} m65_window_t;
+
+// Represents a type of mapper. Mappers are data: a bank switch only remaps the windows whose bank changed, which is a
+// pointer update per page.
+typedef struct
+{
+	// The name of the mapper and its iNES mapper number (or -1).
+	const char* name;
+	int ines;
+
+	// The pages whose writes go to the registers instead of memory, and how they set them. The register written is
+	// (addr >> reg_shift) & reg_mask.
+	uint8_t reg_page;
+	uint8_t reg_pages;
+	m65_regs_decode_t decode;
+	uint8_t reg_shift;
+	uint8_t reg_mask;
+
+	// The values of the registers after a reset.
+	uint8_t reset[M65_MAPPER_REGS];
+
+	// The register and bits that select the layout, or -1 if there is only one.
+	int8_t mode_reg;
+	uint8_t mode_shift;
+	uint8_t mode_mask;
+
+	// The windows of every layout.
+	m65_window_t layouts[M65_MAPPER_LAYOUTS][M65_MAPPER_WINDOWS];
+
+	// The size of the cartridge RAM in pages.
+	unsigned ram_pages;
+} m65_mapper_type_t;
+
+// Represents a mapper connected to a memory map.
+typedef struct
+{
+	// The type of the mapper.
+	const m65_mapper_type_t* type;
+
+	// The memory map it drives.
+	m65_mem_t* mem;
+
+	// The program ROM and the cartridge RAM.
+	const uint8_t* rom;
+	size_t rom_size;
+	uint8_t* ram;
+
+	// The registers, and the shift register of serial mappers.
+	uint8_t regs[M65_MAPPER_REGS];
+	uint8_t shift;
+	uint8_t shift_count;
+
+	// What each window of the current layout is mapped to, so that only banks that changed get remapped.
+	int layout;
+	const uint8_t* mapped[M65_MAPPER_WINDOWS];
+
+	// The number of register writes and of windows remapped.
+	uint64_t writes;
+	uint64_t switches;
+} m65_mapper_t;
+
+// The built in mapper types, ending with one whose name is NULL.
+extern const m65_mapper_type_t m65_mappers[];
+
+// m65_mapper_find(const char*) -> const m65_mapper_type_t*
+// Finds a built in mapper type by name. Returns NULL if there is none.
+const m65_mapper_type_t* m65_mapper_find(const char* name);
+
+// m65_mapper_find_ines(int) -> const m65_mapper_type_t*
+// Finds a built in mapper type by its iNES mapper number. Returns NULL if there is none.
+const m65_mapper_type_t* m65_mapper_find_ines(int number);
+
+// m65_mapper_init(m65_mapper_t*, const m65_mapper_type_t*, m65_mem_t*, const m65_rom_t*) -> bool
+// Connects a mapper with the program ROM of an image to a memory map, taking over the writes to its register pages,
+// and maps the banks selected after a reset. The ROM has to stay open while the mapper is. Returns false if the
+// cartridge RAM can't be allocated.
+bool m65_mapper_init(m65_mapper_t* mapper, const m65_mapper_type_t* type, m65_mem_t* mem, const m65_rom_t* rom);
+
+// m65_mapper_clone(m65_mapper_t*, const m65_mapper_t*, m65_mem_t*) -> bool
+// Initialises a mapper as a copy of another one, with a copy of its cartridge RAM, connected to a copy of its memory
+// map made with m65_mem_clone(). Returns false if the cartridge RAM can't be allocated.
+bool m65_mapper_clone(m65_mapper_t* dst, const m65_mapper_t* src, m65_mem_t* mem);
+
+// m65_mapper_free(m65_mapper_t*) -> void
+// Disconnects a mapper from its memory map and frees its RAM. The ROM banks stay mapped; windows into the cartridge
+// RAM go back to the RAM of the memory map.
+void m65_mapper_free(m65_mapper_t* mapper);
+
+// m65_mapper_write(m65_mapper_t*, uint16_t, uint8_t) -> void
+// Writes to the registers of a mapper, as a write by the processor to a register page would.
+void m65_mapper_write(m65_mapper_t* mapper, uint16_t addr, uint8_t data);
+
+#endif /* MAPPER_H */
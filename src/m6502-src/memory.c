@@ -0,0 +1,650 @@
+//
+// MOS6502 Emulator
+// memory.c: Implements the paged memory map.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+// A page that swallows writes to read only memory. It is never read from.
+uint8_t m65_mem_sink[M65_PAGE_SIZE];
+
+// A page of zeros that the unwritten pages of sparse memory maps read from.
+const uint8_t m65_mem_zero[M65_PAGE_SIZE];
+
+// m65_mem_page(m65_mem_t*) -> uint8_t*
+// Allocates a zeroed page from the arena of a sparse map. Returns NULL if memory can't be allocated.
+static uint8_t* m65_mem_page(m65_mem_t* mem)
+{
+	uint8_t* page = m65_slab_alloc(&mem->arena->pages);
+	if (page != NULL)
+		memset(page, 0, M65_PAGE_SIZE);
+	return page;
+}
+
+// m65_mem_clear(m65_mem_t*) -> void
+// Clears the state of a memory map that isn't memory.
+static void m65_mem_clear(m65_mem_t* mem)
+{
+	memset(&mem->code, 0, sizeof(mem->code));
+	memset(&mem->dirty, 0, sizeof(mem->dirty));
+	memset(mem->io, 0, sizeof(mem->io));
+	memset(mem->io_ctx, 0, sizeof(mem->io_ctx));
+	memset(&mem->devices, 0, sizeof(mem->devices));
+	mem->devices.deadline = UINT64_MAX;
+}
+
+// m65_mem_init(m65_mem_t*) -> bool
+// Initialises a memory map with all pages mapped to its own RAM. Returns false if the RAM can't be allocated.
+bool m65_mem_init(m65_mem_t* mem)
+{
+	m65_mem_clear(mem);
+	mem->sparse = NULL;
+	mem->arena = NULL;
+	mem->ram = calloc(M65_PAGES, M65_PAGE_SIZE);
+	if (mem->ram == NULL)
+		return false;
+
+	m65_mem_map_ram(mem, 0, M65_PAGES, mem->ram);
+	return true;
+}
+
+// m65_mem_init_sparse(m65_mem_t*) -> bool
+// Initialises a memory map whose RAM is allocated a page at a time from the arena of the thread.
+bool m65_mem_init_sparse(m65_mem_t* mem)
+{
+	m65_arena_t* arena = m65_arena_thread();
+	if (arena != NULL)
+		return m65_mem_init_arena(mem, arena);
+
+	mem->sparse = NULL;
+	mem->ram = NULL;
+	return false;
+}
+
+// m65_mem_init_arena(m65_mem_t*, m65_arena_t*) -> bool
+// Initialises a memory map whose RAM is allocated a page at a time from an arena.
+bool m65_mem_init_arena(m65_mem_t* mem, m65_arena_t* arena)
+{
+	m65_mem_clear(mem);
+	mem->ram = NULL;
+	mem->arena = arena;
+	mem->sparse = m65_slab_alloc(&arena->tables);
+	if (mem->sparse == NULL)
+		return false;
+	memset(mem->sparse, 0, M65_PAGES * sizeof(uint8_t*));
+
+	// The step engines access the zero page and the stack directly
+	for (unsigned page = 0; page < 2; page++)
+	{
+		if ((mem->sparse[page] = m65_mem_page(mem)) == NULL)
+		{
+			m65_mem_free(mem);
+			return false;
+		}
+	}
+
+	m65_mem_map_own(mem, 0, M65_PAGES);
+	return true;
+}
+
+// m65_mem_free(m65_mem_t*) -> void
+// Frees the RAM of a memory map. Mapped ROM is owned by whoever mapped it.
+void m65_mem_free(m65_mem_t* mem)
+{
+	if (mem->sparse != NULL)
+	{
+		for (unsigned page = 0; page < M65_PAGES; page++)
+		{
+			if (mem->sparse[page] != NULL)
+				m65_slab_release(&mem->arena->pages, mem->sparse[page]);
+		}
+		m65_slab_release(&mem->arena->tables, mem->sparse);
+		mem->sparse = NULL;
+	}
+
+	free(mem->ram);
+	mem->ram = NULL;
+}
+
+// m65_mem_new(m65_arena_t*) -> m65_mem_t*
+// Allocates a sparse memory map from an arena and initialises it.
+m65_mem_t* m65_mem_new(m65_arena_t* arena)
+{
+	m65_mem_t* mem = m65_slab_alloc(&arena->maps);
+	if (mem != NULL && !m65_mem_init_arena(mem, arena))
+	{
+		m65_slab_release(&arena->maps, mem);
+		return NULL;
+	}
+
+	return mem;
+}
+
+// m65_mem_release(m65_arena_t*, m65_mem_t*) -> void
+// Frees a memory map allocated from an arena and gives it back to the arena.
+void m65_mem_release(m65_arena_t* arena, m65_mem_t* mem)
+{
+	if (mem == NULL)
+		return;
+
+	m65_mem_free(mem);
+	m65_slab_release(&arena->maps, mem);
+}
+
+// m65_mem_clone(m65_mem_t*, const m65_mem_t*) -> bool
+// Initialises a sparse memory map as a snapshot of another one.
+bool m65_mem_clone(m65_mem_t* dst, const m65_mem_t* src)
+{
+	if (src->devices.count > 0 || !m65_mem_init_sparse(dst))
+		return false;
+
+	// Copy the pages the source owns, leaving out the unwritten ones
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		const uint8_t* own = src->sparse != NULL ? src->sparse[page] : src->ram + page * M65_PAGE_SIZE;
+		if (own == NULL || (page >= 2 && memcmp(own, m65_mem_zero, M65_PAGE_SIZE) == 0))
+			continue;
+		if (dst->sparse[page] == NULL && (dst->sparse[page] = m65_mem_page(dst)) == NULL)
+		{
+			m65_mem_free(dst);
+			return false;
+		}
+		memcpy(dst->sparse[page], own, M65_PAGE_SIZE);
+	}
+
+	// Pages mapped to the source's own RAM get the copy, or read as zero if it wasn't copied
+	for (unsigned page = 2; page < M65_PAGES; page++)
+	{
+		const uint8_t* own = src->sparse != NULL ? src->sparse[page] : src->ram + page * M65_PAGE_SIZE;
+		uint8_t* copy = dst->sparse[page];
+		uint8_t* write = src->write[page] != NULL || src->io[page] != NULL ? src->write[page] : src->code.write[page];
+		uint8_t* io_write = src->code.write[page];
+
+		dst->read[page] = src->read[page] != own || own == NULL ? src->read[page] : copy != NULL ? copy : m65_mem_zero;
+		dst->write[page] = write != own || own == NULL ? write : copy;
+		dst->code.write[page] = io_write != own || own == NULL ? io_write : copy;
+		dst->io[page] = src->io[page];
+		dst->io_ctx[page] = src->io_ctx[page];
+	}
+
+	return true;
+}
+
+// m65_mem_relocate(m65_mem_t*, const uint8_t*, size_t, uint8_t*) -> void
+// Points the pages mapped into some memory to the same place in other memory.
+void m65_mem_relocate(m65_mem_t* mem, const uint8_t* from, size_t size, uint8_t* to)
+{
+	uintptr_t start = (uintptr_t) from;
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		uintptr_t read = (uintptr_t) mem->read[page];
+		uintptr_t write = (uintptr_t) mem->write[page];
+		uintptr_t io_write = (uintptr_t) mem->code.write[page];
+		if (read - start < size)
+			mem->read[page] = to + (read - start);
+		if (write - start < size)
+			mem->write[page] = to + (write - start);
+		if (io_write - start < size)
+			mem->code.write[page] = to + (io_write - start);
+	}
+
+	mem->zp = mem->write[0];
+	mem->stack = mem->write[1];
+}
+
+// m65_mem_own(m65_mem_t*, uint8_t, bool) -> uint8_t*
+// Returns the page of the map's own RAM at a page, allocating it if alloc is set. Returns NULL for unwritten pages of
+// sparse maps, or if the page can't be allocated.
+static uint8_t* m65_mem_own(m65_mem_t* mem, uint8_t page, bool alloc)
+{
+	if (mem->sparse == NULL)
+		return mem->ram + page * M65_PAGE_SIZE;
+	if (mem->sparse[page] == NULL && alloc)
+		mem->sparse[page] = m65_mem_page(mem);
+	return mem->sparse[page];
+}
+
+// m65_mem_invalidate(m65_mem_t*, uint8_t) -> void
+// Forgets that a page contains code because its contents changed, restoring its write pointer.
+static void m65_mem_invalidate(m65_mem_t* mem, uint8_t page)
+{
+	// Clean pages become dirty and get their write pointer back, so that further writes to them are fast again
+	if (!m65_mem_is_dirty(mem, page))
+	{
+		mem->dirty.pages[page >> 3] |= 1 << (page & 7);
+		if (mem->write[page] == NULL && mem->io[page] == NULL && !m65_mem_is_code(mem, page))
+			mem->write[page] = mem->code.write[page];
+	}
+
+	if (!m65_mem_is_code(mem, page))
+		return;
+
+	mem->code.pages[page >> 3] &= ~(1 << (page & 7));
+	if (mem->write[page] == NULL && mem->io[page] == NULL)
+		mem->write[page] = mem->code.write[page];
+	mem->code.generation[page]++;
+	if (mem->code.hook != NULL)
+		mem->code.hook(mem->code.ctx, page);
+}
+
+// m65_mem_set_read(m65_mem_t*, uint8_t, const uint8_t*) -> void
+// Sets the memory a page is read from. Device pages keep reading from the device.
+static void m65_mem_set_read(m65_mem_t* mem, uint8_t page, const uint8_t* data)
+{
+	mem->read[page] = mem->devices.pages[page] == NULL ? data : NULL;
+}
+
+// m65_mem_set_write(m65_mem_t*, uint8_t, uint8_t*) -> void
+// Sets the memory a page is written to. I/O pages keep it with the tracking state, like code pages.
+static void m65_mem_set_write(m65_mem_t* mem, uint8_t page, uint8_t* data)
+{
+	if (mem->io[page] != NULL)
+	{
+		mem->code.write[page] = data;
+		mem->write[page] = NULL;
+	} else mem->write[page] = data;
+}
+
+// m65_mem_track_code(m65_mem_t*, m65_code_hook_t, void*) -> void
+// Starts tracking the pages that code is executed from, forgetting any that were tracked before.
+void m65_mem_track_code(m65_mem_t* mem, m65_code_hook_t hook, void* ctx)
+{
+	m65_mem_untrack_code(mem);
+	mem->code.enabled = true;
+	mem->code.hook = hook;
+	mem->code.ctx = ctx;
+}
+
+// m65_mem_untrack_code(m65_mem_t*) -> void
+// Stops tracking code.
+void m65_mem_untrack_code(m65_mem_t* mem)
+{
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		if (m65_mem_is_code(mem, page) && m65_mem_is_dirty(mem, page) && mem->write[page] == NULL
+				&& mem->io[page] == NULL)
+			mem->write[page] = mem->code.write[page];
+	}
+
+	memset(mem->code.pages, 0, sizeof(mem->code.pages));
+	mem->code.enabled = false;
+	mem->code.hook = NULL;
+	mem->code.ctx = NULL;
+}
+
+// m65_mem_mark_code(m65_mem_t*, uint8_t) -> void
+// Marks a page as containing code.
+void m65_mem_mark_code(m65_mem_t* mem, uint8_t page)
+{
+	// Writes to the zero page and the stack bypass the page tables, so they can't be tracked
+	if (page < 2)
+		return;
+
+	mem->code.pages[page >> 3] |= 1 << (page & 7);
+
+	// Read only pages never change, so writes to them can keep going to the sink, and I/O pages, clean pages and
+	// unwritten pages already take the slow path
+	if (mem->write[page] != NULL && mem->write[page] != m65_mem_sink && mem->io[page] == NULL)
+	{
+		mem->code.write[page] = mem->write[page];
+		mem->write[page] = NULL;
+	}
+}
+
+// m65_mem_alloc_own(m65_mem_t*, uint8_t) -> uint8_t*
+// Gives an unwritten page of a sparse map its memory and maps the page to it. Returns NULL if it can't be allocated.
+static uint8_t* m65_mem_alloc_own(m65_mem_t* mem, uint8_t page)
+{
+	uint8_t* own = m65_mem_own(mem, page, true);
+	if (own == NULL)
+		return NULL;
+
+	// Code pages keep taking the slow path
+	m65_mem_set_read(mem, page, own);
+	if (m65_mem_is_code(mem, page))
+		mem->code.write[page] = own;
+	else m65_mem_set_write(mem, page, own);
+	return own;
+}
+
+// m65_mem_track_dirty(m65_mem_t*) -> void
+// Starts tracking the pages whose contents change, with every page dirty.
+void m65_mem_track_dirty(m65_mem_t* mem)
+{
+	mem->dirty.enabled = true;
+	memset(mem->dirty.pages, 0xff, sizeof(mem->dirty.pages));
+}
+
+// m65_mem_clean(m65_mem_t*) -> void
+// Marks every page except the zero page and the stack clean.
+void m65_mem_clean(m65_mem_t* mem)
+{
+	for (unsigned i = 0; i < sizeof(mem->dirty.pages); i++)
+	{
+		for (uint8_t bits = mem->dirty.pages[i]; bits != 0; bits &= bits - 1)
+		{
+			// Writes to clean pages take the slow path, like writes to code pages
+			unsigned page = i * 8 + __builtin_ctz(bits);
+			if (page >= 2 && mem->write[page] != NULL && mem->write[page] != m65_mem_sink)
+			{
+				mem->code.write[page] = mem->write[page];
+				mem->write[page] = NULL;
+			}
+		}
+		mem->dirty.pages[i] = 0;
+	}
+
+	mem->dirty.pages[0] = 3;
+}
+
+// m65_mem_own_data(const m65_mem_t*, uint8_t) -> const uint8_t*
+// Returns the map's own RAM at a page.
+const uint8_t* m65_mem_own_data(const m65_mem_t* mem, uint8_t page)
+{
+	if (mem->sparse == NULL)
+		return mem->ram + page * M65_PAGE_SIZE;
+	return mem->sparse[page] != NULL ? mem->sparse[page] : m65_mem_zero;
+}
+
+// m65_mem_load_own(m65_mem_t*, uint8_t, const uint8_t*) -> bool
+// Copies a page of data into the map's own RAM at a page.
+bool m65_mem_load_own(m65_mem_t* mem, uint8_t page, const uint8_t* data)
+{
+	uint8_t* own = m65_mem_own(mem, page, false);
+	if (own == NULL)
+	{
+		if (memcmp(data, m65_mem_zero, M65_PAGE_SIZE) == 0)
+			return true;
+
+		// Pages mapped to something else only get the memory
+		bool mapped = mem->write[page] == NULL && mem->code.write[page] == NULL;
+		if ((own = mapped ? m65_mem_alloc_own(mem, page) : m65_mem_own(mem, page, true)) == NULL)
+			return false;
+	}
+
+	if (memcmp(own, data, M65_PAGE_SIZE) != 0)
+	{
+		memcpy(own, data, M65_PAGE_SIZE);
+		m65_mem_invalidate(mem, page);
+	}
+	return true;
+}
+
+// m65_mem_write_code(m65_mem_t*, uint16_t, uint8_t) -> void
+// Writes a byte to an I/O page or a writable code page. Writes that don't change anything leave the page alone.
+void m65_mem_write_code(m65_mem_t* mem, uint16_t addr, uint8_t data)
+{
+	uint8_t page = addr >> 8;
+	if (mem->io[page] != NULL)
+	{
+		mem->io[page](mem->io_ctx[page], addr, data);
+		return;
+	}
+
+	// Unwritten pages of sparse maps read as zero until something else is written to them
+	if (mem->code.write[page] == NULL)
+	{
+		uint8_t* own;
+		if (data == 0 || (own = m65_mem_alloc_own(mem, page)) == NULL)
+			return;
+		own[addr & 0xff] = data;
+		m65_mem_invalidate(mem, page);
+		return;
+	}
+
+	uint8_t* byte = &mem->code.write[page][addr & 0xff];
+	if (*byte == data)
+		return;
+
+	*byte = data;
+	m65_mem_invalidate(mem, page);
+}
+
+// m65_mem_map_ram(m65_mem_t*, uint8_t, unsigned, uint8_t*) -> void
+// Maps count pages starting at page to writable memory.
+void m65_mem_map_ram(m65_mem_t* mem, uint8_t page, unsigned count, uint8_t* data)
+{
+	for (unsigned i = 0; i < count && page + i < M65_PAGES; i++)
+	{
+		m65_mem_invalidate(mem, page + i);
+		m65_mem_set_read(mem, page + i, data + i * M65_PAGE_SIZE);
+		m65_mem_set_write(mem, page + i, data + i * M65_PAGE_SIZE);
+	}
+
+	mem->zp = mem->write[0];
+	mem->stack = mem->write[1];
+}
+
+// m65_mem_map_own(m65_mem_t*, uint8_t, unsigned) -> void
+// Maps count pages starting at page back to the map's own RAM.
+void m65_mem_map_own(m65_mem_t* mem, uint8_t page, unsigned count)
+{
+	for (unsigned i = 0; i < count && page + i < M65_PAGES; i++)
+	{
+		uint8_t* own = m65_mem_own(mem, page + i, false);
+		if (own != NULL)
+		{
+			m65_mem_map_ram(mem, page + i, 1, own);
+			continue;
+		}
+
+		// Unwritten pages read as zero and take the slow path on writes (see m65_mem_write_code())
+		m65_mem_invalidate(mem, page + i);
+		m65_mem_set_read(mem, page + i, m65_mem_zero);
+		m65_mem_set_write(mem, page + i, NULL);
+		mem->code.write[page + i] = NULL;
+	}
+}
+
+// m65_mem_map_rom(m65_mem_t*, uint8_t, const uint8_t*, size_t) -> void
+// Maps size bytes of read only memory starting at a page without copying it.
+void m65_mem_map_rom(m65_mem_t* mem, uint8_t page, const uint8_t* data, size_t size)
+{
+	unsigned i;
+	for (i = 0; (i + 1) * M65_PAGE_SIZE <= size && page + i < M65_PAGES; i++)
+	{
+		// The zero page and the stack have to stay RAM
+		if (page + i < 2)
+		{
+			memcpy(mem->write[page + i], data + i * M65_PAGE_SIZE, M65_PAGE_SIZE);
+			continue;
+		}
+
+		m65_mem_invalidate(mem, page + i);
+		m65_mem_set_read(mem, page + i, data + i * M65_PAGE_SIZE);
+		m65_mem_set_write(mem, page + i, m65_mem_sink);
+	}
+
+	// The last page would read past the end of the image, so it's copied instead
+	if (i * M65_PAGE_SIZE < size && page + i < M65_PAGES)
+	{
+		if (page + i < 2)
+		{
+			memset(mem->write[page + i], 0, M65_PAGE_SIZE);
+			memcpy(mem->write[page + i], data + i * M65_PAGE_SIZE, size - i * M65_PAGE_SIZE);
+			return;
+		}
+
+		m65_mem_invalidate(mem, page + i);
+		uint8_t* copy = m65_mem_own(mem, page + i, true);
+		if (copy == NULL)
+			return;
+		memset(copy, 0, M65_PAGE_SIZE);
+		memcpy(copy, data + i * M65_PAGE_SIZE, size - i * M65_PAGE_SIZE);
+		m65_mem_set_read(mem, page + i, copy);
+		m65_mem_set_write(mem, page + i, m65_mem_sink);
+	}
+}
+
+// m65_mem_map_io(m65_mem_t*, uint8_t, unsigned, m65_io_write_t, void*) -> void
+// Sends writes to count pages starting at page to a handler, or back to memory if it's NULL.
+void m65_mem_map_io(m65_mem_t* mem, uint8_t page, unsigned count, m65_io_write_t write, void* ctx)
+{
+	for (unsigned i = page < 2 ? 2 - page : 0; i < count && page + i < M65_PAGES; i++)
+	{
+		// Pages with a NULL write pointer keep their memory in the tracking state
+		unsigned p = page + i;
+		if (write != NULL && mem->write[p] != NULL)
+		{
+			mem->code.write[p] = mem->write[p];
+			mem->write[p] = NULL;
+		} else if (write == NULL && mem->io[p] != NULL)
+		{
+			mem->write[p] = mem->code.write[p];
+			if ((m65_mem_is_code(mem, p) || !m65_mem_is_dirty(mem, p)) && mem->write[p] != m65_mem_sink)
+				mem->write[p] = NULL;
+		}
+
+		mem->io[p] = write;
+		mem->io_ctx[p] = ctx;
+	}
+}
+
+// m65_mem_now(const m65_mem_t*) -> uint64_t
+// Returns the cycle devices are caught up to on accesses.
+static inline uint64_t m65_mem_now(const m65_mem_t* mem)
+{
+	return mem->devices.clock != NULL ? *mem->devices.clock : 0;
+}
+
+// m65_mem_update_deadline(m65_mem_t*) -> void
+// Finds the earliest deadline of the devices.
+static void m65_mem_update_deadline(m65_mem_t* mem)
+{
+	mem->devices.deadline = UINT64_MAX;
+	for (unsigned i = 0; i < mem->devices.count; i++)
+	{
+		if (mem->devices.list[i]->deadline < mem->devices.deadline)
+			mem->devices.deadline = mem->devices.list[i]->deadline;
+	}
+}
+
+// m65_mem_write_device(void*, uint16_t, uint8_t) -> void
+// Writes to a register of a device.
+static void m65_mem_write_device(void* ctx, uint16_t addr, uint8_t data)
+{
+	m65_mem_t* mem = ctx;
+	m65_device_t* dev = mem->devices.pages[addr >> 8];
+	m65_device_sync(mem, dev, m65_mem_now(mem));
+	if (dev->write != NULL)
+	{
+		dev->write(dev, addr, data);
+		m65_mem_update_deadline(mem);
+	}
+}
+
+// m65_mem_read_device(m65_mem_t*, uint16_t) -> uint8_t
+// Reads a register of a device.
+uint8_t m65_mem_read_device(m65_mem_t* mem, uint16_t addr)
+{
+	m65_device_t* dev = mem->devices.pages[addr >> 8];
+	m65_device_sync(mem, dev, m65_mem_now(mem));
+	if (dev->read == NULL)
+		return 0xff;
+
+	uint8_t data = dev->read(dev, addr);
+	m65_mem_update_deadline(mem);
+	return data;
+}
+
+// m65_mem_map_device(m65_mem_t*, uint8_t, unsigned, m65_device_t*) -> bool
+// Maps a device into count pages starting at page.
+bool m65_mem_map_device(m65_mem_t* mem, uint8_t page, unsigned count, m65_device_t* dev)
+{
+	unsigned i;
+	for (i = 0; i < mem->devices.count && mem->devices.list[i] != dev; i++);
+	if (i == mem->devices.count)
+	{
+		if (mem->devices.count == M65_DEVICES)
+			return false;
+		mem->devices.list[mem->devices.count++] = dev;
+	}
+
+	for (i = page < 2 ? 2 - page : 0; i < count && page + i < M65_PAGES; i++)
+	{
+		m65_mem_invalidate(mem, page + i);
+		mem->devices.pages[page + i] = dev;
+		mem->read[page + i] = NULL;
+	}
+
+	m65_mem_map_io(mem, page, count, m65_mem_write_device, mem);
+	m65_mem_update_deadline(mem);
+	return true;
+}
+
+// m65_mem_unmap_device(m65_mem_t*, m65_device_t*) -> void
+// Removes a device from a memory map, mapping its pages back to the map's own RAM.
+void m65_mem_unmap_device(m65_mem_t* mem, m65_device_t* dev)
+{
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		if (mem->devices.pages[page] != dev)
+			continue;
+
+		mem->devices.pages[page] = NULL;
+		m65_mem_map_io(mem, page, 1, NULL, NULL);
+		m65_mem_map_own(mem, page, 1);
+	}
+
+	for (unsigned i = 0; i < mem->devices.count; i++)
+	{
+		if (mem->devices.list[i] == dev)
+			mem->devices.list[i] = mem->devices.list[--mem->devices.count];
+	}
+	m65_mem_update_deadline(mem);
+}
+
+// m65_mem_set_clock(m65_mem_t*, const uint64_t*) -> void
+// Sets the cycle counter devices are caught up to on accesses.
+void m65_mem_set_clock(m65_mem_t* mem, const uint64_t* clock)
+{
+	mem->devices.clock = clock;
+}
+
+// m65_device_sync(m65_mem_t*, m65_device_t*, uint64_t) -> void
+// Catches a device up to a cycle.
+void m65_device_sync(m65_mem_t* mem, m65_device_t* dev, uint64_t now)
+{
+	if (now <= dev->synced)
+		return;
+
+	if (dev->advance != NULL)
+		dev->advance(dev, dev->synced, now);
+	dev->synced = now;
+	dev->syncs++;
+	m65_mem_update_deadline(mem);
+}
+
+// m65_device_schedule(m65_mem_t*, m65_device_t*, uint64_t) -> void
+// Sets the cycle a device has to be caught up by.
+void m65_device_schedule(m65_mem_t* mem, m65_device_t* dev, uint64_t deadline)
+{
+	dev->deadline = deadline;
+	m65_mem_update_deadline(mem);
+}
+
+// m65_mem_sync_due(m65_mem_t*, uint64_t) -> void
+// Catches up the devices whose deadline passed.
+void m65_mem_sync_due(m65_mem_t* mem, uint64_t now)
+{
+	for (unsigned i = 0; i < mem->devices.count; i++)
+	{
+		if (mem->devices.list[i]->deadline <= now)
+			m65_device_sync(mem, mem->devices.list[i], now);
+	}
+}
+
+// m65_mem_sync_all(m65_mem_t*, uint64_t) -> void
+// Catches up every device.
+void m65_mem_sync_all(m65_mem_t* mem, uint64_t now)
+{
+	for (unsigned i = 0; i < mem->devices.count; i++)
+		m65_device_sync(mem, mem->devices.list[i], now);
+}
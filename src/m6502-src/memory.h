@@ -0,0 +1,364 @@
+//
+// MOS6502 Emulator
+// memory.h: Header file for memory.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "m6502.h"
+
+// The address space is split into 256 pages of 256 bytes.
+#define M65_PAGE_SIZE 256
+#define M65_PAGES 256
+
+// Called after a code page was written to or remapped, so that anything cached about the code in it can be dropped.
+typedef void (*m65_code_hook_t)(void* ctx, uint8_t page);
+
+// Called for every write to an I/O page, such as the registers of a mapper, instead of writing to memory.
+typedef void (*m65_io_write_t)(void* ctx, uint16_t addr, uint8_t data);
+
+// The most devices a memory map can have.
+#define M65_DEVICES 16
+
+// Represents a peripheral mapped into the address space. Devices aren't ticked along with the processor; they remember
+// the cycle they were last caught up to and are run over the whole span since then when the processor accesses one of
+// their pages, or when their deadline passes.
+typedef struct s_m65_device m65_device_t;
+struct s_m65_device
+{
+	// Runs the device from cycle from up to cycle to. NULL for devices that don't do anything on their own.
+	void (*advance)(m65_device_t* dev, uint64_t from, uint64_t to);
+
+	// Reads and writes a register. The device is caught up to the cycle of the access first.
+	uint8_t (*read)(m65_device_t* dev, uint16_t addr);
+	void (*write)(m65_device_t* dev, uint16_t addr, uint8_t data);
+
+	// Anything the device needs, such as the processor whose interrupt lines it drives.
+	void* ctx;
+
+	// The cycle the device was last caught up to.
+	uint64_t synced;
+
+	// The cycle the device has to be caught up by even if nothing accesses it, for example because a timer raises an
+	// interrupt then, or UINT64_MAX. Devices move it on when they are caught up; set it from outside with
+	// m65_device_schedule().
+	uint64_t deadline;
+
+	// The number of times the device was caught up.
+	uint64_t syncs;
+};
+
+// Represents the memory map seen by a processor. Every page points directly at the memory backing it, so mapping ROM,
+// RAM or a bank into a page is a pointer update and accesses never copy or check what is behind the page. Pages 0 and
+// 1 are always RAM and never tracked as code.
+typedef struct
+{
+	// The memory each page is read from. Device pages are NULL, so that reads from them take the slow path.
+	const uint8_t* read[M65_PAGES];
+
+	// The memory each page is written to. Pages mapped read only write into m65_mem_sink. I/O pages are NULL, and so
+	// are writable code pages while code is tracked, clean pages while changes are tracked and unwritten pages of
+	// sparse maps, so that writes to them take the slow path.
+	uint8_t* write[M65_PAGES];
+
+	// The handlers of writes to I/O pages (see m65_mem_map_io()) and their contexts, or NULL for memory.
+	m65_io_write_t io[M65_PAGES];
+	void* io_ctx[M65_PAGES];
+
+	// The 64 KiB of RAM owned by a dense memory map, or NULL for a sparse one.
+	uint8_t* ram;
+
+	// The RAM pages owned by a sparse memory map, or NULL for a dense one. Pages are NULL until they're first written.
+	uint8_t** sparse;
+
+	// The arena the pages of a sparse memory map come from.
+	m65_arena_t* arena;
+
+	// The zero page and the stack page. Pages 0 and 1 are always RAM, so the step engine accesses them through these
+	// instead of the page tables.
+	uint8_t* zp;
+	uint8_t* stack;
+
+	// The code tracking state (see m65_mem_track_code()).
+	struct
+	{
+		// Whether executed code is tracked at all.
+		bool enabled;
+
+		// The pages that code was executed from, one bit per page.
+		uint8_t pages[M65_PAGES / 8];
+
+		// The number of times the contents of each code page changed.
+		uint32_t generation[M65_PAGES];
+
+		// The memory writable code pages are written to.
+		uint8_t* write[M65_PAGES];
+
+		// The invalidation hook and its context.
+		m65_code_hook_t hook;
+		void* ctx;
+	} code;
+
+	// The change tracking state (see m65_mem_track_dirty()).
+	struct
+	{
+		// Whether changes are tracked at all.
+		bool enabled;
+
+		// The pages that may have changed since they were last marked clean, one bit per page.
+		uint8_t pages[M65_PAGES / 8];
+	} dirty;
+
+	// The devices (see m65_mem_map_device()).
+	struct
+	{
+		// The device behind each page, or NULL.
+		m65_device_t* pages[M65_PAGES];
+
+		// Every mapped device.
+		m65_device_t* list[M65_DEVICES];
+		unsigned count;
+
+		// The earliest deadline of any device.
+		uint64_t deadline;
+
+		// The cycle counter devices are caught up to, or NULL if they aren't run by accesses.
+		const uint64_t* clock;
+	} devices;
+} m65_mem_t;
+
+// A page that swallows writes to read only memory. It is never read from.
+extern uint8_t m65_mem_sink[M65_PAGE_SIZE];
+
+// A page of zeros that the unwritten pages of sparse memory maps read from.
+extern const uint8_t m65_mem_zero[M65_PAGE_SIZE];
+
+// m65_mem_init(m65_mem_t*) -> bool
+// Initialises a memory map with all pages mapped to its own RAM. Returns false if the RAM can't be allocated.
+bool m65_mem_init(m65_mem_t* mem);
+
+// m65_mem_init_sparse(m65_mem_t*) -> bool
+// Initialises a memory map like m65_mem_init(), but only allocates its RAM a page at a time, on the first write that
+// changes a page (the zero page and the stack are allocated right away). Unwritten pages read as zero from a shared
+// page. Pages come from the arena of the thread (m65_arena_thread()) and go back to it, so maps that only touch a few
+// pages take little memory and are cheap to create. Accesses to written pages are as fast as with a dense map. Returns
+// false if memory can't be allocated.
+bool m65_mem_init_sparse(m65_mem_t* mem);
+
+// m65_mem_init_arena(m65_mem_t*, m65_arena_t*) -> bool
+// Initialises a sparse memory map whose pages come from an arena. The map only has to be freed if the arena isn't reset
+// or freed along with it. Returns false if memory can't be allocated.
+bool m65_mem_init_arena(m65_mem_t* mem, m65_arena_t* arena);
+
+// m65_mem_free(m65_mem_t*) -> void
+// Frees the RAM of a memory map. Mapped ROM is owned by whoever mapped it.
+void m65_mem_free(m65_mem_t* mem);
+
+// m65_mem_new(m65_arena_t*) -> m65_mem_t*
+// Allocates a sparse memory map from an arena and initialises it with m65_mem_init_arena(). Returns NULL if memory
+// can't be allocated.
+m65_mem_t* m65_mem_new(m65_arena_t* arena);
+
+// m65_mem_release(m65_arena_t*, m65_mem_t*) -> void
+// Frees a memory map allocated with m65_mem_new() and gives it back to its arena, or does nothing for NULL.
+void m65_mem_release(m65_arena_t* arena, m65_mem_t* mem);
+
+// m65_mem_clone(m65_mem_t*, const m65_mem_t*) -> bool
+// Initialises a sparse memory map (like m65_mem_init_sparse()) as a snapshot of another one: the RAM it owns is copied,
+// and pages mapped to anything else, such as ROM or the RAM of a mapper, point at the same memory. I/O handlers are
+// kept along with their contexts (see m65_mapper_clone()). Code isn't tracked in the copy. Maps with devices can't be
+// copied. Returns false if they have devices or memory can't be allocated.
+bool m65_mem_clone(m65_mem_t* dst, const m65_mem_t* src);
+
+// m65_mem_relocate(m65_mem_t*, const uint8_t*, size_t, uint8_t*) -> void
+// Points the pages mapped into the size bytes at from to the same place in to instead, for example after copying the
+// memory behind them.
+void m65_mem_relocate(m65_mem_t* mem, const uint8_t* from, size_t size, uint8_t* to);
+
+// m65_mem_map_own(m65_mem_t*, uint8_t, unsigned) -> void
+// Maps count pages starting at page back to the map's own RAM.
+void m65_mem_map_own(m65_mem_t* mem, uint8_t page, unsigned count);
+
+// m65_mem_map_ram(m65_mem_t*, uint8_t, unsigned, uint8_t*) -> void
+// Maps count pages starting at page to writable memory.
+void m65_mem_map_ram(m65_mem_t* mem, uint8_t page, unsigned count, uint8_t* data);
+
+// m65_mem_map_rom(m65_mem_t*, uint8_t, const uint8_t*, size_t) -> void
+// Maps size bytes of read only memory starting at a page without copying it. A partial last page is copied into the
+// map's RAM and made read only. Pages 0 and 1 stay RAM; the ROM is copied into them.
+void m65_mem_map_rom(m65_mem_t* mem, uint8_t page, const uint8_t* data, size_t size);
+
+// m65_mem_map_io(m65_mem_t*, uint8_t, unsigned, m65_io_write_t, void*) -> void
+// Sends writes to count pages starting at page to a handler (or back to memory if it's NULL). Reads still come from
+// whatever is mapped there, and the pages stay I/O when ROM or RAM is mapped over them. Pages 0 and 1 can't be I/O.
+void m65_mem_map_io(m65_mem_t* mem, uint8_t page, unsigned count, m65_io_write_t write, void* ctx);
+
+// m65_mem_map_device(m65_mem_t*, uint8_t, unsigned, m65_device_t*) -> bool
+// Maps a device into count pages starting at page. Reads and writes of these pages catch the device up to the clock
+// (see m65_mem_set_clock()) and then go to its registers. Pages 0 and 1 can't be devices. Returns false if there are
+// too many devices.
+bool m65_mem_map_device(m65_mem_t* mem, uint8_t page, unsigned count, m65_device_t* dev);
+
+// m65_mem_unmap_device(m65_mem_t*, m65_device_t*) -> void
+// Removes a device from a memory map, mapping its pages back to the map's own RAM.
+void m65_mem_unmap_device(m65_mem_t* mem, m65_device_t* dev);
+
+// m65_mem_set_clock(m65_mem_t*, const uint64_t*) -> void
+// Sets the cycle counter devices are caught up to on accesses, normally &cpu->cycles. The cycle engine accesses devices
+// on the exact cycle; the step engines access them on the cycle the instruction started.
+void m65_mem_set_clock(m65_mem_t* mem, const uint64_t* clock);
+
+// m65_device_sync(m65_mem_t*, m65_device_t*, uint64_t) -> void
+// Catches a device up to a cycle.
+void m65_device_sync(m65_mem_t* mem, m65_device_t* dev, uint64_t now);
+
+// m65_device_schedule(m65_mem_t*, m65_device_t*, uint64_t) -> void
+// Sets the cycle a device has to be caught up by.
+void m65_device_schedule(m65_mem_t* mem, m65_device_t* dev, uint64_t deadline);
+
+// m65_mem_sync_due(m65_mem_t*, uint64_t) -> void
+// Catches up the devices whose deadline passed. Use m65_mem_poll_devices() instead.
+void m65_mem_sync_due(m65_mem_t* mem, uint64_t now);
+
+// m65_mem_sync_all(m65_mem_t*, uint64_t) -> void
+// Catches up every device, for example at the end of a frame.
+void m65_mem_sync_all(m65_mem_t* mem, uint64_t now);
+
+// m65_mem_read_device(m65_mem_t*, uint16_t) -> uint8_t
+// Reads a register of a device. Use m65_mem_read() instead.
+uint8_t m65_mem_read_device(m65_mem_t* mem, uint16_t addr);
+
+// m65_mem_track_code(m65_mem_t*, m65_code_hook_t, void*) -> void
+// Starts tracking the pages that code is executed from, forgetting any that were tracked before. Writes that change a
+// code page and remapping a code page increment its generation and call the hook (if not NULL). Writes to other pages
+// cost nothing extra.
+void m65_mem_track_code(m65_mem_t* mem, m65_code_hook_t hook, void* ctx);
+
+// m65_mem_untrack_code(m65_mem_t*) -> void
+// Stops tracking code.
+void m65_mem_untrack_code(m65_mem_t* mem);
+
+// m65_mem_mark_code(m65_mem_t*, uint8_t) -> void
+// Marks a page as containing code. Pages 0 and 1 are left alone. Use m65_mem_exec() instead.
+void m65_mem_mark_code(m65_mem_t* mem, uint8_t page);
+
+// m65_mem_track_dirty(m65_mem_t*) -> void
+// Starts tracking the pages whose contents change, with every page dirty. The first write that changes a clean page
+// marks it dirty and takes the slow path; writes to dirty pages cost nothing extra. Remapping a page marks it dirty.
+// The zero page and the stack are written directly by the step engines, so they're always dirty.
+void m65_mem_track_dirty(m65_mem_t* mem);
+
+// m65_mem_clean(m65_mem_t*) -> void
+// Marks every page except the zero page and the stack clean, for example after saving them. This only looks at the
+// pages that were dirty.
+void m65_mem_clean(m65_mem_t* mem);
+
+// m65_mem_own_data(const m65_mem_t*, uint8_t) -> const uint8_t*
+// Returns the map's own RAM at a page, whatever is mapped there, or m65_mem_zero for unwritten pages of sparse maps.
+const uint8_t* m65_mem_own_data(const m65_mem_t* mem, uint8_t page);
+
+// m65_mem_load_own(m65_mem_t*, uint8_t, const uint8_t*) -> bool
+// Copies a page of data into the map's own RAM at a page, as writes would, so the page becomes dirty and code in it is
+// invalidated if it changed. Returns false if memory can't be allocated.
+bool m65_mem_load_own(m65_mem_t* mem, uint8_t page, const uint8_t* data);
+
+// m65_mem_write_code(m65_mem_t*, uint16_t, uint8_t) -> void
+// Writes a byte to an I/O page, a writable code page, a clean page or an unwritten page of a sparse map. Use
+// m65_mem_write() instead.
+void m65_mem_write_code(m65_mem_t* mem, uint16_t addr, uint8_t data);
+
+// m65_mem_is_code(const m65_mem_t*, uint8_t) -> bool
+// Checks if code was executed from a page since tracking started or the page was last invalidated.
+static inline bool m65_mem_is_code(const m65_mem_t* mem, uint8_t page)
+{
+	return mem->code.pages[page >> 3] & 1 << (page & 7);
+}
+
+// m65_mem_is_dirty(const m65_mem_t*, uint8_t) -> bool
+// Checks if a page may have changed since it was last marked clean. Every page is dirty while changes aren't tracked.
+static inline bool m65_mem_is_dirty(const m65_mem_t* mem, uint8_t page)
+{
+	return !mem->dirty.enabled || mem->dirty.pages[page >> 3] & 1 << (page & 7);
+}
+
+// m65_mem_generation(const m65_mem_t*, uint8_t) -> uint32_t
+// Returns the write generation of a page. Anything derived from the code in a page is still valid as long as the
+// generation is the same as when it was derived.
+static inline uint32_t m65_mem_generation(const m65_mem_t* mem, uint8_t page)
+{
+	return mem->code.generation[page];
+}
+
+// m65_mem_exec(m65_mem_t*, uint16_t) -> void
+// Notes that an instruction is executed from an address. This marks the pages holding its opcode and operands as code.
+static inline void m65_mem_exec(m65_mem_t* mem, uint16_t addr)
+{
+	if (!mem->code.enabled)
+		return;
+
+	uint16_t last = addr + 2;
+	if (!m65_mem_is_code(mem, addr >> 8))
+		m65_mem_mark_code(mem, addr >> 8);
+	if (!m65_mem_is_code(mem, last >> 8))
+		m65_mem_mark_code(mem, last >> 8);
+}
+
+// m65_mem_poll_devices(m65_mem_t*, uint64_t) -> void
+// Catches up the devices whose deadline passed. Engines call this after every instruction or cycle.
+static inline void m65_mem_poll_devices(m65_mem_t* mem, uint64_t now)
+{
+	if (now >= mem->devices.deadline)
+		m65_mem_sync_due(mem, now);
+}
+
+// m65_mem_read(m65_mem_t*, uint16_t) -> uint8_t
+// Reads a byte from memory.
+static inline uint8_t m65_mem_read(m65_mem_t* mem, uint16_t addr)
+{
+	const uint8_t* page = mem->read[addr >> 8];
+	if (page != NULL)
+		return page[addr & 0xff];
+	return m65_mem_read_device(mem, addr);
+}
+
+// m65_mem_peek(const m65_mem_t*, uint16_t) -> uint8_t
+// Reads a byte from memory without side effects, for looking at code. Device pages read as 0xFF.
+static inline uint8_t m65_mem_peek(const m65_mem_t* mem, uint16_t addr)
+{
+	const uint8_t* page = mem->read[addr >> 8];
+	return page != NULL ? page[addr & 0xff] : 0xff;
+}
+
+// m65_mem_write(m65_mem_t*, uint16_t, uint8_t) -> void
+// Writes a byte to memory.
+static inline void m65_mem_write(m65_mem_t* mem, uint16_t addr, uint8_t data)
+{
+	uint8_t* page = mem->write[addr >> 8];
+	if (page != NULL)
+		page[addr & 0xff] = data;
+	else m65_mem_write_code(mem, addr, data);
+}
+
+// m65_mem_bus(m65_mem_t*, m6502_t*) -> void
+// Performs the bus transaction requested by the pins of a processor, after catching up devices whose deadline passed.
+// Call this before every m65_cycle().
+static inline void m65_mem_bus(m65_mem_t* mem, m6502_t* cpu)
+{
+	m65_mem_poll_devices(mem, cpu->cycles);
+	if (cpu->pins.rw == READ)
+	{
+		// Opcode fetches are what marks code
+		if (m65_fetching(cpu))
+			m65_mem_exec(mem, cpu->pins.addr);
+		cpu->pins.data = m65_mem_read(mem, cpu->pins.addr);
+	} else m65_mem_write(mem, cpu->pins.addr, cpu->pins.data);
+}
+
+#endif /* MEMORY_H */
@@ -0,0 +1,212 @@
+//
+// MOS6502 Emulator
+// opcodes.c: Implements the opcode metadata and timing tables.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <stdio.h>
+
+#include "opcodes.h"
+
+// The length in bytes of an instruction of each addressing mode.
+const uint8_t m65_mode_length[14] = {
+	// impl acc imm zp zpx zpy abs absx absy ind indx indy indzp rel
+	1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2, 2
+};
+
+// The opcodes shared by all variants. Each entry is op(opcode, addressing mode, cycles, penalties).
+#define m65_ops_common(op)																			\
+	/* ora, and, eor, lda, cmp */																	\
+	m65_ops_alu(op, 0x00) m65_ops_alu(op, 0x20) m65_ops_alu(op, 0x40)								\
+	m65_ops_alu(op, 0xA0) m65_ops_alu(op, 0xC0)														\
+																									\
+	/* sta */																						\
+	op(0x85, ZP, 3, 0) op(0x95, ZPX, 4, 0) op(0x8D, ABS, 4, 0) op(0x9D, ABSX, 5, 0)				\
+	op(0x99, ABSY, 5, 0) op(0x81, INDX, 6, 0) op(0x91, INDY, 6, 0)									\
+																									\
+	/* bit, jmp, jsr */																				\
+	op(0x24, ZP, 3, 0) op(0x2C, ABS, 4, 0) op(0x4C, ABS, 3, 0) op(0x20, ABS, 6, 0)					\
+																									\
+	/* sty, ldy, cpy, cpx */																		\
+	op(0x84, ZP, 3, 0) op(0x94, ZPX, 4, 0) op(0x8C, ABS, 4, 0)										\
+	op(0xA0, IMM, 2, 0) op(0xA4, ZP, 3, 0) op(0xB4, ZPX, 4, 0) op(0xAC, ABS, 4, 0)					\
+	op(0xBC, ABSX, 4, M65_PEN_PAGE)																	\
+	op(0xC0, IMM, 2, 0) op(0xC4, ZP, 3, 0) op(0xCC, ABS, 4, 0)										\
+	op(0xE0, IMM, 2, 0) op(0xE4, ZP, 3, 0) op(0xEC, ABS, 4, 0)										\
+																									\
+	/* stx, ldx */																					\
+	op(0x86, ZP, 3, 0) op(0x96, ZPY, 4, 0) op(0x8E, ABS, 4, 0)										\
+	op(0xA2, IMM, 2, 0) op(0xA6, ZP, 3, 0) op(0xB6, ZPY, 4, 0) op(0xAE, ABS, 4, 0)					\
+	op(0xBE, ABSY, 4, M65_PEN_PAGE)																	\
+																									\
+	/* dec, inc */																					\
+	op(0xC6, ZP, 5, 0) op(0xD6, ZPX, 6, 0) op(0xCE, ABS, 6, 0) op(0xDE, ABSX, 7, 0)				\
+	op(0xE6, ZP, 5, 0) op(0xF6, ZPX, 6, 0) op(0xEE, ABS, 6, 0) op(0xFE, ABSX, 7, 0)				\
+																									\
+	/* branches */																					\
+	op(0x10, REL, 2, M65_PEN_BRANCH) op(0x30, REL, 2, M65_PEN_BRANCH)								\
+	op(0x50, REL, 2, M65_PEN_BRANCH) op(0x70, REL, 2, M65_PEN_BRANCH)								\
+	op(0x90, REL, 2, M65_PEN_BRANCH) op(0xB0, REL, 2, M65_PEN_BRANCH)								\
+	op(0xD0, REL, 2, M65_PEN_BRANCH) op(0xF0, REL, 2, M65_PEN_BRANCH)								\
+																									\
+	/* brk, rti, rts */																				\
+	op(0x00, IMPL, 7, 0) op(0x40, IMPL, 6, 0) op(0x60, IMPL, 6, 0)									\
+																									\
+	/* opcodes that end with 8 */																	\
+	op(0x08, IMPL, 3, 0) op(0x18, IMPL, 2, 0) op(0x28, IMPL, 4, 0) op(0x38, IMPL, 2, 0)			\
+	op(0x48, IMPL, 3, 0) op(0x58, IMPL, 2, 0) op(0x68, IMPL, 4, 0) op(0x78, IMPL, 2, 0)			\
+	op(0x88, IMPL, 2, 0) op(0x98, IMPL, 2, 0) op(0xA8, IMPL, 2, 0) op(0xB8, IMPL, 2, 0)			\
+	op(0xC8, IMPL, 2, 0) op(0xD8, IMPL, 2, 0) op(0xE8, IMPL, 2, 0) op(0xF8, IMPL, 2, 0)			\
+																									\
+	/* opcodes that end with a */																	\
+	op(0x8A, IMPL, 2, 0) op(0x9A, IMPL, 2, 0) op(0xAA, IMPL, 2, 0) op(0xBA, IMPL, 2, 0)			\
+	op(0xCA, IMPL, 2, 0) op(0xEA, IMPL, 2, 0)
+
+// The eight opcodes of an accumulator instruction. base is the opcode of the (zp, x) form.
+#define m65_ops_alu(op, base, ...)																	\
+	op(base | 0x09, IMM, 2, __VA_ARGS__ 0) op(base | 0x05, ZP, 3, __VA_ARGS__ 0)					\
+	op(base | 0x15, ZPX, 4, __VA_ARGS__ 0) op(base | 0x0D, ABS, 4, __VA_ARGS__ 0)					\
+	op(base | 0x1D, ABSX, 4, __VA_ARGS__ M65_PEN_PAGE) op(base | 0x19, ABSY, 4, __VA_ARGS__ M65_PEN_PAGE)	\
+	op(base | 0x01, INDX, 6, __VA_ARGS__ 0) op(base | 0x11, INDY, 5, __VA_ARGS__ M65_PEN_PAGE)
+
+// The opcodes that differ between the NMOS chips and the 65C02.
+#define m65_ops_nmos(op)																			\
+	m65_ops_alu(op, 0x60) m65_ops_alu(op, 0xE0)														\
+	op(0x6C, IND, 5, 0)
+
+#define m65_ops_cmos(op)																			\
+	m65_ops_alu(op, 0x60, M65_PEN_DECIMAL |) m65_ops_alu(op, 0xE0, M65_PEN_DECIMAL |)				\
+	op(0x6C, IND, 6, 0)																				\
+																									\
+	/* inc a, dec a, phy, ply, phx, plx */															\
+	op(0x1A, ACC, 2, 0) op(0x3A, ACC, 2, 0) op(0x5A, IMPL, 3, 0) op(0x7A, IMPL, 4, 0)				\
+	op(0xDA, IMPL, 3, 0) op(0xFA, IMPL, 4, 0)														\
+																									\
+	/* stz */																						\
+	op(0x64, ZP, 3, 0) op(0x74, ZPX, 4, 0) op(0x9C, ABS, 4, 0) op(0x9E, ABSX, 5, 0)				\
+																									\
+	/* bra */																						\
+	op(0x80, REL, 2, M65_PEN_BRANCH)																\
+																									\
+	/* (zp) forms of the accumulator instructions */												\
+	op(0x12, INDZP, 5, 0) op(0x32, INDZP, 5, 0) op(0x52, INDZP, 5, 0)								\
+	op(0x72, INDZP, 5, M65_PEN_DECIMAL) op(0x92, INDZP, 5, 0) op(0xB2, INDZP, 5, 0)				\
+	op(0xD2, INDZP, 5, 0) op(0xF2, INDZP, 5, M65_PEN_DECIMAL)
+
+#define m65_opinfo_(code, mode, cycles, penalty) [code] = {M65_MODE_##mode, cycles, penalty},
+
+static const m65_opinfo_t m65_opinfo_nmos[256] = {
+	m65_ops_common(m65_opinfo_)
+	m65_ops_nmos(m65_opinfo_)
+};
+
+static const m65_opinfo_t m65_opinfo_cmos[256] = {
+	m65_ops_common(m65_opinfo_)
+	m65_ops_cmos(m65_opinfo_)
+};
+
+#undef m65_opinfo_
+
+// The opcode tables of each variant, indexed by m65_variant_t. The 2A03 has the same timing as the NMOS 6502.
+const m65_opinfo_t* const m65_opinfo[3] = {
+	m65_opinfo_nmos, m65_opinfo_cmos, m65_opinfo_nmos
+};
+
+#ifdef M65_VERIFY_CYCLES
+// m65_verify_read(m6502_t*, uint16_t, uint8_t*) -> bool
+// Looks up the data the current instruction read from an address.
+static bool m65_verify_read(m6502_t* cpu, uint16_t addr, uint8_t* data)
+{
+	for (uint8_t i = 0; i < cpu->verify.reads; i++)
+	{
+		if (cpu->verify.bus[i].addr == addr)
+		{
+			*data = cpu->verify.bus[i].data;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// m65_verify_cycle(m6502_t*, bool) -> void
+// Records the bus transaction of the previous cycle and, at the start of an instruction, its initial state.
+void m65_verify_cycle(m6502_t* cpu, bool start)
+{
+	if (start)
+	{
+		// The opcode was just fetched; remember the state the timing depends on
+		cpu->verify.start = cpu->cycles;
+		cpu->verify.pc = cpu->pins.addr;
+		cpu->verify.opcode = cpu->ir;
+		cpu->verify.x = cpu->x;
+		cpu->verify.y = cpu->y;
+		cpu->verify.flags = cpu->flags;
+		cpu->verify.reads = 0;
+	} else if (cpu->pins.rw == READ && cpu->verify.reads < sizeof(cpu->verify.bus) / sizeof(cpu->verify.bus[0]))
+	{
+		cpu->verify.bus[cpu->verify.reads].addr = cpu->pins.addr;
+		cpu->verify.bus[cpu->verify.reads].data = cpu->pins.data;
+		cpu->verify.reads++;
+	}
+}
+
+// m65_verify_end(m6502_t*) -> void
+// Checks the cycles the instruction that just finished took against the timing table.
+void m65_verify_end(m6502_t* cpu)
+{
+	const m65_opinfo_t* info = &m65_opinfo[cpu->variant][cpu->verify.opcode];
+	uint16_t pc = cpu->verify.pc;
+	uint8_t low = 0, high = 0, ptr = 0;
+	uint16_t base = 0, addr = 0;
+	bool taken = false;
+
+	// Undocumented opcodes have no timing to check against
+	if (info->cycles == 0)
+		return;
+
+	// Recompute the effective address from the bytes the instruction read
+	m65_verify_read(cpu, pc + 1, &low);
+	m65_verify_read(cpu, pc + 2, &high);
+	switch (info->mode)
+	{
+		case M65_MODE_ABSX:
+			base = high << 8 | low;
+			addr = base + cpu->verify.x;
+			break;
+		case M65_MODE_ABSY:
+			base = high << 8 | low;
+			addr = base + cpu->verify.y;
+			break;
+		case M65_MODE_INDY:
+			m65_verify_read(cpu, low, &ptr);
+			base = ptr;
+			addr = base + cpu->verify.y;
+			break;
+		case M65_MODE_REL:
+		{
+			//							  N		  V		  C		  Z
+			static const uint8_t flags[4] = {1 << 7, 1 << 6, 1 << 0, 1 << 1};
+			uint8_t opcode = cpu->verify.opcode;
+			taken = opcode == 0x80
+				 || (bool) (cpu->verify.flags & flags[opcode >> 6]) == (bool) (opcode & 0x20);
+			base = pc + 2;
+			addr = base + (int8_t) low;
+			break;
+		}
+		default:
+			break;
+	}
+
+	uint64_t taken_cycles = cpu->cycles - cpu->verify.start + 1;
+	uint8_t expected = m65_op_cycles(info, base, addr, taken, cpu->verify.flags & 0x08);
+	if (taken_cycles != expected)
+	{
+		cpu->verify.errors++;
+		fprintf(stderr, "cycle mismatch: opcode 0x%02x at 0x%04x took %" PRIu64 " cycles, expected %u\n",
+				cpu->verify.opcode, pc, taken_cycles, expected);
+	}
+}
+#endif
@@ -0,0 +1,93 @@
+//
+// MOS6502 Emulator
+// opcodes.h: Header file for opcodes.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include "m6502.h"
+
+// The addressing modes as seen from outside the processor.
+typedef enum
+{
+	M65_MODE_IMPL,
+	M65_MODE_ACC,
+	M65_MODE_IMM,
+	M65_MODE_ZP,
+	M65_MODE_ZPX,
+	M65_MODE_ZPY,
+	M65_MODE_ABS,
+	M65_MODE_ABSX,
+	M65_MODE_ABSY,
+	M65_MODE_IND,
+	M65_MODE_INDX,
+	M65_MODE_INDY,
+	M65_MODE_INDZP,
+	M65_MODE_REL
+} m65_mode_t;
+
+// Extra cycles an instruction may take on top of its base cycle count.
+// - M65_PEN_PAGE: +1 if indexing crosses a page boundary.
+// - M65_PEN_BRANCH: +1 if the branch is taken, +1 more if it lands on another page.
+// - M65_PEN_DECIMAL: +1 if the decimal flag is set.
+#define M65_PEN_PAGE	0x01
+#define M65_PEN_BRANCH	0x02
+#define M65_PEN_DECIMAL	0x04
+
+// Represents the metadata of an opcode.
+typedef struct
+{
+	// The addressing mode (m65_mode_t).
+	uint8_t mode;
+
+	// The number of cycles the instruction takes without penalties, or 0 if the opcode isn't implemented.
+	uint8_t cycles;
+
+	// The penalties that apply to the instruction (M65_PEN_*).
+	uint8_t penalty;
+} m65_opinfo_t;
+
+// The opcode tables of each variant, indexed by m65_variant_t.
+extern const m65_opinfo_t* const m65_opinfo[3];
+
+// The length in bytes of an instruction of each addressing mode.
+extern const uint8_t m65_mode_length[14];
+
+// m65_op_cycles(const m65_opinfo_t*, uint16_t, uint16_t, bool, bool) -> uint8_t
+// Returns the cycles an instruction takes. base is the address before indexing and addr is the address after indexing
+// (for branches, the address after the instruction and the branch target); taken is whether a branch is taken and
+// decimal is whether the decimal flag is set. It's inline so that the penalties of constant metadata fold away.
+static inline uint8_t m65_op_cycles(const m65_opinfo_t* info, uint16_t base, uint16_t addr, bool taken, bool decimal)
+{
+	uint8_t cycles = info->cycles;
+
+	// Indexing across a page boundary
+	if ((info->penalty & M65_PEN_PAGE) && (base & 0xff00) != (addr & 0xff00))
+		cycles++;
+
+	// Taken branches, and taken branches that land on another page
+	if ((info->penalty & M65_PEN_BRANCH) && taken)
+		cycles += 1 + ((base & 0xff00) != (addr & 0xff00));
+
+	// Decimal mode on the 65C02
+	if ((info->penalty & M65_PEN_DECIMAL) && decimal)
+		cycles++;
+
+	return cycles;
+}
+
+#ifdef M65_VERIFY_CYCLES
+// m65_verify_cycle(m6502_t*, bool) -> void
+// Records the bus transaction of the previous cycle and, at the start of an instruction, its initial state.
+void m65_verify_cycle(m6502_t* cpu, bool start);
+
+// m65_verify_end(m6502_t*) -> void
+// Checks the cycles the instruction that just finished took against the timing table.
+void m65_verify_end(m6502_t* cpu);
+#endif
+
+#endif /* OPCODES_H */
@@ -0,0 +1,96 @@
+//
+// MOS6502 Emulator
+// pace.c: Implements running processors in real time.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <errno.h>
+
+#include "pace.h"
+#include "step.h"
+
+// m65_pace_ns(const struct timespec*) -> uint64_t
+// Converts a time to nanoseconds.
+static inline uint64_t m65_pace_ns(const struct timespec* time)
+{
+	return time->tv_sec * 1000000000ull + time->tv_nsec;
+}
+
+// m65_pace_now() -> uint64_t
+// Returns the host clock in nanoseconds.
+static inline uint64_t m65_pace_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return m65_pace_ns(&now);
+}
+
+// m65_pace_init(m65_pace_t*, uint64_t, uint64_t) -> void
+// Starts pacing a processor at the given clock rate from its current cycle count.
+void m65_pace_init(m65_pace_t* pace, uint64_t hz, uint64_t cycles)
+{
+	*pace = (m65_pace_t) {
+		.hz = hz,
+		.batch = hz / 1000 ? hz / 1000 : 1,
+		.start_cycles = cycles,
+		.max_lag = 100000000
+	};
+	clock_gettime(CLOCK_MONOTONIC, &pace->start);
+}
+
+// m65_pace_sync(m65_pace_t*, uint64_t) -> void
+// Sleeps until the host clock reaches the emulated time of a cycle count.
+void m65_pace_sync(m65_pace_t* pace, uint64_t cycles)
+{
+	// The emulated time, split so that the multiplication can't overflow
+	uint64_t elapsed = cycles - pace->start_cycles;
+	uint64_t deadline = m65_pace_ns(&pace->start) + elapsed / pace->hz * 1000000000ull
+					  + elapsed % pace->hz * 1000000000ull / pace->hz;
+	uint64_t now = m65_pace_now();
+	pace->syncs++;
+
+	// Running behind: don't sleep, and start over if there's no point in catching up
+	if (now >= deadline)
+	{
+		uint64_t lag = now - deadline;
+		pace->late++;
+		if (lag > pace->max_lag_ns)
+			pace->max_lag_ns = lag;
+		if (lag > pace->max_lag)
+		{
+			pace->resyncs++;
+			pace->start_cycles = cycles;
+			clock_gettime(CLOCK_MONOTONIC, &pace->start);
+		}
+		return;
+	}
+
+	struct timespec until = {deadline / 1000000000ull, deadline % 1000000000ull};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+
+	uint64_t woke = m65_pace_now();
+	uint64_t oversleep = woke > deadline ? woke - deadline : 0;
+	pace->slept_ns += woke - now;
+	pace->oversleep_ns += oversleep;
+	if (oversleep > pace->max_oversleep_ns)
+		pace->max_oversleep_ns = oversleep;
+}
+
+// m65_pace_run(m65_pace_t*, m6502_t*, m65_mem_t*, uint64_t) -> uint64_t
+// Executes whole instructions like m65_run() at the clock rate.
+uint64_t m65_pace_run(m65_pace_t* pace, m6502_t* cpu, m65_mem_t* mem, uint64_t cycles)
+{
+	uint64_t start = cpu->cycles;
+	uint64_t end = start + cycles;
+
+	while (cpu->cycles < end)
+	{
+		uint64_t left = end - cpu->cycles;
+		m65_run(cpu, mem, left < pace->batch ? left : pace->batch);
+		m65_pace_sync(pace, cpu->cycles);
+	}
+
+	return cpu->cycles - start;
+}
@@ -0,0 +1,64 @@
+//
+// MOS6502 Emulator
+// pace.h: Header file for pace.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef PACE_H
+#define PACE_H
+
+#include <time.h>
+
+#include "m6502.h"
+#include "memory.h"
+
+// Common clock rates.
+#define M65_HZ_NTSC 1789773
+#define M65_HZ_1MHZ 1000000
+
+// Represents the pacing of a processor to a clock rate in real time. Cycles run in batches as fast as the engine
+// allows, and the host thread sleeps after every batch until the wall clock catches up with the emulated time, so it
+// only uses as much of a host core as the emulation needs.
+typedef struct
+{
+	// The clock rate in Hz.
+	uint64_t hz;
+
+	// The number of cycles between synchronisations with the host clock (a millisecond worth by default).
+	uint64_t batch;
+
+	// The host time and cycle count emulated time is measured from.
+	struct timespec start;
+	uint64_t start_cycles;
+
+	// How far behind the host clock emulation may fall before it gives up catching up and starts over from the current
+	// time, in nanoseconds (100 ms by default).
+	uint64_t max_lag;
+
+	// Drift statistics. Lag is how far the host clock was past the end of a batch when it finished; oversleep is how
+	// long sleeps lasted past their deadline.
+	uint64_t syncs;
+	uint64_t late;
+	uint64_t resyncs;
+	uint64_t slept_ns;
+	uint64_t max_lag_ns;
+	uint64_t oversleep_ns;
+	uint64_t max_oversleep_ns;
+} m65_pace_t;
+
+// m65_pace_init(m65_pace_t*, uint64_t, uint64_t) -> void
+// Starts pacing a processor at the given clock rate from its current cycle count.
+void m65_pace_init(m65_pace_t* pace, uint64_t hz, uint64_t cycles);
+
+// m65_pace_sync(m65_pace_t*, uint64_t) -> void
+// Sleeps until the host clock reaches the emulated time of a cycle count. Hosts that run the processor themselves call
+// this every batch cycles.
+void m65_pace_sync(m65_pace_t* pace, uint64_t cycles);
+
+// m65_pace_run(m65_pace_t*, m6502_t*, m65_mem_t*, uint64_t) -> uint64_t
+// Executes whole instructions like m65_run() at the clock rate. Returns the number of cycles run.
+uint64_t m65_pace_run(m65_pace_t* pace, m6502_t* cpu, m65_mem_t* mem, uint64_t cycles);
+
+#endif /* PACE_H */
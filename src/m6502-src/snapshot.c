@@ -0,0 +1,429 @@
+//
+// MOS6502 Emulator
+// snapshot.c: Implements the deduplicating snapshot store.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+// A pack file starts with the 7 bytes "M65SNAP", a version byte and the size of m6502_t as a 32 bit number, and is
+// followed by records, each starting with a tag byte:
+// - 'P': a page (256 bytes). Pages get ids in the order they're written, starting at 1.
+// - 'S': a snapshot: the id of the snapshot it was saved relative to (32 bits, all ones for none), the processor
+//   (m6502_t), and the number of pages that differ from that snapshot (16 bits) followed by their numbers (8 bits) and
+//   ids (32 bits). Snapshots get ids in the order they're written, starting at 0.
+// Numbers are in the byte order of the host, since the processor is stored as it is in memory anyway.
+//
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+// The version of the pack file format.
+#define M65_SNAP_VERSION 1
+
+// The first bytes of a pack file.
+static const char m65_snap_magic[7] = "M65SNAP";
+
+// The group of pages that are all zero, which every page of a snapshot starts out in.
+static const m65_snap_group_t m65_snap_zero_group;
+
+// m65_snap_hash(const uint8_t*) -> uint64_t
+// Hashes the contents of a page, eight bytes at a time.
+static uint64_t m65_snap_hash(const uint8_t* data)
+{
+	uint64_t hash = 0x9e3779b97f4a7c15;
+	for (unsigned i = 0; i < M65_PAGE_SIZE; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0xff51afd7ed558ccd;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+// m65_snap_insert(m65_snap_store_t*, uint32_t) -> void
+// Puts a page into the hash table, which has room for it.
+static void m65_snap_insert(m65_snap_store_t* store, uint32_t id)
+{
+	size_t mask = store->table_size - 1;
+	size_t slot = store->hashes[id] & mask;
+	while (store->table[slot] != 0)
+		slot = (slot + 1) & mask;
+	store->table[slot] = id + 1;
+}
+
+// m65_snap_add_page(m65_snap_store_t*, const uint8_t*, uint64_t) -> bool
+// Adds a page to the store, whether it's there already or not. Returns false if memory can't be allocated.
+static bool m65_snap_add_page(m65_snap_store_t* store, const uint8_t* data, uint64_t hash)
+{
+	if (store->page_count == store->page_capacity)
+	{
+		size_t capacity = store->page_capacity ? store->page_capacity * 2 : 1024;
+		const uint8_t** pages = realloc(store->pages, capacity * sizeof(uint8_t*));
+		if (pages != NULL)
+			store->pages = pages;
+		uint64_t* hashes = realloc(store->hashes, capacity * sizeof(uint64_t));
+		if (hashes != NULL)
+			store->hashes = hashes;
+		if (pages == NULL || hashes == NULL)
+			return false;
+		store->page_capacity = capacity;
+	}
+
+	// The table is kept at most half full
+	if ((store->page_count + 1) * 2 > store->table_size)
+	{
+		size_t size = store->table_size ? store->table_size * 2 : 2048;
+		uint32_t* table = calloc(size, sizeof(uint32_t));
+		if (table == NULL)
+			return false;
+		free(store->table);
+		store->table = table;
+		store->table_size = size;
+		for (uint32_t id = 0; id < store->page_count; id++)
+			m65_snap_insert(store, id);
+	}
+
+	uint8_t* page = m65_arena_alloc(&store->arena, M65_PAGE_SIZE);
+	if (page == NULL)
+		return false;
+	memcpy(page, data, M65_PAGE_SIZE);
+	store->pages[store->page_count] = page;
+	store->hashes[store->page_count] = hash;
+	m65_snap_insert(store, store->page_count++);
+	return true;
+}
+
+// m65_snap_intern(m65_snap_store_t*, const uint8_t*, m65_page_id_t*, bool*) -> bool
+// Finds the id of a page, adding it to the store and the pack file if it's new. Returns false if memory can't be
+// allocated.
+static bool m65_snap_intern(m65_snap_store_t* store, const uint8_t* data, m65_page_id_t* id, bool* found)
+{
+	uint64_t hash = m65_snap_hash(data);
+	size_t mask = store->table_size - 1;
+	for (size_t slot = hash & mask; store->table[slot] != 0; slot = (slot + 1) & mask)
+	{
+		uint32_t other = store->table[slot] - 1;
+		if (store->hashes[other] == hash && memcmp(store->pages[other], data, M65_PAGE_SIZE) == 0)
+		{
+			*id = other;
+			*found = true;
+			return true;
+		}
+	}
+
+	if (!m65_snap_add_page(store, data, hash))
+		return false;
+	if (store->pack != NULL)
+	{
+		fputc('P', store->pack);
+		fwrite(data, 1, M65_PAGE_SIZE, store->pack);
+	}
+
+	*id = store->page_count - 1;
+	*found = false;
+	return true;
+}
+
+// m65_snap_new(m65_snap_store_t*, uint32_t) -> m65_snapshot_t*
+// Allocates a snapshot with the pages of its parent (or all zero), without adding it to the store yet. Returns NULL if
+// memory can't be allocated.
+static m65_snapshot_t* m65_snap_new(m65_snap_store_t* store, uint32_t parent)
+{
+	if (store->count == store->capacity)
+	{
+		size_t capacity = store->capacity ? store->capacity * 2 : 1024;
+		m65_snapshot_t** snapshots = realloc(store->snapshots, capacity * sizeof(m65_snapshot_t*));
+		if (snapshots == NULL)
+			return NULL;
+		store->snapshots = snapshots;
+		store->capacity = capacity;
+	}
+
+	m65_snapshot_t* snap = m65_arena_alloc(&store->arena, sizeof(m65_snapshot_t));
+	if (snap == NULL)
+		return NULL;
+
+	snap->parent = parent;
+	for (unsigned i = 0; i < M65_PAGES / M65_SNAP_GROUP; i++)
+		snap->groups[i] = parent != M65_SNAP_NONE ? store->snapshots[parent]->groups[i] : &m65_snap_zero_group;
+	return snap;
+}
+
+// m65_snap_set(m65_snap_store_t*, m65_snapshot_t*, bool*, uint8_t, m65_page_id_t) -> bool
+// Sets the id of a page of a new snapshot, copying its group first unless the snapshot already owns it. Returns false
+// if memory can't be allocated.
+static bool m65_snap_set(m65_snap_store_t* store, m65_snapshot_t* snap, bool* owned, uint8_t page, m65_page_id_t id)
+{
+	unsigned group = page / M65_SNAP_GROUP;
+	if (!owned[group])
+	{
+		m65_snap_group_t* copy = m65_arena_alloc(&store->arena, sizeof(m65_snap_group_t));
+		if (copy == NULL)
+			return false;
+		*copy = *snap->groups[group];
+		snap->groups[group] = copy;
+		owned[group] = true;
+	}
+
+	// The snapshot owns the group, so it isn't actually const
+	((m65_snap_group_t*) snap->groups[group])->pages[page % M65_SNAP_GROUP] = id;
+	return true;
+}
+
+// m65_snap_load(m65_snap_store_t*) -> bool
+// Loads the snapshots in the pack file, dropping a record cut short at its end, and leaves the file positioned for
+// appending.
+static bool m65_snap_load(m65_snap_store_t* store)
+{
+	FILE* pack = store->pack;
+	char magic[sizeof(m65_snap_magic)];
+	int version;
+	uint32_t cpu_size = sizeof(m6502_t);
+
+	// A new file gets a header
+	if (fread(magic, 1, sizeof(magic), pack) == 0 && feof(pack))
+	{
+		rewind(pack);
+		fwrite(m65_snap_magic, 1, sizeof(m65_snap_magic), pack);
+		fputc(M65_SNAP_VERSION, pack);
+		fwrite(&cpu_size, sizeof(cpu_size), 1, pack);
+		return fflush(pack) == 0;
+	}
+
+	if (memcmp(magic, m65_snap_magic, sizeof(magic)) != 0 || (version = fgetc(pack)) != M65_SNAP_VERSION
+			|| fread(&cpu_size, sizeof(cpu_size), 1, pack) != 1 || cpu_size != sizeof(m6502_t))
+		return false;
+
+	while (true)
+	{
+		long start = ftell(pack);
+		int tag = fgetc(pack);
+		if (tag == EOF)
+			break;
+
+		bool complete = false;
+		if (tag == 'P')
+		{
+			uint8_t data[M65_PAGE_SIZE];
+			if ((complete = fread(data, 1, sizeof(data), pack) == sizeof(data))
+					&& !m65_snap_add_page(store, data, m65_snap_hash(data)))
+				return false;
+		} else if (tag == 'S')
+		{
+			uint32_t parent;
+			uint16_t count;
+			m6502_t cpu;
+			if (fread(&parent, sizeof(parent), 1, pack) == 1 && fread(&cpu, sizeof(cpu), 1, pack) == 1
+					&& fread(&count, sizeof(count), 1, pack) == 1)
+			{
+				if (count > M65_PAGES || (parent != M65_SNAP_NONE && parent >= store->count))
+					return false;
+
+				m65_snapshot_t* snap = m65_snap_new(store, parent);
+				bool owned[M65_PAGES / M65_SNAP_GROUP] = { false };
+				if (snap == NULL)
+					return false;
+				snap->cpu = cpu;
+
+				unsigned i;
+				for (i = 0; i < count; i++)
+				{
+					int page = fgetc(pack);
+					m65_page_id_t id;
+					if (page == EOF || fread(&id, sizeof(id), 1, pack) != 1)
+						break;
+					if (id >= store->page_count || !m65_snap_set(store, snap, owned, page, id))
+						return false;
+				}
+
+				if ((complete = i == count))
+					store->snapshots[store->count++] = snap;
+			}
+		} else return false;
+
+		// What's left of a record that was cut short is dropped, and the next record goes in its place
+		if (!complete)
+		{
+			if (fseek(pack, start, SEEK_SET) != 0 || ftruncate(fileno(pack), start) != 0)
+				return false;
+			break;
+		}
+	}
+
+	return fseek(pack, 0, SEEK_END) == 0;
+}
+
+// m65_snap_init(m65_snap_store_t*, const char*) -> bool
+// Initialises a snapshot store, loading the snapshots in a pack file if path isn't NULL.
+bool m65_snap_init(m65_snap_store_t* store, const char* path)
+{
+	memset(store, 0, sizeof(m65_snap_store_t));
+	m65_arena_init(&store->arena, false);
+
+	// Page 0 is the page of zeros
+	if (!m65_snap_add_page(store, m65_mem_zero, m65_snap_hash(m65_mem_zero)))
+	{
+		m65_snap_free(store);
+		return false;
+	}
+
+	if (path == NULL)
+		return true;
+	if ((store->pack = fopen(path, "r+b")) == NULL)
+		store->pack = fopen(path, "w+b");
+	if (store->pack == NULL || !m65_snap_load(store))
+	{
+		m65_snap_free(store);
+		return false;
+	}
+
+	return true;
+}
+
+// m65_snap_free(m65_snap_store_t*) -> void
+// Writes out the rest of the pack file and frees a snapshot store.
+void m65_snap_free(m65_snap_store_t* store)
+{
+	if (store->pack != NULL)
+		fclose(store->pack);
+	free(store->pages);
+	free(store->hashes);
+	free(store->table);
+	free(store->snapshots);
+	m65_arena_free(&store->arena);
+	memset(store, 0, sizeof(m65_snap_store_t));
+}
+
+// m65_snap_flush(m65_snap_store_t*) -> bool
+// Writes out the snapshots saved so far to the pack file.
+bool m65_snap_flush(m65_snap_store_t* store)
+{
+	return store->pack == NULL || fflush(store->pack) == 0;
+}
+
+// m65_snap_save(m65_snap_store_t*, const m6502_t*, m65_mem_t*, uint32_t) -> uint32_t
+// Saves the state of a processor and the RAM owned by its memory map.
+uint32_t m65_snap_save(m65_snap_store_t* store, const m6502_t* cpu, m65_mem_t* mem, uint32_t base)
+{
+	// Without tracking, or without a snapshot the map matches, every page has to be looked at
+	if (!mem->dirty.enabled || base >= store->count)
+	{
+		m65_mem_track_dirty(mem);
+		base = M65_SNAP_NONE;
+	}
+
+	m65_snapshot_t* snap = m65_snap_new(store, base);
+	if (snap == NULL)
+		return M65_SNAP_NONE;
+	snap->cpu = *cpu;
+	snap->cpu.coverage = NULL;
+	snap->cpu.traps = NULL;
+
+	// The lines of other threads are kept along with the NMI edge latch, so that on restore only the lines that changed
+	// since are taken as new, and an NMI held all along isn't taken twice
+	atomic_init(&snap->cpu.int_async, 0);
+
+	// Only the dirty pages can differ from the base
+	bool owned[M65_PAGES / M65_SNAP_GROUP] = { false };
+	uint8_t changed[M65_PAGES];
+	m65_page_id_t ids[M65_PAGES];
+	unsigned count = 0;
+	for (unsigned i = 0; i < sizeof(mem->dirty.pages); i++)
+	{
+		for (uint8_t bits = mem->dirty.pages[i]; bits != 0; bits &= bits - 1)
+		{
+			unsigned page = i * 8 + __builtin_ctz(bits);
+			m65_page_id_t id;
+			bool found;
+			if (!m65_snap_intern(store, m65_mem_own_data(mem, page), &id, &found))
+				return M65_SNAP_NONE;
+			if (m65_snap_page(store, snap, page) == store->pages[id])
+				continue;
+
+			if (!m65_snap_set(store, snap, owned, page, id))
+				return M65_SNAP_NONE;
+			changed[count] = page;
+			ids[count++] = id;
+			store->pages_saved++;
+			store->pages_shared += found;
+		}
+	}
+
+	if (store->pack != NULL)
+	{
+		uint16_t written = count;
+		fputc('S', store->pack);
+		fwrite(&base, sizeof(base), 1, store->pack);
+		fwrite(&snap->cpu, sizeof(snap->cpu), 1, store->pack);
+		fwrite(&written, sizeof(written), 1, store->pack);
+		for (unsigned i = 0; i < count; i++)
+		{
+			fputc(changed[i], store->pack);
+			fwrite(&ids[i], sizeof(ids[i]), 1, store->pack);
+		}
+
+		// A pack that failed to be written no longer matches the store, so nothing more goes into it
+		if (ferror(store->pack))
+		{
+			fclose(store->pack);
+			store->pack = NULL;
+			return M65_SNAP_NONE;
+		}
+	}
+
+	m65_mem_clean(mem);
+	store->snapshots[store->count] = snap;
+	return store->count++;
+}
+
+// m65_snap_restore(m65_snap_store_t*, uint32_t, m6502_t*, m65_mem_t*, uint32_t) -> bool
+// Restores a snapshot into a processor and its memory map.
+bool m65_snap_restore(m65_snap_store_t* store, uint32_t id, m6502_t* cpu, m65_mem_t* mem, uint32_t base)
+{
+	if (id >= store->count)
+		return false;
+
+	const m65_snapshot_t* snap = store->snapshots[id];
+	const m65_snapshot_t* from = mem->dirty.enabled && base < store->count ? store->snapshots[base] : NULL;
+	if (!mem->dirty.enabled)
+		m65_mem_track_dirty(mem);
+
+	for (unsigned group = 0; group < M65_PAGES / M65_SNAP_GROUP; group++)
+	{
+		// Groups shared with the base only differ in their dirty pages
+		bool shared = from != NULL && from->groups[group] == snap->groups[group];
+		bool dirty = false;
+		for (unsigned i = group * M65_SNAP_GROUP / 8; i < (group + 1) * M65_SNAP_GROUP / 8; i++)
+			dirty |= mem->dirty.pages[i] != 0;
+		if (shared && !dirty)
+			continue;
+
+		for (unsigned page = group * M65_SNAP_GROUP; page < (group + 1) * M65_SNAP_GROUP; page++)
+		{
+			const uint8_t* data = m65_snap_page(store, snap, page);
+			if (from != NULL && !m65_mem_is_dirty(mem, page) && m65_snap_page(store, from, page) == data)
+				continue;
+			if (!m65_mem_load_own(mem, page, data))
+				return false;
+		}
+	}
+
+	// Other threads may be signalling the processor, so everything but their register is copied, and their lines are
+	// taken again at the next instruction boundary, against the lines they held when the snapshot was saved
+	m65_coverage_t* coverage = cpu->coverage;
+	m65_traps_t* traps = cpu->traps;
+	size_t async = offsetof(m6502_t, int_async);
+	size_t after = async + sizeof(cpu->int_async);
+	memcpy(cpu, &snap->cpu, async);
+	memcpy((uint8_t*) cpu + after, (const uint8_t*) &snap->cpu + after, sizeof(m6502_t) - after);
+	atomic_fetch_or_explicit(&cpu->int_async, M65_ASYNC_PENDING, memory_order_relaxed);
+	cpu->coverage = coverage;
+	cpu->traps = traps;
+	m65_mem_clean(mem);
+	return true;
+}
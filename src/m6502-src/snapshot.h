@@ -0,0 +1,116 @@
+//
+// MOS6502 Emulator
+// snapshot.h: Header file for snapshot.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+
+#include "arena.h"
+#include "m6502.h"
+#include "memory.h"
+
+// The id of no snapshot.
+#define M65_SNAP_NONE UINT32_MAX
+
+// The number of pages in a group of page ids. Snapshots share the groups in which no page changed.
+#define M65_SNAP_GROUP 16
+
+// The id of a unique page in a snapshot store. Page 0 is the page of zeros.
+typedef uint32_t m65_page_id_t;
+
+// Represents the ids of the pages of a group.
+typedef struct
+{
+	m65_page_id_t pages[M65_SNAP_GROUP];
+} m65_snap_group_t;
+
+// Represents a snapshot of a processor and of the RAM owned by a memory map.
+typedef struct
+{
+	// The snapshot this one was saved relative to, or M65_SNAP_NONE.
+	uint32_t parent;
+
+	// The processor, without its coverage map and trap table.
+	m6502_t cpu;
+
+	// The pages, in groups shared with other snapshots.
+	const m65_snap_group_t* groups[M65_PAGES / M65_SNAP_GROUP];
+} m65_snapshot_t;
+
+// Represents a store of snapshots that keeps every distinct page once. Pages are found by a hash of their contents and
+// compared in full, so pages with the same hash are never confused. Snapshots are kept until the store is freed, and
+// are appended to a pack file as they're saved if the store has one.
+typedef struct
+{
+	// The memory the pages, groups and snapshots are in.
+	m65_arena_t arena;
+
+	// The pages and their hashes, by id.
+	const uint8_t** pages;
+	uint64_t* hashes;
+	size_t page_count;
+	size_t page_capacity;
+
+	// An open addressing hash table of page ids plus one (0 is an empty slot), by hash.
+	uint32_t* table;
+	size_t table_size;
+
+	// The snapshots, by id.
+	m65_snapshot_t** snapshots;
+	size_t count;
+	size_t capacity;
+
+	// The pack file, or NULL.
+	FILE* pack;
+
+	// The number of pages saved that changed, and how many of them were already in the store.
+	uint64_t pages_saved;
+	uint64_t pages_shared;
+} m65_snap_store_t;
+
+// m65_snap_init(m65_snap_store_t*, const char*) -> bool
+// Initialises a snapshot store. If path isn't NULL, the snapshots in the pack file at path are loaded (it's created
+// if it doesn't exist), and new ones are appended to it. A record cut short at the end of the file, for example by a
+// crash, is dropped. Returns false if the file can't be read or written or isn't a pack of this build.
+bool m65_snap_init(m65_snap_store_t* store, const char* path);
+
+// m65_snap_free(m65_snap_store_t*) -> void
+// Writes out the rest of the pack file and frees a snapshot store along with all its snapshots.
+void m65_snap_free(m65_snap_store_t* store);
+
+// m65_snap_flush(m65_snap_store_t*) -> bool
+// Writes out the snapshots saved so far to the pack file, which is written through a buffer. Returns false if it can't
+// be written.
+bool m65_snap_flush(m65_snap_store_t* store);
+
+// m65_snap_save(m65_snap_store_t*, const m6502_t*, m65_mem_t*, uint32_t) -> uint32_t
+// Saves the state of a processor and the RAM owned by its memory map (see m65_mem_own_data()); ROM and the RAM of
+// mappers aren't part of snapshots. base is the snapshot that the map was last saved to or restored from, or
+// M65_SNAP_NONE. The first save tracks changes to the map (m65_mem_track_dirty()), and from then on only pages that
+// changed since base are hashed, so saving takes time in the number of those. Returns the id of the snapshot, or
+// M65_SNAP_NONE if memory can't be allocated or the pack file can't be written.
+uint32_t m65_snap_save(m65_snap_store_t* store, const m6502_t* cpu, m65_mem_t* mem, uint32_t base);
+
+// m65_snap_restore(m65_snap_store_t*, uint32_t, m6502_t*, m65_mem_t*, uint32_t) -> bool
+// Restores a snapshot into a processor and its memory map. The processor keeps its coverage map and trap table, and
+// the interrupt lines of other threads (see m65_irq_assert_async()), which it takes again at its next boundary as if
+// they changed from what they were when the snapshot was saved, so an NMI held since then doesn't fire again. base
+// is as for m65_snap_save(); only the pages that differ between the snapshot and base or changed since are copied, so
+// restoring a snapshot close to base takes time in the number of those. Returns false if there is no such snapshot or
+// memory can't be allocated.
+bool m65_snap_restore(m65_snap_store_t* store, uint32_t id, m6502_t* cpu, m65_mem_t* mem, uint32_t base);
+
+// m65_snap_page(const m65_snap_store_t*, const m65_snapshot_t*, uint8_t) -> const uint8_t*
+// Returns the contents of a page of a snapshot.
+static inline const uint8_t* m65_snap_page(const m65_snap_store_t* store, const m65_snapshot_t* snap, uint8_t page)
+{
+	return store->pages[snap->groups[page / M65_SNAP_GROUP]->pages[page % M65_SNAP_GROUP]];
+}
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,619 @@
+//
+// MOS6502 Emulator
+// step.c: Implements the instruction stepping execution engine.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "exec.h"
+#include "step.h"
+#include "traps.h"
+#include "variant.h"
+
+// The most cycles the instructions of a fused sequence take before the last one.
+#define M65_FUSE_SLACK 6
+
+// The header of a cache file. The pages follow it.
+typedef struct
+{
+	// "M65FUSE" followed by a zero byte.
+	char magic[8];
+
+	// The variant the pages were decoded for and the number of pages.
+	uint8_t variant;
+	uint8_t reserved[3];
+	uint32_t pages;
+} m65_cache_header_t;
+
+// A page of a cache file.
+typedef struct
+{
+	// The page and the hash of its contents (see m65_page_hash()).
+	uint64_t page;
+	uint64_t hash;
+
+	// The kind of sequence at each address.
+	uint8_t fuse[M65_PAGE_SIZE];
+} m65_cache_page_t;
+
+// The kinds of fused instruction sequences.
+enum
+{
+	// Not decoded yet.
+	M65_FUSE_UNKNOWN,
+
+	// No sequence starts here.
+	M65_FUSE_NONE,
+
+	// lda, sta (any addressing modes).
+	M65_FUSE_LDA_STA,
+
+	// clc, adc.
+	M65_FUSE_CLC_ADC,
+
+	// dex or dey, bne.
+	M65_FUSE_DEC_BNE,
+
+	// inx, cpx or iny, cpy, bne.
+	M65_FUSE_INC_CMP_BNE
+};
+
+// m65_trap(m6502_t*, m65_mem_t*, uint16_t) -> uint64_t
+// Runs the native implementation of the subroutine at pc and returns from it. Returns the number of cycles the
+// subroutine took, or 0 if it has to be emulated.
+static uint64_t m65_trap(m6502_t* cpu, m65_mem_t* mem, uint16_t pc)
+{
+	m65_trap_t* trap = m65_trap_find(cpu->traps, pc);
+	uint64_t cycles = trap != NULL ? trap->fn(cpu, mem, trap->ctx) : 0;
+	if (cycles == 0)
+		return 0;
+	trap->hits++;
+
+	// Return like rts, which polls the interrupt lines with the flags the subroutine left
+	uint16_t next = m65_pull(cpu, mem);
+	next |= m65_pull(cpu, mem) << 8;
+	m65_boundary(cpu, next + 1, 0, cpu->flags);
+	cpu->ir = 0x60;
+	cpu->cycles += cycles;
+	return cycles;
+}
+
+// m65_step_any(m6502_t*, m65_mem_t*, m65_variant_t, int, bool, bool) -> uint8_t
+// Executes one instruction at an instruction boundary. The traits are constants in the callers (see variant.h).
+static inline uint8_t m65_step_any(m6502_t* cpu, m65_mem_t* mem, m65_variant_t variant, int bcd, bool jmp_bug,
+		bool int_cld)
+{
+	uint16_t pc = cpu->pins.addr;
+
+	// Hardware interrupts take the place of the next instruction
+	m65_int_poll_async(cpu);
+	if (cpu->handle_interrupt)
+	{
+		cpu->handle_interrupt = false;
+		m65_int_select(cpu);
+		cpu->ir = 0;
+
+		// The lines are polled with the flags the interrupt left, so they're read only once it set I
+		uint16_t next = m65_interrupt(cpu, mem, pc, int_cld);
+		m65_boundary(cpu, next, 7, cpu->flags);
+		return 7;
+	}
+
+	// Trapped subroutines can take more cycles than fit in the result. Only calls are trapped: the jsr that just
+	// executed left its opcode in ir and always lands on its operand, while jumps and branches back to the entry of a
+	// subroutine run emulated
+	uint64_t trapped;
+	if (cpu->traps != NULL && cpu->ir == 0x20 && m65_trapped(cpu->traps, pc) && (trapped = m65_trap(cpu, mem, pc)) != 0)
+		return trapped < UINT8_MAX ? trapped : UINT8_MAX;
+
+	m65_mem_exec(mem, pc);
+	if (cpu->coverage != NULL)
+		m65_cover_exec(cpu->coverage, pc);
+	uint8_t op = m65_mem_read(mem, pc);
+	const m65_opinfo_t* info = &m65_opinfo[variant][op];
+
+	// Unimplemented opcodes jam the processor like they do m65_cycle()
+	if (info->cycles == 0)
+	{
+		cpu->ir = op;
+		cpu->pins.rw = READ;
+		cpu->pins.data = op;
+		cpu->cycles++;
+		cpu->int_poll = m65_int_pending(cpu);
+		return 1;
+	}
+
+	// Operands are code, which is never in device registers
+	uint8_t length = m65_mode_length[info->mode];
+	uint8_t low = length > 1 ? m65_mem_peek(mem, pc + 1) : 0;
+	uint8_t high = length > 2 ? m65_mem_peek(mem, pc + 2) : 0;
+	return m65_exec(cpu, mem, pc, op, low, high, info, bcd, jmp_bug, int_cld);
+}
+
+// m65_step_touches(const m6502_t*, const m65_mem_t*, const uint8_t*) -> bool
+// Checks if the next instruction may access any of the pages in a bitmap.
+bool m65_step_touches(const m6502_t* cpu, const m65_mem_t* mem, const uint8_t* pages)
+{
+#define m65_page_set(addr) (pages[(uint16_t) (addr) >> 11] & 1 << ((uint16_t) (addr) >> 8 & 7))
+
+	// Instructions that already started may do anything
+	uint16_t pc = cpu->pins.addr;
+	if (cpu->phase != M65_PHASE_FETCH)
+		return true;
+
+	// The opcode and the bytes after it, which are also read by the dummy cycles of implied instructions
+	if (m65_page_set(pc) || m65_page_set(pc + 1) || m65_page_set(pc + 2))
+		return true;
+
+	// Interrupts use the stack and the vectors. A signal from another thread may still leave none pending, so the
+	// instruction itself is checked as well
+	if ((cpu->handle_interrupt || m65_int_signalled(cpu)) && (m65_page_set(0x0100) || m65_page_set(0xFFFA)))
+		return true;
+	if (cpu->handle_interrupt)
+		return false;
+
+	// Trapped subroutines may access anything
+	if (cpu->traps != NULL && cpu->ir == 0x20 && m65_trapped(cpu->traps, pc))
+		return true;
+
+	uint8_t op = m65_mem_peek(mem, pc);
+	const m65_opinfo_t* info = &m65_opinfo[cpu->variant][op];
+	if (info->cycles == 0)
+		return false;
+
+	switch (op)
+	{
+		// Stack instructions
+		case 0x00:
+			if (m65_page_set(0xFFFE))
+				return true;
+		case 0x20: case 0x40: case 0x60: case 0x08: case 0x28: case 0x48: case 0x68:
+		case 0x5A: case 0x7A: case 0xDA: case 0xFA:
+			if (m65_page_set(0x0100))
+				return true;
+			break;
+		default:
+			break;
+	}
+
+	// The pointers of indirect addressing modes and the effective address
+	uint16_t base = 0;
+	uint16_t addr = m65_address(cpu, mem, pc, info, &base);
+	switch (info->mode)
+	{
+		case M65_MODE_IMPL:
+		case M65_MODE_ACC:
+		case M65_MODE_REL:
+			return false;
+		case M65_MODE_INDX:
+		case M65_MODE_INDY:
+		case M65_MODE_INDZP:
+			return m65_page_set(0) || m65_page_set(addr);
+		case M65_MODE_IND:
+			return m65_page_set(addr) || m65_page_set(addr + 1);
+		default:
+			return m65_page_set(addr);
+	}
+
+#undef m65_page_set
+}
+
+// m65_step_<variant>(m6502_t*, m65_mem_t*) -> uint8_t
+// Executes one instruction of a processor of a fixed variant.
+#define m65_step_(v)																			\
+uint8_t m65_step_##v (m6502_t* cpu, m65_mem_t* mem)												\
+{																								\
+	uint8_t cycles = 0;																			\
+																								\
+	/* Finish the current instruction cycle by cycle */											\
+	while (cpu->phase != M65_PHASE_FETCH)														\
+	{																							\
+		m65_mem_bus(mem, cpu);																	\
+		m65_cycle_##v(cpu);																		\
+		cycles++;																				\
+	}																							\
+																								\
+	if (cycles != 0)																			\
+		return cycles;																			\
+	return m65_step_any(cpu, mem, M65_TRAIT(ID, v), M65_TRAIT(BCD, v), M65_TRAIT(JMP_BUG, v),	\
+			M65_TRAIT(INT_CLD, v));																\
+}
+
+m65_variants_(m65_step_)
+
+#undef m65_step_
+
+// m65_step(m6502_t*, m65_mem_t*) -> uint8_t
+// Executes one whole instruction of a processor of the variant it was initialised with.
+uint8_t m65_step(m6502_t* cpu, m65_mem_t* mem)
+{
+	switch (cpu->variant)
+	{
+		case M65_CMOS:
+			return m65_step_cmos(cpu, mem);
+		case M65_2A03:
+			return m65_step_2a03(cpu, mem);
+		case M65_NMOS:
+		default:
+			return m65_step_nmos(cpu, mem);
+	}
+}
+
+// m65_run(m6502_t*, m65_mem_t*, uint64_t) -> uint64_t
+// Executes whole instructions until at least the given number of cycles passed.
+uint64_t m65_run(m6502_t* cpu, m65_mem_t* mem, uint64_t cycles)
+{
+	uint64_t start = cpu->cycles;
+	uint64_t end = start + cycles;
+
+#define m65_run_(v)									\
+		while (cpu->cycles < end)					\
+		{											\
+			m65_step_##v(cpu, mem);					\
+			m65_mem_poll_devices(mem, cpu->cycles);	\
+		}											\
+		break;
+
+	switch (cpu->variant)
+	{
+		case M65_CMOS:
+			m65_run_(cmos)
+		case M65_2A03:
+			m65_run_(2a03)
+		case M65_NMOS:
+		default:
+			m65_run_(nmos)
+	}
+
+#undef m65_run_
+
+	return cpu->cycles - start;
+}
+
+// m65_fuse_decode(const m65_mem_t*, m65_variant_t, uint16_t) -> uint8_t
+// Finds the kind of fused sequence that starts at an address. Sequences lie within one page, and only their last
+// instruction writes to memory, so they can't modify themselves.
+static uint8_t m65_fuse_decode(const m65_mem_t* mem, m65_variant_t variant, uint16_t pc)
+{
+	uint8_t ops[3];
+	unsigned count = 0;
+
+	// The instructions that start at the address and end in its page
+	for (uint16_t addr = pc; count < 3 && addr >> 8 == pc >> 8; count++)
+	{
+		ops[count] = m65_mem_peek(mem, addr);
+		const m65_opinfo_t* info = &m65_opinfo[variant][ops[count]];
+		if (info->cycles == 0 || (addr & 0xff) + m65_mode_length[info->mode] > M65_PAGE_SIZE)
+			break;
+		addr += m65_mode_length[info->mode];
+	}
+
+	if (count >= 2 && m65_alu_op(ops[0], 0xA0) && m65_alu_op(ops[1], 0x80) && ops[1] != 0x89)
+		return M65_FUSE_LDA_STA;
+	if (count >= 2 && ops[0] == 0x18 && m65_alu_op(ops[1], 0x60))
+		return M65_FUSE_CLC_ADC;
+	if (count >= 2 && (ops[0] == 0xCA || ops[0] == 0x88) && ops[1] == 0xD0)
+		return M65_FUSE_DEC_BNE;
+	if (count == 3 && ops[2] == 0xD0 && ((ops[0] == 0xE8 && (ops[1] == 0xE0 || ops[1] == 0xE4 || ops[1] == 0xEC))
+			|| (ops[0] == 0xC8 && (ops[1] == 0xC0 || ops[1] == 0xC4 || ops[1] == 0xCC))))
+		return M65_FUSE_INC_CMP_BNE;
+	return M65_FUSE_NONE;
+}
+
+// m65_cache_lookup(m65_cache_t*, m65_mem_t*, m65_variant_t, uint16_t) -> uint8_t
+// Returns the kind of fused sequence that starts at an address, decoding it if it isn't cached. A page is dropped from
+// the cache when its generation changed or it isn't marked as code anymore.
+static inline uint8_t m65_cache_lookup(m65_cache_t* cache, m65_mem_t* mem, m65_variant_t variant, uint16_t pc)
+{
+	uint8_t page = pc >> 8;
+	uint8_t* fuse = cache->fuse[page];
+
+	// Code in the zero page and the stack can't be tracked
+	if (page < 2)
+		return M65_FUSE_NONE;
+
+	if (fuse == NULL || cache->generation[page] != m65_mem_generation(mem, page) || !m65_mem_is_code(mem, page))
+	{
+		if (fuse == NULL && (fuse = cache->fuse[page] = malloc(M65_PAGE_SIZE)) == NULL)
+			return M65_FUSE_NONE;
+
+		// Marking the page makes writes to it bump its generation
+		memset(fuse, M65_FUSE_UNKNOWN, M65_PAGE_SIZE);
+		if (!m65_mem_is_code(mem, page))
+			m65_mem_mark_code(mem, page);
+		cache->generation[page] = m65_mem_generation(mem, page);
+	}
+
+	if (fuse[pc & 0xff] == M65_FUSE_UNKNOWN)
+		fuse[pc & 0xff] = m65_fuse_decode(mem, variant, pc);
+	return fuse[pc & 0xff];
+}
+
+// m65_fused(m6502_t*, m65_mem_t*, uint8_t, m65_variant_t, int) -> void
+// Executes a fused sequence at an instruction boundary with no interrupt pending and no device deadline before its
+// last instruction. None of the instructions change the I flag, but a device read by one of them can still raise an
+// interrupt, so the sequence ends after any instruction that reads memory and leaves one pending. The cycle counter
+// moves on as each instruction retires, so devices accessed by the sequence are caught up to the same cycle as when
+// stepping. The result is the same as stepping them one by one.
+static inline void m65_fused(m6502_t* cpu, m65_mem_t* mem, uint8_t fuse, m65_variant_t variant, int bcd)
+{
+	const m65_opinfo_t* table = m65_opinfo[variant];
+	bool decimal = cpu->flags & 0x08;
+	uint16_t pc = cpu->pins.addr;
+	bool taken = false;
+	const m65_opinfo_t* info;
+	uint16_t base;
+	uint16_t addr;
+	uint8_t op;
+
+	// Decodes the instruction at pc
+#define m65_fused_decode()					\
+	op = m65_mem_read(mem, pc);				\
+	info = &table[op];						\
+	if (cpu->coverage != NULL)				\
+		m65_cover_exec(cpu->coverage, pc);	\
+	base = 0;								\
+	addr = m65_address(cpu, mem, pc, info, &base)
+
+	// Moves past the instruction at pc
+#define m65_fused_retire()											\
+	cpu->cycles += m65_op_cycles(info, base, addr, taken, decimal);	\
+	pc += m65_mode_length[info->mode]
+
+	// Ends the sequence after the instruction at pc if it made an interrupt pending, which is handled next
+#define m65_fused_poll()								\
+	if (m65_int_pending(cpu) || m65_int_signalled(cpu))	\
+	{													\
+		m65_fused_retire();								\
+		cpu->ir = op;									\
+		m65_boundary(cpu, pc, 0, cpu->flags);			\
+		return;											\
+	}
+
+	m65_fused_decode();
+	switch (fuse)
+	{
+		case M65_FUSE_LDA_STA:
+			cpu->a = m65_nz(cpu, m65_mem_read(mem, addr));
+			m65_fused_poll();
+			m65_fused_retire();
+			m65_fused_decode();
+			m65_mem_write(mem, addr, cpu->a);
+			break;
+		case M65_FUSE_CLC_ADC:
+			cpu->flags &= 0xFE;
+			m65_fused_retire();
+			m65_fused_decode();
+			m65_alu_adc(cpu, m65_mem_read(mem, addr), bcd);
+			break;
+		case M65_FUSE_DEC_BNE:
+			if (op == 0xCA)
+				cpu->x = m65_nz(cpu, cpu->x - 1);
+			else cpu->y = m65_nz(cpu, cpu->y - 1);
+			m65_fused_retire();
+			m65_fused_decode();
+			taken = !(cpu->flags & 0x02);
+			if (cpu->coverage != NULL)
+				m65_cover_branch(cpu->coverage, pc, taken);
+			break;
+		case M65_FUSE_INC_CMP_BNE:
+			if (op == 0xE8)
+				cpu->x = m65_nz(cpu, cpu->x + 1);
+			else cpu->y = m65_nz(cpu, cpu->y + 1);
+			m65_fused_retire();
+			m65_fused_decode();
+			m65_compare(cpu, op >= 0xE0 ? cpu->x : cpu->y, m65_mem_read(mem, addr));
+			m65_fused_poll();
+			m65_fused_retire();
+			m65_fused_decode();
+			taken = !(cpu->flags & 0x02);
+			if (cpu->coverage != NULL)
+				m65_cover_branch(cpu->coverage, pc, taken);
+			break;
+		default:
+			break;
+	}
+
+	m65_fused_retire();
+	cpu->ir = op;
+	m65_boundary(cpu, taken ? addr : pc, 0, cpu->flags);
+
+#undef m65_fused_decode
+#undef m65_fused_retire
+#undef m65_fused_poll
+}
+
+// m65_page_hash(const uint8_t*) -> uint64_t
+// Hashes the contents of a page (FNV-1a).
+static uint64_t m65_page_hash(const uint8_t* data)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (unsigned i = 0; i < M65_PAGE_SIZE; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+// m65_cache_mapped(const m65_cache_t*, const uint8_t*) -> bool
+// Checks if a decoded page lives in the mapped cache file rather than on the heap.
+static bool m65_cache_mapped(const m65_cache_t* cache, const uint8_t* fuse)
+{
+	const uint8_t* map = cache->map;
+	return map != NULL && fuse >= map && fuse < map + cache->map_size;
+}
+
+// m65_cache_init(m65_cache_t*) -> void
+// Initialises an empty cache.
+void m65_cache_init(m65_cache_t* cache)
+{
+	memset(cache, 0, sizeof(m65_cache_t));
+}
+
+// m65_cache_free(m65_cache_t*) -> void
+// Frees the decoded pages of a cache.
+void m65_cache_free(m65_cache_t* cache)
+{
+	for (unsigned page = 0; page < M65_PAGES; page++)
+	{
+		if (!m65_cache_mapped(cache, cache->fuse[page]))
+			free(cache->fuse[page]);
+		cache->fuse[page] = NULL;
+	}
+
+	if (cache->map != NULL)
+		munmap(cache->map, cache->map_size);
+	cache->map = NULL;
+	cache->map_size = 0;
+}
+
+// m65_cache_save(const m65_cache_t*, const m65_mem_t*, m65_variant_t, const char*) -> bool
+// Writes the valid decoded pages of a cache to a file.
+bool m65_cache_save(const m65_cache_t* cache, const m65_mem_t* mem, m65_variant_t variant, const char* path)
+{
+	m65_cache_header_t header = { "M65FUSE", variant, {0}, 0 };
+	m65_cache_page_t record;
+
+	// Write through a temporary file so that other processes never see half of it
+	char tmp[4096 + 32];
+	if (snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long) getpid()) >= (int) sizeof(tmp))
+		return false;
+	FILE* file = fopen(tmp, "wb");
+	if (file == NULL)
+		return false;
+
+	fwrite(&header, sizeof(header), 1, file);
+	for (unsigned page = 2; page < M65_PAGES; page++)
+	{
+		// Only pages that still hold the code they were decoded from
+		const uint8_t* fuse = cache->fuse[page];
+		if (fuse == NULL || mem->read[page] == NULL || cache->generation[page] != m65_mem_generation(mem, page)
+				|| !m65_mem_is_code(mem, page))
+			continue;
+
+		// Decode the rest of the page, so that loading it skips decoding entirely
+		record.page = page;
+		record.hash = m65_page_hash(mem->read[page]);
+		for (unsigned i = 0; i < M65_PAGE_SIZE; i++)
+			record.fuse[i] = fuse[i] != M65_FUSE_UNKNOWN ? fuse[i] : m65_fuse_decode(mem, variant, page << 8 | i);
+		fwrite(&record, sizeof(record), 1, file);
+		header.pages++;
+	}
+
+	// The header goes in last, with the number of pages
+	bool ok = !ferror(file) && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = fclose(file) == 0 && ok;
+	if (!ok || rename(tmp, path) != 0)
+	{
+		unlink(tmp);
+		return false;
+	}
+	return true;
+}
+
+// m65_cache_load(m65_cache_t*, m65_mem_t*, m65_variant_t, const char*) -> size_t
+// Maps the pages of a cache file that match memory into a cache.
+size_t m65_cache_load(m65_cache_t* cache, m65_mem_t* mem, m65_variant_t variant, const char* path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(m65_cache_header_t) || cache->map != NULL)
+	{
+		close(fd);
+		return 0;
+	}
+
+	// Decoding writes to pages whose generation changed, which mustn't go back to the file
+	void* map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	const m65_cache_header_t* header = map;
+	m65_cache_page_t* records = (m65_cache_page_t*) (header + 1);
+	if (memcmp(header->magic, "M65FUSE", 8) != 0 || header->variant != variant
+			|| sizeof(*header) + header->pages * sizeof(m65_cache_page_t) != (size_t) st.st_size)
+	{
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	cache->map = map;
+	cache->map_size = st.st_size;
+	size_t loaded = 0;
+	for (uint32_t i = 0; i < header->pages; i++)
+	{
+		uint64_t page = records[i].page;
+		if (page < 2 || page >= M65_PAGES || mem->read[page] == NULL
+				|| records[i].hash != m65_page_hash(mem->read[page]))
+			continue;
+
+		// Marking the page makes writes to it bump its generation
+		if (!m65_cache_mapped(cache, cache->fuse[page]))
+			free(cache->fuse[page]);
+		cache->fuse[page] = records[i].fuse;
+		if (!m65_mem_is_code(mem, page))
+			m65_mem_mark_code(mem, page);
+		cache->generation[page] = m65_mem_generation(mem, page);
+		loaded++;
+	}
+
+	if (loaded == 0)
+	{
+		munmap(map, st.st_size);
+		cache->map = NULL;
+		cache->map_size = 0;
+	}
+	return loaded;
+}
+
+// m65_run_cached(m6502_t*, m65_mem_t*, m65_cache_t*, uint64_t) -> uint64_t
+// Executes whole instructions like m65_run(), running common sequences of instructions as one.
+uint64_t m65_run_cached(m6502_t* cpu, m65_mem_t* mem, m65_cache_t* cache, uint64_t cycles)
+{
+	uint64_t start = cpu->cycles;
+	uint64_t end = start + cycles;
+
+	// Sequences only run when m65_run() would run all of their instructions without catching up devices in between
+#define m65_run_cached_(v)																			\
+		while (cpu->cycles < end)																	\
+		{																							\
+			uint8_t fuse = M65_FUSE_NONE;															\
+			if (cpu->phase == M65_PHASE_FETCH && !cpu->handle_interrupt && !m65_int_pending(cpu)	\
+					&& !m65_int_signalled(cpu)														\
+					&& end - cpu->cycles > M65_FUSE_SLACK											\
+					&& mem->devices.deadline > cpu->cycles + M65_FUSE_SLACK							\
+					&& (cpu->traps == NULL || !m65_trapped(cpu->traps, cpu->pins.addr)))			\
+				fuse = m65_cache_lookup(cache, mem, M65_TRAIT(ID, v), cpu->pins.addr);				\
+																									\
+			if (fuse != M65_FUSE_NONE)																\
+				m65_fused(cpu, mem, fuse, M65_TRAIT(ID, v), M65_TRAIT(BCD, v));						\
+			else m65_step_##v(cpu, mem);															\
+			m65_mem_poll_devices(mem, cpu->cycles);													\
+		}																							\
+		break;
+
+	switch (cpu->variant)
+	{
+		case M65_CMOS:
+			m65_run_cached_(cmos)
+		case M65_2A03:
+			m65_run_cached_(2a03)
+		case M65_NMOS:
+		default:
+			m65_run_cached_(nmos)
+	}
+
+#undef m65_run_cached_
+
+	return cpu->cycles - start;
+}
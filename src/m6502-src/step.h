@@ -0,0 +1,86 @@
+//
+// MOS6502 Emulator
+// step.h: Header file for step.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef STEP_H
+#define STEP_H
+
+#include "m6502.h"
+#include "memory.h"
+
+// Represents the predecoded code of a processor for m65_run_cached(). Every address code was executed from remembers
+// which fused sequence of instructions starts there, if any. Decoding a page marks it as code in the memory map (see
+// m65_mem_track_code()), and pages whose generation changed are decoded again, so self-modifying code works.
+typedef struct
+{
+	// The kind of sequence at each address of each page, or NULL for pages that weren't decoded.
+	uint8_t* fuse[M65_PAGES];
+
+	// The generation of each page when it was decoded.
+	uint32_t generation[M65_PAGES];
+
+	// The cache file the pages loaded by m65_cache_load() are mapped from, or NULL.
+	void* map;
+	size_t map_size;
+} m65_cache_t;
+
+// m65_step(m6502_t*, m65_mem_t*) -> uint8_t
+// Executes one whole instruction (or interrupt sequence) at once and returns the number of cycles it took. The state
+// of the processor afterwards is the same as after running those cycles with m65_cycle(), but only the registers,
+// the cycle counter and memory are updated on the way; there are no bus transactions. A processor that is in the
+// middle of an instruction finishes it cycle by cycle first. A jammed processor takes one cycle per call. A call to a
+// trapped subroutine (see traps.h) runs the whole subroutine; its cycles are capped at 255 in the result but not in the
+// cycle counter.
+uint8_t m65_step(m6502_t* cpu, m65_mem_t* mem);
+
+// m65_step_<variant>(m6502_t*, m65_mem_t*) -> uint8_t
+// Executes one instruction of a processor of a fixed variant.
+uint8_t m65_step_nmos(m6502_t* cpu, m65_mem_t* mem);
+uint8_t m65_step_cmos(m6502_t* cpu, m65_mem_t* mem);
+uint8_t m65_step_2a03(m6502_t* cpu, m65_mem_t* mem);
+
+// m65_run(m6502_t*, m65_mem_t*, uint64_t) -> uint64_t
+// Executes whole instructions until at least the given number of cycles passed. Returns the number of cycles run,
+// which overshoots by the rest of the last instruction. Devices whose deadline passed are caught up after every
+// instruction.
+uint64_t m65_run(m6502_t* cpu, m65_mem_t* mem, uint64_t cycles);
+
+// m65_cache_init(m65_cache_t*) -> void
+// Initialises an empty cache. A cache belongs to one processor and memory map.
+void m65_cache_init(m65_cache_t* cache);
+
+// m65_cache_free(m65_cache_t*) -> void
+// Frees the decoded pages of a cache.
+void m65_cache_free(m65_cache_t* cache);
+
+// m65_cache_save(const m65_cache_t*, const m65_mem_t*, m65_variant_t, const char*) -> bool
+// Writes the decoded pages of a cache that still hold the code they were decoded from to a file, fully decoded and
+// keyed by a hash of their contents, so that later runs of the same code start warm with m65_cache_load(). The file is
+// replaced atomically, so processes can share it while others save it. Returns false if it can't be written.
+bool m65_cache_save(const m65_cache_t* cache, const m65_mem_t* mem, m65_variant_t variant, const char* path);
+
+// m65_cache_load(m65_cache_t*, m65_mem_t*, m65_variant_t, const char*) -> size_t
+// Maps the pages of a cache file whose contents match memory into a cache and marks them as code, replacing what the
+// cache had for them. The file is mapped copy on write, so the decoded pages aren't copied. Returns the number of pages
+// taken from the file, which is 0 if it doesn't exist, is corrupt or was saved for another variant. A cache maps at
+// most one file.
+size_t m65_cache_load(m65_cache_t* cache, m65_mem_t* mem, m65_variant_t variant, const char* path);
+
+// m65_run_cached(m6502_t*, m65_mem_t*, m65_cache_t*, uint64_t) -> uint64_t
+// Executes whole instructions like m65_run(), with the same result, but runs common sequences of instructions (lda and
+// sta, clc and adc, dex or dey and bne, inx and cpx or iny and cpy and bne) with a single dispatch. Sequences are only
+// fused when no interrupt is pending, all of their instructions fit in the remaining cycles and no device deadline
+// passes before their last instruction, so devices see the same cycles as with m65_run(). A sequence ends early when
+// a device it reads raises an interrupt.
+uint64_t m65_run_cached(m6502_t* cpu, m65_mem_t* mem, m65_cache_t* cache, uint64_t cycles);
+
+// m65_step_touches(const m6502_t*, const m65_mem_t*, const uint8_t*) -> bool
+// Checks if the next instruction may access any of the pages set in a bitmap of M65_PAGES bits. The check is
+// conservative: it returns true for instructions that already started and for calls to trapped subroutines.
+bool m65_step_touches(const m6502_t* cpu, const m65_mem_t* mem, const uint8_t* pages);
+
+#endif /* STEP_H */
@@ -0,0 +1,218 @@
+//
+// MOS6502 Emulator
+// system.c: Implements boards with several processors sharing memory.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "step.h"
+#include "system.h"
+
+// Represents the arguments of a processor thread.
+typedef struct
+{
+	m65_system_t* sys;
+	unsigned index;
+	uint64_t end;
+} m65_thread_t;
+
+// m65_system_init(m65_system_t*, unsigned) -> bool
+// Initialises a system of NMOS processors with private memory and nothing shared.
+bool m65_system_init(m65_system_t* sys, unsigned count)
+{
+	memset(sys, 0, sizeof(m65_system_t));
+	sys->count = count;
+	sys->quantum = 1024;
+	sys->cpus = calloc(count, sizeof(m6502_t));
+	sys->mems = calloc(count, sizeof(m65_mem_t));
+	sys->times = calloc(count, sizeof(uint64_t));
+	sys->shared_ram = calloc(M65_PAGES, M65_PAGE_SIZE);
+	pthread_mutex_init(&sys->lock, NULL);
+	pthread_cond_init(&sys->cond, NULL);
+
+	if (sys->cpus == NULL || sys->mems == NULL || sys->times == NULL || sys->shared_ram == NULL)
+	{
+		m65_system_free(sys);
+		return false;
+	}
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		init_6502(&sys->cpus[i]);
+		if (!m65_mem_init(&sys->mems[i]))
+		{
+			m65_system_free(sys);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// m65_system_free(m65_system_t*) -> void
+// Frees the processors and memory of a system.
+void m65_system_free(m65_system_t* sys)
+{
+	for (unsigned i = 0; sys->mems != NULL && i < sys->count; i++)
+		m65_mem_free(&sys->mems[i]);
+
+	free(sys->cpus);
+	free(sys->mems);
+	free(sys->times);
+	free(sys->shared_ram);
+	sys->cpus = NULL;
+	sys->mems = NULL;
+	sys->times = NULL;
+	sys->shared_ram = NULL;
+	pthread_mutex_destroy(&sys->lock);
+	pthread_cond_destroy(&sys->cond);
+}
+
+// m65_system_share(m65_system_t*, uint8_t, unsigned) -> void
+// Maps count pages starting at page to the shared RAM in the memory maps of all processors.
+void m65_system_share(m65_system_t* sys, uint8_t page, unsigned count)
+{
+	for (unsigned i = 0; i < count && page + i < M65_PAGES; i++)
+		sys->shared[(page + i) >> 3] |= 1 << ((page + i) & 7);
+
+	for (unsigned i = 0; i < sys->count; i++)
+		m65_mem_map_ram(&sys->mems[i], page, count, sys->shared_ram + page * M65_PAGE_SIZE);
+}
+
+// m65_system_private(m65_system_t*, unsigned, uint64_t) -> bool
+// Runs a processor as whole instructions until its next instruction may touch a shared page, or for a quantum or until
+// the end. Returns false if it couldn't run any instruction that way.
+static bool m65_system_private(m65_system_t* sys, unsigned i, uint64_t end)
+{
+	m6502_t* cpu = &sys->cpus[i];
+	m65_mem_t* mem = &sys->mems[i];
+	uint64_t limit = cpu->cycles + sys->quantum < end ? cpu->cycles + sys->quantum : end;
+	bool ran = false;
+
+	while (cpu->cycles < limit && !m65_step_touches(cpu, mem, sys->shared))
+	{
+		m65_step(cpu, mem);
+		m65_mem_poll_devices(mem, cpu->cycles);
+		ran = true;
+	}
+
+	return ran;
+}
+
+// m65_system_cycle(m65_system_t*, unsigned) -> void
+// Runs one cycle of a processor.
+static void m65_system_cycle(m65_system_t* sys, unsigned i)
+{
+	m65_mem_bus(&sys->mems[i], &sys->cpus[i]);
+	m65_cycle(&sys->cpus[i]);
+}
+
+// m65_system_run(m65_system_t*, uint64_t) -> void
+// Runs every processor of the system for a number of cycles on the calling thread.
+void m65_system_run(m65_system_t* sys, uint64_t cycles)
+{
+	uint64_t end = sys->time += cycles;
+
+	while (true)
+	{
+		// The processor furthest behind runs next
+		unsigned next = sys->count;
+		for (unsigned i = 0; i < sys->count; i++)
+		{
+			if (sys->cpus[i].cycles < end && (next == sys->count || sys->cpus[i].cycles < sys->cpus[next].cycles))
+				next = i;
+		}
+
+		if (next == sys->count)
+			break;
+
+		// Accesses to shared pages go one cycle at a time
+		if (!m65_system_private(sys, next, end))
+			m65_system_cycle(sys, next);
+	}
+}
+
+// m65_system_publish(m65_system_t*, unsigned, uint64_t) -> void
+// Publishes the time of a processor to the other threads.
+static void m65_system_publish(m65_system_t* sys, unsigned i, uint64_t time)
+{
+	pthread_mutex_lock(&sys->lock);
+	sys->times[i] = time;
+	pthread_cond_broadcast(&sys->cond);
+	pthread_mutex_unlock(&sys->lock);
+}
+
+// m65_system_first(const m65_system_t*, unsigned) -> bool
+// Checks if a processor is the furthest behind, which means that no other processor can access shared pages before
+// it anymore.
+static bool m65_system_first(const m65_system_t* sys, unsigned i)
+{
+	for (unsigned j = 0; j < sys->count; j++)
+	{
+		if (sys->times[j] < sys->times[i] || (sys->times[j] == sys->times[i] && j < i))
+			return false;
+	}
+
+	return true;
+}
+
+// m65_system_thread(void*) -> void*
+// Runs a processor of a system on a thread.
+static void* m65_system_thread(void* arg)
+{
+	m65_thread_t* thread = arg;
+	m65_system_t* sys = thread->sys;
+	unsigned i = thread->index;
+	m6502_t* cpu = &sys->cpus[i];
+
+	while (cpu->cycles < thread->end)
+	{
+		if (m65_system_private(sys, i, thread->end))
+		{
+			m65_system_publish(sys, i, cpu->cycles);
+			continue;
+		}
+
+		// Wait until every other processor is past this cycle
+		pthread_mutex_lock(&sys->lock);
+		sys->times[i] = cpu->cycles;
+		while (!m65_system_first(sys, i))
+			pthread_cond_wait(&sys->cond, &sys->lock);
+		pthread_mutex_unlock(&sys->lock);
+
+		m65_system_cycle(sys, i);
+		m65_system_publish(sys, i, cpu->cycles);
+	}
+
+	// Finished processors don't hold back the others
+	m65_system_publish(sys, i, UINT64_MAX);
+	return NULL;
+}
+
+// m65_system_run_threads(m65_system_t*, uint64_t) -> void
+// Runs every processor of the system for a number of cycles on a thread of its own.
+void m65_system_run_threads(m65_system_t* sys, uint64_t cycles)
+{
+	uint64_t end = sys->time += cycles;
+	pthread_t* threads = malloc(sys->count * sizeof(pthread_t));
+	m65_thread_t* args = malloc(sys->count * sizeof(m65_thread_t));
+
+	for (unsigned i = 0; i < sys->count; i++)
+		sys->times[i] = sys->cpus[i].cycles;
+
+	for (unsigned i = 0; i < sys->count; i++)
+	{
+		args[i] = (m65_thread_t) {sys, i, end};
+		pthread_create(&threads[i], NULL, m65_system_thread, &args[i]);
+	}
+
+	for (unsigned i = 0; i < sys->count; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(args);
+}
@@ -0,0 +1,75 @@
+//
+// MOS6502 Emulator
+// system.h: Header file for system.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include <pthread.h>
+
+#include "m6502.h"
+#include "memory.h"
+
+// Represents a board with several processors that share some of their memory, like a main processor and an I/O
+// coprocessor talking through a mailbox.
+//
+// Every processor has its own memory map, and the pages marked as shared point at the same RAM in all of them. The
+// cycle counters of the processors are the time of the system. Accesses to shared pages happen in the order of that
+// time (ties go to the processor with the lower index), exactly as if all processors were stepped cycle by cycle, so
+// runs are deterministic. Only instructions that may touch a shared page are run cycle by cycle in that order; the
+// others run as whole instructions, up to a quantum ahead of the slowest processor.
+typedef struct
+{
+	// The number of processors.
+	unsigned count;
+
+	// The processors and their memory maps.
+	m6502_t* cpus;
+	m65_mem_t* mems;
+
+	// The RAM behind the shared pages.
+	uint8_t* shared_ram;
+
+	// The shared pages, one bit per page.
+	uint8_t shared[M65_PAGES / 8];
+
+	// The number of cycles a processor runs on its own before the others get to run.
+	uint64_t quantum;
+
+	// The time the system runs until.
+	uint64_t time;
+
+	// The synchronisation between threads in m65_system_run_threads(). times holds the last time each processor
+	// published, which the others wait on before accessing shared pages.
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t* times;
+} m65_system_t;
+
+// m65_system_init(m65_system_t*, unsigned) -> bool
+// Initialises a system of NMOS processors with private memory and nothing shared. Returns false if memory can't be
+// allocated. Processors can be reinitialised with init_6502_variant() before the system runs.
+bool m65_system_init(m65_system_t* sys, unsigned count);
+
+// m65_system_free(m65_system_t*) -> void
+// Frees the processors and memory of a system.
+void m65_system_free(m65_system_t* sys);
+
+// m65_system_share(m65_system_t*, uint8_t, unsigned) -> void
+// Maps count pages starting at page to the shared RAM in the memory maps of all processors.
+void m65_system_share(m65_system_t* sys, uint8_t page, unsigned count);
+
+// m65_system_run(m65_system_t*, uint64_t) -> void
+// Runs every processor of the system for a number of cycles on the calling thread.
+void m65_system_run(m65_system_t* sys, uint64_t cycles);
+
+// m65_system_run_threads(m65_system_t*, uint64_t) -> void
+// Runs every processor of the system for a number of cycles on a thread of its own. Accesses to shared pages happen in
+// the same order as with m65_system_run().
+void m65_system_run_threads(m65_system_t* sys, uint64_t cycles);
+
+#endif /* SYSTEM_H */
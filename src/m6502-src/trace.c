@@ -0,0 +1,429 @@
+//
+// MOS6502 Emulator
+// trace.c: Implements the background trace writer.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+// The delta format starts with the 7 bytes "M65TRC1" and the variant, followed by the records. Every record is a tag
+// byte, the number of cycles since the previous record as an unsigned LEB128 number, and then the fields the tag
+// says changed:
+// - bits 0-4: a, x, y, s, and flags, one byte each in that order
+// - bit 5: pc, if it isn't right after the previous instruction (little endian)
+// - bit 6: the instruction bytes, if they aren't the same as the last time pc was traced (three bytes)
+// Everything starts out as zero. A loop that doesn't change memory takes two or three bytes per instruction. A tag of
+// 0x80 on its own starts over from zero, which is how traces are appended to each other (see m65_trace_append()).
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "disasm.h"
+#include "opcodes.h"
+#include "trace.h"
+
+// The size of the output buffer of the writer.
+#define M65_TRACE_BUFFER 65536
+
+// The most bytes a record takes in either format.
+#define M65_TRACE_RECORD_MAX 80
+
+// The first bytes of a trace in the delta format.
+static const char m65_trace_magic[7] = "M65TRC1";
+
+// Represents the state of a writer (or of m65_trace_dump()).
+typedef struct
+{
+	m65_variant_t variant;
+	FILE* out;
+
+	// The output waiting to be written.
+	uint8_t buf[M65_TRACE_BUFFER];
+	size_t pos;
+
+	// The previous record and the length of its instruction, which the delta format is relative to.
+	m65_trace_record_t last;
+	uint8_t length;
+
+	// The last instruction bytes seen at each address.
+	uint8_t (*seen)[3];
+
+	// The disassembly of the last instruction seen at each address, for text.
+	char (*text)[M65_DISASM_SIZE];
+} m65_writer_t;
+
+// m65_writer_init(m65_writer_t*, FILE*, m65_variant_t) -> bool
+// Initialises the state of a writer.
+static bool m65_writer_init(m65_writer_t* w, FILE* out, m65_variant_t variant)
+{
+	memset(w, 0, sizeof(m65_writer_t));
+	w->variant = variant;
+	w->out = out;
+	w->seen = calloc(65536, sizeof(*w->seen));
+	w->text = calloc(65536, sizeof(*w->text));
+	return w->seen != NULL && w->text != NULL;
+}
+
+// m65_writer_free(m65_writer_t*) -> void
+// Frees the state of a writer.
+static void m65_writer_free(m65_writer_t* w)
+{
+	free(w->seen);
+	free(w->text);
+}
+
+// m65_writer_flush(m65_writer_t*) -> void
+// Writes the buffered output.
+static void m65_writer_flush(m65_writer_t* w)
+{
+	fwrite(w->buf, 1, w->pos, w->out);
+	w->pos = 0;
+}
+
+// m65_put_hex(char*, unsigned, int) -> char*
+// Writes a number as a fixed number of hex digits and returns the end.
+static inline char* m65_put_hex(char* p, unsigned value, int digits)
+{
+	static const char hex[] = "0123456789abcdef";
+	for (int i = digits - 1; i >= 0; i--)
+		p[i] = hex[value & 0xf], value >>= 4;
+	return p + digits;
+}
+
+// m65_writer_text(m65_writer_t*, const m65_trace_record_t*) -> void
+// Formats a record as a line of text.
+static void m65_writer_text(m65_writer_t* w, const m65_trace_record_t* record)
+{
+	char* p = (char*) w->buf + w->pos;
+
+	// The cycle count, in decimal
+	char digits[20];
+	int count = 0;
+	uint64_t cycles = record->cycles;
+	do
+	{
+		digits[count++] = '0' + cycles % 10;
+		cycles /= 10;
+	} while (cycles);
+	while (count)
+		*p++ = digits[--count];
+
+	*p++ = ' ';
+	p = m65_put_hex(p, record->pc, 4);
+	*p++ = ' ';
+	p = m65_put_hex(p, record->bytes[0], 2);
+
+	const char names[] = "axysp";
+	const uint8_t regs[] = {record->a, record->x, record->y, record->s, record->flags};
+	for (int i = 0; i < 5; i++)
+	{
+		*p++ = ' ';
+		*p++ = names[i];
+		*p++ = '=';
+		p = m65_put_hex(p, regs[i], 2);
+	}
+
+	// The disassembly is only redone when the instruction at the address changed
+	char* text = w->text[record->pc];
+	if (text[0] == '\0' || memcmp(w->seen[record->pc], record->bytes, 3) != 0)
+	{
+		m65_disasm_bytes(w->variant, record->pc, record->bytes, text);
+		memcpy(w->seen[record->pc], record->bytes, 3);
+	}
+
+	*p++ = ' ';
+	size_t length = strlen(text);
+	memcpy(p, text, length);
+	p += length;
+	*p++ = '\n';
+	w->pos = (uint8_t*) p - w->buf;
+}
+
+// m65_writer_delta(m65_writer_t*, const m65_trace_record_t*) -> void
+// Encodes a record in the delta format.
+static void m65_writer_delta(m65_writer_t* w, const m65_trace_record_t* record)
+{
+	uint8_t* tag = w->buf + w->pos;
+	uint8_t* p = tag + 1;
+	*tag = 0;
+
+	uint64_t delta = record->cycles - w->last.cycles;
+	do
+	{
+		*p = delta & 0x7f;
+		delta >>= 7;
+		*p++ |= delta ? 0x80 : 0;
+	} while (delta);
+
+	const uint8_t regs[] = {record->a, record->x, record->y, record->s, record->flags};
+	const uint8_t last[] = {w->last.a, w->last.x, w->last.y, w->last.s, w->last.flags};
+	for (int i = 0; i < 5; i++)
+	{
+		if (regs[i] != last[i])
+		{
+			*tag |= 1 << i;
+			*p++ = regs[i];
+		}
+	}
+
+	if (record->pc != (uint16_t) (w->last.pc + w->length))
+	{
+		*tag |= 0x20;
+		*p++ = record->pc & 0xff;
+		*p++ = record->pc >> 8;
+	}
+
+	if (memcmp(w->seen[record->pc], record->bytes, 3) != 0)
+	{
+		*tag |= 0x40;
+		memcpy(p, record->bytes, 3);
+		memcpy(w->seen[record->pc], record->bytes, 3);
+		p += 3;
+	}
+
+	const m65_opinfo_t* info = &m65_opinfo[w->variant][record->bytes[0]];
+	w->length = info->cycles ? m65_mode_length[info->mode] : 1;
+	w->last = *record;
+	w->pos = p - w->buf;
+}
+
+// m65_trace_writer(void*) -> void*
+// Writes the records of a trace as they come in.
+static void* m65_trace_writer(void* arg)
+{
+	m65_trace_t* trace = arg;
+	m65_writer_t* w = malloc(sizeof(m65_writer_t));
+	bool ok = w != NULL && m65_writer_init(w, trace->out, trace->variant);
+	size_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+
+	if (ok && trace->format == M65_TRACE_DELTA)
+	{
+		fwrite(m65_trace_magic, 1, sizeof(m65_trace_magic), trace->out);
+		fputc(trace->variant, trace->out);
+	}
+
+	while (true)
+	{
+		bool done = atomic_load_explicit(&trace->done, memory_order_acquire);
+		size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+
+		// Wait for more records, writing out what there is in the meantime
+		if (head == tail)
+		{
+			if (done)
+				break;
+			if (ok)
+				m65_writer_flush(w);
+			nanosleep(&(struct timespec) {0, 100000}, NULL);
+			continue;
+		}
+
+		// Take the records out in batches, handing the space back after each one
+		while (tail != head)
+		{
+			size_t end = head - tail > 1024 ? tail + 1024 : head;
+			for (; ok && tail != end; tail++)
+			{
+				if (w->pos > M65_TRACE_BUFFER - M65_TRACE_RECORD_MAX)
+					m65_writer_flush(w);
+
+				const m65_trace_record_t* record = &trace->ring[tail & (trace->capacity - 1)];
+				if (trace->format == M65_TRACE_TEXT)
+					m65_writer_text(w, record);
+				else m65_writer_delta(w, record);
+			}
+
+			tail = end;
+			atomic_store_explicit(&trace->tail, tail, memory_order_release);
+		}
+	}
+
+	if (ok)
+		m65_writer_flush(w);
+	if (w != NULL)
+		m65_writer_free(w);
+	free(w);
+	return NULL;
+}
+
+// m65_trace_init(m65_trace_t*, FILE*, m65_trace_format_t, m65_trace_policy_t, m65_variant_t, size_t) -> bool
+// Starts a trace that is written to out by a background thread.
+bool m65_trace_init(m65_trace_t* trace, FILE* out, m65_trace_format_t format, m65_trace_policy_t policy,
+		m65_variant_t variant, size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size *= 2;
+
+	memset(trace, 0, sizeof(m65_trace_t));
+	trace->ring = malloc(size * sizeof(m65_trace_record_t));
+	trace->capacity = size;
+	trace->format = format;
+	trace->policy = policy;
+	trace->variant = variant;
+	trace->out = out;
+	atomic_init(&trace->head, 0);
+	atomic_init(&trace->tail, 0);
+	atomic_init(&trace->done, false);
+
+	if (trace->ring == NULL || pthread_create(&trace->thread, NULL, m65_trace_writer, trace) != 0)
+	{
+		free(trace->ring);
+		trace->ring = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// m65_trace_close(m65_trace_t*) -> uint64_t
+// Writes the records still in the queue, stops the writer thread and frees the queue.
+uint64_t m65_trace_close(m65_trace_t* trace)
+{
+	atomic_store_explicit(&trace->done, true, memory_order_release);
+	pthread_join(trace->thread, NULL);
+	fflush(trace->out);
+	free(trace->ring);
+	trace->ring = NULL;
+	return trace->dropped;
+}
+
+// m65_trace_full(m65_trace_t*, const m65_trace_record_t*) -> bool
+// Handles a push to a full queue according to the policy.
+bool m65_trace_full(m65_trace_t* trace, const m65_trace_record_t* record)
+{
+	if (trace->policy == M65_TRACE_DROP)
+	{
+		trace->dropped++;
+		return false;
+	}
+
+	// Wait until the writer made room
+	size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	while (head - (trace->tail_seen = atomic_load_explicit(&trace->tail, memory_order_acquire)) == trace->capacity)
+		nanosleep(&(struct timespec) {0, 20000}, NULL);
+	return m65_trace_push(trace, record);
+}
+
+// m65_trace_read(FILE*, m65_writer_t*, m65_trace_record_t*) -> int
+// Decodes the next record of a trace in the delta format. Returns 1 on success, 0 at the end of the trace and -1 if
+// the trace ends in the middle of a record.
+static int m65_trace_read(FILE* in, m65_writer_t* w, m65_trace_record_t* record)
+{
+	int tag;
+	while ((tag = fgetc(in)) == 0x80)
+	{
+		memset(&w->last, 0, sizeof(w->last));
+		memset(w->seen, 0, 65536 * sizeof(*w->seen));
+		w->length = 0;
+	}
+	if (tag == EOF)
+		return 0;
+
+	*record = w->last;
+	uint64_t delta = 0;
+	int shift = 0;
+	int byte;
+	do
+	{
+		if ((byte = fgetc(in)) == EOF)
+			return -1;
+		delta |= (uint64_t) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	record->cycles += delta;
+
+	uint8_t* regs[] = {&record->a, &record->x, &record->y, &record->s, &record->flags};
+	for (int i = 0; i < 5; i++)
+	{
+		if (tag & 1 << i)
+		{
+			if ((byte = fgetc(in)) == EOF)
+				return -1;
+			*regs[i] = byte;
+		}
+	}
+
+	record->pc = w->last.pc + w->length;
+	if (tag & 0x20)
+	{
+		int low = fgetc(in);
+		int high = fgetc(in);
+		if (high == EOF)
+			return -1;
+		record->pc = low | high << 8;
+	}
+
+	if (tag & 0x40)
+	{
+		if (fread(w->seen[record->pc], 1, 3, in) != 3)
+			return -1;
+	}
+	memcpy(record->bytes, w->seen[record->pc], 3);
+
+	const m65_opinfo_t* info = &m65_opinfo[w->variant][record->bytes[0]];
+	w->length = info->cycles ? m65_mode_length[info->mode] : 1;
+	w->last = *record;
+	return 1;
+}
+
+// m65_trace_dump(FILE*, FILE*) -> bool
+// Converts a trace in the delta format to text.
+bool m65_trace_dump(FILE* in, FILE* out)
+{
+	char magic[sizeof(m65_trace_magic)];
+	int variant;
+	if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, m65_trace_magic, sizeof(magic)) != 0
+			|| (variant = fgetc(in)) == EOF || variant > M65_2A03)
+		return false;
+
+	// Decoding and formatting keep separate copies of the instructions seen at each address
+	m65_writer_t* decoder = malloc(sizeof(m65_writer_t));
+	m65_writer_t* writer = malloc(sizeof(m65_writer_t));
+	bool ok = decoder != NULL && writer != NULL && m65_writer_init(decoder, NULL, variant)
+		&& m65_writer_init(writer, out, variant);
+
+	m65_trace_record_t record;
+	int status = 0;
+	while (ok && (status = m65_trace_read(in, decoder, &record)) == 1)
+	{
+		if (writer->pos > M65_TRACE_BUFFER - M65_TRACE_RECORD_MAX)
+			m65_writer_flush(writer);
+		m65_writer_text(writer, &record);
+	}
+
+	if (ok)
+		m65_writer_flush(writer);
+	if (decoder != NULL)
+		m65_writer_free(decoder);
+	if (writer != NULL)
+		m65_writer_free(writer);
+	free(decoder);
+	free(writer);
+	return ok && status == 0;
+}
+
+// m65_trace_append(FILE*, FILE*, m65_trace_format_t, bool) -> bool
+// Copies a whole trace to the end of another.
+bool m65_trace_append(FILE* out, FILE* in, m65_trace_format_t format, bool first)
+{
+	if (format == M65_TRACE_DELTA && !first)
+	{
+		// The trace goes on from its first record, starting over from zero
+		char magic[sizeof(m65_trace_magic) + 1];
+		if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, m65_trace_magic, sizeof(magic) - 1) != 0
+				|| fputc(0x80, out) == EOF)
+			return false;
+	}
+
+	char buf[M65_TRACE_BUFFER];
+	size_t size;
+	while ((size = fread(buf, 1, sizeof(buf), in)) > 0)
+	{
+		if (fwrite(buf, 1, size, out) != size)
+			return false;
+	}
+
+	return !ferror(in);
+}
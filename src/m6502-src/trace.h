@@ -0,0 +1,128 @@
+//
+// MOS6502 Emulator
+// trace.h: Header file for trace.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "m6502.h"
+
+// Represents the state of the processor when it starts an instruction.
+typedef struct
+{
+	// The cycle the opcode was fetched on.
+	uint64_t cycles;
+
+	// The address of the instruction.
+	uint16_t pc;
+
+	// The opcode and the two bytes after it.
+	uint8_t bytes[3];
+
+	// The registers.
+	uint8_t a, x, y, s, flags;
+} m65_trace_record_t;
+
+// The formats a trace is written in.
+typedef enum
+{
+	// One line of text per instruction, with its disassembly.
+	M65_TRACE_TEXT,
+
+	// A compact binary format where every record only stores what changed since the previous one (see trace.c).
+	// m65_trace_dump() turns it into text.
+	M65_TRACE_DELTA
+} m65_trace_format_t;
+
+// What the emulation thread does when the writer falls behind and the queue is full.
+typedef enum
+{
+	// Wait for the writer, which slows emulation down but loses nothing.
+	M65_TRACE_BLOCK,
+
+	// Drop the record and count it.
+	M65_TRACE_DROP
+} m65_trace_policy_t;
+
+// Represents a trace written by a background thread. The emulation thread pushes records into a single producer,
+// single consumer queue without taking locks or making system calls, and the writer thread takes them out in batches,
+// formats or encodes them, and writes them.
+typedef struct
+{
+	// The queue. head is only written by the emulation thread and tail only by the writer; both count records from the
+	// start and are taken modulo the capacity. The emulation thread keeps its own copy of tail so that it only has to
+	// look at the writer's when the queue seems full.
+	m65_trace_record_t* ring;
+	size_t capacity;
+	_Alignas(64) atomic_size_t head;
+	size_t tail_seen;
+	_Alignas(64) atomic_size_t tail;
+
+	// Set when no more records will come.
+	_Alignas(64) atomic_bool done;
+
+	// The number of records dropped because the queue was full.
+	uint64_t dropped;
+
+	// How records are written.
+	m65_trace_format_t format;
+	m65_trace_policy_t policy;
+	m65_variant_t variant;
+	FILE* out;
+
+	// The writer thread.
+	pthread_t thread;
+} m65_trace_t;
+
+// m65_trace_init(m65_trace_t*, FILE*, m65_trace_format_t, m65_trace_policy_t, m65_variant_t, size_t) -> bool
+// Starts a trace that is written to out by a background thread. capacity is the number of records the queue holds
+// (rounded up to a power of two). Returns false if the queue or the thread can't be created.
+bool m65_trace_init(m65_trace_t* trace, FILE* out, m65_trace_format_t format, m65_trace_policy_t policy,
+		m65_variant_t variant, size_t capacity);
+
+// m65_trace_close(m65_trace_t*) -> uint64_t
+// Writes the records still in the queue, stops the writer thread and frees the queue. The file isn't closed. Returns
+// the number of records that were dropped.
+uint64_t m65_trace_close(m65_trace_t* trace);
+
+// m65_trace_full(m65_trace_t*, const m65_trace_record_t*) -> bool
+// Handles a push to a full queue according to the policy. Use m65_trace_push() instead.
+bool m65_trace_full(m65_trace_t* trace, const m65_trace_record_t* record);
+
+// m65_trace_push(m65_trace_t*, const m65_trace_record_t*) -> bool
+// Queues a record. Returns false if it was dropped.
+static inline bool m65_trace_push(m65_trace_t* trace, const m65_trace_record_t* record)
+{
+	size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	if (head - trace->tail_seen == trace->capacity)
+	{
+		trace->tail_seen = atomic_load_explicit(&trace->tail, memory_order_acquire);
+		if (head - trace->tail_seen == trace->capacity)
+			return m65_trace_full(trace, record);
+	}
+
+	trace->ring[head & (trace->capacity - 1)] = *record;
+	atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+	return true;
+}
+
+// m65_trace_dump(FILE*, FILE*) -> bool
+// Converts a trace in the delta format to text. Returns false if the input isn't a delta trace or ends in the middle
+// of a record.
+bool m65_trace_dump(FILE* in, FILE* out);
+
+// m65_trace_append(FILE*, FILE*, m65_trace_format_t, bool) -> bool
+// Copies a whole trace, read from in, to the end of the trace being written to out, so that traces of consecutive parts
+// of a run make up the trace of the whole run. first is set for the first part. Delta traces after the first lose
+// their header and start over from zero instead. Returns false if the trace can't be read or written.
+bool m65_trace_append(FILE* out, FILE* in, m65_trace_format_t format, bool first);
+
+#endif /* TRACE_H */
@@ -0,0 +1,80 @@
+//
+// MOS6502 Emulator
+// traps.c: Implements running guest subroutines natively.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "traps.h"
+
+// m65_traps_init(m65_traps_t*) -> void
+// Initialises an empty trap table.
+void m65_traps_init(m65_traps_t* traps)
+{
+	memset(traps, 0, sizeof(m65_traps_t));
+}
+
+// m65_traps_free(m65_traps_t*) -> void
+// Frees a trap table.
+void m65_traps_free(m65_traps_t* traps)
+{
+	free(traps->traps);
+	m65_traps_init(traps);
+}
+
+// m65_trap_find(m65_traps_t*, uint16_t) -> m65_trap_t*
+// Finds the trap on an address.
+m65_trap_t* m65_trap_find(m65_traps_t* traps, uint16_t addr)
+{
+	if (!m65_trapped(traps, addr))
+		return NULL;
+
+	for (size_t i = 0; i < traps->count; i++)
+	{
+		if (traps->traps[i].addr == addr)
+			return &traps->traps[i];
+	}
+
+	return NULL;
+}
+
+// m65_trap_add(m65_traps_t*, uint16_t, m65_trap_fn_t, void*) -> bool
+// Runs the subroutine at an address natively, replacing any trap it had.
+bool m65_trap_add(m65_traps_t* traps, uint16_t addr, m65_trap_fn_t fn, void* ctx)
+{
+	m65_trap_t* trap = m65_trap_find(traps, addr);
+	if (trap == NULL)
+	{
+		if (traps->count == traps->capacity)
+		{
+			size_t capacity = traps->capacity ? traps->capacity * 2 : 16;
+			m65_trap_t* grown = realloc(traps->traps, capacity * sizeof(m65_trap_t));
+			if (grown == NULL)
+				return false;
+			traps->traps = grown;
+			traps->capacity = capacity;
+		}
+
+		trap = &traps->traps[traps->count++];
+	}
+
+	*trap = (m65_trap_t) {addr, fn, ctx, 0};
+	traps->bits[addr >> 6] |= (uint64_t) 1 << (addr & 63);
+	return true;
+}
+
+// m65_trap_remove(m65_traps_t*, uint16_t) -> void
+// Runs the subroutine at an address emulated again.
+void m65_trap_remove(m65_traps_t* traps, uint16_t addr)
+{
+	m65_trap_t* trap = m65_trap_find(traps, addr);
+	if (trap == NULL)
+		return;
+
+	*trap = traps->traps[--traps->count];
+	traps->bits[addr >> 6] &= ~((uint64_t) 1 << (addr & 63));
+}
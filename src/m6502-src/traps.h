@@ -0,0 +1,79 @@
+//
+// MOS6502 Emulator
+// traps.h: Header file for traps.c.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef TRAPS_H
+#define TRAPS_H
+
+#include "m6502.h"
+#include "memory.h"
+
+// A native implementation of a guest subroutine. It updates the registers and memory exactly like the subroutine
+// would, and returns the number of cycles the subroutine takes from its first instruction up to and including its rts,
+// or 0 to run the subroutine emulated after all (for inputs it doesn't handle). The return address is pulled by the
+// caller.
+typedef uint64_t (*m65_trap_fn_t)(m6502_t* cpu, m65_mem_t* mem, void* ctx);
+
+// Represents a trap on a subroutine.
+typedef struct
+{
+	// The address of the first instruction of the subroutine.
+	uint16_t addr;
+
+	// The native implementation and its context.
+	m65_trap_fn_t fn;
+	void* ctx;
+
+	// The number of calls the native implementation handled.
+	uint64_t hits;
+} m65_trap_t;
+
+// Represents the subroutines of a processor that are run natively. A processor with a trap table attached
+// (m6502_t.traps) checks the bit of every address it enters with jsr with the step engines (m65_step(), m65_run() and
+// m65_run_cached()), and when it's set, calls the native implementation instead and returns as if the subroutine
+// executed its rts. Jumps, branches and returns to a trapped address run emulated, so a subroutine that loops back to
+// its entry is only trapped once per call. The cycle engine doesn't trap. Interrupts that come in during a trapped
+// subroutine are taken after it returns.
+struct s_m65_traps
+{
+	// The addresses that have a trap, one bit per address.
+	uint64_t bits[1024];
+
+	// The traps.
+	m65_trap_t* traps;
+	size_t count;
+	size_t capacity;
+};
+
+// m65_traps_init(m65_traps_t*) -> void
+// Initialises an empty trap table.
+void m65_traps_init(m65_traps_t* traps);
+
+// m65_traps_free(m65_traps_t*) -> void
+// Frees a trap table.
+void m65_traps_free(m65_traps_t* traps);
+
+// m65_trap_add(m65_traps_t*, uint16_t, m65_trap_fn_t, void*) -> bool
+// Runs the subroutine at an address natively, replacing any trap it had. Returns false if memory can't be allocated.
+bool m65_trap_add(m65_traps_t* traps, uint16_t addr, m65_trap_fn_t fn, void* ctx);
+
+// m65_trap_remove(m65_traps_t*, uint16_t) -> void
+// Runs the subroutine at an address emulated again.
+void m65_trap_remove(m65_traps_t* traps, uint16_t addr);
+
+// m65_trap_find(m65_traps_t*, uint16_t) -> m65_trap_t*
+// Finds the trap on an address. Returns NULL if there is none.
+m65_trap_t* m65_trap_find(m65_traps_t* traps, uint16_t addr);
+
+// m65_trapped(const m65_traps_t*, uint16_t) -> bool
+// Checks if an address has a trap.
+static inline bool m65_trapped(const m65_traps_t* traps, uint16_t addr)
+{
+	return traps->bits[addr >> 6] >> (addr & 63) & 1;
+}
+
+#endif /* TRAPS_H */
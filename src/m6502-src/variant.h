@@ -0,0 +1,53 @@
+//
+// MOS6502 Emulator
+// variant.h: Compile time traits of the supported chip variants.
+//
+// Created by jenra.
+// Created on October 19 2026.
+//
+
+#ifndef VARIANT_H
+#define VARIANT_H
+
+// Every variant specialised function is generated from a macro template that takes the variant suffix (nmos, cmos,
+// or 2a03). The traits below are pasted together with that suffix, so each one is a constant in the generated code
+// and the compiler folds the checks away.
+#define M65_TRAIT(trait, v) M65_##trait##_##v
+
+// The m65_variant_t of each variant.
+#define M65_ID_nmos M65_NMOS
+#define M65_ID_cmos M65_CMOS
+#define M65_ID_2a03 M65_2A03
+
+// Decimal mode behaviour of adc and sbc.
+#define M65_BCD_NONE 0
+#define M65_BCD_NMOS 1
+#define M65_BCD_CMOS 2
+
+#define M65_BCD_nmos M65_BCD_NMOS
+#define M65_BCD_cmos M65_BCD_CMOS
+#define M65_BCD_2a03 M65_BCD_NONE
+
+// Whether jmp ($xxff) reads the high byte of the target from $xx00 instead of the next page.
+#define M65_JMP_BUG_nmos 1
+#define M65_JMP_BUG_cmos 0
+#define M65_JMP_BUG_2a03 1
+
+// Whether interrupts (and brk) clear the decimal flag.
+#define M65_INT_CLD_nmos 0
+#define M65_INT_CLD_cmos 1
+#define M65_INT_CLD_2a03 0
+
+// Whether the opcodes added by the 65C02 are decoded.
+#define M65_EXT_OPS_nmos 0
+#define M65_EXT_OPS_cmos 1
+#define M65_EXT_OPS_2a03 0
+
+// m65_variants_(template) -> void
+// Instantiates a template once for each variant.
+#define m65_variants_(template)	\
+	template(nmos)				\
+	template(cmos)				\
+	template(2a03)
+
+#endif /* VARIANT_H */
@@ -6,66 +6,1106 @@
 // Created on June 8 2020.
 //
 
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "m6502-src/aot.h"
+#include "m6502-src/coverage.h"
+#include "m6502-src/loader.h"
+#include "m6502-src/mapper.h"
 #include "m6502-src/m6502.h"
+#include "m6502-src/memory.h"
+#include "m6502-src/opcodes.h"
+#include "m6502-src/pace.h"
+#include "m6502-src/step.h"
+#include "m6502-src/trace.h"
 
-int main()
+// Represents a single run of the emulator and its results.
+typedef struct
 {
-	// Init cpu
+	// The memory image and where to put it.
+	const char* image;
+	bool has_load;
+	uint16_t load;
+	bool rom;
+
+	// The mapper the image is banked through, or NULL. ines picks it by the iNES header of the image.
+	const m65_mapper_type_t* mapper;
+	bool ines;
+
+	// Where to start executing instead of the reset vector.
+	bool has_entry;
+	uint16_t entry;
+
+	// The chip to emulate.
+	m65_variant_t variant;
+
+	// When to stop. A limit of 0 means no limit.
+	uint64_t max_cycles;
+	uint64_t max_instructions;
+	bool stop_brk;
+	bool has_stop_pc;
+	uint16_t stop_pc;
+	bool has_stop_write;
+	uint16_t stop_write;
+
+	// Where to write the instruction trace, or NULL, and how.
+	const char* trace;
+	m65_trace_format_t trace_format;
+	m65_trace_policy_t trace_policy;
+
+	// Whether to count executed opcodes and their cycles.
+	bool profile;
+
+	// Whether to run whole instructions with fused sequences, keeping the decoded code next to the image.
+	bool fused;
+
+	// The clock rate to run at in real time, or 0 to run as fast as possible.
+	uint64_t hz;
+
+	// The JSON describing the result of the job.
+	char* output;
+	size_t output_size;
+
+	// The copy of its line of the jobs file that the strings of the job point into, or NULL.
+	char* line;
+} job_t;
+
+// The jobs to run and the next one a worker should pick up.
+static job_t* jobs = NULL;
+static size_t job_count = 0;
+static atomic_size_t next_job = 0;
+
+// The coverage map every job merges into, the file it's kept in, and the listing to report it for.
+static m65_coverage_t* coverage = NULL;
+static const char* coverage_file = NULL;
+static const char* listing_file = NULL;
+
+// The delta trace to convert to text instead of running anything.
+static const char* dump_file = NULL;
+
+// The file to write the image compiled to C to instead of running it.
+static const char* compile_file = NULL;
+
+// The number of cycles between the checkpoints of runs whose trace is written afterwards in parallel, or 0 to write
+// traces while running, and the number of threads that write them.
+static uint64_t checkpoint_interval = 0;
+static int trace_threads = 1;
+
+// Represents a segment of a checkpointed run: the state of the run at the checkpoint it starts at, and its trace.
+typedef struct
+{
+	// The processor and memory at the start of the segment, and the mapper if the image is banked.
 	m6502_t cpu;
-	init_6502(&cpu);
+	m65_mem_t mem;
+	m65_mapper_t mapper;
+	bool mapped;
+
+	// The cycle the segment ends before.
+	uint64_t end;
+
+	// The trace of the segment and the number of records it dropped, or NULL if it couldn't be written, and whether it
+	// was traced.
+	FILE* trace;
+	uint64_t dropped;
+	bool done;
+} segment_t;
+
+// Represents the segments of a checkpointed run being traced.
+typedef struct
+{
+	const job_t* job;
+	segment_t** segments;
+	size_t count;
+
+	// The cycle after the last instruction the run traced; it stopped before tracing any later one.
+	uint64_t traced;
+
+	// The next segment a thread should trace, and the number whose traces were written to the file. Threads stay
+	// at most window segments ahead of the file, so that only so many traces are kept in temporary files.
+	size_t next;
+	size_t written;
+	size_t window;
+
+	// Guards the counters and the done flags of the segments.
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} segments_t;
+
+// usage(const char*) -> void
+// Prints how to use the program.
+static void usage(const char* name)
+{
+	fprintf(stderr,
+		"usage: %s [options] image\n"
+		"       %s [options] -j jobs\n"
+		"       %s -D trace\n"
+		"       %s [options] -A out.c image\n"
+		"\n"
+		"Runs a memory image and prints the final state as JSON.\n"
+		"\n"
+		"options:\n"
+		"  -l, --load ADDR           put the program at ADDR (default: the image's own load address)\n"
+		"  -r, --rom                 map the image read only instead of copying it into RAM\n"
+		"  -M, --mapper NAME         bank the image through a mapper: nrom, mmc1, uxrom, cnrom, axrom,\n"
+		"                            colordreams, bnrom, gxrom, bank8k, or ines to use the iNES header\n"
+		"  -e, --entry ADDR          start at ADDR instead of the reset vector\n"
+		"  -V, --variant NAME        emulate an nmos (default), cmos, or 2a03 processor\n"
+		"  -c, --cycles N            stop after N cycles\n"
+		"  -i, --instructions N      stop after N instructions\n"
+		"  -b, --brk                 stop before executing brk\n"
+		"  -p, --pc ADDR             stop when the program counter reaches ADDR\n"
+		"  -w, --write ADDR          stop after ADDR is written to\n"
+		"  -t, --trace FILE          write a trace of every instruction to FILE (- for stderr)\n"
+		"  -Z, --trace-delta         write the trace in the compact delta format instead of text, which is\n"
+		"                            much faster; use it for long runs\n"
+		"  -d, --trace-drop          drop trace records when the writer falls behind instead of waiting\n"
+		"  -k, --checkpoint N        with -t, run untraced while copying the state every N cycles, then write the\n"
+		"                            trace by rerunning the parts between the copies in parallel\n"
+		"  -D, --dump-trace FILE     print the delta trace FILE as text and exit\n"
+		"  -A, --compile FILE        compile the code reachable from the vectors and the entry point of the\n"
+		"                            mapped image to C in FILE and exit\n"
+		"  -P, --profile             count executed opcodes and their cycles\n"
+		"  -F, --fused               run whole instructions, fusing common sequences, and keep the decoded code\n"
+		"                            in IMAGE.fuse for the next run; only stops on -c and unimplemented opcodes\n"
+		"  -R, --realtime HZ         run at HZ cycles per second in real time (ntsc for 1789773, or a number)\n"
+		"  -j, --jobs FILE           run every line of FILE as a job; lines take the same options\n"
+		"  -T, --threads N           run N jobs in parallel (default: one per processor)\n"
+		"  -C, --coverage FILE       add the instructions and branches executed by all jobs to FILE\n"
+		"  -L, --listing FILE        with -C, write an lcov report for the assembler listing FILE to the\n"
+		"                            coverage file with .info appended\n"
+		"\n"
+		"Addresses may be written in decimal, as 0x1234, or as $1234.\n",
+		name, name, name, name);
+}
+
+// parse_number(const char*, uint64_t, uint64_t*) -> bool
+// Parses a number that is at most max.
+static bool parse_number(const char* text, uint64_t max, uint64_t* value)
+{
+	char* end;
+	int base = 0;
+	if (*text == '$')
+	{
+		text++;
+		base = 16;
+	}
 
-	// Init memory
-	uint8_t memory[1 << 16] = { 0 };
-	memory[0x1234] = 0x40;
+	*value = strtoull(text, &end, base);
+	return *text != '\0' && *end == '\0' && *value <= max;
+}
 
-	memory[0x8000] = 0xa9;
-	memory[0x8001] = 0x01;
-	memory[0x8002] = 0x69;
-	memory[0x8003] = 0x7f;
+// parse_job(job_t*, int, char**, const char**, int*) -> bool
+// Parses the options of a job. The jobs file, thread count, coverage, trace dump, compile and checkpoint options are
+// only accepted on the command line.
+static bool parse_job(job_t* job, int argc, char** argv, const char** jobs_file, int* threads)
+{
+	static const struct option options[] = {
+		{"load", required_argument, NULL, 'l'},
+		{"rom", no_argument, NULL, 'r'},
+		{"mapper", required_argument, NULL, 'M'},
+		{"entry", required_argument, NULL, 'e'},
+		{"variant", required_argument, NULL, 'V'},
+		{"cycles", required_argument, NULL, 'c'},
+		{"instructions", required_argument, NULL, 'i'},
+		{"brk", no_argument, NULL, 'b'},
+		{"pc", required_argument, NULL, 'p'},
+		{"write", required_argument, NULL, 'w'},
+		{"trace", required_argument, NULL, 't'},
+		{"trace-delta", no_argument, NULL, 'Z'},
+		{"trace-drop", no_argument, NULL, 'd'},
+		{"checkpoint", required_argument, NULL, 'k'},
+		{"dump-trace", required_argument, NULL, 'D'},
+		{"compile", required_argument, NULL, 'A'},
+		{"profile", no_argument, NULL, 'P'},
+		{"fused", no_argument, NULL, 'F'},
+		{"realtime", required_argument, NULL, 'R'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"threads", required_argument, NULL, 'T'},
+		{"coverage", required_argument, NULL, 'C'},
+		{"listing", required_argument, NULL, 'L'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
 
-	memory[0xfffc] = 0x00;
-	memory[0xfffd] = 0x80;
+	uint64_t value;
+	int opt;
+	optind = 0;
+	while ((opt = getopt_long(argc, argv, "l:rM:e:V:c:i:bp:w:t:Zdk:D:A:PFR:j:T:C:L:h", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'l':
+				if (!parse_number(optarg, 0xffff, &value))
+					return false;
+				job->has_load = true;
+				job->load = value;
+				break;
+			case 'r':
+				job->rom = true;
+				break;
+			case 'M':
+				job->ines = strcmp(optarg, "ines") == 0;
+				if (!job->ines && (job->mapper = m65_mapper_find(optarg)) == NULL)
+					return false;
+				break;
+			case 'e':
+				if (!parse_number(optarg, 0xffff, &value))
+					return false;
+				job->has_entry = true;
+				job->entry = value;
+				break;
+			case 'V':
+				if (strcmp(optarg, "nmos") == 0)
+					job->variant = M65_NMOS;
+				else if (strcmp(optarg, "cmos") == 0 || strcmp(optarg, "65c02") == 0)
+					job->variant = M65_CMOS;
+				else if (strcmp(optarg, "2a03") == 0)
+					job->variant = M65_2A03;
+				else return false;
+				break;
+			case 'c':
+				if (!parse_number(optarg, UINT64_MAX, &job->max_cycles))
+					return false;
+				break;
+			case 'i':
+				if (!parse_number(optarg, UINT64_MAX, &job->max_instructions))
+					return false;
+				break;
+			case 'b':
+				job->stop_brk = true;
+				break;
+			case 'p':
+				if (!parse_number(optarg, 0xffff, &value))
+					return false;
+				job->has_stop_pc = true;
+				job->stop_pc = value;
+				break;
+			case 'w':
+				if (!parse_number(optarg, 0xffff, &value))
+					return false;
+				job->has_stop_write = true;
+				job->stop_write = value;
+				break;
+			case 't':
+				job->trace = optarg;
+				break;
+			case 'Z':
+				job->trace_format = M65_TRACE_DELTA;
+				break;
+			case 'd':
+				job->trace_policy = M65_TRACE_DROP;
+				break;
+			case 'P':
+				job->profile = true;
+				break;
+			case 'F':
+				job->fused = true;
+				break;
+			case 'R':
+				if (strcmp(optarg, "ntsc") == 0)
+					job->hz = M65_HZ_NTSC;
+				else if (!parse_number(optarg, UINT64_MAX, &job->hz) || job->hz == 0)
+					return false;
+				break;
+			case 'j':
+			case 'T':
+				if (jobs_file == NULL)
+					return false;
+				if (opt == 'j')
+					*jobs_file = optarg;
+				else if (!parse_number(optarg, 4096, &value) || value == 0)
+					return false;
+				else *threads = value;
+				break;
+			case 'k':
+				if (jobs_file == NULL || !parse_number(optarg, UINT64_MAX, &checkpoint_interval)
+						|| checkpoint_interval == 0)
+					return false;
+				break;
+			case 'C':
+			case 'L':
+			case 'D':
+			case 'A':
+				if (jobs_file == NULL)
+					return false;
+				if (opt == 'C')
+					coverage_file = optarg;
+				else if (opt == 'L')
+					listing_file = optarg;
+				else if (opt == 'D')
+					dump_file = optarg;
+				else compile_file = optarg;
+				break;
+			default:
+				return false;
+		}
+	}
 
-	// Reset the CPU to prepare it for execution
-	m65_res(&cpu);
+	// Fused runs only stop between batches of whole instructions, so they can't stop on single instructions or watch
+	// every one
+	if (job->fused && (job->max_instructions || job->stop_brk || job->has_stop_pc || job->has_stop_write
+			|| job->trace != NULL || job->profile || job->hz || coverage_file != NULL))
+		return false;
 
-	// Do a few cycles of operation
-	for (int i = 0; i < 11; i++)
+	// The image is the only positional argument
+	if (optind < argc)
+		job->image = argv[optind++];
+	return optind == argc;
+}
+
+// load_jobs(const char*, const job_t*) -> bool
+// Reads the jobs file. Every line starts from the options given on the command line.
+static bool load_jobs(const char* path, const job_t* defaults)
+{
+	FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	char* line = NULL;
+	size_t line_size = 0;
+	size_t capacity = 0;
+	if (file == NULL)
 	{
-		// Read
-		if (cpu.pins.rw == READ)
-			cpu.pins.data = memory[cpu.pins.addr];
+		perror(path);
+		return false;
+	}
 
-		// Write
-		else if (cpu.pins.rw == WRITE)
-			memory[cpu.pins.addr] = cpu.pins.data;
+	bool ok = true;
+	for (size_t line_no = 1; ok && getline(&line, &line_size, file) != -1; line_no++)
+	{
+		// Split a copy of the line into arguments, skipping empty lines and comments. The job keeps the copy
+		char* copy = strdup(line);
+		char* args[64] = { "job" };
+		int argc = 1;
+		for (char* arg = strtok(copy, " \t\r\n"); arg != NULL && argc < 64; arg = strtok(NULL, " \t\r\n"))
+			args[argc++] = arg;
+		if (argc == 1 || args[1][0] == '#')
+		{
+			free(copy);
+			continue;
+		}
 
-		// Debug info
-		if (i > 0)
+		if (job_count == capacity)
 		{
-			printf("addr in pins: 0x%04x\n", cpu.pins.addr);
-			printf("data in pins: 0x%02x\n", cpu.pins.data);
+			capacity = capacity ? capacity * 2 : 64;
+			jobs = realloc(jobs, capacity * sizeof(job_t));
 		}
-		printf("\ncycle #%i:\n", i);
 
-		// Processor cycle
+		jobs[job_count] = *defaults;
+		jobs[job_count].line = copy;
+		if (!parse_job(&jobs[job_count], argc, args, NULL, NULL) || jobs[job_count].image == NULL)
+		{
+			fprintf(stderr, "%s:%zu: invalid job\n", path, line_no);
+			free(copy);
+			ok = false;
+			continue;
+		}
+		job_count++;
+	}
+
+	free(line);
+	if (file != stdin)
+		fclose(file);
+	return ok;
+}
+
+// take_checkpoint(const m6502_t*, const m65_mem_t*, const m65_mapper_t*) -> segment_t*
+// Copies the state of a run at the start of a segment. mapper is NULL if the image isn't banked. Returns NULL if memory
+// can't be allocated.
+static segment_t* take_checkpoint(const m6502_t* cpu, const m65_mem_t* mem, const m65_mapper_t* mapper)
+{
+	segment_t* segment = calloc(1, sizeof(segment_t));
+	if (segment == NULL)
+		return NULL;
+
+	segment->cpu = *cpu;
+	segment->cpu.coverage = NULL;
+	if (!m65_mem_clone(&segment->mem, mem))
+	{
+		free(segment);
+		return NULL;
+	}
+
+	if (mapper != NULL && !(segment->mapped = m65_mapper_clone(&segment->mapper, mapper, &segment->mem)))
+	{
+		m65_mem_free(&segment->mem);
+		free(segment);
+		return NULL;
+	}
+
+	return segment;
+}
+
+// free_segment(segment_t*) -> void
+// Frees a segment and closes its trace.
+static void free_segment(segment_t* segment)
+{
+	if (segment->mapped)
+		m65_mapper_free(&segment->mapper);
+	if (segment->trace != NULL)
+		fclose(segment->trace);
+	m65_mem_free(&segment->mem);
+	free(segment);
+}
+
+// trace_segments(void*) -> void*
+// Traces segments of a checkpointed run until there are none left. Every segment reruns a copy of its checkpoint, so
+// the checkpoints are only read and can be shared between threads.
+static void* trace_segments(void* arg)
+{
+	segments_t* segments = arg;
+	const job_t* job = segments->job;
+	while (true)
+	{
+		pthread_mutex_lock(&segments->lock);
+		while (segments->next < segments->count && segments->next >= segments->written + segments->window)
+			pthread_cond_wait(&segments->changed, &segments->lock);
+		size_t i = segments->next++;
+		pthread_mutex_unlock(&segments->lock);
+		if (i >= segments->count)
+			return NULL;
+
+		segment_t* segment = segments->segments[i];
+		m6502_t cpu = segment->cpu;
+		m65_mem_t mem;
+		m65_mapper_t mapper;
+		bool ok = m65_mem_clone(&mem, &segment->mem);
+		if (ok && segment->mapped && !m65_mapper_clone(&mapper, &segment->mapper, &mem))
+		{
+			m65_mem_free(&mem);
+			ok = false;
+		}
+
+		m65_trace_t tracer;
+		FILE* trace = ok ? tmpfile() : NULL;
+		if (trace != NULL && m65_trace_init(&tracer, trace, job->trace_format, job->trace_policy, job->variant, 1 << 16))
+		{
+			// Run the cycles of the segment like the run did
+			while (cpu.cycles < segment->end)
+			{
+				m65_mem_bus(&mem, &cpu);
+				if (m65_fetching(&cpu) && cpu.cycles < segments->traced)
+				{
+					uint16_t pc = cpu.pins.addr;
+					m65_trace_record_t record = {cpu.cycles, pc, {cpu.pins.data, m65_mem_peek(&mem, pc + 1),
+						m65_mem_peek(&mem, pc + 2)}, cpu.a, cpu.x, cpu.y, cpu.s, cpu.flags};
+					m65_trace_push(&tracer, &record);
+				}
+				m65_cycle(&cpu);
+			}
+
+			segment->dropped = m65_trace_close(&tracer);
+		} else if (trace != NULL)
+		{
+			fclose(trace);
+			trace = NULL;
+		}
+
+		if (ok)
+		{
+			if (segment->mapped)
+				m65_mapper_free(&mapper);
+			m65_mem_free(&mem);
+		}
+
+		pthread_mutex_lock(&segments->lock);
+		segment->trace = trace;
+		segment->done = true;
+		pthread_cond_broadcast(&segments->changed);
+		pthread_mutex_unlock(&segments->lock);
+	}
+}
+
+// trace_checkpoints(const job_t*, FILE*, segment_t**, size_t, uint64_t, uint64_t*) -> bool
+// Traces the segments of a checkpointed run in parallel and writes their traces to a file in order as they finish.
+// traced is the cycle after the last instruction the run traced. Adds the number of dropped records to dropped. Returns
+// false if a segment couldn't be traced.
+static bool trace_checkpoints(const job_t* job, FILE* trace, segment_t** list, size_t count, uint64_t traced,
+		uint64_t* dropped)
+{
+	int threads = (size_t) trace_threads < count ? trace_threads : (int) count;
+	segments_t segments = {job, list, count, traced, 0, 0, 4 * threads, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_COND_INITIALIZER};
+	pthread_t* pool = malloc(threads * sizeof(pthread_t));
+	if (pool == NULL)
+		return false;
+	for (int i = 0; i < threads; i++)
+		pthread_create(&pool[i], NULL, trace_segments, &segments);
+
+	bool ok = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		pthread_mutex_lock(&segments.lock);
+		while (!list[i]->done)
+			pthread_cond_wait(&segments.changed, &segments.lock);
+		pthread_mutex_unlock(&segments.lock);
+
+		// Segments after a failed one are still waited for, but not written
+		if (list[i]->trace == NULL)
+			ok = false;
+		else
+		{
+			rewind(list[i]->trace);
+			ok = ok && m65_trace_append(trace, list[i]->trace, job->trace_format, i == 0);
+			*dropped += list[i]->dropped;
+			fclose(list[i]->trace);
+			list[i]->trace = NULL;
+		}
+
+		pthread_mutex_lock(&segments.lock);
+		segments.written++;
+		pthread_cond_broadcast(&segments.changed);
+		pthread_mutex_unlock(&segments.lock);
+	}
+
+	for (int i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+	free(pool);
+	pthread_mutex_destroy(&segments.lock);
+	pthread_cond_destroy(&segments.changed);
+	return ok;
+}
+
+// print_json_string(FILE*, const char*) -> void
+// Prints a string as a JSON string literal, escaping quotes, backslashes and control characters.
+static void print_json_string(FILE* out, const char* text)
+{
+	fputc('"', out);
+	for (const unsigned char* c = (const unsigned char*) text; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+// run_fused(const job_t*, m6502_t*, m65_mem_t*, uint16_t*, size_t*, bool*) -> const char*
+// Runs a job with m65_run_cached() in batches of cycles, starting from the decoded code in IMAGE.fuse and saving it
+// back afterwards. A run stops on the cycle limit, or when the next instruction is unimplemented between batches, so
+// a processor that jammed in the middle of one stays jammed until its end. The last few cycles before the limit run
+// cycle by cycle, so the run stops on the same cycle as an unfused one. Stores the address of the last instruction
+// fetched, the number of pages loaded from the file and whether it was saved. Returns why the run stopped.
+static const char* run_fused(const job_t* job, m6502_t* cpu, m65_mem_t* mem, uint16_t* pc, size_t* loaded, bool* saved)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s.fuse", job->image);
+	m65_cache_t cache;
+	m65_cache_init(&cache);
+	*loaded = m65_cache_load(&cache, mem, job->variant, path);
+
+	// Whole instructions overshoot a batch by less than 8 cycles, so batches end at least 8 cycles before the limit
+	const char* stop = "limit";
+	while (!job->max_cycles || cpu->cycles + 8 < job->max_cycles)
+	{
+		if (m65_opinfo[job->variant][m65_mem_peek(mem, cpu->pins.addr)].cycles == 0)
+		{
+			stop = "illegal";
+			break;
+		}
+
+		uint64_t batch = 1 << 16;
+		if (job->max_cycles && job->max_cycles - cpu->cycles - 8 < batch)
+			batch = job->max_cycles - cpu->cycles - 8;
+		m65_run_cached(cpu, mem, &cache, batch);
+	}
+
+	// The rest runs like the cycle by cycle loop of run_job()
+	*pc = cpu->pins.addr;
+	while (job->max_cycles && strcmp(stop, "limit") == 0)
+	{
+		m65_mem_bus(mem, cpu);
+		if (m65_fetching(cpu))
+		{
+			*pc = cpu->pins.addr;
+			if (m65_opinfo[job->variant][cpu->pins.data].cycles == 0)
+				stop = "illegal";
+		}
+
+		if (cpu->cycles >= job->max_cycles)
+			break;
+		m65_cycle(cpu);
+	}
+
+	*saved = m65_cache_save(&cache, mem, job->variant, path);
+	m65_cache_free(&cache);
+	return stop;
+}
+
+// run_job(job_t*, size_t) -> void
+// Runs a job and stores its result as JSON.
+static void run_job(job_t* job, size_t index)
+{
+	FILE* out = open_memstream(&job->output, &job->output_size);
+	const char* stop = "limit";
+
+	// Open the image and the trace
+	m65_rom_t* rom = m65_rom_open(job->image);
+	if (rom == NULL)
+	{
+		fprintf(out, "{\"job\": %zu, \"image\": ", index);
+		print_json_string(out, job->image);
+		fputs(", \"error\": \"could not load the image\"}", out);
+		fclose(out);
+		return;
+	}
+
+	// The trace is written by a background thread so that tracing barely slows the run down
+	FILE* trace = NULL;
+	m65_trace_t tracer;
+	if (job->trace != NULL && strcmp(job->trace, "-") == 0)
+		trace = stderr;
+	else if (job->trace != NULL)
+	{
+		// Every job of a jobs file gets its own trace
+		char path[4096];
+		if (job_count > 1)
+			snprintf(path, sizeof(path), "%s.%zu", job->trace, index);
+		else snprintf(path, sizeof(path), "%s", job->trace);
+		trace = fopen(path, "w");
+	}
+
+	// A checkpointed run is traced afterwards, from copies of its state taken every checkpoint_interval cycles
+	bool checkpointed = trace != NULL && checkpoint_interval != 0;
+	if (trace != NULL && !checkpointed
+			&& !m65_trace_init(&tracer, trace, job->trace_format, job->trace_policy, job->variant, 1 << 16))
+	{
+		if (trace != stderr)
+			fclose(trace);
+		trace = NULL;
+	}
+
+	// Init memory and cpu. Most programs touch a few pages, so only those get memory
+	m65_mem_t mem;
+	m6502_t cpu;
+	bool memory = m65_mem_init_sparse(&mem);
+	m65_mapper_t mapper;
+	const m65_mapper_type_t* mapper_type = job->ines ? m65_mapper_find_ines(rom->mapper) : job->mapper;
+	uint16_t load = job->has_load ? job->load : rom->load;
+	if (!memory)
+		mapper_type = NULL;
+	else if (mapper_type != NULL)
+		mapper_type = m65_mapper_init(&mapper, mapper_type, &mem, rom) ? mapper_type : NULL;
+	else if (job->rom)
+		m65_rom_map_at(&mem, rom, load);
+	else m65_rom_load_at(&mem, rom, load);
+
+	if (!memory || (mapper_type == NULL && (job->ines || job->mapper != NULL)))
+	{
+		fprintf(out, "{\"job\": %zu, \"image\": ", index);
+		print_json_string(out, job->image);
+		fprintf(out, ", \"error\": \"%s\"}", memory ? "could not set up the mapper" : "could not allocate memory");
+		fclose(out);
+		if (trace != NULL)
+		{
+			if (!checkpointed)
+				m65_trace_close(&tracer);
+			if (trace != stderr)
+				fclose(trace);
+		}
+		m65_mem_free(&mem);
+		m65_rom_close(rom);
+		return;
+	}
+
+	init_6502_variant(&cpu, job->variant);
+	if (job->has_entry)
+	{
+		// Start as if the previous instruction fetched the opcode at the entry point
+		cpu.pins.addr = job->entry;
+		cpu.pc = job->entry + 1;
+	} else m65_res(&cpu);
+
+	// Every job records its own coverage, which is merged when it's done
+	m65_coverage_t* cov = coverage != NULL ? calloc(1, sizeof(m65_coverage_t)) : NULL;
+	cpu.coverage = cov;
+
+	// Per opcode counts and cycles
+	uint64_t* counts = job->profile ? calloc(512, sizeof(uint64_t)) : NULL;
+	uint64_t* cycles = counts != NULL ? counts + 256 : NULL;
+	uint64_t instructions = 0;
+	uint64_t start = 0;
+	int opcode = -1;
+	uint16_t pc = cpu.pins.addr;
+	bool written = false;
+
+	// The checkpoints taken so far, and the cycle after the last instruction traced
+	segment_t** segments = NULL;
+	size_t segment_count = 0;
+	uint64_t next_checkpoint = cpu.cycles;
+	uint64_t traced = 0;
+	bool checkpoints_ok = true;
+
+	// Real time runs sleep every batch of cycles
+	m65_pace_t pace;
+	uint64_t next_sync = UINT64_MAX;
+	if (job->hz)
+	{
+		m65_pace_init(&pace, job->hz, cpu.cycles);
+		next_sync = cpu.cycles + pace.batch;
+	}
+
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	// Fused runs skip the cycle by cycle loop
+	size_t fuse_loaded = 0;
+	bool fuse_saved = false;
+	if (job->fused)
+	{
+		stop = run_fused(job, &cpu, &mem, &pc, &fuse_loaded, &fuse_saved);
+	}
+
+	while (!job->fused)
+	{
+		if (checkpointed && cpu.cycles >= next_checkpoint)
+		{
+			// The segment of the previous checkpoint ends where the next one starts
+			segment_t** grown = realloc(segments, (segment_count + 1) * sizeof(segment_t*));
+			segment_t* segment = take_checkpoint(&cpu, &mem, mapper_type != NULL ? &mapper : NULL);
+			if (grown != NULL)
+				segments = grown;
+			if (grown == NULL || segment == NULL)
+			{
+				if (segment != NULL)
+					free_segment(segment);
+				checkpoints_ok = false;
+				break;
+			}
+
+			if (segment_count > 0)
+				segments[segment_count - 1]->end = cpu.cycles;
+			segments[segment_count++] = segment;
+			next_checkpoint = cpu.cycles + checkpoint_interval;
+		}
+
+		// Stop after the instruction that wrote to the sentinel address, since read-modify-write instructions write
+		// twice
+		written = written || (job->has_stop_write && cpu.pins.rw == WRITE && cpu.pins.addr == job->stop_write);
+		m65_mem_bus(&mem, &cpu);
+
+		// The opcode of the next instruction was just fetched
+		if (m65_fetching(&cpu))
+		{
+			if (opcode >= 0)
+			{
+				instructions++;
+				if (counts != NULL)
+				{
+					counts[opcode]++;
+					cycles[opcode] += cpu.cycles - start;
+				}
+			}
+
+			opcode = cpu.pins.data;
+			start = cpu.cycles;
+			pc = cpu.pins.addr;
+
+			if (job->max_instructions && instructions >= job->max_instructions)
+				break;
+			if (written)
+			{
+				stop = "write";
+				break;
+			}
+			if (job->has_stop_pc && cpu.pins.addr == job->stop_pc)
+			{
+				stop = "pc";
+				break;
+			}
+			if (job->stop_brk && opcode == 0x00)
+			{
+				stop = "brk";
+				break;
+			}
+			if (m65_opinfo[job->variant][opcode].cycles == 0)
+			{
+				stop = "illegal";
+				break;
+			}
+
+			if (checkpointed)
+				traced = cpu.cycles + 1;
+			else if (trace != NULL)
+			{
+				// The operands are peeked, so that tracing never reads device registers
+				m65_trace_record_t record = {cpu.cycles, pc, {opcode, m65_mem_peek(&mem, pc + 1),
+					m65_mem_peek(&mem, pc + 2)}, cpu.a, cpu.x, cpu.y, cpu.s, cpu.flags};
+				m65_trace_push(&tracer, &record);
+			}
+		}
+
+		if (job->max_cycles && cpu.cycles >= job->max_cycles)
+			break;
+		if (cpu.cycles >= next_sync)
+		{
+			m65_pace_sync(&pace, cpu.cycles);
+			next_sync = cpu.cycles + pace.batch;
+		}
 		m65_cycle(&cpu);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	uint64_t dropped = trace != NULL && !checkpointed ? m65_trace_close(&tracer) : 0;
+
+	// The last segment ends after the cycle the run stopped on
+	if (checkpointed && checkpoints_ok)
+	{
+		segments[segment_count - 1]->end = cpu.cycles + 1;
+		checkpoints_ok = trace_checkpoints(job, trace, segments, segment_count, traced, &dropped);
+	}
+	for (size_t i = 0; i < segment_count; i++)
+		free_segment(segments[i]);
+	free(segments);
+	uint64_t elapsed = (end.tv_sec - begin.tv_sec) * 1000000000ull + end.tv_nsec - begin.tv_nsec;
+
+	// Report the final state, with pc being the address of the last instruction fetched
+	fprintf(out, "{\"job\": %zu, \"image\": ", index);
+	print_json_string(out, job->image);
+	fprintf(out, ", \"stop\": \"%s\", \"cycles\": %" PRIu64, stop, cpu.cycles);
+	if (!job->fused)
+		fprintf(out, ", \"instructions\": %" PRIu64, instructions);
+	fprintf(out, ", \"elapsed_ns\": %" PRIu64 ", \"pc\": %u, \"a\": %u, \"x\": %u, \"y\": %u, \"s\": %u, \"flags\": %u",
+			elapsed, pc, cpu.a, cpu.x, cpu.y, cpu.s, cpu.flags);
+
+	if (counts != NULL)
+	{
+		const char* separator = "";
+		fputs(", \"profile\": {", out);
+		for (int i = 0; i < 256; i++)
+		{
+			if (counts[i] == 0)
+				continue;
+			fprintf(out, "%s\"%02x\": {\"count\": %" PRIu64 ", \"cycles\": %" PRIu64 "}", separator, i, counts[i],
+					cycles[i]);
+			separator = ", ";
+		}
+		fputs("}", out);
+	}
+
+	if (job->fused)
+		fprintf(out, ", \"fuse\": {\"loaded\": %zu, \"saved\": %s}", fuse_loaded, fuse_saved ? "true" : "false");
+	if (trace != NULL)
+		fprintf(out, ", \"trace_dropped\": %" PRIu64, dropped);
+	if (checkpointed)
+	{
+		fprintf(out, ", \"trace_segments\": %zu", segment_count);
+		if (!checkpoints_ok)
+			fputs(", \"error\": \"could not write the checkpointed trace\"", out);
+	}
+	if (mapper_type != NULL)
+	{
+		fprintf(out, ", \"mapper\": {\"name\": \"%s\", \"writes\": %" PRIu64 ", \"switches\": %" PRIu64 "}",
+				mapper_type->name, mapper.writes, mapper.switches);
+	}
 
-		// Debug info
-		printf("flags: 0x%02x\n", cpu.flags);
-		printf("accumulator: 0x%02x\n", cpu.a);
-		printf("x register: 0x%02x\n", cpu.x);
-		printf("y register: 0x%02x\n", cpu.y);
-		printf("stack pointer: 0x01%02x\n", cpu.s);
-		printf("program counter: 0x%04x\n", cpu.pc);
-		printf("pin mode: %s\n", (cpu.pins.rw == READ ? "read" : "write"));
+	if (job->hz)
+	{
+		uint64_t sleeps = pace.syncs - pace.late;
+		fprintf(out, ", \"pace\": {\"hz\": %" PRIu64 ", \"syncs\": %" PRIu64 ", \"late\": %" PRIu64
+				", \"resyncs\": %" PRIu64 ", \"slept_ns\": %" PRIu64 ", \"max_lag_ns\": %" PRIu64
+				", \"max_oversleep_ns\": %" PRIu64 ", \"mean_oversleep_ns\": %" PRIu64 "}", pace.hz, pace.syncs,
+				pace.late, pace.resyncs, pace.slept_ns, pace.max_lag_ns, pace.max_oversleep_ns,
+				sleeps ? pace.oversleep_ns / sleeps : 0);
+	}
+	fputs("}", out);
+	fclose(out);
+
+	if (cov != NULL)
+	{
+		m65_coverage_merge(coverage, cov);
+		free(cov);
 	}
 
-	printf("Accumulator: 0x%02x\n", cpu.a);
-	printf("Flags: 0x%02x\n", cpu.flags);
-	printf("memory 0x42: 0x%02x\n", memory[0x42]);
+	free(counts);
+	if (mapper_type != NULL)
+		m65_mapper_free(&mapper);
+	if (trace != NULL && trace != stderr)
+		fclose(trace);
+	m65_mem_free(&mem);
+	m65_rom_close(rom);
+}
+
+// compile_job(const job_t*) -> bool
+// Compiles the code of the image of a job, mapped as the job would run it, to C in the compile file.
+static bool compile_job(const job_t* job)
+{
+	m65_rom_t* rom = m65_rom_open(job->image);
+	if (rom == NULL)
+	{
+		fprintf(stderr, "%s: could not load the image\n", job->image);
+		return false;
+	}
+
+	m65_mem_t mem;
+	bool memory = m65_mem_init_sparse(&mem);
+	m65_mapper_t mapper;
+	const m65_mapper_type_t* mapper_type = job->ines ? m65_mapper_find_ines(rom->mapper) : job->mapper;
+	uint16_t load = job->has_load ? job->load : rom->load;
+	bool mapped = false;
+	if (memory && mapper_type != NULL)
+		mapped = m65_mapper_init(&mapper, mapper_type, &mem, rom);
+	else if (memory && job->rom)
+		m65_rom_map_at(&mem, rom, load);
+	else if (memory)
+		m65_rom_load_at(&mem, rom, load);
+	bool ok = memory && (mapped || (!job->ines && job->mapper == NULL));
+
+	FILE* out = NULL;
+	if (!memory)
+		fprintf(stderr, "%s: could not allocate memory\n", job->image);
+	else if (!ok)
+		fprintf(stderr, "%s: could not set up the mapper\n", job->image);
+	else if ((out = strcmp(compile_file, "-") == 0 ? stdout : fopen(compile_file, "w")) == NULL
+			|| !m65_aot_compile(&mem, job->variant, &job->entry, job->has_entry, out))
+	{
+		perror(compile_file);
+		ok = false;
+	}
+
+	if (out != NULL && out != stdout && fclose(out) != 0 && ok)
+	{
+		perror(compile_file);
+		ok = false;
+	}
+	if (mapped)
+		m65_mapper_free(&mapper);
+	m65_mem_free(&mem);
+	m65_rom_close(rom);
+	return ok;
+}
+
+// worker(void*) -> void*
+// Runs jobs until there are none left.
+static void* worker(void* arg)
+{
+	(void) arg;
+	for (size_t i; (i = atomic_fetch_add(&next_job, 1)) < job_count; )
+		run_job(&jobs[i], i);
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	job_t defaults = { 0 };
+	const char* jobs_file = NULL;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!parse_job(&defaults, argc, argv, &jobs_file, &threads)
+			|| (dump_file == NULL && (defaults.image == NULL) == (jobs_file == NULL)))
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	// Converting a trace doesn't run anything
+	if (dump_file != NULL)
+	{
+		FILE* in = strcmp(dump_file, "-") == 0 ? stdin : fopen(dump_file, "rb");
+		if (in == NULL)
+		{
+			perror(dump_file);
+			return 1;
+		}
+
+		bool ok = m65_trace_dump(in, stdout);
+		if (in != stdin)
+			fclose(in);
+		if (!ok)
+			fprintf(stderr, "%s: not a delta trace, or cut short\n", dump_file);
+		return !ok;
+	}
+
+	// Compiling an image doesn't run it either
+	if (compile_file != NULL)
+	{
+		if (jobs_file != NULL)
+		{
+			usage(argv[0]);
+			return 2;
+		}
+		return !compile_job(&defaults);
+	}
+
+	// A single job, or every job in the jobs file
+	if (jobs_file == NULL)
+	{
+		jobs = malloc(sizeof(job_t));
+		jobs[0] = defaults;
+		job_count = 1;
+	} else if (!load_jobs(jobs_file, &defaults))
+		return 2;
+
+	// Coverage accumulates over runs in the coverage file
+	if (coverage_file != NULL)
+	{
+		coverage = calloc(1, sizeof(m65_coverage_t));
+		if (access(coverage_file, F_OK) == 0 && !m65_coverage_load(coverage, coverage_file))
+		{
+			fprintf(stderr, "%s: not a coverage file\n", coverage_file);
+			return 2;
+		}
+	}
+
+	// Checkpointed traces are written on the threads the jobs leave free, so that a single job uses all of them and
+	// jobs running in parallel don't each start as many again
+	int total = threads;
+	if ((size_t) threads > job_count)
+		threads = job_count;
+	if (threads < 1)
+		threads = 1;
+	trace_threads = total / threads > 1 ? total / threads : 1;
+
+	pthread_t* pool = malloc(threads * sizeof(pthread_t));
+	for (int i = 0; i < threads; i++)
+		pthread_create(&pool[i], NULL, worker, NULL);
+	for (int i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+
+	// Print the results in the order of the jobs, one JSON object per line
+	int status = 0;
+	for (size_t i = 0; i < job_count; i++)
+	{
+		puts(jobs[i].output);
+		if (strstr(jobs[i].output, "\"error\"") != NULL)
+			status = 1;
+		free(jobs[i].output);
+		free(jobs[i].line);
+	}
+
+	if (coverage != NULL)
+	{
+		if (!m65_coverage_save(coverage, coverage_file))
+		{
+			perror(coverage_file);
+			status = 1;
+		}
+
+		if (listing_file != NULL)
+		{
+			char path[4096];
+			snprintf(path, sizeof(path), "%s.info", coverage_file);
+			FILE* info = fopen(path, "w");
+			if (info == NULL || !m65_coverage_lcov(coverage, listing_file, info))
+			{
+				perror(info == NULL ? path : listing_file);
+				status = 1;
+			}
+			if (info != NULL)
+				fclose(info);
+		}
+
+		free(coverage);
+	}
 
-	return 0;
+	free(pool);
+	free(jobs);
+	return status;
 }